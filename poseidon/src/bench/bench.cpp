@@ -0,0 +1,132 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2018, LH_Mouse. All wrongs reserved.
+
+#include "../precompiled.hpp"
+#include "bench.hpp"
+#include "../time.hpp"
+#include <algorithm>
+#include <cstdio>
+
+namespace Poseidon {
+namespace Bench {
+
+double Latency_recorder::get_percentile(double fraction){
+	if(m_samples.empty()){
+		return 0;
+	}
+	std::size_t index = static_cast<std::size_t>(fraction * static_cast<double>(m_samples.size()));
+	if(index >= m_samples.size()){
+		index = m_samples.size() - 1;
+	}
+	std::nth_element(m_samples.begin(), m_samples.begin() + static_cast<std::ptrdiff_t>(index), m_samples.end());
+	return m_samples.at(index);
+}
+double Latency_recorder::get_max() const {
+	if(m_samples.empty()){
+		return 0;
+	}
+	return *std::max_element(m_samples.begin(), m_samples.end());
+}
+
+Json_object Latency_recorder::dump(){
+	Json_object obj;
+	obj.set(Rcnts::view("samples"), m_samples.size());
+	obj.set(Rcnts::view("p50"), get_percentile(0.50));
+	obj.set(Rcnts::view("p99"), get_percentile(0.99));
+	obj.set(Rcnts::view("max"), get_max());
+	return obj;
+}
+
+bool Reporter::is_selected(const char *name) const {
+	return m_options.filter.empty() || std::strstr(name, m_options.filter.c_str());
+}
+
+void Reporter::add_result(Json_object result){
+	// 人类可读的摘要输出到标准错误，JSON 结果最后统一输出。
+	const AUTO_REF(name, result.get("name").get<std::string>());
+	const AUTO(ops_per_sec, result.get("ops_per_sec").get<double>());
+	std::fprintf(stderr, "%-40s %14.0f ops/s", name.c_str(), ops_per_sec);
+	if(result.has("bytes_per_sec")){
+		std::fprintf(stderr, " %10.1f MiB/s", result.get("bytes_per_sec").get<double>() / 1048576.0);
+	}
+	if(result.has("latency_ns")){
+		const AUTO_REF(latency, result.get("latency_ns").get<Json_object>());
+		std::fprintf(stderr, "  p50 %.0f ns  p99 %.0f ns", latency.get("p50").get<double>(), latency.get("p99").get<double>());
+	}
+	std::fputc('\n', stderr);
+	m_results.push_back(STD_MOVE_IDN(result));
+}
+Json_object Reporter::dump() const {
+	Json_object options;
+	options.set(Rcnts::view("duration_ms"), m_options.duration);
+	options.set(Rcnts::view("connections"), m_options.connections);
+	options.set(Rcnts::view("message_size"), m_options.message_size);
+	options.set(Rcnts::view("filter"), m_options.filter);
+
+	Json_object root;
+	root.set(Rcnts::view("version"), PACKAGE_STRING);
+	root.set(Rcnts::view("timestamp"), get_utc_time());
+	root.set(Rcnts::view("options"), STD_MOVE_IDN(options));
+	root.set(Rcnts::view("results"), m_results);
+	return root;
+}
+
+State::State(double duration)
+	: m_duration(duration)
+	, m_batch_size(1), m_remaining(0), m_batch_begin(0)
+	, m_first_begin(-1), m_elapsed(0), m_iterations(0), m_bytes_per_iteration(0), m_latencies()
+{
+	//
+}
+
+bool State::refill(){
+	const double now = get_hi_res_mono_clock();
+	if(m_first_begin < 0){
+		m_first_begin = now;
+	} else {
+		const double batch_elapsed = now - m_batch_begin;
+		// 太短的批次误差太大，只用于校准批的大小，不计入结果。
+		if(batch_elapsed >= 0.25){
+			m_elapsed += batch_elapsed;
+			m_iterations += m_batch_size;
+			m_latencies.record(batch_elapsed * 1e6 / static_cast<double>(m_batch_size));
+		}
+		if((now - m_first_begin >= m_duration) && (m_iterations != 0)){
+			return false;
+		}
+		if(batch_elapsed < 1.0){
+			m_batch_size *= 2;
+		}
+	}
+	m_remaining = m_batch_size - 1;
+	m_batch_begin = get_hi_res_mono_clock();
+	return true;
+}
+
+Json_object State::dump(const char *group, const char *name){
+	const double seconds = m_elapsed / 1000;
+
+	Json_object obj;
+	obj.set(Rcnts::view("group"), group);
+	obj.set(Rcnts::view("name"), name);
+	obj.set(Rcnts::view("iterations"), m_iterations);
+	obj.set(Rcnts::view("elapsed_ms"), m_elapsed);
+	obj.set(Rcnts::view("ops_per_sec"), static_cast<double>(m_iterations) / seconds);
+	if(m_bytes_per_iteration != 0){
+		obj.set(Rcnts::view("bytes_per_sec"), static_cast<double>(m_iterations) * static_cast<double>(m_bytes_per_iteration) / seconds);
+	}
+	obj.set(Rcnts::view("latency_ns"), m_latencies.dump());
+	return obj;
+}
+
+void run_micro_benchmark(Reporter &reporter, const char *name, Micro_benchmark_proc proc){
+	if(!reporter.is_selected(name)){
+		return;
+	}
+	State state(reporter.get_options().duration);
+	(*proc)(state);
+	reporter.add_result(state.dump("micro", name));
+}
+
+}
+}
@@ -0,0 +1,134 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2018, LH_Mouse. All wrongs reserved.
+
+#ifndef POSEIDON_BENCH_BENCH_HPP_
+#define POSEIDON_BENCH_BENCH_HPP_
+
+#include "../cxx_ver.hpp"
+#include "../cxx_util.hpp"
+#include "../json.hpp"
+#include <boost/container/vector.hpp>
+#include <boost/cstdint.hpp>
+#include <string>
+
+namespace Poseidon {
+namespace Bench {
+
+struct Options {
+	// 每个基准测试至少运行的毫秒数。
+	double duration;
+	// 宏观基准测试的并发连接数。
+	std::size_t connections;
+	// 宏观基准测试的消息大小。
+	std::size_t message_size;
+	// 非空时只运行名字中包含这个子串的基准测试。
+	std::string filter;
+};
+
+// 延迟样本，单位是纳秒。
+class Latency_recorder {
+private:
+	boost::container::vector<double> m_samples;
+
+public:
+	Latency_recorder()
+		: m_samples()
+	{
+		//
+	}
+
+public:
+	bool empty() const {
+		return m_samples.empty();
+	}
+	std::size_t size() const {
+		return m_samples.size();
+	}
+	void record(double nanoseconds){
+		m_samples.push_back(nanoseconds);
+	}
+	void merge(const Latency_recorder &other){
+		m_samples.insert(m_samples.end(), other.m_samples.begin(), other.m_samples.end());
+	}
+
+	// 注意：这个函数会重排样本。
+	double get_percentile(double fraction);
+	double get_max() const;
+
+	Json_object dump();
+};
+
+class Reporter : NONCOPYABLE {
+private:
+	Options m_options;
+	Json_array m_results;
+
+public:
+	explicit Reporter(const Options &options)
+		: m_options(options), m_results()
+	{
+		//
+	}
+
+public:
+	const Options & get_options() const {
+		return m_options;
+	}
+	bool is_selected(const char *name) const;
+
+	void add_result(Json_object result);
+	Json_object dump() const;
+};
+
+// 微基准测试的循环控制。用法：
+//   while(state.next()){ /* 被测代码 */ }
+// 循环以批为单位计时，每批的平均耗时作为一个延迟样本。
+class State : NONCOPYABLE {
+private:
+	const double m_duration;
+
+	boost::uint64_t m_batch_size;
+	boost::uint64_t m_remaining;
+	double m_batch_begin;
+
+	double m_first_begin;
+	double m_elapsed;
+	boost::uint64_t m_iterations;
+	boost::uint64_t m_bytes_per_iteration;
+	Latency_recorder m_latencies;
+
+public:
+	explicit State(double duration);
+
+private:
+	bool refill();
+
+public:
+	bool next(){
+		if(__builtin_expect(m_remaining == 0, false)){
+			return refill();
+		}
+		--m_remaining;
+		return true;
+	}
+
+	void set_bytes_per_iteration(boost::uint64_t bytes){
+		m_bytes_per_iteration = bytes;
+	}
+
+	Json_object dump(const char *group, const char *name);
+};
+
+typedef void (*Micro_benchmark_proc)(State &state);
+
+extern void run_micro_benchmark(Reporter &reporter, const char *name, Micro_benchmark_proc proc);
+
+extern void run_codec_benchmarks(Reporter &reporter);
+extern void run_protocol_benchmarks(Reporter &reporter);
+extern void run_dispatcher_benchmarks(Reporter &reporter);
+extern void run_echo_benchmarks(Reporter &reporter);
+
+}
+}
+
+#endif
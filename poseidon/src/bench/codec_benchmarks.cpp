@@ -0,0 +1,358 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2018, LH_Mouse. All wrongs reserved.
+
+#include "../precompiled.hpp"
+#include "bench.hpp"
+#include "../stream_buffer.hpp"
+#include "../json.hpp"
+#include "../json_reader.hpp"
+#include "../base64.hpp"
+#include "../hex.hpp"
+#include "../md5.hpp"
+#include "../sha1.hpp"
+#include "../sha256.hpp"
+#include "../crc32.hpp"
+#include "../random.hpp"
+#include "../thread.hpp"
+#include "../time.hpp"
+#include "../atomic.hpp"
+#include <unistd.h>
+
+namespace Poseidon {
+namespace Bench {
+
+namespace {
+	// 阻止编译器把被测代码当作死代码删掉。
+	volatile boost::uint64_t g_sink;
+
+	const std::size_t g_block_size = 16384;
+
+	const std::string &get_random_block(){
+		static std::string s_block;
+		if(s_block.empty()){
+			s_block.resize(g_block_size);
+			random_fill(&s_block[0], s_block.size());
+		}
+		return s_block;
+	}
+
+	const std::string &get_sample_json(){
+		static std::string s_json;
+		if(s_json.empty()){
+			Json_array items;
+			for(unsigned i = 0; i < 64; ++i){
+				Json_array tags;
+				tags.push_back("alpha");
+				tags.push_back("beta");
+				Json_object item;
+				item.set(Rcnts::view("id"), i);
+				item.set(Rcnts::view("name"), "item-" + boost::lexical_cast<std::string>(i));
+				item.set(Rcnts::view("score"), i * 1.5);
+				item.set(Rcnts::view("active"), (i % 3) != 0);
+				item.set(Rcnts::view("note"), "a \"quoted\" note\nwith a line break");
+				item.set(Rcnts::view("tags"), STD_MOVE_IDN(tags));
+				items.push_back(STD_MOVE_IDN(item));
+			}
+			Json_object root;
+			root.set(Rcnts::view("items"), STD_MOVE_IDN(items));
+			root.set(Rcnts::view("next"), Json_null());
+			s_json = root.dump().dump_string();
+		}
+		return s_json;
+	}
+
+	void bench_stream_buffer_put_get(State &state){
+		Stream_buffer buffer;
+		char data[64] = { };
+		while(state.next()){
+			buffer.put(data, sizeof(data));
+			buffer.get(data, sizeof(data));
+		}
+		g_sink = static_cast<unsigned char>(data[0]);
+		state.set_bytes_per_iteration(sizeof(data));
+	}
+	void bench_stream_buffer_splice(State &state){
+		const AUTO_REF(block, get_random_block());
+		Stream_buffer a(block.data(), block.size()), b;
+		while(state.next()){
+			b.splice(a);
+			a.splice(b);
+		}
+		g_sink = a.size();
+		state.set_bytes_per_iteration(block.size());
+	}
+
+	void bench_json_parse(State &state){
+		const AUTO_REF(json, get_sample_json());
+		Json_object obj;
+		while(state.next()){
+			obj.parse(json.data(), json.size());
+		}
+		g_sink = obj.size();
+		state.set_bytes_per_iteration(json.size());
+	}
+	void bench_json_dump(State &state){
+		const AUTO_REF(json, get_sample_json());
+		Json_object obj;
+		obj.parse(json.data(), json.size());
+		Stream_buffer buffer;
+		while(state.next()){
+			buffer.clear();
+			obj.dump(buffer);
+		}
+		g_sink = buffer.size();
+		state.set_bytes_per_iteration(json.size());
+	}
+
+	class Counting_json_reader : public Json_reader {
+	public:
+		std::size_t m_events;
+
+	public:
+		Counting_json_reader()
+			: m_events(0)
+		{
+			//
+		}
+
+	protected:
+		void on_object_begin() OVERRIDE {
+			++m_events;
+		}
+		void on_object_key(const std::string &/*key*/) OVERRIDE {
+			++m_events;
+		}
+		void on_object_end() OVERRIDE {
+			++m_events;
+		}
+		void on_array_begin() OVERRIDE {
+			++m_events;
+		}
+		void on_array_end() OVERRIDE {
+			++m_events;
+		}
+		void on_string_begin() OVERRIDE {
+			++m_events;
+		}
+		void on_string_data(const char */*data*/, std::size_t /*size*/) OVERRIDE {
+			//
+		}
+		void on_string_end() OVERRIDE {
+			//
+		}
+		void on_number(double /*value*/) OVERRIDE {
+			++m_events;
+		}
+		void on_boolean(bool /*value*/) OVERRIDE {
+			++m_events;
+		}
+		void on_null() OVERRIDE {
+			++m_events;
+		}
+	};
+
+	void bench_json_reader(State &state){
+		const AUTO_REF(json, get_sample_json());
+		Counting_json_reader reader;
+		while(state.next()){
+			reader.put(json);
+			reader.finalize();
+		}
+		g_sink = reader.m_events;
+		state.set_bytes_per_iteration(json.size());
+	}
+
+	void bench_base64_encode(State &state){
+		const AUTO_REF(block, get_random_block());
+		Base64_encoder encoder;
+		while(state.next()){
+			encoder.put(block.data(), block.size());
+			g_sink = encoder.finalize().size();
+		}
+		state.set_bytes_per_iteration(block.size());
+	}
+	void bench_base64_decode(State &state){
+		const AUTO(text, base64_encode(get_random_block()));
+		Base64_decoder decoder;
+		while(state.next()){
+			decoder.put(text.data(), text.size());
+			g_sink = decoder.finalize().size();
+		}
+		state.set_bytes_per_iteration(text.size());
+	}
+	void bench_hex_encode(State &state){
+		const AUTO_REF(block, get_random_block());
+		Hex_encoder encoder;
+		while(state.next()){
+			encoder.put(block.data(), block.size());
+			g_sink = encoder.finalize().size();
+		}
+		state.set_bytes_per_iteration(block.size());
+	}
+	void bench_hex_decode(State &state){
+		const AUTO(text, hex_encode(get_random_block()));
+		Hex_decoder decoder;
+		while(state.next()){
+			decoder.put(text.data(), text.size());
+			g_sink = decoder.finalize().size();
+		}
+		state.set_bytes_per_iteration(text.size());
+	}
+
+	template<typename StreambufT>
+	void bench_hash(State &state){
+		const AUTO_REF(block, get_random_block());
+		StreambufT sb;
+		while(state.next()){
+			sb.put(block.data(), block.size());
+			g_sink = sb.finalize()[0];
+		}
+		state.set_bytes_per_iteration(block.size());
+	}
+	void bench_crc32(State &state){
+		const AUTO_REF(block, get_random_block());
+		Crc32_streambuf sb;
+		while(state.next()){
+			sb.put(block.data(), block.size());
+			g_sink = sb.finalize();
+		}
+		state.set_bytes_per_iteration(block.size());
+	}
+
+	void bench_random_uint64(State &state){
+		boost::uint64_t sum = 0;
+		while(state.next()){
+			sum += random_uint64();
+		}
+		g_sink = sum;
+		state.set_bytes_per_iteration(8);
+	}
+	void bench_random_fill(State &state){
+		unsigned char data[4096];
+		while(state.next()){
+			random_fill(data, sizeof(data));
+		}
+		g_sink = data[0];
+		state.set_bytes_per_iteration(sizeof(data));
+	}
+	void bench_random_fill_secure(State &state){
+		unsigned char data[4096];
+		while(state.next()){
+			random_fill_secure(data, sizeof(data));
+		}
+		g_sink = data[0];
+		state.set_bytes_per_iteration(sizeof(data));
+	}
+
+	// 多个线程同时调用 random_uint64()，如果每个线程的生成器互不干扰，总吞吐量应当随线程数线性增长。
+	struct Random_thread_context {
+		const volatile bool *start;
+		double duration;
+
+		boost::uint64_t iterations;
+		double elapsed;
+	};
+
+	void random_thread_proc(Random_thread_context *ctx){
+		while(!atomic_load(*(ctx->start), memory_order_acquire)){
+			atomic_pause();
+		}
+		boost::uint64_t sum = 0;
+		boost::uint64_t iterations = 0;
+		const double begin = get_hi_res_mono_clock();
+		double now;
+		do {
+			for(unsigned i = 0; i < 4096; ++i){
+				sum += random_uint64();
+			}
+			iterations += 4096;
+			now = get_hi_res_mono_clock();
+		} while(now - begin < ctx->duration);
+		g_sink = sum;
+		ctx->iterations = iterations;
+		ctx->elapsed = now - begin;
+	}
+
+	void run_random_scaling_benchmark(Reporter &reporter, std::size_t thread_count){
+		char name[64];
+		std::sprintf(name, "random.uint64_threads_%lu", static_cast<unsigned long>(thread_count));
+		if(!reporter.is_selected(name)){
+			return;
+		}
+		const AUTO_REF(options, reporter.get_options());
+
+		volatile bool start = false;
+		boost::container::vector<Random_thread_context> contexts(thread_count);
+		boost::container::vector<boost::shared_ptr<Thread> > threads;
+		for(std::size_t i = 0; i < contexts.size(); ++i){
+			AUTO_REF(ctx, contexts.at(i));
+			ctx.start = &start;
+			ctx.duration = options.duration;
+			ctx.iterations = 0;
+			ctx.elapsed = 0;
+			threads.push_back(boost::make_shared<Thread>(boost::bind(&random_thread_proc, &ctx), Rcnts::view("  B "), Rcnts::view("Bench random")));
+		}
+		atomic_store(start, true, memory_order_release);
+		for(std::size_t i = 0; i < threads.size(); ++i){
+			threads.at(i)->join();
+		}
+
+		boost::uint64_t iterations = 0;
+		double aggregate = 0;
+		double elapsed = 0;
+		Json_array per_thread;
+		for(std::size_t i = 0; i < contexts.size(); ++i){
+			const AUTO_REF(ctx, contexts.at(i));
+			const double ops_per_sec = static_cast<double>(ctx.iterations) / ctx.elapsed * 1000;
+			iterations += ctx.iterations;
+			aggregate += ops_per_sec;
+			elapsed = std::max(elapsed, ctx.elapsed);
+			per_thread.push_back(ops_per_sec);
+		}
+
+		Json_object obj;
+		obj.set(Rcnts::view("group"), "micro");
+		obj.set(Rcnts::view("name"), name);
+		obj.set(Rcnts::view("threads"), thread_count);
+		obj.set(Rcnts::view("iterations"), iterations);
+		obj.set(Rcnts::view("elapsed_ms"), elapsed);
+		obj.set(Rcnts::view("ops_per_sec"), aggregate);
+		obj.set(Rcnts::view("ops_per_sec_per_thread"), aggregate / static_cast<double>(thread_count));
+		obj.set(Rcnts::view("ops_per_sec_by_thread"), STD_MOVE_IDN(per_thread));
+		reporter.add_result(STD_MOVE_IDN(obj));
+	}
+}
+
+void run_codec_benchmarks(Reporter &reporter){
+	run_micro_benchmark(reporter, "stream_buffer.put_get_64", &bench_stream_buffer_put_get);
+	run_micro_benchmark(reporter, "stream_buffer.splice_16k", &bench_stream_buffer_splice);
+	run_micro_benchmark(reporter, "json.parse", &bench_json_parse);
+	run_micro_benchmark(reporter, "json.dump", &bench_json_dump);
+	run_micro_benchmark(reporter, "json.reader", &bench_json_reader);
+	run_micro_benchmark(reporter, "base64.encode_16k", &bench_base64_encode);
+	run_micro_benchmark(reporter, "base64.decode_16k", &bench_base64_decode);
+	run_micro_benchmark(reporter, "hex.encode_16k", &bench_hex_encode);
+	run_micro_benchmark(reporter, "hex.decode_16k", &bench_hex_decode);
+	run_micro_benchmark(reporter, "hash.md5_16k", &bench_hash<Md5_streambuf>);
+	run_micro_benchmark(reporter, "hash.sha1_16k", &bench_hash<Sha1_streambuf>);
+	run_micro_benchmark(reporter, "hash.sha256_16k", &bench_hash<Sha256_streambuf>);
+	run_micro_benchmark(reporter, "hash.crc32_16k", &bench_crc32);
+	run_micro_benchmark(reporter, "random.uint64", &bench_random_uint64);
+	run_micro_benchmark(reporter, "random.fill_4k", &bench_random_fill);
+	run_micro_benchmark(reporter, "random.fill_secure_4k", &bench_random_fill_secure);
+
+	// 线程数依次翻倍，直到在线 CPU 的数量，但至少测到四个线程。线程数超过 CPU 数量时，每个线程的吞吐量自然会下降。
+	const long cpu_count = ::sysconf(_SC_NPROCESSORS_ONLN);
+	const std::size_t max_thread_count = (cpu_count > 4) ? static_cast<std::size_t>(cpu_count) : 4;
+	std::size_t thread_count = 1;
+	for(;;){
+		run_random_scaling_benchmark(reporter, thread_count);
+		if(thread_count >= max_thread_count){
+			break;
+		}
+		thread_count = std::min(thread_count * 2, max_thread_count);
+	}
+}
+
+}
+}
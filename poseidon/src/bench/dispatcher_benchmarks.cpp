@@ -0,0 +1,56 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2018, LH_Mouse. All wrongs reserved.
+
+#include "../precompiled.hpp"
+#include "bench.hpp"
+#include "../job_base.hpp"
+#include "../promise.hpp"
+#include "../singletons/job_dispatcher.hpp"
+
+namespace Poseidon {
+namespace Bench {
+
+namespace {
+	class Trivial_job : public Job_base {
+	private:
+		const boost::shared_ptr<Promise> m_promise;
+
+	public:
+		explicit Trivial_job(boost::shared_ptr<Promise> promise)
+			: m_promise(STD_MOVE(promise))
+		{
+			//
+		}
+
+	protected:
+		boost::weak_ptr<const void> get_category() const OVERRIDE {
+			return VAL_INIT;
+		}
+		void perform() OVERRIDE {
+			m_promise->set_success();
+		}
+	};
+
+	// 挂起当前纤程，在下一轮调度中恢复。测量的是一次切出和切回的开销。
+	void bench_job_dispatcher_yield(State &state){
+		while(state.next()){
+			Job_dispatcher::yield(VAL_INIT, true);
+		}
+	}
+	// 投递一个新任务并等待它完成，包括创建纤程的开销。
+	void bench_job_dispatcher_enqueue_and_wait(State &state){
+		while(state.next()){
+			const AUTO(promise, boost::make_shared<Promise>());
+			Job_dispatcher::enqueue(boost::make_shared<Trivial_job>(promise), VAL_INIT);
+			Job_dispatcher::yield(promise, true);
+		}
+	}
+}
+
+void run_dispatcher_benchmarks(Reporter &reporter){
+	run_micro_benchmark(reporter, "job_dispatcher.yield", &bench_job_dispatcher_yield);
+	run_micro_benchmark(reporter, "job_dispatcher.enqueue_and_wait", &bench_job_dispatcher_enqueue_and_wait);
+}
+
+}
+}
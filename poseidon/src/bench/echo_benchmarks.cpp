@@ -0,0 +1,387 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2018, LH_Mouse. All wrongs reserved.
+
+#include "../precompiled.hpp"
+#include "bench.hpp"
+#include "../tcp_server_base.hpp"
+#include "../ip_port.hpp"
+#include "../sock_addr.hpp"
+#include "../raii.hpp"
+#include "../thread.hpp"
+#include "../time.hpp"
+#include "../log.hpp"
+#include "../endian.hpp"
+#include "../singletons/epoll_daemon.hpp"
+#include "../http/session.hpp"
+#include "../http/upgraded_session_base.hpp"
+#include "../websocket/session.hpp"
+#include "../websocket/handshake.hpp"
+#include "../cbpp/session.hpp"
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+namespace Poseidon {
+namespace Bench {
+
+namespace {
+	class Echo_websocket_session : public Websocket::Session {
+	public:
+		explicit Echo_websocket_session(const boost::shared_ptr<Http::Low_level_session> &parent)
+			: Websocket::Session(parent)
+		{
+			//
+		}
+
+	protected:
+		void on_sync_data_message(Websocket::Opcode opcode, Stream_buffer payload) OVERRIDE {
+			send(opcode, STD_MOVE(payload));
+		}
+	};
+
+	class Echo_http_session : public Http::Session {
+	public:
+		explicit Echo_http_session(Move<Unique_file> socket)
+			: Http::Session(STD_MOVE(socket))
+		{
+			//
+		}
+
+	protected:
+		boost::shared_ptr<Http::Upgraded_session_base> on_low_level_request_end(boost::uint64_t content_length, Option_map headers) OVERRIDE {
+			const AUTO_REF(request_headers, get_low_level_request_headers());
+			if(::strcasecmp(request_headers.headers.get("Upgrade").c_str(), "websocket") != 0){
+				return Http::Session::on_low_level_request_end(content_length, STD_MOVE(headers));
+			}
+			AUTO(response_headers, Websocket::make_handshake_response(request_headers));
+			const bool accepted = response_headers.status_code == Http::status_switching_protocols;
+			Http::Low_level_session::send(STD_MOVE(response_headers));
+			if(!accepted){
+				shutdown_read();
+				return VAL_INIT;
+			}
+			return boost::make_shared<Echo_websocket_session>(virtual_shared_from_this<Echo_http_session>());
+		}
+
+		void on_sync_request(Http::Request_headers /*request_headers*/, Stream_buffer entity) OVERRIDE {
+			Http::Response_headers response_headers = { 10001, Http::status_ok, "OK" };
+			send(STD_MOVE(response_headers), STD_MOVE(entity));
+		}
+	};
+
+	class Echo_cbpp_session : public Cbpp::Session {
+	public:
+		explicit Echo_cbpp_session(Move<Unique_file> socket)
+			: Cbpp::Session(STD_MOVE(socket))
+		{
+			//
+		}
+
+	protected:
+		void on_sync_data_message(boost::uint16_t message_id, Stream_buffer payload) OVERRIDE {
+			send(message_id, STD_MOVE(payload));
+		}
+	};
+
+	template<typename SessionT>
+	class Echo_server : public Tcp_server_base {
+	public:
+		explicit Echo_server(const Sock_addr &addr)
+			: Tcp_server_base(addr)
+		{
+			//
+		}
+
+	protected:
+		boost::shared_ptr<Tcp_session_base> on_client_connect(Move<Unique_file> client) OVERRIDE {
+			AUTO(session, boost::make_shared<SessionT>(STD_MOVE(client)));
+			session->set_no_delay(true);
+			return STD_MOVE_IDN(session);
+		}
+	};
+
+	enum Protocol {
+		protocol_http       = 0,
+		protocol_websocket  = 1,
+		protocol_cbpp       = 2,
+	};
+
+	// 阻塞模式的回环客户端。每个连接同时只有一个请求，收到响应之后才发送下一个。
+	class Echo_client : NONCOPYABLE {
+	private:
+		const Protocol m_protocol;
+		const std::size_t m_message_size;
+
+		Unique_file m_socket;
+		std::string m_request;
+		std::string m_received;
+
+	public:
+		Echo_client(Protocol protocol, std::size_t message_size)
+			: m_protocol(protocol), m_message_size(message_size)
+		{
+			//
+		}
+
+	private:
+		bool send_all(const std::string &data){
+			std::size_t offset = 0;
+			while(offset < data.size()){
+				const ::ssize_t result = ::send(m_socket.get(), data.data() + offset, data.size() - offset, MSG_NOSIGNAL);
+				if(result < 0){
+					if(errno == EINTR){
+						continue;
+					}
+					return false;
+				}
+				offset += static_cast<std::size_t>(result);
+			}
+			return true;
+		}
+		// 确保接收缓冲区中至少有 size 字节。
+		bool receive_at_least(std::size_t size){
+			char buffer[4096];
+			while(m_received.size() < size){
+				const ::ssize_t result = ::recv(m_socket.get(), buffer, sizeof(buffer), 0);
+				if(result < 0){
+					if(errno == EINTR){
+						continue;
+					}
+					return false;
+				}
+				if(result == 0){
+					return false;
+				}
+				m_received.append(buffer, static_cast<std::size_t>(result));
+			}
+			return true;
+		}
+		// 接收 HTTP 响应头，返回其长度（包括空行）。失败返回零。
+		std::size_t receive_http_headers(){
+			for(;;){
+				const std::size_t pos = m_received.find("\r\n\r\n");
+				if(pos != std::string::npos){
+					return pos + 4;
+				}
+				if(!receive_at_least(m_received.size() + 1)){
+					return 0;
+				}
+			}
+		}
+
+		bool read_http_response(){
+			const std::size_t header_size = receive_http_headers();
+			if((header_size == 0) || (m_received.compare(0, 13, "HTTP/1.1 200 ") != 0)){
+				return false;
+			}
+			std::size_t content_length = 0;
+			for(std::size_t pos = m_received.find('\n'); pos < header_size; pos = m_received.find('\n', pos + 1)){
+				if(::strncasecmp(m_received.c_str() + pos + 1, "Content-Length:", 15) == 0){
+					content_length = std::strtoul(m_received.c_str() + pos + 16, NULLPTR, 10);
+					break;
+				}
+			}
+			if(!receive_at_least(header_size + content_length)){
+				return false;
+			}
+			m_received.erase(0, header_size + content_length);
+			return content_length == m_message_size;
+		}
+		bool read_websocket_response(){
+			if(!receive_at_least(2)){
+				return false;
+			}
+			std::size_t header_size = 2;
+			std::size_t payload_size = static_cast<unsigned char>(m_received[1]) & 0x7Fu;
+			if(payload_size == 126){
+				header_size = 4;
+				if(!receive_at_least(header_size)){
+					return false;
+				}
+				payload_size = static_cast<unsigned char>(m_received[2]) * 256u + static_cast<unsigned char>(m_received[3]);
+			}
+			if(!receive_at_least(header_size + payload_size)){
+				return false;
+			}
+			m_received.erase(0, header_size + payload_size);
+			return payload_size == m_message_size;
+		}
+		bool read_cbpp_response(){
+			if(!receive_at_least(4)){
+				return false;
+			}
+			const std::size_t payload_size = static_cast<unsigned char>(m_received[0]) * 256u + static_cast<unsigned char>(m_received[1]);
+			if(!receive_at_least(4 + payload_size)){
+				return false;
+			}
+			m_received.erase(0, 4 + payload_size);
+			return payload_size == m_message_size;
+		}
+
+	public:
+		bool connect(boost::uint16_t port){
+			::sockaddr_in sin = { };
+			sin.sin_family = AF_INET;
+			sin.sin_port = htons(port);
+			sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			if(!m_socket.reset(::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP))){
+				return false;
+			}
+			if(::connect(m_socket.get(), reinterpret_cast<const ::sockaddr *>(&sin), sizeof(sin)) != 0){
+				return false;
+			}
+			static const int s_true_value = true;
+			::setsockopt(m_socket.get(), IPPROTO_TCP, TCP_NODELAY, &s_true_value, sizeof(s_true_value));
+
+			const std::string payload(m_message_size, 'x');
+			switch(m_protocol){
+			case protocol_http:
+				m_request = "POST /echo HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Length: " + boost::lexical_cast<std::string>(m_message_size) + "\r\n\r\n";
+				m_request += payload;
+				break;
+			case protocol_websocket:
+				if(!send_all("GET /echo HTTP/1.1\r\nHost: 127.0.0.1\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+				             "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n"))
+				{
+					return false;
+				}
+				{
+					const std::size_t header_size = receive_http_headers();
+					if((header_size == 0) || (m_received.compare(0, 13, "HTTP/1.1 101 ") != 0)){
+						return false;
+					}
+					m_received.erase(0, header_size);
+				}
+				// 客户端的帧必须带掩码。全零的掩码不改变载荷。
+				m_request = "\x82";
+				if(m_message_size < 126){
+					m_request += static_cast<char>(0x80u | m_message_size);
+				} else {
+					m_request += static_cast<char>(0x80u | 126u);
+					m_request += static_cast<char>(m_message_size >> 8);
+					m_request += static_cast<char>(m_message_size);
+				}
+				m_request.append(4, '\0');
+				m_request += payload;
+				break;
+			case protocol_cbpp:
+				m_request += static_cast<char>(m_message_size >> 8);
+				m_request += static_cast<char>(m_message_size);
+				m_request += static_cast<char>(0);
+				m_request += static_cast<char>(100);
+				m_request += payload;
+				break;
+			}
+			return true;
+		}
+
+		bool round_trip(){
+			if(!send_all(m_request)){
+				return false;
+			}
+			switch(m_protocol){
+			case protocol_http:
+				return read_http_response();
+			case protocol_websocket:
+				return read_websocket_response();
+			case protocol_cbpp:
+				return read_cbpp_response();
+			}
+			return false;
+		}
+	};
+
+	struct Client_context {
+		Protocol protocol;
+		std::size_t message_size;
+		boost::uint16_t port;
+		double deadline;
+
+		boost::uint64_t requests;
+		boost::uint64_t errors;
+		Latency_recorder latencies;
+	};
+
+	void client_thread_proc(Client_context *ctx){
+		Echo_client client(ctx->protocol, ctx->message_size);
+		if(!client.connect(ctx->port)){
+			ctx->errors += 1;
+			return;
+		}
+		double now = get_hi_res_mono_clock();
+		while(now < ctx->deadline){
+			const double begin = now;
+			if(!client.round_trip()){
+				ctx->errors += 1;
+				return;
+			}
+			now = get_hi_res_mono_clock();
+			ctx->requests += 1;
+			ctx->latencies.record((now - begin) * 1e6);
+		}
+	}
+
+	template<typename SessionT>
+	void run_echo_benchmark(Reporter &reporter, const char *name, Protocol protocol){
+		if(!reporter.is_selected(name)){
+			return;
+		}
+		const AUTO_REF(options, reporter.get_options());
+		const std::size_t message_size = std::min<std::size_t>(options.message_size, 65000);
+
+		const AUTO(server, boost::make_shared<Echo_server<SessionT> >(Ip_port("127.0.0.1", 0)));
+		Epoll_daemon::add_socket(server, false);
+		const boost::uint16_t port = server->get_local_info().port();
+
+		const double begin = get_hi_res_mono_clock();
+		boost::container::vector<Client_context> contexts(options.connections);
+		boost::container::vector<boost::shared_ptr<Thread> > threads;
+		for(std::size_t i = 0; i < contexts.size(); ++i){
+			AUTO_REF(ctx, contexts.at(i));
+			ctx.protocol = protocol;
+			ctx.message_size = message_size;
+			ctx.port = port;
+			ctx.deadline = begin + options.duration;
+			ctx.requests = 0;
+			ctx.errors = 0;
+			threads.push_back(boost::make_shared<Thread>(boost::bind(&client_thread_proc, &ctx), Rcnts::view("  B "), Rcnts::view("Bench client")));
+		}
+		for(std::size_t i = 0; i < threads.size(); ++i){
+			threads.at(i)->join();
+		}
+		const double elapsed = get_hi_res_mono_clock() - begin;
+
+		boost::uint64_t requests = 0, errors = 0;
+		Latency_recorder latencies;
+		for(std::size_t i = 0; i < contexts.size(); ++i){
+			const AUTO_REF(ctx, contexts.at(i));
+			requests += ctx.requests;
+			errors += ctx.errors;
+			latencies.merge(ctx.latencies);
+		}
+
+		Json_object obj;
+		obj.set(Rcnts::view("group"), "macro");
+		obj.set(Rcnts::view("name"), name);
+		obj.set(Rcnts::view("connections"), contexts.size());
+		obj.set(Rcnts::view("message_size"), message_size);
+		obj.set(Rcnts::view("iterations"), requests);
+		obj.set(Rcnts::view("errors"), errors);
+		obj.set(Rcnts::view("elapsed_ms"), elapsed);
+		obj.set(Rcnts::view("ops_per_sec"), static_cast<double>(requests) / elapsed * 1000);
+		obj.set(Rcnts::view("bytes_per_sec"), static_cast<double>(requests) * static_cast<double>(message_size) / elapsed * 1000);
+		obj.set(Rcnts::view("latency_ns"), latencies.dump());
+		reporter.add_result(STD_MOVE_IDN(obj));
+	}
+}
+
+void run_echo_benchmarks(Reporter &reporter){
+	run_echo_benchmark<Echo_http_session>(reporter, "echo.http", protocol_http);
+	run_echo_benchmark<Echo_http_session>(reporter, "echo.websocket", protocol_websocket);
+	run_echo_benchmark<Echo_cbpp_session>(reporter, "echo.cbpp", protocol_cbpp);
+}
+
+}
+}
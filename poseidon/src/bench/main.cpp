@@ -0,0 +1,180 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2018, LH_Mouse. All wrongs reserved.
+
+#include "../precompiled.hpp"
+#include "bench.hpp"
+#include "../singletons/main_config.hpp"
+#include "../singletons/profile_depository.hpp"
+#include "../singletons/job_dispatcher.hpp"
+#include "../singletons/timer_daemon.hpp"
+#include "../singletons/epoll_daemon.hpp"
+#include "../log.hpp"
+#include "../atomic.hpp"
+#include "../thread.hpp"
+#include "../promise.hpp"
+#include "../async_job.hpp"
+#include <signal.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace Poseidon;
+
+namespace {
+	volatile bool g_running = true;
+
+	template<typename T>
+	struct Raii_singleton_runner : NONCOPYABLE {
+		Raii_singleton_runner(){
+			T::start();
+		}
+		~Raii_singleton_runner(){
+			T::stop();
+		}
+	};
+
+	// 需要服务器组件的基准测试在这个线程中驱动，主线程运行 Job_dispatcher 的主循环。
+	void driver_thread_proc(Bench::Reporter *reporter){
+		try {
+			const AUTO(promise, boost::make_shared<Promise>());
+			enqueue_async_job(promise, boost::bind(&Bench::run_dispatcher_benchmarks, boost::ref(*reporter)));
+			while(!promise->is_satisfied()){
+				::usleep(10000);
+			}
+			promise->check_and_rethrow();
+
+			Bench::run_echo_benchmarks(*reporter);
+		} catch(std::exception &e){
+			POSEIDON_LOG_ERROR("std::exception thrown: what = ", e.what());
+		} catch(...){
+			POSEIDON_LOG_ERROR("Unknown exception thrown.");
+		}
+		atomic_store(g_running, false, memory_order_release);
+	}
+}
+
+int main(int argc, char **argv, char **/*envp*/){
+	bool all_logs = false;
+	int help = 0; // 1 = exit with EXIT_SUCCESS, * = exit with EXIT_FAILURE.
+	const char *new_wd = NULLPTR;
+	const char *output_path = NULLPTR;
+
+	Bench::Options options;
+	options.duration = 1000;
+	options.connections = 4;
+	options.message_size = 128;
+
+	int opt;
+	while((opt = ::getopt(argc, argv, "ac:d:f:ho:s:")) != -1){
+		switch(opt){
+		case 'a':
+			all_logs = true;
+			break;
+		case 'c':
+			options.connections = std::strtoul(optarg, NULLPTR, 10);
+			break;
+		case 'd':
+			options.duration = std::strtod(optarg, NULLPTR);
+			break;
+		case 'f':
+			options.filter = optarg;
+			break;
+		case 'h':
+			help |= 1;
+			break;
+		case 'o':
+			output_path = optarg;
+			break;
+		case 's':
+			options.message_size = std::strtoul(optarg, NULLPTR, 10);
+			break;
+		default:
+			help |= 2;
+			break;
+		}
+	}
+	switch(argc - optind){
+	case 0:
+		break;
+	case 1:
+		new_wd = argv[optind];
+		break;
+	default:
+		::fprintf(stderr, "%s: too many arguments -- '%s'\n", argv[0], argv[optind + 1]);
+		help |= 2;
+		break;
+	}
+	if((options.duration <= 0) || (options.connections == 0) || (options.message_size == 0)){
+		::fprintf(stderr, "%s: invalid duration, connection count or message size\n", argv[0]);
+		help |= 2;
+	}
+	if(help){
+		::fprintf(stdout,
+			//        1         2         3         4         5         6         7         8
+			// 345678901234567890123456789012345678901234567890123456789012345678901234567890
+			"Usage: %s [-ah] [-c <n>] [-d <ms>] [-f <filter>] [-o <file>] [-s <bytes>]\n"
+			"          [<directory>]\n"
+			"  -a            do not mask trace, debug and info logs\n"
+			"  -c <n>        number of concurrent connections for echo benchmarks (4)\n"
+			"  -d <ms>       minimum duration of each benchmark in milliseconds (1000)\n"
+			"  -f <filter>   run only benchmarks whose names contain this substring\n"
+			"  -h            show this help message then exit\n"
+			"  -o <file>     write JSON results to this file instead of stdout\n"
+			"  -s <bytes>    message size for echo benchmarks (128)\n"
+			"  <directory>   load 'main.conf' from this directory\n"
+			, argv[0]);
+		return (help == 1) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	Logger::set_thread_tag("P   "); // Primary
+	if(!all_logs){
+		Logger::set_mask(Logger::level_trace | Logger::level_debug | Logger::level_info, 0);
+	}
+
+	::signal(SIGCHLD, SIG_IGN);
+	::signal(SIGPIPE, SIG_IGN);
+
+	Bench::Reporter reporter(options);
+	try {
+		if(new_wd){
+			Main_config::set_run_path(new_wd);
+		}
+		Main_config::reload();
+
+		// 纯计算的基准测试不需要任何组件，在启动之前运行，避免后台线程的干扰。
+		Bench::run_codec_benchmarks(reporter);
+		Bench::run_protocol_benchmarks(reporter);
+
+#define START(x_)   const Raii_singleton_runner<x_> POSEIDON_UNIQUE_NAME
+
+		START(Profile_depository);
+		START(Job_dispatcher);
+		START(Timer_daemon);
+		START(Epoll_daemon);
+
+		Thread driver(boost::bind(&driver_thread_proc, &reporter), Rcnts::view("  B "), Rcnts::view("Bench driver"));
+		Job_dispatcher::do_modal(g_running);
+		driver.join();
+	} catch(std::exception &e){
+		POSEIDON_LOG_ERROR("std::exception thrown in main(): what = ", e.what());
+		return EXIT_FAILURE;
+	} catch(...){
+		POSEIDON_LOG_ERROR("Unknown exception thrown in main().");
+		return EXIT_FAILURE;
+	}
+
+	const std::string json = reporter.dump().dump().dump_string();
+	std::FILE *const output = output_path ? std::fopen(output_path, "w") : stdout;
+	if(!output){
+		const int err_code = errno;
+		::fprintf(stderr, "%s: could not open '%s' for writing: %s\n", argv[0], output_path, ::strerror(err_code));
+		return EXIT_FAILURE;
+	}
+	std::fwrite(json.data(), 1, json.size(), output);
+	std::fputc('\n', output);
+	if(output != stdout){
+		std::fclose(output);
+	}
+	return EXIT_SUCCESS;
+}
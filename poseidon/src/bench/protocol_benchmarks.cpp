@@ -0,0 +1,214 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2018, LH_Mouse. All wrongs reserved.
+
+#include "../precompiled.hpp"
+#include "bench.hpp"
+#include "../stream_buffer.hpp"
+#include "../http/server_reader.hpp"
+#include "../http/server_writer.hpp"
+#include "../websocket/reader.hpp"
+#include "../websocket/writer.hpp"
+#include "../cbpp/reader.hpp"
+#include "../cbpp/writer.hpp"
+
+namespace Poseidon {
+namespace Bench {
+
+namespace {
+	volatile boost::uint64_t g_sink;
+
+	const char g_http_request[] =
+		"GET /bench/resource?id=42&name=poseidon HTTP/1.1\r\n"
+		"Host: localhost\r\n"
+		"User-Agent: poseidon-bench\r\n"
+		"Accept: application/json\r\n"
+		"Accept-Encoding: gzip, deflate\r\n"
+		"Connection: keep-alive\r\n"
+		"\r\n";
+
+	class Counting_http_server_reader : public Http::Server_reader {
+	public:
+		std::size_t m_requests;
+
+	public:
+		Counting_http_server_reader()
+			: m_requests(0)
+		{
+			//
+		}
+
+	protected:
+		void on_request_headers(Http::Request_headers /*request_headers*/, boost::uint64_t /*content_length*/) OVERRIDE {
+			//
+		}
+		void on_request_entity(boost::uint64_t /*entity_offset*/, Stream_buffer /*entity*/) OVERRIDE {
+			//
+		}
+		bool on_request_end(boost::uint64_t /*content_length*/, Option_map /*headers*/) OVERRIDE {
+			++m_requests;
+			return true;
+		}
+	};
+
+	class Discarding_http_server_writer : public Http::Server_writer {
+	public:
+		std::size_t m_bytes;
+
+	public:
+		Discarding_http_server_writer()
+			: m_bytes(0)
+		{
+			//
+		}
+
+	protected:
+		long on_encoded_data_avail(Stream_buffer encoded) OVERRIDE {
+			m_bytes += encoded.size();
+			return 0;
+		}
+	};
+
+	void bench_http_server_reader(State &state){
+		const Stream_buffer request(g_http_request, sizeof(g_http_request) - 1);
+		Counting_http_server_reader reader;
+		while(state.next()){
+			reader.put_encoded_data(request);
+		}
+		g_sink = reader.m_requests;
+		state.set_bytes_per_iteration(request.size());
+	}
+	void bench_http_server_writer(State &state){
+		const Stream_buffer entity("{\"status\":\"ok\"}");
+		Discarding_http_server_writer writer;
+		while(state.next()){
+			Http::Response_headers response_headers = { 10001, Http::status_ok, "OK" };
+			response_headers.headers.set(Rcnts::view("Content-Type"), "application/json");
+			response_headers.headers.set(Rcnts::view("Cache-Control"), "no-cache");
+			writer.put_response(STD_MOVE(response_headers), entity, true);
+		}
+		g_sink = writer.m_bytes;
+	}
+
+	template<typename WriterT>
+	class Capturing_writer : public WriterT {
+	public:
+		Stream_buffer m_encoded;
+
+	protected:
+		long on_encoded_data_avail(Stream_buffer encoded) OVERRIDE {
+			m_encoded.splice(encoded);
+			return 0;
+		}
+	};
+
+	class Counting_websocket_reader : public Websocket::Reader {
+	public:
+		std::size_t m_messages;
+
+	public:
+		Counting_websocket_reader()
+			: Websocket::Reader(true)
+			, m_messages(0)
+		{
+			//
+		}
+
+	protected:
+		void on_data_message_header(Websocket::Opcode /*opcode*/) OVERRIDE {
+			//
+		}
+		void on_data_message_payload(boost::uint64_t /*whole_offset*/, Stream_buffer /*payload*/) OVERRIDE {
+			//
+		}
+		bool on_data_message_end(boost::uint64_t /*whole_size*/) OVERRIDE {
+			++m_messages;
+			return true;
+		}
+		bool on_control_message(Websocket::Opcode /*opcode*/, Stream_buffer /*payload*/) OVERRIDE {
+			return true;
+		}
+	};
+
+	void bench_websocket_reader(State &state){
+		char payload[128] = { };
+		Capturing_writer<Websocket::Writer> writer;
+		writer.put_message(Websocket::opcode_data_binary, true, Stream_buffer(payload, sizeof(payload)));
+		const Stream_buffer frame = STD_MOVE(writer.m_encoded);
+		Counting_websocket_reader reader;
+		while(state.next()){
+			reader.put_encoded_data(frame);
+		}
+		g_sink = reader.m_messages;
+		state.set_bytes_per_iteration(frame.size());
+	}
+	void bench_websocket_writer(State &state){
+		char payload[128] = { };
+		Capturing_writer<Websocket::Writer> writer;
+		while(state.next()){
+			writer.put_message(Websocket::opcode_data_binary, true, Stream_buffer(payload, sizeof(payload)));
+			writer.m_encoded.clear();
+		}
+		state.set_bytes_per_iteration(sizeof(payload));
+	}
+
+	class Counting_cbpp_reader : public Cbpp::Reader {
+	public:
+		std::size_t m_messages;
+
+	public:
+		Counting_cbpp_reader()
+			: m_messages(0)
+		{
+			//
+		}
+
+	protected:
+		void on_data_message_header(boost::uint16_t /*message_id*/, boost::uint64_t /*payload_size*/) OVERRIDE {
+			//
+		}
+		void on_data_message_payload(boost::uint64_t /*payload_offset*/, Stream_buffer /*payload*/) OVERRIDE {
+			//
+		}
+		bool on_data_message_end(boost::uint64_t /*payload_size*/) OVERRIDE {
+			++m_messages;
+			return true;
+		}
+		bool on_control_message(Cbpp::Status_code /*status_code*/, Stream_buffer /*param*/) OVERRIDE {
+			return true;
+		}
+	};
+
+	void bench_cbpp_reader(State &state){
+		char payload[128] = { };
+		Capturing_writer<Cbpp::Writer> writer;
+		writer.put_data_message(100, Stream_buffer(payload, sizeof(payload)));
+		const Stream_buffer frame = STD_MOVE(writer.m_encoded);
+		Counting_cbpp_reader reader;
+		while(state.next()){
+			reader.put_encoded_data(frame);
+		}
+		g_sink = reader.m_messages;
+		state.set_bytes_per_iteration(frame.size());
+	}
+	void bench_cbpp_writer(State &state){
+		char payload[128] = { };
+		Capturing_writer<Cbpp::Writer> writer;
+		while(state.next()){
+			writer.put_data_message(100, Stream_buffer(payload, sizeof(payload)));
+			writer.m_encoded.clear();
+		}
+		state.set_bytes_per_iteration(sizeof(payload));
+	}
+}
+
+void run_protocol_benchmarks(Reporter &reporter){
+	run_micro_benchmark(reporter, "http.server_reader", &bench_http_server_reader);
+	run_micro_benchmark(reporter, "http.server_writer", &bench_http_server_writer);
+	run_micro_benchmark(reporter, "websocket.reader_128", &bench_websocket_reader);
+	run_micro_benchmark(reporter, "websocket.writer_128", &bench_websocket_writer);
+	run_micro_benchmark(reporter, "cbpp.reader_128", &bench_cbpp_reader);
+	run_micro_benchmark(reporter, "cbpp.writer_128", &bench_cbpp_writer);
+}
+
+}
+}
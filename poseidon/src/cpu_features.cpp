@@ -0,0 +1,44 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2018, LH_Mouse. All wrongs reserved.
+
+#include "precompiled.hpp"
+#include "cpu_features.hpp"
+#if defined(__i386__) || defined(__x86_64__)
+#  include <cpuid.h>
+#endif
+
+namespace Poseidon {
+
+namespace {
+	Cpu_features detect_cpu_features() NOEXCEPT {
+		Cpu_features features = { };
+#if defined(__i386__) || defined(__x86_64__)
+		unsigned eax, ebx, ecx, edx;
+		if(::__get_cpuid(1, &eax, &ebx, &ecx, &edx) == 0){
+			return features;
+		}
+		features.ssse3 = (ecx & bit_SSSE3) != 0;
+		features.sse4_1 = (ecx & bit_SSE4_1) != 0;
+		features.pclmul = (ecx & bit_PCLMUL) != 0;
+		bool ymm_enabled = false;
+		if((ecx & bit_OSXSAVE) && (ecx & bit_AVX)){
+			unsigned xcr0_lo, xcr0_hi;
+			__asm__ volatile ("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+			ymm_enabled = (xcr0_lo & 6) == 6;
+		}
+		if(::__get_cpuid_max(0, NULLPTR) >= 7){
+			__cpuid_count(7, 0, eax, ebx, ecx, edx);
+			features.avx2 = ymm_enabled && ((ebx & bit_AVX2) != 0);
+			features.sha = (ebx & bit_SHA) != 0;
+		}
+#endif
+		return features;
+	}
+}
+
+const Cpu_features &get_cpu_features() NOEXCEPT {
+	static const Cpu_features s_features = detect_cpu_features();
+	return s_features;
+}
+
+}
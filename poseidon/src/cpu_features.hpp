@@ -0,0 +1,25 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2018, LH_Mouse. All wrongs reserved.
+
+#ifndef POSEIDON_CPU_FEATURES_HPP_
+#define POSEIDON_CPU_FEATURES_HPP_
+
+#include "cxx_ver.hpp"
+
+namespace Poseidon {
+
+// 运行时检测的 CPU 指令集扩展，用于选择加速的实现。
+struct Cpu_features {
+	bool ssse3;
+	bool sse4_1;
+	bool pclmul;
+	bool avx2;   // 同时要求操作系统保存 YMM 寄存器。
+	bool sha;
+};
+
+// 第一次调用时通过 CPUID 检测，之后返回缓存的结果。
+extern const Cpu_features &get_cpu_features() NOEXCEPT;
+
+}
+
+#endif
@@ -3,6 +3,11 @@
 
 #include "precompiled.hpp"
 #include "crc32.hpp"
+#include "cpu_features.hpp"
+#include "endian.hpp"
+#if defined(__i386__) || defined(__x86_64__)
+#  include <x86intrin.h>
+#endif
 
 namespace Poseidon {
 
@@ -43,6 +48,141 @@ namespace {
 		0xBDBDF21C, 0xCABAC28A, 0x53B39330, 0x24B4A3A6, 0xBAD03605, 0xCDD70693, 0x54DE5729, 0x23D967BF,
 		0xB3667A2E, 0xC4614AB8, 0x5D681B02, 0x2A6F2B94, 0xB40BBE37, 0xC30C8EA1, 0x5A05DF1B, 0x2D02EF8D,
 	};
+
+	// Slicing-by-8，每次处理八个字节。
+	struct Crc32_slice_tables {
+		boost::uint32_t t[8][256];
+	};
+
+	Crc32_slice_tables create_slice_tables(){
+		Crc32_slice_tables tables;
+		for(unsigned i = 0; i < 256; ++i){
+			tables.t[0][i] = g_crc32_table[i];
+		}
+		for(unsigned k = 1; k < 8; ++k){
+			for(unsigned i = 0; i < 256; ++i){
+				const boost::uint32_t prev = tables.t[k - 1][i];
+				tables.t[k][i] = g_crc32_table[prev & 0xFF] ^ (prev >> 8);
+			}
+		}
+		return tables;
+	}
+	const Crc32_slice_tables &get_slice_tables(){
+		static const Crc32_slice_tables s_tables = create_slice_tables();
+		return s_tables;
+	}
+
+	boost::uint32_t update_generic(boost::uint32_t reg, const unsigned char *data, std::size_t size){
+		const AUTO_REF(t, get_slice_tables().t);
+		const unsigned char *read = data;
+		std::size_t remaining = size;
+		while(remaining >= 8){
+			boost::uint32_t lo, hi;
+			std::memcpy(&lo, read, 4);
+			std::memcpy(&hi, read + 4, 4);
+			lo = load_le(lo) ^ reg;
+			hi = load_le(hi);
+			reg = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24]
+			    ^ t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+			read += 8;
+			remaining -= 8;
+		}
+		while(remaining != 0){
+			reg = t[0][(reg ^ *read) & 0xFF] ^ (reg >> 8);
+			++read;
+			--remaining;
+		}
+		return reg;
+	}
+
+#if defined(__i386__) || defined(__x86_64__)
+	// 使用 PCLMULQDQ 折叠，要求 size 不小于 64 且是 16 的倍数。
+	// Intel, Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction.
+	__attribute__((__target__("pclmul,sse4.1")))
+	boost::uint32_t update_pclmul(boost::uint32_t reg, const unsigned char *data, std::size_t size){
+		const __m128i k1k2 = _mm_set_epi64x(0x01C6E41596, 0x0154442BD4);
+		const __m128i k3k4 = _mm_set_epi64x(0x00CCAA009E, 0x01751997D0);
+		const __m128i k5k0 = _mm_set_epi64x(0x0000000000, 0x0163CD6124);
+		const __m128i poly = _mm_set_epi64x(0x01F7011641, 0x01DB710641);
+		const __m128i mask32 = _mm_setr_epi32(-1, 0, -1, 0);
+
+		const unsigned char *read = data;
+		std::size_t remaining = size;
+		__m128i x1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(read + 0x00));
+		__m128i x2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(read + 0x10));
+		__m128i x3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(read + 0x20));
+		__m128i x4 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(read + 0x30));
+		x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(static_cast<int>(reg)));
+		read += 64;
+		remaining -= 64;
+		// 四路并行折叠。
+		while(remaining >= 64){
+			const __m128i x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+			const __m128i x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+			const __m128i x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+			const __m128i x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+			x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+			x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+			x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+			x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+			x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128(reinterpret_cast<const __m128i *>(read + 0x00)));
+			x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128(reinterpret_cast<const __m128i *>(read + 0x10)));
+			x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128(reinterpret_cast<const __m128i *>(read + 0x20)));
+			x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128(reinterpret_cast<const __m128i *>(read + 0x30)));
+			read += 64;
+			remaining -= 64;
+		}
+		// 合并为 128 位。
+		__m128i x5;
+		x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+		x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+		x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+		while(remaining >= 16){
+			x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+			x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+			x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128(reinterpret_cast<const __m128i *>(read))), x5);
+			read += 16;
+			remaining -= 16;
+		}
+		// 128 位折叠到 64 位。
+		x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+		x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+		x2 = _mm_srli_si128(x1, 4);
+		x1 = _mm_and_si128(x1, mask32);
+		x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+		x1 = _mm_xor_si128(x1, x2);
+		// Barrett 约减到 32 位。
+		x2 = _mm_and_si128(x1, mask32);
+		x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+		x2 = _mm_and_si128(x2, mask32);
+		x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+		x1 = _mm_xor_si128(x1, x2);
+		return static_cast<boost::uint32_t>(_mm_extract_epi32(x1, 1));
+	}
+#endif
+
+	boost::uint32_t update(boost::uint32_t reg, const unsigned char *data, std::size_t size){
+		const unsigned char *read = data;
+		std::size_t remaining = size;
+#if defined(__i386__) || defined(__x86_64__)
+		if(remaining >= 64){
+			const AUTO_REF(features, get_cpu_features());
+			if(features.pclmul && features.sse4_1){
+				const std::size_t bulk = remaining & ~static_cast<std::size_t>(15);
+				reg = update_pclmul(reg, read, bulk);
+				read += bulk;
+				remaining -= bulk;
+			}
+		}
+#endif
+		return update_generic(reg, read, remaining);
+	}
 }
 
 Crc32_streambuf::Crc32_streambuf()
@@ -66,6 +206,18 @@ Crc32_streambuf::int_type Crc32_streambuf::overflow(Crc32_streambuf::int_type c)
 	return c;
 }
 
+std::streamsize Crc32_streambuf::xsputn(const char *s, std::streamsize n){
+	if(n <= 0){
+		return 0;
+	}
+	put(s, static_cast<std::size_t>(n));
+	return n;
+}
+
+void Crc32_streambuf::put(const void *data, std::size_t size){
+	m_reg = update(m_reg, static_cast<const unsigned char *>(data), size);
+}
+
 Crc32 Crc32_streambuf::finalize(){
 	Crc32 crc32;
 	crc32 = ~m_reg;
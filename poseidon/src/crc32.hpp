@@ -29,8 +29,12 @@ public:
 
 protected:
 	int_type overflow(int_type c = traits_type::eof()) OVERRIDE;
+	std::streamsize xsputn(const char *s, std::streamsize n) OVERRIDE;
 
 public:
+	// 批量输入，不经过逐字符的 streambuf 接口。
+	void put(const void *data, std::size_t size);
+
 	void reset() NOEXCEPT;
 	Crc32 finalize();
 };
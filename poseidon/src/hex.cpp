@@ -5,6 +5,10 @@
 #include "hex.hpp"
 #include "profiler.hpp"
 #include "exception.hpp"
+#include "cpu_features.hpp"
+#if defined(__i386__) || defined(__x86_64__)
+#  include <x86intrin.h>
+#endif
 
 namespace Poseidon {
 
@@ -18,11 +22,170 @@ namespace {
 		return g_hex_table[(byte & 0x0F) + upper_case * sizeof(g_hex_table) / 2];
 	}
 	int from_hex_digit(unsigned char ch){
-		const AUTO(p, static_cast<const unsigned char *>(std::memchr(g_hex_table, ch, sizeof(g_hex_table))));
-		if(!p){
-			return -1;
+		const unsigned digit = static_cast<unsigned>(ch - '0');
+		if(digit < 10){
+			return static_cast<int>(digit);
 		}
-		return (p - g_hex_table) & 0x0F;
+		const unsigned letter = static_cast<unsigned>((ch | 0x20) - 'a');
+		if(letter < 6){
+			return static_cast<int>(letter + 10);
+		}
+		return -1;
+	}
+
+	// 以下批量编解码函数返回消耗的输入字节数。解码时遇到空白或者非法字符时停止，交给逐字符的代码处理。
+
+	std::size_t encode_generic(unsigned char *out, const unsigned char *in, std::size_t size, bool upper_case){
+		for(std::size_t i = 0; i < size; ++i){
+			out[i * 2 + 0] = to_hex_digit(in[i] >> 4u, upper_case);
+			out[i * 2 + 1] = to_hex_digit(in[i] >> 0u, upper_case);
+		}
+		return size;
+	}
+	std::size_t decode_generic(unsigned char *out, const unsigned char *in, std::size_t size){
+		std::size_t n = 0;
+		while(size - n >= 2){
+			const int hi = from_hex_digit(in[n]);
+			const int lo = from_hex_digit(in[n + 1]);
+			if((hi | lo) < 0){
+				break;
+			}
+			*out = static_cast<unsigned char>((hi << 4) | lo);
+			++out;
+			n += 2;
+		}
+		return n;
+	}
+
+#if defined(__i386__) || defined(__x86_64__)
+	__attribute__((__target__("ssse3")))
+	std::size_t encode_ssse3(unsigned char *out, const unsigned char *in, std::size_t size, bool upper_case){
+		const __m128i lut = _mm_loadu_si128(reinterpret_cast<const __m128i *>(g_hex_table + upper_case * sizeof(g_hex_table) / 2));
+		std::size_t n = 0;
+		while(size - n >= 16){
+			const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + n));
+			const __m128i hi = _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0x0F)));
+			const __m128i lo = _mm_shuffle_epi8(lut, _mm_and_si128(v, _mm_set1_epi8(0x0F)));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(out +  0), _mm_unpacklo_epi8(hi, lo));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(out + 16), _mm_unpackhi_epi8(hi, lo));
+			out += 32;
+			n += 16;
+		}
+		return n;
+	}
+	__attribute__((__target__("avx2")))
+	std::size_t encode_avx2(unsigned char *out, const unsigned char *in, std::size_t size, bool upper_case){
+		const __m256i lut = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(g_hex_table + upper_case * sizeof(g_hex_table) / 2)));
+		std::size_t n = 0;
+		while(size - n >= 32){
+			const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + n));
+			const __m256i hi = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0F)));
+			const __m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(v, _mm256_set1_epi8(0x0F)));
+			// 交错是在每个 128 位通道内进行的，需要把通道重新排列一下。
+			const __m256i t0 = _mm256_unpacklo_epi8(hi, lo);
+			const __m256i t1 = _mm256_unpackhi_epi8(hi, lo);
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(out +  0), _mm256_permute2x128_si256(t0, t1, 0x20));
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(out + 32), _mm256_permute2x128_si256(t0, t1, 0x31));
+			out += 64;
+			n += 32;
+		}
+		return n;
+	}
+
+	// 把 16 个字符翻译成半字节。如果有字符不是十六进制数字，返回 false。
+	__attribute__((__target__("ssse3")))
+	bool decode_nibbles_ssse3(__m128i &out, __m128i in){
+		const __m128i digit = _mm_sub_epi8(in, _mm_set1_epi8('0'));
+		const __m128i is_digit = _mm_and_si128(_mm_cmpgt_epi8(digit, _mm_set1_epi8(-1)), _mm_cmpgt_epi8(_mm_set1_epi8(10), digit));
+		const __m128i letter = _mm_sub_epi8(_mm_or_si128(in, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+		const __m128i is_letter = _mm_and_si128(_mm_cmpgt_epi8(letter, _mm_set1_epi8(-1)), _mm_cmpgt_epi8(_mm_set1_epi8(6), letter));
+		if(_mm_movemask_epi8(_mm_or_si128(is_digit, is_letter)) != 0xFFFF){
+			return false;
+		}
+		out = _mm_or_si128(_mm_and_si128(is_digit, digit), _mm_and_si128(is_letter, _mm_add_epi8(letter, _mm_set1_epi8(10))));
+		return true;
+	}
+	__attribute__((__target__("ssse3")))
+	std::size_t decode_ssse3(unsigned char *out, const unsigned char *in, std::size_t size){
+		std::size_t n = 0;
+		while(size - n >= 32){
+			__m128i v0, v1;
+			if(!decode_nibbles_ssse3(v0, _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + n +  0)))){
+				break;
+			}
+			if(!decode_nibbles_ssse3(v1, _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + n + 16)))){
+				break;
+			}
+			// 每两个半字节合并成一个字节，高位在前。
+			v0 = _mm_maddubs_epi16(v0, _mm_set1_epi16(0x0110));
+			v1 = _mm_maddubs_epi16(v1, _mm_set1_epi16(0x0110));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_packus_epi16(v0, v1));
+			out += 16;
+			n += 32;
+		}
+		return n;
+	}
+	__attribute__((__target__("avx2")))
+	bool decode_nibbles_avx2(__m256i &out, __m256i in){
+		const __m256i digit = _mm256_sub_epi8(in, _mm256_set1_epi8('0'));
+		const __m256i is_digit = _mm256_and_si256(_mm256_cmpgt_epi8(digit, _mm256_set1_epi8(-1)), _mm256_cmpgt_epi8(_mm256_set1_epi8(10), digit));
+		const __m256i letter = _mm256_sub_epi8(_mm256_or_si256(in, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+		const __m256i is_letter = _mm256_and_si256(_mm256_cmpgt_epi8(letter, _mm256_set1_epi8(-1)), _mm256_cmpgt_epi8(_mm256_set1_epi8(6), letter));
+		if(_mm256_movemask_epi8(_mm256_or_si256(is_digit, is_letter)) != -1){
+			return false;
+		}
+		out = _mm256_or_si256(_mm256_and_si256(is_digit, digit), _mm256_and_si256(is_letter, _mm256_add_epi8(letter, _mm256_set1_epi8(10))));
+		return true;
+	}
+	__attribute__((__target__("avx2")))
+	std::size_t decode_avx2(unsigned char *out, const unsigned char *in, std::size_t size){
+		std::size_t n = 0;
+		while(size - n >= 64){
+			__m256i v0, v1;
+			if(!decode_nibbles_avx2(v0, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + n +  0)))){
+				break;
+			}
+			if(!decode_nibbles_avx2(v1, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + n + 32)))){
+				break;
+			}
+			v0 = _mm256_maddubs_epi16(v0, _mm256_set1_epi16(0x0110));
+			v1 = _mm256_maddubs_epi16(v1, _mm256_set1_epi16(0x0110));
+			// 打包是在每个 128 位通道内进行的，需要把 64 位的块重新排列一下。
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(out), _mm256_permute4x64_epi64(_mm256_packus_epi16(v0, v1), 0xD8));
+			out += 32;
+			n += 64;
+		}
+		return n;
+	}
+#endif
+
+	std::size_t encode_bulk(unsigned char *out, const unsigned char *in, std::size_t size, bool upper_case){
+		std::size_t n = 0;
+#if defined(__i386__) || defined(__x86_64__)
+		const AUTO_REF(features, get_cpu_features());
+		if(features.avx2){
+			n += encode_avx2(out + n * 2, in + n, size - n, upper_case);
+		}
+		if(features.ssse3){
+			n += encode_ssse3(out + n * 2, in + n, size - n, upper_case);
+		}
+#endif
+		n += encode_generic(out + n * 2, in + n, size - n, upper_case);
+		return n;
+	}
+	std::size_t decode_bulk(unsigned char *out, const unsigned char *in, std::size_t size){
+		std::size_t n = 0;
+#if defined(__i386__) || defined(__x86_64__)
+		const AUTO_REF(features, get_cpu_features());
+		if(features.avx2){
+			n += decode_avx2(out + n / 2, in + n, size - n);
+		}
+		if(features.ssse3){
+			n += decode_ssse3(out + n / 2, in + n, size - n);
+		}
+#endif
+		n += decode_generic(out + n / 2, in + n, size - n);
+		return n;
 	}
 }
 
@@ -41,10 +204,14 @@ void Hex_encoder::clear(){
 void Hex_encoder::put(const void *data, std::size_t size){
 	POSEIDON_PROFILE_ME;
 
-	for(std::size_t i = 0; i < size; ++i){
-		const unsigned ch = static_cast<const unsigned char *>(data)[i];
-		m_buffer.put(to_hex_digit(ch >> 4, m_upper_case));
-		m_buffer.put(to_hex_digit(ch >> 0, m_upper_case));
+	const unsigned char *read = static_cast<const unsigned char *>(data);
+	std::size_t remaining = size;
+	unsigned char out[4096];
+	while(remaining != 0){
+		const std::size_t n = encode_bulk(out, read, std::min<std::size_t>(remaining, sizeof(out) / 2), m_upper_case);
+		m_buffer.put(out, n * 2);
+		read += n;
+		remaining -= n;
 	}
 }
 void Hex_encoder::put(const Stream_buffer &buffer){
@@ -81,8 +248,22 @@ void Hex_decoder::clear(){
 void Hex_decoder::put(const void *data, std::size_t size){
 	POSEIDON_PROFILE_ME;
 
-	for(std::size_t i = 0; i < size; ++i){
-		const unsigned char ch = static_cast<const unsigned char *>(data)[i];
+	const unsigned char *read = static_cast<const unsigned char *>(data);
+	std::size_t remaining = size;
+	unsigned char out[2048];
+	while(remaining != 0){
+		if(m_seq == 1){
+			const std::size_t n = decode_bulk(out, read, std::min<std::size_t>(remaining, sizeof(out) * 2));
+			if(n != 0){
+				m_buffer.put(out, n / 2);
+				read += n;
+				remaining -= n;
+				continue;
+			}
+		}
+		const unsigned char ch = *read;
+		++read;
+		--remaining;
 		if((ch == ' ') || (ch == '\t') || (ch == '\r') || (ch == '\n')){
 			continue;
 		}
@@ -213,7 +213,13 @@ __attribute__((__noreturn__)) void throw_authentication_failure_basic(const boos
 }
 
 namespace {
-	const boost::uint32_t g_server_id = random_uint32();
+	boost::uint32_t create_server_id(){
+		boost::uint32_t server_id;
+		random_fill_secure(&server_id, sizeof(server_id));
+		return server_id;
+	}
+
+	const boost::uint32_t g_server_id = create_server_id();
 
 	struct Nonce {
 		boost::uint32_t server_id; // g_server_id
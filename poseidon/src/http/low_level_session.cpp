@@ -9,10 +9,58 @@
 #include "../log.hpp"
 #include "../profiler.hpp"
 #include "../stream_buffer.hpp"
+#include "../system_exception.hpp"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 
 namespace Poseidon {
 namespace Http {
 
+namespace {
+	// 只处理单一区间。多区间请求按照 RFC 7233 的许可忽略 Range，返回整个文件。
+	bool parse_byte_range(boost::uint64_t &begin, boost::uint64_t &end, const std::string &range, boost::uint64_t size_total){
+		if(::strncasecmp(range.c_str(), "bytes=", 6) != 0){
+			return false;
+		}
+		const char *read = range.c_str() + 6;
+		if(std::strchr(read, ',')){
+			return false;
+		}
+		char *eptr;
+		if(*read == '-'){
+			// bytes=-500 表示最后 500 字节。
+			const AUTO(suffix_length, ::strtoull(read + 1, &eptr, 10));
+			if((eptr == read + 1) || (*eptr != 0)){
+				return false;
+			}
+			begin = size_total - std::min<boost::uint64_t>(suffix_length, size_total);
+			end = size_total;
+			return true;
+		}
+		const AUTO(first, ::strtoull(read, &eptr, 10));
+		if((eptr == read) || (*eptr != '-')){
+			return false;
+		}
+		read = eptr + 1;
+		boost::uint64_t last = UINT64_MAX;
+		if(*read != 0){
+			last = ::strtoull(read, &eptr, 10);
+			if((eptr == read) || (*eptr != 0) || (last < first)){
+				return false;
+			}
+		}
+		begin = first;
+		if(first >= size_total){
+			// 起始位置在文件末尾之后，无法满足。
+			end = begin;
+			return true;
+		}
+		end = std::min<boost::uint64_t>(last, size_total - 1) + 1;
+		return true;
+	}
+}
+
 Low_level_session::Low_level_session(Move<Unique_file> socket)
 	: Tcp_session_base(STD_MOVE(socket)), Server_reader(), Server_writer()
 {
@@ -142,6 +190,72 @@ bool Low_level_session::send(Status_code status_code, Option_map headers, Stream
 	return send(STD_MOVE(response_headers), STD_MOVE(entity));
 }
 
+bool Low_level_session::send_file(Response_headers response_headers, Move<Unique_file> file, boost::uint64_t offset, boost::uint64_t length){
+	POSEIDON_PROFILE_ME;
+
+	if(!Server_writer::put_response_headers(STD_MOVE(response_headers), length)){
+		return false;
+	}
+	return Tcp_session_base::send_file(STD_MOVE(file), offset, length);
+}
+bool Low_level_session::send_file(const Request_headers &request_headers, Move<Unique_file> file, Option_map headers){
+	POSEIDON_PROFILE_ME;
+
+	Unique_file file_owned(STD_MOVE(file));
+	struct ::stat stat_buf;
+	POSEIDON_THROW_UNLESS(::fstat(file_owned.get(), &stat_buf) == 0, System_exception);
+	const AUTO(size_total, static_cast<boost::uint64_t>(stat_buf.st_size));
+
+	char temp[256];
+	unsigned len;
+	Status_code status_code = status_ok;
+	boost::uint64_t begin = 0, end = size_total;
+	headers.set(Rcnts::view("Accept-Ranges"), "bytes");
+	const AUTO_REF(range, request_headers.headers.get("Range"));
+	if(!range.empty() && !request_headers.headers.has("If-Range") && parse_byte_range(begin, end, range, size_total)){
+		if(begin >= end){
+			len = (unsigned)std::sprintf(temp, "bytes */%llu", (unsigned long long)size_total);
+			headers.set(Rcnts::view("Content-Range"), std::string(temp, len));
+			return send_default(status_range_not_satisfiable, STD_MOVE(headers));
+		}
+		status_code = status_partial_content;
+		len = (unsigned)std::sprintf(temp, "bytes %llu-%llu/%llu", (unsigned long long)begin, (unsigned long long)(end - 1), (unsigned long long)size_total);
+		headers.set(Rcnts::view("Content-Range"), std::string(temp, len));
+	}
+
+	Response_headers response_headers;
+	response_headers.version = request_headers.version;
+	response_headers.status_code = status_code;
+	response_headers.reason = get_status_code_desc(status_code).desc_short;
+	response_headers.headers = STD_MOVE(headers);
+	if(request_headers.verb == verb_head){
+		return Server_writer::put_response_headers(STD_MOVE(response_headers), end - begin);
+	}
+	return send_file(STD_MOVE(response_headers), STD_MOVE(file_owned), begin, end - begin);
+}
+bool Low_level_session::send_file(const Request_headers &request_headers, const std::string &path, Option_map headers){
+	POSEIDON_PROFILE_ME;
+
+	Unique_file file;
+	if(!file.reset(::open(path.c_str(), O_RDONLY | O_CLOEXEC))){
+		const int err_code = errno;
+		POSEIDON_LOG_DEBUG("Failed to open file: path = ", path, ", err_code = ", err_code);
+		if((err_code == ENOENT) || (err_code == ENOTDIR)){
+			POSEIDON_THROW(Exception, status_not_found);
+		}
+		if(err_code == EACCES){
+			POSEIDON_THROW(Exception, status_forbidden);
+		}
+		POSEIDON_THROW(System_exception, err_code);
+	}
+	struct ::stat stat_buf;
+	POSEIDON_THROW_UNLESS(::fstat(file.get(), &stat_buf) == 0, System_exception);
+	if(!S_ISREG(stat_buf.st_mode)){
+		POSEIDON_THROW(Exception, status_forbidden);
+	}
+	return send_file(request_headers, STD_MOVE(file), STD_MOVE(headers));
+}
+
 bool Low_level_session::send_chunked_header(Response_headers response_headers){
 	POSEIDON_PROFILE_ME;
 
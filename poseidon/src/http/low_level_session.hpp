@@ -65,6 +65,12 @@ public:
 	virtual bool send(Status_code status_code, Stream_buffer entity, const Header_option &content_type);
 	virtual bool send(Status_code status_code, Option_map headers, Stream_buffer entity = Stream_buffer());
 
+	// 文件内容通过 sendfile() 发送，不经过用户态缓冲区。
+	virtual bool send_file(Response_headers response_headers, Move<Unique_file> file, boost::uint64_t offset, boost::uint64_t length);
+	// 根据请求中的 Range 选择 200、206 或 416 响应。对于 HEAD 请求只发送响应头。
+	virtual bool send_file(const Request_headers &request_headers, Move<Unique_file> file, Option_map headers = Option_map());
+	virtual bool send_file(const Request_headers &request_headers, const std::string &path, Option_map headers = Option_map());
+
 	virtual bool send_chunked_header(Response_headers response_headers);
 	virtual bool send_chunk(Stream_buffer entity);
 	virtual bool send_chunked_trailer(Option_map headers = Option_map());
@@ -7,10 +7,246 @@
 #include "../log.hpp"
 #include "../profiler.hpp"
 #include "../string.hpp"
+#include "../time.hpp"
+#include "../singletons/main_config.hpp"
+#include <boost/scoped_array.hpp>
 
 namespace Poseidon {
 namespace Http {
 
+namespace {
+	// 响应头先完整地写入一块连续的内存，然后一次性放入 Stream_buffer。
+	class Header_renderer : NONCOPYABLE {
+	private:
+		char m_small[1024];
+		boost::scoped_array<char> m_large;
+		char *m_begin;
+		char *m_write;
+
+	public:
+		// capacity 必须不小于将要写入的字节数。
+		explicit Header_renderer(std::size_t capacity)
+			: m_large(), m_begin(m_small), m_write(m_small)
+		{
+			if(capacity > sizeof(m_small)){
+				m_large.reset(new char[capacity]);
+				m_begin = m_large.get();
+				m_write = m_begin;
+			}
+		}
+
+	public:
+		void put(const char *str, std::size_t len){
+			std::memcpy(m_write, str, len);
+			m_write += len;
+		}
+		void put(const char *str){
+			put(str, std::strlen(str));
+		}
+		void put(const std::string &str){
+			put(str.data(), str.size());
+		}
+		void put_decimal(boost::uint64_t value){
+			char temp[24];
+			char *const end = temp + sizeof(temp);
+			char *read = end;
+			do {
+				*(--read) = static_cast<char>('0' + value % 10);
+				value /= 10;
+			} while(value != 0);
+			put(read, static_cast<std::size_t>(end - read));
+		}
+		void put_hex(boost::uint64_t value){
+			char temp[24];
+			char *const end = temp + sizeof(temp);
+			char *read = end;
+			do {
+				*(--read) = "0123456789abcdef"[value % 16];
+				value /= 16;
+			} while(value != 0);
+			put(read, static_cast<std::size_t>(end - read));
+		}
+		void put_header(const char *key, std::size_t key_len, const std::string &value){
+			char *write = m_write;
+			std::memcpy(write, key, key_len);
+			write += key_len;
+			*(write++) = ':';
+			*(write++) = ' ';
+			std::memcpy(write, value.data(), value.size());
+			write += value.size();
+			*(write++) = '\r';
+			*(write++) = '\n';
+			m_write = write;
+		}
+		void flush_into(Stream_buffer &data) const {
+			data.put(m_begin, static_cast<std::size_t>(m_write - m_begin));
+		}
+	};
+
+	void render_status_line(Header_renderer &renderer, const Response_headers &response_headers){
+		// 常见的版本号使用预先准备好的前缀。
+		switch(response_headers.version){
+		case 10001:
+			renderer.put("HTTP/1.1 ", 9);
+			break;
+		case 10000:
+			renderer.put("HTTP/1.0 ", 9);
+			break;
+		default:
+			renderer.put("HTTP/", 5);
+			renderer.put_decimal(response_headers.version / 10000);
+			renderer.put(".", 1);
+			renderer.put_decimal(response_headers.version % 10000);
+			renderer.put(" ", 1);
+			break;
+		}
+		const unsigned status_code = static_cast<unsigned>(response_headers.status_code);
+		if((100 <= status_code) && (status_code <= 999)){
+			const char digits[3] = { static_cast<char>('0' + status_code / 100), static_cast<char>('0' + status_code / 10 % 10), static_cast<char>('0' + status_code % 10) };
+			renderer.put(digits, 3);
+		} else {
+			renderer.put_decimal(status_code);
+		}
+		renderer.put(" ", 1);
+		renderer.put(response_headers.reason);
+		renderer.put("\r\n", 2);
+	}
+
+	enum Header_class {
+		header_other,
+		header_content_length,
+		header_content_type,
+		header_transfer_encoding,
+		header_date,
+		header_server,
+	};
+
+	// 只有响应写入器需要特殊处理的几个头部。不区分大小写。
+	Header_class classify_header(const char *key){
+		switch(key[0]){
+		case 'C':
+		case 'c':
+			if(::strcasecmp(key, "Content-Length") == 0){
+				return header_content_length;
+			}
+			if(::strcasecmp(key, "Content-Type") == 0){
+				return header_content_type;
+			}
+			break;
+		case 'T':
+		case 't':
+			if(::strcasecmp(key, "Transfer-Encoding") == 0){
+				return header_transfer_encoding;
+			}
+			break;
+		case 'D':
+		case 'd':
+			if(::strcasecmp(key, "Date") == 0){
+				return header_date;
+			}
+			break;
+		case 'S':
+		case 's':
+			if(::strcasecmp(key, "Server") == 0){
+				return header_server;
+			}
+			break;
+		}
+		return header_other;
+	}
+
+	// Date 和 Server 头每个线程每秒只生成一次。
+	struct Cached_headers {
+		boost::uint64_t second_plus_one;
+		std::size_t date_len;
+		char date[64];
+		std::size_t server_len;
+		char server[256];
+	};
+
+	__thread Cached_headers t_cached_headers;
+
+	const Cached_headers &get_cached_headers(){
+		AUTO_REF(cache, t_cached_headers);
+		const AUTO(utc_now, get_utc_time());
+		if(cache.second_plus_one == utc_now / 1000 + 1){
+			return cache;
+		}
+		static CONSTEXPR const char s_weekdays[7][4] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+		static CONSTEXPR const char s_months[12][4] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+		const AUTO(dt, break_down_time(utc_now));
+		// 1970-01-01 是星期四。
+		const unsigned weekday = static_cast<unsigned>((utc_now / 86400000 + 4) % 7);
+		int len = std::sprintf(cache.date, "Date: %s, %02u %s %04u %02u:%02u:%02u GMT\r\n",
+			s_weekdays[weekday], dt.day, s_months[(dt.mon - 1) % 12], dt.yr, dt.hr, dt.min, dt.sec);
+		cache.date_len = static_cast<std::size_t>(len);
+		const AUTO(server, Main_config::get<std::string>("http_server_name"));
+		if(server.empty()){
+			cache.server_len = 0;
+		} else {
+			len = std::snprintf(cache.server, sizeof(cache.server), "Server: %.200s\r\n", server.c_str());
+			cache.server_len = static_cast<std::size_t>(len);
+		}
+		cache.second_plus_one = utc_now / 1000 + 1;
+		return cache;
+	}
+
+	// 计算响应头最多需要多少字节。
+	std::size_t estimate_header_size(const Response_headers &response_headers){
+		std::size_t size = 64 + response_headers.reason.size();
+		for(AUTO(it, response_headers.headers.begin()); it != response_headers.headers.end(); ++it){
+			size += std::strlen(it->first.get()) + it->second.size() + 4;
+		}
+		// Content-Length 或者 Transfer-Encoding，以及结尾的空行。
+		size += 64;
+		// Date 和 Server。
+		size += sizeof(t_cached_headers.date) + sizeof(t_cached_headers.server);
+		return size;
+	}
+
+	// 写入除特殊头部以外的所有头部，然后写入 Date 和 Server 头（如果调用者没有指定）。
+	void render_headers(Header_renderer &renderer, const Option_map &headers, bool keep_content_length, bool keep_content_type, bool keep_transfer_encoding){
+		bool has_date = false;
+		bool has_server = false;
+		for(AUTO(it, headers.begin()); it != headers.end(); ++it){
+			const char *const key = it->first.get();
+			switch(classify_header(key)){
+			case header_content_length:
+				if(!keep_content_length){
+					continue;
+				}
+				break;
+			case header_content_type:
+				if(!keep_content_type){
+					continue;
+				}
+				break;
+			case header_transfer_encoding:
+				if(!keep_transfer_encoding){
+					continue;
+				}
+				break;
+			case header_date:
+				has_date = true;
+				break;
+			case header_server:
+				has_server = true;
+				break;
+			default:
+				break;
+			}
+			renderer.put_header(key, std::strlen(key), it->second);
+		}
+		const AUTO_REF(cache, get_cached_headers());
+		if(!has_date){
+			renderer.put(cache.date, cache.date_len);
+		}
+		if(!has_server){
+			renderer.put(cache.server, cache.server_len);
+		}
+	}
+}
+
 Server_writer::Server_writer(){
 	//
 }
@@ -23,68 +259,55 @@ long Server_writer::put_response(Response_headers response_headers, Stream_buffe
 
 	Stream_buffer data;
 
-	const unsigned ver_major = response_headers.version / 10000, ver_minor = response_headers.version % 10000;
-	const unsigned status_code = static_cast<unsigned>(response_headers.status_code);
-	char temp[64];
-	unsigned len = (unsigned)std::sprintf(temp, "HTTP/%u.%u %u ", ver_major, ver_minor, status_code);
-	data.put(temp, len);
-	data.put(response_headers.reason);
-	data.put("\r\n");
-
-	AUTO_REF(headers, response_headers.headers);
-	if(entity.empty()){
-		headers.erase("Content-Type");
-		headers.erase("Transfer-Encoding");
-		if(set_content_length){
-			headers.set(Rcnts::view("Content-Length"), "0");
-		}
-	} else {
-		headers.erase("Transfer-Encoding");
-		if(set_content_length){
-			len = (unsigned)std::sprintf(temp, "%llu", (unsigned long long)entity.size());
-			headers.set(Rcnts::view("Content-Length"), std::string(temp, len));
-		}
-	}
-
-	for(AUTO(it, headers.begin()); it != headers.end(); ++it){
-		data.put(it->first.get());
-		data.put(": ");
-		data.put(it->second);
-		data.put("\r\n");
+	Header_renderer renderer(estimate_header_size(response_headers));
+	render_status_line(renderer, response_headers);
+	render_headers(renderer, response_headers.headers, !set_content_length, !entity.empty(), false);
+	if(set_content_length){
+		renderer.put("Content-Length: ", 16);
+		renderer.put_decimal(entity.size());
+		renderer.put("\r\n", 2);
 	}
-	data.put("\r\n");
+	renderer.put("\r\n", 2);
+	renderer.flush_into(data);
 
 	data.splice(entity);
 
 	return on_encoded_data_avail(STD_MOVE(data));
 }
 
-long Server_writer::put_chunked_header(Response_headers response_headers){
+long Server_writer::put_response_headers(Response_headers response_headers, boost::uint64_t content_length){
 	POSEIDON_PROFILE_ME;
 
 	Stream_buffer data;
 
-	const unsigned ver_major = response_headers.version / 10000, ver_minor = response_headers.version % 10000;
-	const unsigned status_code = static_cast<unsigned>(response_headers.status_code);
-	char temp[64];
-	unsigned len = (unsigned)std::sprintf(temp, "HTTP/%u.%u %u ", ver_major, ver_minor, status_code);
-	data.put(temp, len);
-	data.put(response_headers.reason);
-	data.put("\r\n");
+	Header_renderer renderer(estimate_header_size(response_headers));
+	render_status_line(renderer, response_headers);
+	render_headers(renderer, response_headers.headers, false, true, false);
+	renderer.put("Content-Length: ", 16);
+	renderer.put_decimal(content_length);
+	renderer.put("\r\n", 2);
+	renderer.put("\r\n", 2);
+	renderer.flush_into(data);
 
-	AUTO_REF(headers, response_headers.headers);
-	const AUTO_REF(transfer_encoding, headers.get("Transfer-Encoding"));
-	if(transfer_encoding.empty() || (::strcasecmp(transfer_encoding.c_str(), "identity") == 0)){
-		headers.set(Rcnts::view("Transfer-Encoding"), "chunked");
-	}
+	return on_encoded_data_avail(STD_MOVE(data));
+}
 
-	for(AUTO(it, headers.begin()); it != headers.end(); ++it){
-		data.put(it->first.get());
-		data.put(": ");
-		data.put(it->second);
-		data.put("\r\n");
+long Server_writer::put_chunked_header(Response_headers response_headers){
+	POSEIDON_PROFILE_ME;
+
+	Stream_buffer data;
+
+	const AUTO_REF(transfer_encoding, response_headers.headers.get("Transfer-Encoding"));
+	const bool chunked = transfer_encoding.empty() || (::strcasecmp(transfer_encoding.c_str(), "identity") == 0);
+
+	Header_renderer renderer(estimate_header_size(response_headers));
+	render_status_line(renderer, response_headers);
+	render_headers(renderer, response_headers.headers, true, true, !chunked);
+	if(chunked){
+		renderer.put("Transfer-Encoding: chunked\r\n", 28);
 	}
-	data.put("\r\n");
+	renderer.put("\r\n", 2);
+	renderer.flush_into(data);
 
 	return on_encoded_data_avail(STD_MOVE(data));
 }
@@ -94,9 +317,10 @@ long Server_writer::put_chunk(Stream_buffer entity){
 
 	Stream_buffer chunk;
 
-	char temp[64];
-	unsigned len = (unsigned)std::sprintf(temp, "%llx\r\n", (unsigned long long)entity.size());
-	chunk.put(temp, len);
+	Header_renderer renderer(32);
+	renderer.put_hex(entity.size());
+	renderer.put("\r\n", 2);
+	renderer.flush_into(chunk);
 	chunk.splice(entity);
 	chunk.put("\r\n");
 
@@ -24,6 +24,8 @@ protected:
 
 public:
 	long put_response(Response_headers response_headers, Stream_buffer entity, bool set_content_length);
+	// 只写入响应头，实体由调用者另行发送。
+	long put_response_headers(Response_headers response_headers, boost::uint64_t content_length);
 
 	long put_chunked_header(Response_headers response_headers);
 	long put_chunk(Stream_buffer entity);
@@ -5,8 +5,15 @@
 #include "json.hpp"
 #include "log.hpp"
 #include "profiler.hpp"
-#include "buffer_streams.hpp"
+#include "stream_buffer.hpp"
 #include "exception.hpp"
+#include <boost/container/deque.hpp>
+#include <boost/container/vector.hpp>
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
+#include <cstdio>
+#include <cstdlib>
 
 namespace Poseidon {
 
@@ -312,6 +319,512 @@ namespace {
 		}
 		return ret;
 	}
+
+	// 以下是基于连续缓冲区的解析器和直接写入 Stream_buffer 的序列化器。
+	// 语法与上面基于 std::istream 的解析器保持一致，包括单引号字符串和多余的逗号。
+
+	CONSTEXPR const unsigned g_max_depth = 1000;
+
+	// 返回 [begin, end) 中第一个不满足 is_space() 的字符。
+	inline bool is_space(char ch){
+		return (ch == ' ') || (ch == '\t') || (ch == '\r') || (ch == '\n');
+	}
+	const char *skip_spaces(const char *begin, const char *end){
+		const char *read = begin;
+#ifdef __SSE2__
+		while((end - read >= 16) && is_space(*read)){
+			const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(read));
+			__m128i m = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+			m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+			m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+			m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+			const unsigned mask = ~static_cast<unsigned>(_mm_movemask_epi8(m)) & 0xFFFFu;
+			if(mask != 0){
+				return read + __builtin_ctz(mask);
+			}
+			read += 16;
+		}
+#endif
+		while((read != end) && is_space(*read)){
+			++read;
+		}
+		return read;
+	}
+	// 返回 [begin, end) 中第一个等于 quote 或 '\\' 的字符。
+	const char *find_string_special(const char *begin, const char *end, char quote){
+		const char *read = begin;
+#ifdef __SSE2__
+		const __m128i vq = _mm_set1_epi8(quote);
+		const __m128i vb = _mm_set1_epi8('\\');
+		while(end - read >= 16){
+			const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(read));
+			const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, vq), _mm_cmpeq_epi8(v, vb))));
+			if(mask != 0){
+				return read + __builtin_ctz(mask);
+			}
+			read += 16;
+		}
+#endif
+		while((read != end) && (*read != quote) && (*read != '\\')){
+			++read;
+		}
+		return read;
+	}
+
+	class Json_parser {
+	private:
+		const char *m_read;
+		const char *m_end;
+		unsigned m_depth;
+		// 解析对象时暂存成员。deque 在尾部插入时不会移动已有元素，因此可以直接在里面解析嵌套的值。
+		boost::container::deque<std::pair<Rcnts, Json_element> > m_members;
+		boost::container::vector<std::size_t> m_order;
+		std::string m_key;
+
+	public:
+		Json_parser(const char *begin, const char *end)
+			: m_read(begin), m_end(end), m_depth(0)
+		{
+			//
+		}
+
+	private:
+		__attribute__((__noreturn__)) void fail(const char *msg) const {
+			POSEIDON_LOG_WARNING("JSON parser error: ", msg);
+			POSEIDON_THROW(Exception, Rcnts::view(msg));
+		}
+		char peek_nonspace(){
+			m_read = skip_spaces(m_read, m_end);
+			if(m_read == m_end){
+				return 0;
+			}
+			return *m_read;
+		}
+		void expect_literal(const char *str, std::size_t len){
+			if((static_cast<std::size_t>(m_end - m_read) < len) || (std::memcmp(m_read, str, len) != 0)){
+				fail("Invalid literal");
+			}
+			m_read += len;
+		}
+		unsigned accept_hex4(){
+			if(m_end - m_read < 4){
+				fail("Invalid hex digit for \\u");
+			}
+			unsigned value = 0;
+			for(unsigned i = 0; i < 4; ++i){
+				unsigned hexc = static_cast<unsigned char>(m_read[i]);
+				if(('0' <= hexc) && (hexc <= '9')){
+					hexc -= '0';
+				} else if(('A' <= hexc) && (hexc <= 'F')){
+					hexc -= 'A' - 0x0A;
+				} else if(('a' <= hexc) && (hexc <= 'f')){
+					hexc -= 'a' - 0x0A;
+				} else {
+					fail("Invalid hex digit for \\u");
+				}
+				value = (value << 4) | hexc;
+			}
+			m_read += 4;
+			return value;
+		}
+		void accept_string(std::string &ret){
+			ret.clear();
+			const char equote = *m_read;
+			if((equote != '\"') && (equote != '\'')){
+				fail("String open expected");
+			}
+			++m_read;
+			for(;;){
+				const char *const special = find_string_special(m_read, m_end, equote);
+				ret.append(m_read, special);
+				m_read = special;
+				if(m_read == m_end){
+					fail("String not closed");
+				}
+				if(*m_read == equote){
+					++m_read;
+					break;
+				}
+				// 转义序列。
+				++m_read;
+				if(m_read == m_end){
+					fail("String not closed");
+				}
+				const char ch = *(m_read++);
+				switch(ch){
+				case '\"':
+				case '\'':
+				case '\\':
+				case '/':
+					ret += ch;
+					break;
+				case 'b':
+					ret += '\b';
+					break;
+				case 'f':
+					ret += '\f';
+					break;
+				case 'n':
+					ret += '\n';
+					break;
+				case 'r':
+					ret += '\r';
+					break;
+				case 't':
+					ret += '\t';
+					break;
+				case 'u': {
+					unsigned code_point = accept_hex4();
+					// 代理对。落单的代理项按原样编码。
+					if((0xD800 <= code_point) && (code_point < 0xDC00) && (m_end - m_read >= 6) && (m_read[0] == '\\') && (m_read[1] == 'u')){
+						const char *const saved = m_read;
+						m_read += 2;
+						const unsigned low = accept_hex4();
+						if((0xDC00 <= low) && (low < 0xE000)){
+							code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+						} else {
+							m_read = saved;
+						}
+					}
+					if(code_point < 0x80){
+						ret += static_cast<char>(code_point);
+					} else if(code_point < 0x800){
+						ret += static_cast<char>((code_point >> 6) | 0xC0);
+						ret += static_cast<char>((code_point & 0x3F) | 0x80);
+					} else if(code_point < 0x10000){
+						ret += static_cast<char>((code_point >> 12) | 0xE0);
+						ret += static_cast<char>(((code_point >> 6) & 0x3F) | 0x80);
+						ret += static_cast<char>((code_point & 0x3F) | 0x80);
+					} else {
+						ret += static_cast<char>((code_point >> 18) | 0xF0);
+						ret += static_cast<char>(((code_point >> 12) & 0x3F) | 0x80);
+						ret += static_cast<char>(((code_point >> 6) & 0x3F) | 0x80);
+						ret += static_cast<char>((code_point & 0x3F) | 0x80);
+					}
+					break; }
+				default:
+					fail("Unknown escaped character sequence");
+				}
+			}
+		}
+		double accept_number(){
+			const char *const begin = m_read;
+			const char *read = begin;
+			bool integral = true;
+			while(read != m_end){
+				const char ch = *read;
+				if(('0' <= ch) && (ch <= '9')){
+					// 数字。
+				} else if((ch == '.') || (ch == 'e') || (ch == 'E') || (ch == '+') || ((ch == '-') && (read != begin))){
+					integral = false;
+				} else if(ch != '-'){
+					break;
+				}
+				++read;
+			}
+			const std::size_t len = static_cast<std::size_t>(read - begin);
+			// 不超过 15 位的整数可以精确地表示为 double。
+			const std::size_t digits = len - (*begin == '-');
+			if(integral && (digits != 0) && (digits <= 15)){
+				boost::int64_t value = 0;
+				for(const char *p = read - static_cast<std::ptrdiff_t>(digits); p != read; ++p){
+					value = value * 10 + (*p - '0');
+				}
+				m_read = read;
+				if(*begin == '-'){
+					return (value == 0) ? -0.0 : static_cast<double>(-value);
+				}
+				return static_cast<double>(value);
+			}
+			char str[64];
+			if((len == 0) || (len >= sizeof(str))){
+				fail("Number expected");
+			}
+			std::memcpy(str, begin, len);
+			str[len] = 0;
+			char *eptr;
+			const double value = std::strtod(str, &eptr);
+			if(eptr != str + len){
+				fail("Number expected");
+			}
+			m_read = read;
+			return value;
+		}
+		void accept_object(Json_object &ret){
+			if(peek_nonspace() != '{'){
+				fail("Object open expected");
+			}
+			++m_read;
+			const std::size_t base = m_members.size();
+			for(;;){
+				const char ch = peek_nonspace();
+				if(ch == 0){
+					fail("Object not closed");
+				}
+				if(ch == '}'){
+					++m_read;
+					break;
+				}
+				if(ch == ','){
+					++m_read;
+					continue;
+				}
+				accept_string(m_key);
+				if(peek_nonspace() != ':'){
+					fail("Colon expected");
+				}
+				++m_read;
+				m_members.push_back(std::make_pair(Rcnts(m_key), Json_element()));
+				accept_element(m_members.back().second);
+			}
+			// 按键排序，相同的键保留最后一个，然后按顺序追加，这样不需要移动已有元素。
+			m_order.clear();
+			for(std::size_t i = base; i < m_members.size(); ++i){
+				m_order.push_back(i);
+			}
+			std::stable_sort(m_order.begin(), m_order.end(), Member_comparator(m_members));
+			ret.clear();
+			ret.reserve(m_order.size());
+			for(std::size_t i = 0; i < m_order.size(); ++i){
+				AUTO_REF(member, m_members.at(m_order.at(i)));
+				if((i + 1 < m_order.size()) && !(member.first < m_members.at(m_order.at(i + 1)).first)){
+					continue;
+				}
+				ret.set(STD_MOVE(member.first), Json_element())->second.swap(member.second);
+			}
+			m_members.erase(m_members.begin() + static_cast<std::ptrdiff_t>(base), m_members.end());
+		}
+		void accept_array(Json_array &ret){
+			if(peek_nonspace() != '['){
+				fail("Array open expected");
+			}
+			++m_read;
+			ret.clear();
+			for(;;){
+				const char ch = peek_nonspace();
+				if(ch == 0){
+					fail("Array not closed");
+				}
+				if(ch == ']'){
+					++m_read;
+					break;
+				}
+				if(ch == ','){
+					++m_read;
+					continue;
+				}
+				accept_element(ret.push_back(Json_element()));
+			}
+		}
+
+		class Member_comparator {
+		private:
+			const boost::container::deque<std::pair<Rcnts, Json_element> > &m_members;
+
+		public:
+			explicit Member_comparator(const boost::container::deque<std::pair<Rcnts, Json_element> > &members)
+				: m_members(members)
+			{
+				//
+			}
+
+		public:
+			bool operator()(std::size_t lhs, std::size_t rhs) const {
+				return m_members[lhs].first < m_members[rhs].first;
+			}
+		};
+
+	public:
+		void accept_element(Json_element &ret){
+			if(++m_depth > g_max_depth){
+				fail("JSON nesting too deep");
+			}
+			switch(peek_nonspace()){
+			case '\"':
+			case '\'': {
+				std::string str;
+				accept_string(str);
+				ret.set(STD_MOVE(str));
+				break; }
+			case '-':
+			case '0': case '1': case '2': case '3': case '4':
+			case '5': case '6': case '7': case '8': case '9':
+				ret.set(accept_number());
+				break;
+			case '{':
+				ret.set(Json_object());
+				accept_object(ret.get<Json_object>());
+				break;
+			case '[':
+				ret.set(Json_array());
+				accept_array(ret.get<Json_array>());
+				break;
+			case 't':
+				expect_literal("true", 4);
+				ret.set(true);
+				break;
+			case 'f':
+				expect_literal("false", 5);
+				ret.set(false);
+				break;
+			case 'n':
+				expect_literal("null", 4);
+				ret.set(Json_null());
+				break;
+			case 0:
+				fail("No input character");
+			default:
+				fail("Unknown element type");
+			}
+			--m_depth;
+		}
+		void accept_top_level(Json_element &ret){
+			accept_element(ret);
+			finish();
+		}
+		void accept_top_level(Json_object &ret){
+			++m_depth;
+			accept_object(ret);
+			--m_depth;
+			finish();
+		}
+		void accept_top_level(Json_array &ret){
+			++m_depth;
+			accept_array(ret);
+			--m_depth;
+			finish();
+		}
+		void finish(){
+			if(peek_nonspace() != 0){
+				fail("Trailing characters after JSON value");
+			}
+		}
+	};
+
+	template<typename T>
+	void parse_contiguous(T &ret, const void *data, std::size_t size){
+		const char *const begin = static_cast<const char *>(data);
+		Json_parser parser(begin, begin + size);
+		parser.accept_top_level(ret);
+	}
+	template<typename T>
+	void parse_buffer(T &ret, const Stream_buffer &buffer){
+		const void *data;
+		std::size_t size;
+		Stream_buffer::Enumeration_cookie cookie;
+		if(!buffer.enumerate_chunk(&data, &size, cookie)){
+			parse_contiguous(ret, "", 0);
+			return;
+		}
+		if(size == buffer.size()){
+			parse_contiguous(ret, data, size);
+			return;
+		}
+		// 数据不连续，需要复制一份。
+		const AUTO(str, buffer.dump_string());
+		parse_contiguous(ret, str.data(), str.size());
+	}
+
+	// 返回 [begin, end) 中第一个需要转义的字符。
+	inline bool needs_escaping(unsigned char ch){
+		return (ch < 0x20) || (ch == '\"') || (ch == '\\') || (ch == '/') || (ch == 0x7F) || (ch == 0xFF);
+	}
+	const char *find_escapable(const char *begin, const char *end){
+		const char *read = begin;
+#ifdef __SSE2__
+		while(end - read >= 16){
+			const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(read));
+			__m128i m = _mm_cmpeq_epi8(_mm_max_epu8(v, _mm_set1_epi8(0x1F)), _mm_set1_epi8(0x1F));
+			m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\"')));
+			m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+			m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('/')));
+			m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(0x7F)));
+			m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(-1)));
+			const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(m));
+			if(mask != 0){
+				return read + __builtin_ctz(mask);
+			}
+			read += 16;
+		}
+#endif
+		while((read != end) && !needs_escaping(static_cast<unsigned char>(*read))){
+			++read;
+		}
+		return read;
+	}
+	void dump_string(Stream_buffer &buffer, const char *str, std::size_t len){
+		const char *read = str;
+		const char *const end = str + len;
+		buffer.put('\"');
+		for(;;){
+			const char *const special = find_escapable(read, end);
+			buffer.put(read, static_cast<std::size_t>(special - read));
+			read = special;
+			if(read == end){
+				break;
+			}
+			const unsigned ch = static_cast<unsigned char>(*(read++));
+			char temp[8];
+			std::size_t n = 2;
+			temp[0] = '\\';
+			switch(ch){
+			case '\b':
+				temp[1] = 'b';
+				break;
+			case '\f':
+				temp[1] = 'f';
+				break;
+			case '\n':
+				temp[1] = 'n';
+				break;
+			case '\r':
+				temp[1] = 'r';
+				break;
+			case '\t':
+				temp[1] = 't';
+				break;
+			case '\"':
+			case '\\':
+			case '/':
+				temp[1] = static_cast<char>(ch);
+				break;
+			default:
+				temp[1] = 'u';
+				temp[2] = '0';
+				temp[3] = '0';
+				temp[4] = "0123456789abcdef"[ch >> 4];
+				temp[5] = "0123456789abcdef"[ch & 0x0F];
+				n = 6;
+				break;
+			}
+			buffer.put(temp, n);
+		}
+		buffer.put('\"');
+	}
+	void dump_number(Stream_buffer &buffer, double value){
+		char temp[64];
+		std::size_t len;
+		// 绝对值小于 10^15 的整数不需要 std::snprintf()。与 %.16g 的结果相同。
+		if((value > -1e15) && (value < 1e15) && (value == static_cast<double>(static_cast<boost::int64_t>(value))) && ((value != 0) || !__builtin_signbit(value))){
+			boost::int64_t integer = static_cast<boost::int64_t>(value);
+			const bool negative = integer < 0;
+			boost::uint64_t magnitude = static_cast<boost::uint64_t>(negative ? -integer : integer);
+			char *const end = temp + sizeof(temp);
+			char *write = end;
+			do {
+				*(--write) = static_cast<char>('0' + magnitude % 10);
+				magnitude /= 10;
+			} while(magnitude != 0);
+			if(negative){
+				*(--write) = '-';
+			}
+			len = static_cast<std::size_t>(end - write);
+			buffer.put(write, len);
+			return;
+		}
+		len = static_cast<std::size_t>(std::snprintf(temp, sizeof(temp), "%.16g", value));
+		buffer.put(temp, len);
+	}
 }
 
 const Json_element & null_json_element() NOEXCEPT {
@@ -328,28 +841,45 @@ Json_object::Json_object(std::istream &is)
 Stream_buffer Json_object::dump() const {
 	POSEIDON_PROFILE_ME;
 
-	Buffer_ostream bos;
-	dump(bos);
-	return STD_MOVE(bos.get_buffer());
+	Stream_buffer buffer;
+	dump(buffer);
+	return buffer;
 }
-void Json_object::dump(std::ostream &os) const {
+void Json_object::dump(Stream_buffer &buffer) const {
 	POSEIDON_PROFILE_ME;
 
-	os <<'{';
+	buffer.put('{');
 	AUTO(it, begin());
 	if(it != end()){
 		goto _loop_entry;
 		do {
-			os <<',';
+			buffer.put(',');
 	_loop_entry:
-			os <<'\"';
-			os <<it->first.get();
-			os <<'\"';
-			os <<':';
-			os <<it->second;
+			dump_string(buffer, it->first.get(), std::strlen(it->first.get()));
+			buffer.put(':');
+			it->second.dump(buffer);
 		} while(++it != end());
 	}
-	os <<'}';
+	buffer.put('}');
+}
+void Json_object::dump(std::ostream &os) const {
+	POSEIDON_PROFILE_ME;
+
+	dump().dump(os);
+}
+void Json_object::parse(const void *data, std::size_t size){
+	POSEIDON_PROFILE_ME;
+
+	Json_object obj;
+	parse_contiguous(obj, data, size);
+	obj.swap(*this);
+}
+void Json_object::parse(const Stream_buffer &buffer){
+	POSEIDON_PROFILE_ME;
+
+	Json_object obj;
+	parse_buffer(obj, buffer);
+	obj.swap(*this);
 }
 void Json_object::parse(std::istream &is){
 	POSEIDON_PROFILE_ME;
@@ -370,24 +900,43 @@ Json_array::Json_array(std::istream &is)
 Stream_buffer Json_array::dump() const {
 	POSEIDON_PROFILE_ME;
 
-	Buffer_ostream bos;
-	dump(bos);
-	return STD_MOVE(bos.get_buffer());
+	Stream_buffer buffer;
+	dump(buffer);
+	return buffer;
 }
-void Json_array::dump(std::ostream &os) const {
+void Json_array::dump(Stream_buffer &buffer) const {
 	POSEIDON_PROFILE_ME;
 
-	os <<'[';
+	buffer.put('[');
 	AUTO(it, begin());
 	if(it != end()){
 		goto _loop_entry;
 		do {
-			os <<',';
+			buffer.put(',');
 	_loop_entry:
-			os <<*it;
+			it->dump(buffer);
 		} while(++it != end());
 	}
-	os <<']';
+	buffer.put(']');
+}
+void Json_array::dump(std::ostream &os) const {
+	POSEIDON_PROFILE_ME;
+
+	dump().dump(os);
+}
+void Json_array::parse(const void *data, std::size_t size){
+	POSEIDON_PROFILE_ME;
+
+	Json_array arr;
+	parse_contiguous(arr, data, size);
+	arr.swap(*this);
+}
+void Json_array::parse(const Stream_buffer &buffer){
+	POSEIDON_PROFILE_ME;
+
+	Json_array arr;
+	parse_buffer(arr, buffer);
+	arr.swap(*this);
 }
 void Json_array::parse(std::istream &is){
 	POSEIDON_PROFILE_ME;
@@ -421,72 +970,62 @@ const char * Json_element::get_type_string(Json_element::Type type){
 Stream_buffer Json_element::dump() const {
 	POSEIDON_PROFILE_ME;
 
-	Buffer_ostream bos;
-	dump(bos);
-	return STD_MOVE(bos.get_buffer());
+	Stream_buffer buffer;
+	dump(buffer);
+	return buffer;
 }
-void Json_element::dump(std::ostream &os) const {
+void Json_element::dump(Stream_buffer &buffer) const {
 	POSEIDON_PROFILE_ME;
 
 	const Type type = get_type();
 	switch(type){
 	case type_boolean:
-		os <<(get<bool>() ? "true" : "false");
+		if(get<bool>()){
+			buffer.put("true", 4);
+		} else {
+			buffer.put("false", 5);
+		}
 		break;
 	case type_number:
-		os <<std::setprecision(16) <<get<double>();
+		dump_number(buffer, get<double>());
 		break;
 	case type_string: {
 		const AUTO_REF(str, get<std::string>());
-		os <<'\"';
-		for(AUTO(it, str.begin()); it != str.end(); ++it){
-			const unsigned ch = (unsigned char)*it;
-			switch(ch){
-			case '\b':
-				os <<'\\' <<'b';
-				break;
-			case '\f':
-				os <<'\\' <<'f';
-				break;
-			case '\n':
-				os <<'\\' <<'n';
-				break;
-			case '\r':
-				os <<'\\' <<'r';
-				break;
-			case '\t':
-				os <<'\\' <<'t';
-				break;
-			case '\"':
-			case '\\':
-			case '/':
-				os <<'\\' <<(char)ch;
-				break;
-			default:
-				if((ch < 0x20) || (ch == 0x7F) || (ch == 0xFF)){
-					os <<'\\' <<'u' <<std::setfill('0') <<std::setw(4) <<ch;
-				} else {
-					os <<(char)ch;
-				}
-				break;
-			}
-		}
-		os <<'\"';
+		dump_string(buffer, str.data(), str.size());
 		break; }
 	case type_object:
-		os <<get<Json_object>();
+		get<Json_object>().dump(buffer);
 		break;
 	case type_array:
-		os <<get<Json_array>();
+		get<Json_array>().dump(buffer);
 		break;
 	case type_null:
-		os <<"null";
+		buffer.put("null", 4);
 		break;
 	default:
 		POSEIDON_LOG_FATAL("Unknown JSON element type: type = ", static_cast<int>(type));
 		std::terminate();
 	}
 }
+void Json_element::dump(std::ostream &os) const {
+	POSEIDON_PROFILE_ME;
+
+	dump().dump(os);
+}
+void Json_element::parse(const void *data, std::size_t size){
+	POSEIDON_PROFILE_ME;
+
+	Json_element elem;
+	parse_contiguous(elem, data, size);
+	elem.swap(*this);
+}
+void Json_element::parse(const Stream_buffer &buffer){
+	POSEIDON_PROFILE_ME;
+
+	Json_element elem;
+	parse_buffer(elem, buffer);
+	elem.swap(*this);
+}
 void Json_element::parse(std::istream &is){
 	POSEIDON_PROFILE_ME;
 
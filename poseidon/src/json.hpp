@@ -9,7 +9,7 @@
 #include <iosfwd>
 #include <stdexcept>
 #include <cstddef>
-#include <boost/container/map.hpp>
+#include <boost/container/flat_map.hpp>
 #include <boost/container/deque.hpp>
 #include <boost/variant.hpp>
 #include <boost/type_traits/is_arithmetic.hpp>
@@ -34,7 +34,8 @@ extern const Json_element & null_json_element() NOEXCEPT;
 
 class Json_object {
 public:
-	typedef boost::container::map<Rcnts, Json_element> base_container;
+	// 有序的连续存储，每个对象只有一次内存分配。插入和删除会使迭代器失效。
+	typedef boost::container::flat_map<Rcnts, Json_element> base_container;
 
 	typedef base_container::value_type        value_type;
 	typedef base_container::const_reference   const_reference;
@@ -62,6 +63,7 @@ public:
 	bool empty() const;
 	size_type size() const;
 	void clear();
+	void reserve(size_type n);
 
 	const_iterator begin() const;
 	iterator begin();
@@ -128,7 +130,11 @@ public:
 	void swap(Json_object &rhs) NOEXCEPT;
 
 	Stream_buffer dump() const;
+	void dump(Stream_buffer &buffer) const;
 	void dump(std::ostream &os) const;
+	// 要求整个缓冲区是一个完整的值，末尾允许有空白。出错时抛出异常。
+	void parse(const void *data, std::size_t size);
+	void parse(const Stream_buffer &buffer);
 	void parse(std::istream &is);
 };
 
@@ -221,7 +227,11 @@ public:
 	void swap(Json_array &rhs) NOEXCEPT;
 
 	Stream_buffer dump() const;
+	void dump(Stream_buffer &buffer) const;
 	void dump(std::ostream &os) const;
+	// 要求整个缓冲区是一个完整的值，末尾允许有空白。出错时抛出异常。
+	void parse(const void *data, std::size_t size);
+	void parse(const Stream_buffer &buffer);
 	void parse(std::istream &is);
 };
 
@@ -335,7 +345,11 @@ public:
 	}
 
 	Stream_buffer dump() const;
+	void dump(Stream_buffer &buffer) const;
 	void dump(std::ostream &os) const;
+	// 要求整个缓冲区是一个完整的值，末尾允许有空白。出错时抛出异常。
+	void parse(const void *data, std::size_t size);
+	void parse(const Stream_buffer &buffer);
 	void parse(std::istream &is);
 };
 
@@ -369,6 +383,9 @@ inline Json_object::size_type Json_object::size() const {
 inline void Json_object::clear(){
 	m_elements.clear();
 }
+inline void Json_object::reserve(Json_object::size_type n){
+	m_elements.reserve(n);
+}
 
 inline Json_object::const_iterator Json_object::begin() const {
 	return m_elements.begin();
@@ -632,7 +649,7 @@ inline void Json_array::pop_front(){
 }
 inline Json_element & Json_array::push_back(Json_element val){
 	m_elements.push_back(STD_MOVE(val));
-	return m_elements.front();
+	return m_elements.back();
 }
 inline void Json_array::pop_back(){
 	m_elements.pop_back();
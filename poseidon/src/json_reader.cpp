@@ -0,0 +1,384 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2018, LH_Mouse. All wrongs reserved.
+
+#include "precompiled.hpp"
+#include "json_reader.hpp"
+#include "profiler.hpp"
+#include "exception.hpp"
+#include <cstdlib>
+
+namespace Poseidon {
+
+namespace {
+	CONSTEXPR const std::size_t g_max_depth = 1000;
+	CONSTEXPR const std::size_t g_max_key_length = 4096;
+
+	bool is_space(char ch){
+		return (ch == ' ') || (ch == '\t') || (ch == '\r') || (ch == '\n');
+	}
+	bool is_number_char(char ch){
+		return (('0' <= ch) && (ch <= '9')) || (ch == '-') || (ch == '+') || (ch == '.') || (ch == 'e') || (ch == 'E');
+	}
+	int from_hex_digit(char ch){
+		if(('0' <= ch) && (ch <= '9')){
+			return ch - '0';
+		}
+		if(('A' <= ch) && (ch <= 'F')){
+			return ch - 'A' + 0x0A;
+		}
+		if(('a' <= ch) && (ch <= 'f')){
+			return ch - 'a' + 0x0A;
+		}
+		return -1;
+	}
+	std::size_t encode_utf8(char (&str)[4], unsigned code_point){
+		if(code_point < 0x80){
+			str[0] = static_cast<char>(code_point);
+			return 1;
+		}
+		if(code_point < 0x800){
+			str[0] = static_cast<char>((code_point >> 6) | 0xC0);
+			str[1] = static_cast<char>((code_point & 0x3F) | 0x80);
+			return 2;
+		}
+		if(code_point < 0x10000){
+			str[0] = static_cast<char>((code_point >> 12) | 0xE0);
+			str[1] = static_cast<char>(((code_point >> 6) & 0x3F) | 0x80);
+			str[2] = static_cast<char>((code_point & 0x3F) | 0x80);
+			return 3;
+		}
+		str[0] = static_cast<char>((code_point >> 18) | 0xF0);
+		str[1] = static_cast<char>(((code_point >> 12) & 0x3F) | 0x80);
+		str[2] = static_cast<char>(((code_point >> 6) & 0x3F) | 0x80);
+		str[3] = static_cast<char>((code_point & 0x3F) | 0x80);
+		return 4;
+	}
+}
+
+Json_reader::Json_reader()
+	: m_state(state_value), m_stack(), m_in_key(false), m_quote(0)
+	, m_unicode_digits(0), m_unicode_value(0), m_high_surrogate(0)
+	, m_key(), m_number_length(0), m_literal(NULLPTR), m_literal_offset(0)
+{
+	//
+}
+Json_reader::~Json_reader(){
+	//
+}
+
+void Json_reader::end_value(){
+	if(m_stack.empty()){
+		m_state = state_done;
+	} else if(m_stack[m_stack.size() - 1] == '{'){
+		m_state = state_object_key;
+	} else {
+		m_state = state_array;
+	}
+}
+
+void Json_reader::clear(){
+	m_state = state_value;
+	m_stack.clear();
+	m_in_key = false;
+	m_high_surrogate = 0;
+	m_key.clear();
+	m_number_length = 0;
+}
+void Json_reader::put(const void *data, std::size_t size){
+	POSEIDON_PROFILE_ME;
+
+	const char *read = static_cast<const char *>(data);
+	const char *const end = read + size;
+
+	// 把解码后的字符串数据交给键缓冲区或者回调函数。
+#define EMIT_STRING_DATA_(p_, n_)	\
+	do {	\
+		if(m_in_key){	\
+			POSEIDON_THROW_UNLESS(m_key.size() + (n_) <= g_max_key_length, Exception, Rcnts::view("JSON object key too long"));	\
+			m_key.append((p_), (n_));	\
+		} else {	\
+			on_string_data((p_), (n_));	\
+		}	\
+	} while(false)
+	// 落单的高位代理项按原样编码。
+#define FLUSH_HIGH_SURROGATE_()	\
+	do {	\
+		if(m_high_surrogate != 0){	\
+			char utf8_[4];	\
+			const std::size_t n_ = encode_utf8(utf8_, m_high_surrogate);	\
+			m_high_surrogate = 0;	\
+			EMIT_STRING_DATA_(utf8_, n_);	\
+		}	\
+	} while(false)
+
+	while(read != end){
+		switch(m_state){
+		case state_value:
+		case state_array:
+		case state_object_key:
+		case state_object_colon:
+		case state_done: {
+			const char ch = *read;
+			if(is_space(ch)){
+				++read;
+				break;
+			}
+			POSEIDON_THROW_UNLESS(m_state != state_done, Exception, Rcnts::view("Trailing characters after JSON value"));
+			if(m_state == state_object_colon){
+				POSEIDON_THROW_UNLESS(ch == ':', Exception, Rcnts::view("Colon expected"));
+				++read;
+				m_state = state_value;
+				break;
+			}
+			if(m_state == state_object_key){
+				if(ch == ','){
+					++read;
+					break;
+				}
+				if(ch == '}'){
+					++read;
+					m_stack.erase(m_stack.size() - 1);
+					end_value();
+					on_object_end();
+					break;
+				}
+				POSEIDON_THROW_UNLESS((ch == '\"') || (ch == '\''), Exception, Rcnts::view("String open expected"));
+				++read;
+				m_in_key = true;
+				m_quote = ch;
+				m_key.clear();
+				m_state = state_string;
+				break;
+			}
+			if(m_state == state_array){
+				if(ch == ','){
+					++read;
+					break;
+				}
+				if(ch == ']'){
+					++read;
+					m_stack.erase(m_stack.size() - 1);
+					end_value();
+					on_array_end();
+					break;
+				}
+			}
+			// 开始一个值。
+			switch(ch){
+			case '\"':
+			case '\'':
+				++read;
+				m_in_key = false;
+				m_quote = ch;
+				m_state = state_string;
+				on_string_begin();
+				break;
+			case '-':
+			case '0': case '1': case '2': case '3': case '4':
+			case '5': case '6': case '7': case '8': case '9':
+				m_number_length = 0;
+				m_state = state_number;
+				break;
+			case '{':
+			case '[':
+				POSEIDON_THROW_UNLESS(m_stack.size() < g_max_depth, Exception, Rcnts::view("JSON nesting too deep"));
+				++read;
+				m_stack += ch;
+				if(ch == '{'){
+					m_state = state_object_key;
+					on_object_begin();
+				} else {
+					m_state = state_array;
+					on_array_begin();
+				}
+				break;
+			case 't':
+				m_literal = "true";
+				m_literal_offset = 0;
+				m_state = state_literal;
+				break;
+			case 'f':
+				m_literal = "false";
+				m_literal_offset = 0;
+				m_state = state_literal;
+				break;
+			case 'n':
+				m_literal = "null";
+				m_literal_offset = 0;
+				m_state = state_literal;
+				break;
+			default:
+				POSEIDON_THROW(Exception, Rcnts::view("Unknown element type"));
+			}
+			break; }
+
+		case state_string: {
+			// 一次处理尽可能长的不需要转义的片段。
+			const char *run_end = read;
+			while((run_end != end) && (*run_end != m_quote) && (*run_end != '\\')){
+				++run_end;
+			}
+			if(run_end != read){
+				FLUSH_HIGH_SURROGATE_();
+				EMIT_STRING_DATA_(read, static_cast<std::size_t>(run_end - read));
+				read = run_end;
+				break;
+			}
+			const char ch = *(read++);
+			if(ch == '\\'){
+				m_state = state_string_escape;
+				break;
+			}
+			FLUSH_HIGH_SURROGATE_();
+			end_value();
+			if(m_in_key){
+				m_in_key = false;
+				m_state = state_object_colon;
+				on_object_key(m_key);
+			} else {
+				on_string_end();
+			}
+			break; }
+
+		case state_string_escape: {
+			const char ch = *(read++);
+			if(ch == 'u'){
+				m_unicode_digits = 0;
+				m_unicode_value = 0;
+				m_state = state_string_unicode;
+				break;
+			}
+			FLUSH_HIGH_SURROGATE_();
+			char unescaped;
+			switch(ch){
+			case '\"':
+			case '\'':
+			case '\\':
+			case '/':
+				unescaped = ch;
+				break;
+			case 'b':
+				unescaped = '\b';
+				break;
+			case 'f':
+				unescaped = '\f';
+				break;
+			case 'n':
+				unescaped = '\n';
+				break;
+			case 'r':
+				unescaped = '\r';
+				break;
+			case 't':
+				unescaped = '\t';
+				break;
+			default:
+				POSEIDON_THROW(Exception, Rcnts::view("Unknown escaped character sequence"));
+			}
+			EMIT_STRING_DATA_(&unescaped, 1);
+			m_state = state_string;
+			break; }
+
+		case state_string_unicode: {
+			const int digit = from_hex_digit(*(read++));
+			POSEIDON_THROW_UNLESS(digit >= 0, Exception, Rcnts::view("Invalid hex digit for \\u"));
+			m_unicode_value = (m_unicode_value << 4) | static_cast<unsigned>(digit);
+			if(++m_unicode_digits < 4){
+				break;
+			}
+			m_state = state_string;
+			unsigned code_point = m_unicode_value;
+			if((0xDC00 <= code_point) && (code_point < 0xE000) && (m_high_surrogate != 0)){
+				code_point = 0x10000 + ((m_high_surrogate - 0xD800) << 10) + (code_point - 0xDC00);
+				m_high_surrogate = 0;
+			} else {
+				FLUSH_HIGH_SURROGATE_();
+				if((0xD800 <= code_point) && (code_point < 0xDC00)){
+					m_high_surrogate = code_point;
+					break;
+				}
+			}
+			char utf8[4];
+			const std::size_t n = encode_utf8(utf8, code_point);
+			EMIT_STRING_DATA_(utf8, n);
+			break; }
+
+		case state_number: {
+			while((read != end) && is_number_char(*read)){
+				POSEIDON_THROW_UNLESS(m_number_length < sizeof(m_number) - 1, Exception, Rcnts::view("Number expected"));
+				m_number[m_number_length++] = *(read++);
+			}
+			if(read == end){
+				// 数字可能在下一块数据中继续。
+				break;
+			}
+			m_number[m_number_length] = 0;
+			char *eptr;
+			const double value = std::strtod(m_number, &eptr);
+			POSEIDON_THROW_UNLESS(eptr == m_number + m_number_length, Exception, Rcnts::view("Number expected"));
+			end_value();
+			on_number(value);
+			break; }
+
+		case state_literal: {
+			const char ch = *(read++);
+			POSEIDON_THROW_UNLESS(ch == m_literal[m_literal_offset], Exception, Rcnts::view("Invalid literal"));
+			if(m_literal[++m_literal_offset] != 0){
+				break;
+			}
+			end_value();
+			switch(m_literal[0]){
+			case 't':
+				on_boolean(true);
+				break;
+			case 'f':
+				on_boolean(false);
+				break;
+			default:
+				on_null();
+				break;
+			}
+			break; }
+
+		default:
+			POSEIDON_THROW(Exception, Rcnts::view("Invalid JSON reader state"));
+		}
+	}
+
+#undef EMIT_STRING_DATA_
+#undef FLUSH_HIGH_SURROGATE_
+}
+void Json_reader::put(const Stream_buffer &buffer){
+	POSEIDON_PROFILE_ME;
+
+	const void *data;
+	std::size_t size;
+	Stream_buffer::Enumeration_cookie cookie;
+	while(buffer.enumerate_chunk(&data, &size, cookie)){
+		put(data, size);
+	}
+}
+void Json_reader::put(const char *str){
+	put(str, std::strlen(str));
+}
+void Json_reader::put(const std::string &str){
+	put(str.data(), str.size());
+}
+void Json_reader::finalize(){
+	POSEIDON_PROFILE_ME;
+
+	if(m_state == state_number){
+		// 顶层的数字只有在输入结束时才能确定结尾。
+		POSEIDON_THROW_UNLESS(m_stack.empty(), Exception, Rcnts::view("Incomplete JSON data"));
+		m_number[m_number_length] = 0;
+		char *eptr;
+		const double value = std::strtod(m_number, &eptr);
+		POSEIDON_THROW_UNLESS(eptr == m_number + m_number_length, Exception, Rcnts::view("Number expected"));
+		m_state = state_done;
+		on_number(value);
+	}
+	POSEIDON_THROW_UNLESS(m_state == state_done, Exception, Rcnts::view("Incomplete JSON data"));
+	clear();
+}
+
+}
@@ -0,0 +1,88 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2018, LH_Mouse. All wrongs reserved.
+
+#ifndef POSEIDON_JSON_READER_HPP_
+#define POSEIDON_JSON_READER_HPP_
+
+#include "cxx_ver.hpp"
+#include "stream_buffer.hpp"
+#include <string>
+#include <cstddef>
+
+namespace Poseidon {
+
+// 增量的 JSON 词法分析器，数据可以分任意多次送入，不构造 DOM。
+// 除了键（长度有限制）以外，内存占用与输入大小无关。语法与 Json_object::parse() 一致。
+class Json_reader {
+private:
+	enum State {
+		state_value          = 0, // 期待一个值。
+		state_array          = 1, // 期待一个数组元素、逗号或者 ]。
+		state_object_key     = 2, // 期待一个键、逗号或者 }。
+		state_object_colon   = 3,
+		state_string         = 4,
+		state_string_escape  = 5,
+		state_string_unicode = 6,
+		state_number         = 7,
+		state_literal        = 8,
+		state_done           = 9,
+	};
+
+private:
+	State m_state;
+	std::string m_stack; // 每一层嵌套的开括号。
+	bool m_in_key;
+	char m_quote;
+	unsigned m_unicode_digits;
+	unsigned m_unicode_value;
+	unsigned m_high_surrogate;
+	std::string m_key;
+	char m_number[64];
+	std::size_t m_number_length;
+	const char *m_literal;
+	std::size_t m_literal_offset;
+
+public:
+	Json_reader();
+	virtual ~Json_reader();
+
+private:
+	// 一个值结束之后，回到外层容器的状态。
+	void end_value();
+
+protected:
+	virtual void on_object_begin() = 0;
+	virtual void on_object_key(const std::string &key) = 0;
+	virtual void on_object_end() = 0;
+	virtual void on_array_begin() = 0;
+	virtual void on_array_end() = 0;
+	// 字符串可能被拆成任意多个片段，转义序列已经被解码。
+	virtual void on_string_begin() = 0;
+	virtual void on_string_data(const char *data, std::size_t size) = 0;
+	virtual void on_string_end() = 0;
+	virtual void on_number(double value) = 0;
+	virtual void on_boolean(bool value) = 0;
+	virtual void on_null() = 0;
+
+public:
+	// 当前所在的嵌套层数，顶层为 0。
+	std::size_t get_depth() const {
+		return m_stack.size();
+	}
+	bool is_complete() const {
+		return m_state == state_done;
+	}
+
+	void clear();
+	// 出错时抛出异常，之后需要调用 clear() 才能继续使用。
+	void put(const void *data, std::size_t size);
+	void put(const Stream_buffer &buffer);
+	void put(const char *str);
+	void put(const std::string &str);
+	// 检查文档是否完整，然后准备读取下一个文档。
+	void finalize();
+};
+
+}
+
+#endif
@@ -0,0 +1,268 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2018, LH_Mouse. All wrongs reserved.
+
+#include "../precompiled.hpp"
+#include "connection.hpp"
+#include "../log.hpp"
+#include "../exception.hpp"
+#include "../atomic.hpp"
+#include "../singletons/epoll_daemon.hpp"
+#include "../cbpp/client.hpp"
+#include "../http/client.hpp"
+#include "../http/low_level_client.hpp"
+#include "../websocket/client.hpp"
+#include "../websocket/handshake.hpp"
+
+namespace Poseidon {
+namespace Loadgen {
+
+namespace {
+	class Cbpp_client : public Cbpp::Client {
+	private:
+		const Response_callback m_callback;
+
+		volatile bool m_ready;
+
+	public:
+		Cbpp_client(const Sock_addr &addr, bool use_ssl, bool verify_peer, Response_callback callback)
+			: Cbpp::Client(addr, use_ssl, verify_peer)
+			, m_callback(STD_MOVE_IDN(callback)), m_ready(false)
+		{
+			//
+		}
+
+	protected:
+		void on_sync_connect() OVERRIDE {
+			atomic_store(m_ready, true, memory_order_release);
+		}
+		void on_sync_data_message(boost::uint16_t /*message_id*/, Stream_buffer payload) OVERRIDE {
+			m_callback(true, payload.size());
+		}
+
+	public:
+		bool is_ready() const {
+			return atomic_load(m_ready, memory_order_acquire);
+		}
+	};
+
+	class Cbpp_connection : public Connection {
+	private:
+		const boost::uint16_t m_message_id;
+		const boost::shared_ptr<Cbpp_client> m_client;
+
+	public:
+		Cbpp_connection(const Target &target, const Sock_addr &addr, Response_callback callback)
+			: m_message_id(target.message_id)
+			, m_client(boost::make_shared<Cbpp_client>(addr, target.use_ssl, target.verify_peer, STD_MOVE(callback)))
+		{
+			m_client->set_no_delay(true);
+			Epoll_daemon::add_socket(m_client, false);
+		}
+
+	public:
+		bool is_ready() const OVERRIDE {
+			return m_client->is_ready();
+		}
+		bool is_closed() const OVERRIDE {
+			return m_client->has_been_shutdown_read() || m_client->has_been_shutdown_write();
+		}
+
+		bool send(Stream_buffer payload) OVERRIDE {
+			return m_client->send(m_message_id, STD_MOVE(payload));
+		}
+		void close() NOEXCEPT OVERRIDE {
+			m_client->force_shutdown();
+		}
+	};
+
+	class Http_client : public Http::Client {
+	private:
+		const Response_callback m_callback;
+
+		volatile bool m_ready;
+
+	public:
+		Http_client(const Sock_addr &addr, bool use_ssl, bool verify_peer, Response_callback callback)
+			: Http::Client(addr, use_ssl, verify_peer)
+			, m_callback(STD_MOVE_IDN(callback)), m_ready(false)
+		{
+			//
+		}
+
+	protected:
+		void on_sync_connect() OVERRIDE {
+			atomic_store(m_ready, true, memory_order_release);
+		}
+		void on_sync_response(Http::Response_headers response_headers, Stream_buffer entity) OVERRIDE {
+			m_callback(response_headers.status_code / 100 <= 3, entity.size());
+		}
+
+	public:
+		bool is_ready() const {
+			return atomic_load(m_ready, memory_order_acquire);
+		}
+	};
+
+	class Http_connection : public Connection {
+	private:
+		const std::string m_host;
+		const std::string m_path;
+		const boost::shared_ptr<Http_client> m_client;
+
+	public:
+		Http_connection(const Target &target, const Sock_addr &addr, Response_callback callback)
+			: m_host(target.host), m_path(target.path)
+			, m_client(boost::make_shared<Http_client>(addr, target.use_ssl, target.verify_peer, STD_MOVE(callback)))
+		{
+			m_client->set_no_delay(true);
+			Epoll_daemon::add_socket(m_client, false);
+		}
+
+	public:
+		bool is_ready() const OVERRIDE {
+			return m_client->is_ready();
+		}
+		bool is_closed() const OVERRIDE {
+			return m_client->has_been_shutdown_read() || m_client->has_been_shutdown_write();
+		}
+
+		bool send(Stream_buffer payload) OVERRIDE {
+			Http::Request_headers request_headers;
+			request_headers.verb = payload.empty() ? Http::verb_get : Http::verb_post;
+			request_headers.uri = m_path;
+			request_headers.version = 10001;
+			request_headers.headers.set(Rcnts::view("Host"), m_host);
+			if(!payload.empty()){
+				request_headers.headers.set(Rcnts::view("Content-Type"), "application/octet-stream");
+			}
+			return m_client->send(STD_MOVE(request_headers), STD_MOVE(payload));
+		}
+		void close() NOEXCEPT OVERRIDE {
+			m_client->force_shutdown();
+		}
+	};
+
+	class Websocket_client : public Websocket::Client {
+	private:
+		const Response_callback m_callback;
+
+	public:
+		Websocket_client(const boost::shared_ptr<Http::Low_level_client> &parent, Response_callback callback)
+			: Websocket::Client(parent)
+			, m_callback(STD_MOVE_IDN(callback))
+		{
+			//
+		}
+
+	protected:
+		void on_sync_data_message(Websocket::Opcode /*opcode*/, Stream_buffer payload) OVERRIDE {
+			m_callback(true, payload.size());
+		}
+	};
+
+	// 在 HTTP 连接上完成 WebSocket 握手，然后把连接交给 Websocket_client。
+	class Websocket_handshake_client : public Http::Low_level_client {
+	private:
+		const std::string m_host;
+		const std::string m_path;
+		const Response_callback m_callback;
+
+		std::string m_sec_websocket_key;
+		Http::Response_headers m_response_headers;
+		volatile bool m_ready;
+
+	public:
+		Websocket_handshake_client(const Sock_addr &addr, bool use_ssl, bool verify_peer, std::string host, std::string path, Response_callback callback)
+			: Http::Low_level_client(addr, use_ssl, verify_peer)
+			, m_host(STD_MOVE(host)), m_path(STD_MOVE(path)), m_callback(STD_MOVE_IDN(callback))
+			, m_sec_websocket_key(), m_response_headers(), m_ready(false)
+		{
+			//
+		}
+
+	protected:
+		void on_connect() OVERRIDE {
+			Http::Low_level_client::on_connect();
+
+			AUTO(pair, Websocket::make_handshake_request(m_path, Option_map(), m_host));
+			m_sec_websocket_key = STD_MOVE(pair.second);
+			Http::Low_level_client::send(STD_MOVE(pair.first));
+		}
+
+		void on_low_level_response_headers(Http::Response_headers response_headers, boost::uint64_t /*content_length*/) OVERRIDE {
+			m_response_headers = STD_MOVE(response_headers);
+		}
+		void on_low_level_response_entity(boost::uint64_t /*entity_offset*/, Stream_buffer /*entity*/) OVERRIDE {
+			//
+		}
+		boost::shared_ptr<Http::Upgraded_session_base> on_low_level_response_end(boost::uint64_t /*content_length*/, Option_map /*headers*/) OVERRIDE {
+			if(!Websocket::check_handshake_response(m_response_headers, m_sec_websocket_key)){
+				POSEIDON_LOG_WARNING("WebSocket handshake failed: status_code = ", m_response_headers.status_code);
+				force_shutdown();
+				return VAL_INIT;
+			}
+			AUTO(client, boost::make_shared<Websocket_client>(virtual_shared_from_this<Websocket_handshake_client>(), m_callback));
+			atomic_store(m_ready, true, memory_order_release);
+			return STD_MOVE_IDN(client);
+		}
+
+	public:
+		bool is_ready() const {
+			return atomic_load(m_ready, memory_order_acquire);
+		}
+		boost::shared_ptr<Websocket_client> get_websocket_client() const {
+			return boost::static_pointer_cast<Websocket_client>(get_upgraded_client());
+		}
+	};
+
+	class Websocket_connection : public Connection {
+	private:
+		const boost::shared_ptr<Websocket_handshake_client> m_client;
+
+	public:
+		Websocket_connection(const Target &target, const Sock_addr &addr, Response_callback callback)
+			: m_client(boost::make_shared<Websocket_handshake_client>(addr, target.use_ssl, target.verify_peer, target.host, target.path, STD_MOVE(callback)))
+		{
+			m_client->set_no_delay(true);
+			Epoll_daemon::add_socket(m_client, false);
+		}
+
+	public:
+		bool is_ready() const OVERRIDE {
+			return m_client->is_ready();
+		}
+		bool is_closed() const OVERRIDE {
+			return m_client->has_been_shutdown_read() || m_client->has_been_shutdown_write();
+		}
+
+		bool send(Stream_buffer payload) OVERRIDE {
+			const AUTO(websocket_client, m_client->get_websocket_client());
+			if(!websocket_client){
+				return false;
+			}
+			return websocket_client->send(Websocket::opcode_data_binary, STD_MOVE(payload));
+		}
+		void close() NOEXCEPT OVERRIDE {
+			m_client->force_shutdown();
+		}
+	};
+}
+
+Connection::~Connection(){
+	//
+}
+
+boost::shared_ptr<Connection> create_connection(const Target &target, const Sock_addr &addr, Response_callback callback){
+	switch(target.protocol){
+	case protocol_cbpp:
+		return boost::make_shared<Cbpp_connection>(target, addr, STD_MOVE(callback));
+	case protocol_http:
+		return boost::make_shared<Http_connection>(target, addr, STD_MOVE(callback));
+	case protocol_websocket:
+		return boost::make_shared<Websocket_connection>(target, addr, STD_MOVE(callback));
+	}
+	POSEIDON_THROW(Exception, Rcnts::view("Unknown protocol"));
+}
+
+}
+}
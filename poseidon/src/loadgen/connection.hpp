@@ -0,0 +1,61 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2018, LH_Mouse. All wrongs reserved.
+
+#ifndef POSEIDON_LOADGEN_CONNECTION_HPP_
+#define POSEIDON_LOADGEN_CONNECTION_HPP_
+
+#include "../cxx_ver.hpp"
+#include "../cxx_util.hpp"
+#include "../stream_buffer.hpp"
+#include "../sock_addr.hpp"
+#include <boost/shared_ptr.hpp>
+#include <boost/function.hpp>
+#include <boost/cstdint.hpp>
+#include <string>
+
+namespace Poseidon {
+namespace Loadgen {
+
+enum Protocol {
+	protocol_cbpp       = 0,
+	protocol_http       = 1,
+	protocol_websocket  = 2,
+};
+
+struct Target {
+	Protocol protocol;
+	bool use_ssl;
+	bool verify_peer;
+	std::string host;
+	boost::uint16_t port;
+	// HTTP 和 WebSocket 请求的路径。
+	std::string path;
+	// CBPP 请求的消息号。
+	boost::uint16_t message_id;
+};
+
+// 响应总是按照请求的顺序到达。第一个参数表示是否成功，第二个参数是响应的载荷大小。
+// 回调在 Job_dispatcher 的线程中调用。
+typedef boost::function<void (bool success, std::size_t size)> Response_callback;
+
+// 对各种协议的客户端的统一封装。除了 is_ready() 和 is_closed() 以外，所有函数都只能在 Job_dispatcher 的线程中调用。
+class Connection : NONCOPYABLE {
+public:
+	virtual ~Connection();
+
+public:
+	// 连接已经建立（对于 WebSocket 还要求握手已经完成），可以发送请求。
+	virtual bool is_ready() const = 0;
+	virtual bool is_closed() const = 0;
+
+	// 对于 HTTP，空载荷发送 GET 请求，否则发送 POST 请求。
+	virtual bool send(Stream_buffer payload) = 0;
+	virtual void close() NOEXCEPT = 0;
+};
+
+extern boost::shared_ptr<Connection> create_connection(const Target &target, const Sock_addr &addr, Response_callback callback);
+
+}
+}
+
+#endif
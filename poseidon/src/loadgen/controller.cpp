@@ -0,0 +1,277 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2018, LH_Mouse. All wrongs reserved.
+
+#include "../precompiled.hpp"
+#include "controller.hpp"
+#include "../singletons/timer_daemon.hpp"
+#include "../log.hpp"
+#include "../random.hpp"
+#include "../time.hpp"
+#include <cmath>
+
+namespace Poseidon {
+namespace Loadgen {
+
+namespace {
+	// 连接建立阶段的上限。超时之后即使有连接尚未建立也开始测量。
+	const double g_warmup_timeout = 5000;
+	// 连接被关闭之后，至少等待这么久才重新连接。
+	const double g_reconnect_delay = 100;
+}
+
+Controller::Controller(const Target &target, const Sock_addr &addr, const Options &options, boost::function<void ()> finish_callback)
+	: m_target(target), m_addr(addr), m_options(options), m_finish_callback(STD_MOVE_IDN(finish_callback))
+	, m_payloads(), m_cumulative_weights()
+	, m_slots(options.connections), m_next_slot(0), m_timer()
+	, m_warmup_begin(-1), m_begin(-1), m_end(-1), m_finish(-1), m_scheduled(0)
+	, m_stats(), m_latencies()
+{
+	unsigned total_weight = 0;
+	for(AUTO(it, m_options.mix.begin()); it != m_options.mix.end(); ++it){
+		Stream_buffer payload;
+		for(std::size_t i = 0; i < it->size; ++i){
+			payload.put('x');
+		}
+		m_payloads.push_back(STD_MOVE(payload));
+		total_weight += it->weight;
+		m_cumulative_weights.push_back(total_weight);
+	}
+	for(std::size_t i = 0; i < m_slots.size(); ++i){
+		AUTO_REF(slot, m_slots.at(i));
+		slot.generation = 0;
+		slot.established = false;
+		slot.retry_after = 0;
+	}
+}
+Controller::~Controller(){
+	for(std::size_t i = 0; i < m_slots.size(); ++i){
+		const AUTO_REF(slot, m_slots.at(i));
+		if(slot.connection){
+			slot.connection->close();
+		}
+	}
+}
+
+const Stream_buffer & Controller::pick_payload() const {
+	const unsigned value = random_uint32() % m_cumulative_weights.back();
+	const AUTO(it, std::upper_bound(m_cumulative_weights.begin(), m_cumulative_weights.end(), value));
+	return m_payloads.at(static_cast<std::size_t>(it - m_cumulative_weights.begin()));
+}
+
+void Controller::open_connection(std::size_t index, double now){
+	AUTO_REF(slot, m_slots.at(index));
+	++slot.generation;
+	slot.established = false;
+	slot.retry_after = now + g_reconnect_delay;
+	try {
+		slot.connection = create_connection(m_target, m_addr, boost::bind(&Controller::on_response, this, index, slot.generation, _1, _2));
+	} catch(std::exception &e){
+		POSEIDON_LOG_WARNING("Failed to open connection: what = ", e.what());
+		m_stats.connect_failures += 1;
+		return;
+	}
+	m_stats.connections_opened += 1;
+}
+void Controller::close_connection(std::size_t index, double now){
+	AUTO_REF(slot, m_slots.at(index));
+	if(slot.established){
+		m_stats.connections_lost += 1;
+	} else {
+		m_stats.connect_failures += 1;
+	}
+	m_stats.requests_lost += slot.pending.size();
+	slot.pending.clear();
+	slot.connection->close();
+	slot.connection.reset();
+	slot.established = false;
+	slot.retry_after = now + g_reconnect_delay;
+}
+bool Controller::send_one(std::size_t index, double scheduled){
+	AUTO_REF(slot, m_slots.at(index));
+	const AUTO_REF(payload, pick_payload());
+	if(!slot.connection->send(payload)){
+		m_stats.send_failures += 1;
+		return false;
+	}
+	slot.pending.push_back(scheduled);
+	m_stats.requests_sent += 1;
+	m_stats.bytes_sent += payload.size();
+	return true;
+}
+bool Controller::has_capacity(std::size_t index) const {
+	const AUTO_REF(slot, m_slots.at(index));
+	return slot.established && (slot.pending.size() < m_options.pipeline_depth);
+}
+void Controller::dispatch(double now){
+	if((m_begin < 0) || (now >= m_end)){
+		return;
+	}
+	if(m_options.rate <= 0){
+		// 闭环：让每个连接上都有 pipeline_depth 个请求在等待响应。
+		for(std::size_t i = 0; i < m_slots.size(); ++i){
+			while(has_capacity(i) && send_one(i, now)){
+				//
+			}
+		}
+		return;
+	}
+	// 定速：第 k 个请求的计划发送时间是 m_begin + k / rate，与前面的请求何时完成无关。
+	// 如果所有连接都忙，请求会推迟发送，但是延迟仍然从计划发送时间算起，这样不会因为服务器变慢而少算延迟。
+	const double interval = 1000 / m_options.rate;
+	const boost::uint64_t due = static_cast<boost::uint64_t>(std::floor((now - m_begin) / interval)) + 1;
+	while(m_scheduled < due){
+		std::size_t index = m_next_slot;
+		std::size_t tried = 0;
+		while((tried < m_slots.size()) && !has_capacity(index)){
+			index = (index + 1) % m_slots.size();
+			++tried;
+		}
+		if(tried == m_slots.size()){
+			break;
+		}
+		send_one(index, m_begin + static_cast<double>(m_scheduled) * interval);
+		++m_scheduled;
+		m_next_slot = (index + 1) % m_slots.size();
+	}
+}
+void Controller::finish(double now){
+	m_finish = now;
+	m_timer.reset();
+	for(std::size_t i = 0; i < m_slots.size(); ++i){
+		AUTO_REF(slot, m_slots.at(i));
+		m_stats.requests_timed_out += slot.pending.size();
+		slot.pending.clear();
+	}
+	if(m_options.rate > 0){
+		const double interval = 1000 / m_options.rate;
+		const AUTO(total, static_cast<boost::uint64_t>(std::ceil(m_options.duration / interval)));
+		if(total > m_scheduled){
+			m_stats.requests_unsent += total - m_scheduled;
+		}
+	}
+	m_finish_callback();
+}
+
+void Controller::on_response(std::size_t index, unsigned generation, bool success, std::size_t size){
+	if(is_finished()){
+		return;
+	}
+	AUTO_REF(slot, m_slots.at(index));
+	if((slot.generation != generation) || slot.pending.empty()){
+		return;
+	}
+	const double now = get_hi_res_mono_clock();
+	const double scheduled = slot.pending.front();
+	slot.pending.pop_front();
+	if(success){
+		m_stats.responses_succeeded += 1;
+		m_latencies.record(static_cast<boost::uint64_t>(std::max(now - scheduled, 0.0) * 1e6));
+	} else {
+		m_stats.responses_failed += 1;
+	}
+	m_stats.bytes_received += size;
+
+	if(m_options.rate <= 0){
+		while(has_capacity(index) && (now < m_end) && send_one(index, now)){
+			//
+		}
+	} else {
+		dispatch(now);
+	}
+}
+void Controller::on_timer(){
+	if(is_finished()){
+		return;
+	}
+	const double now = get_hi_res_mono_clock();
+	bool all_established = true;
+	bool any_pending = false;
+	for(std::size_t i = 0; i < m_slots.size(); ++i){
+		AUTO_REF(slot, m_slots.at(i));
+		if(slot.connection && slot.connection->is_closed()){
+			close_connection(i, now);
+		}
+		if(!slot.connection){
+			if((now < m_end || m_begin < 0) && (now >= slot.retry_after)){
+				open_connection(i, now);
+			}
+		} else if(!slot.established && slot.connection->is_ready()){
+			slot.established = true;
+			m_stats.connections_established += 1;
+		}
+		all_established = all_established && slot.established;
+		any_pending = any_pending || !slot.pending.empty();
+	}
+	if(m_begin < 0){
+		if(!all_established && (now < m_warmup_begin + g_warmup_timeout)){
+			return;
+		}
+		if(!all_established){
+			POSEIDON_LOG_WARNING("Not all connections have been established. Starting anyway.");
+		}
+		POSEIDON_LOG_INFO("Starting measurement...");
+		m_begin = now;
+		m_end = now + m_options.duration;
+	}
+	if(now >= m_end){
+		if(!any_pending || (now >= m_end + m_options.drain_timeout)){
+			finish(now);
+		}
+		return;
+	}
+	dispatch(now);
+}
+
+void Controller::start(){
+	const double now = get_hi_res_mono_clock();
+	m_warmup_begin = now;
+	for(std::size_t i = 0; i < m_slots.size(); ++i){
+		open_connection(i, now);
+	}
+	m_timer = Timer_daemon::register_timer(0, 1, boost::bind(&Controller::on_timer, this));
+}
+
+double Controller::get_elapsed() const {
+	if(m_begin < 0){
+		return 0;
+	}
+	return (m_finish >= 0 ? m_finish : get_hi_res_mono_clock()) - m_begin;
+}
+
+Json_object Controller::dump() const {
+	const double elapsed = get_elapsed();
+	const double seconds = elapsed / 1000;
+
+	Json_object connections;
+	connections.set(Rcnts::view("opened"), m_stats.connections_opened);
+	connections.set(Rcnts::view("established"), m_stats.connections_established);
+	connections.set(Rcnts::view("lost"), m_stats.connections_lost);
+	connections.set(Rcnts::view("connect_failures"), m_stats.connect_failures);
+
+	Json_object requests;
+	requests.set(Rcnts::view("sent"), m_stats.requests_sent);
+	requests.set(Rcnts::view("succeeded"), m_stats.responses_succeeded);
+	requests.set(Rcnts::view("failed"), m_stats.responses_failed);
+	requests.set(Rcnts::view("lost"), m_stats.requests_lost);
+	requests.set(Rcnts::view("timed_out"), m_stats.requests_timed_out);
+	requests.set(Rcnts::view("unsent"), m_stats.requests_unsent);
+	requests.set(Rcnts::view("send_failures"), m_stats.send_failures);
+
+	Json_object throughput;
+	if(seconds > 0){
+		throughput.set(Rcnts::view("requests_per_sec"), static_cast<double>(m_stats.responses_succeeded) / seconds);
+		throughput.set(Rcnts::view("bytes_sent_per_sec"), static_cast<double>(m_stats.bytes_sent) / seconds);
+		throughput.set(Rcnts::view("bytes_received_per_sec"), static_cast<double>(m_stats.bytes_received) / seconds);
+	}
+
+	Json_object obj;
+	obj.set(Rcnts::view("elapsed_ms"), elapsed);
+	obj.set(Rcnts::view("connections"), STD_MOVE_IDN(connections));
+	obj.set(Rcnts::view("requests"), STD_MOVE_IDN(requests));
+	obj.set(Rcnts::view("throughput"), STD_MOVE_IDN(throughput));
+	obj.set(Rcnts::view("latency_ns"), m_latencies.dump());
+	return obj;
+}
+
+}
+}
@@ -0,0 +1,132 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2018, LH_Mouse. All wrongs reserved.
+
+#ifndef POSEIDON_LOADGEN_CONTROLLER_HPP_
+#define POSEIDON_LOADGEN_CONTROLLER_HPP_
+
+#include "../cxx_ver.hpp"
+#include "../cxx_util.hpp"
+#include "../json.hpp"
+#include "../sock_addr.hpp"
+#include "../stream_buffer.hpp"
+#include "../fwd.hpp"
+#include "connection.hpp"
+#include "hdr_histogram.hpp"
+#include <boost/container/vector.hpp>
+#include <boost/container/deque.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/function.hpp>
+#include <boost/cstdint.hpp>
+
+namespace Poseidon {
+namespace Loadgen {
+
+struct Mix_element {
+	// 载荷大小。
+	std::size_t size;
+	// 被选中的相对概率。
+	unsigned weight;
+};
+
+struct Options {
+	std::size_t connections;
+	// 测量阶段的毫秒数。
+	double duration;
+	// 每秒发送的请求总数。为零时每个连接收到响应就立即发送下一个请求（闭环）。
+	double rate;
+	// 每个连接上同时等待响应的请求数上限。
+	std::size_t pipeline_depth;
+	// 测量阶段结束之后等待未完成的请求的毫秒数。
+	double drain_timeout;
+	boost::container::vector<Mix_element> mix;
+};
+
+struct Statistics {
+	boost::uint64_t connections_opened;
+	boost::uint64_t connections_established;
+	boost::uint64_t connections_lost;     // 建立之后被关闭。
+	boost::uint64_t connect_failures;     // 建立之前被关闭。
+
+	boost::uint64_t requests_sent;
+	boost::uint64_t responses_succeeded;
+	boost::uint64_t responses_failed;     // 例如 HTTP 状态码大于等于 400。
+	boost::uint64_t requests_lost;        // 连接关闭时仍未收到响应。
+	boost::uint64_t requests_timed_out;   // 等待结束时仍未收到响应。
+	boost::uint64_t requests_unsent;      // 定速模式下因为所有连接都忙而没能发出。
+	boost::uint64_t send_failures;
+
+	boost::uint64_t bytes_sent;
+	boost::uint64_t bytes_received;
+};
+
+// 所有成员函数都必须在 Job_dispatcher 的线程中调用。
+class Controller : NONCOPYABLE {
+private:
+	struct Slot {
+		boost::shared_ptr<Connection> connection;
+		unsigned generation;
+		bool established;
+		double retry_after;
+		// 每个未完成的请求的计划发送时间。
+		boost::container::deque<double> pending;
+	};
+
+private:
+	const Target m_target;
+	const Sock_addr m_addr;
+	const Options m_options;
+	const boost::function<void ()> m_finish_callback;
+
+	boost::container::vector<Stream_buffer> m_payloads;
+	boost::container::vector<unsigned> m_cumulative_weights;
+
+	boost::container::vector<Slot> m_slots;
+	std::size_t m_next_slot;
+	boost::shared_ptr<Timer> m_timer;
+
+	double m_warmup_begin;
+	double m_begin;
+	double m_end;
+	double m_finish;
+	boost::uint64_t m_scheduled;
+
+	Statistics m_stats;
+	Hdr_histogram m_latencies;
+
+public:
+	Controller(const Target &target, const Sock_addr &addr, const Options &options, boost::function<void ()> finish_callback);
+	~Controller();
+
+private:
+	const Stream_buffer & pick_payload() const;
+	void open_connection(std::size_t index, double now);
+	void close_connection(std::size_t index, double now);
+	bool send_one(std::size_t index, double scheduled);
+	bool has_capacity(std::size_t index) const;
+	void dispatch(double now);
+	void finish(double now);
+
+	void on_response(std::size_t index, unsigned generation, bool success, std::size_t size);
+	void on_timer();
+
+public:
+	void start();
+	bool is_finished() const {
+		return m_finish >= 0;
+	}
+
+	const Statistics & get_statistics() const {
+		return m_stats;
+	}
+	const Hdr_histogram & get_latencies() const {
+		return m_latencies;
+	}
+	double get_elapsed() const;
+
+	Json_object dump() const;
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,137 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2018, LH_Mouse. All wrongs reserved.
+
+#include "../precompiled.hpp"
+#include "hdr_histogram.hpp"
+#include <cmath>
+
+namespace Poseidon {
+namespace Loadgen {
+
+std::size_t Hdr_histogram::get_index_of_value(boost::uint64_t value) NOEXCEPT {
+	if(value < sub_bucket_count){
+		return static_cast<std::size_t>(value);
+	}
+	// 最高位在第 b 位时，右移 b - 7 位，剩下的 8 位就是这个值所在的子桶。
+	const unsigned msb = 63u - static_cast<unsigned>(__builtin_clzll(value));
+	const unsigned shift = msb - sub_bucket_bits + 1;
+	return (static_cast<std::size_t>(shift) << (sub_bucket_bits - 1)) + static_cast<std::size_t>(value >> shift);
+}
+boost::uint64_t Hdr_histogram::get_lowest_value_at_index(std::size_t index) NOEXCEPT {
+	if(index < sub_bucket_count){
+		return index;
+	}
+	const unsigned shift = static_cast<unsigned>(index >> (sub_bucket_bits - 1)) - 1;
+	const boost::uint64_t mantissa = index - (static_cast<std::size_t>(shift) << (sub_bucket_bits - 1));
+	return mantissa << shift;
+}
+boost::uint64_t Hdr_histogram::get_highest_value_at_index(std::size_t index) NOEXCEPT {
+	if(index < sub_bucket_count){
+		return index;
+	}
+	const unsigned shift = static_cast<unsigned>(index >> (sub_bucket_bits - 1)) - 1;
+	const boost::uint64_t mantissa = index - (static_cast<std::size_t>(shift) << (sub_bucket_bits - 1));
+	return ((mantissa + 1) << shift) - 1;
+}
+
+Hdr_histogram::Hdr_histogram()
+	: m_counts(bucket_count), m_total_count(0), m_min(UINT64_MAX), m_max(0), m_sum(0)
+{
+	//
+}
+
+void Hdr_histogram::record(boost::uint64_t value, boost::uint64_t count){
+	m_counts.at(get_index_of_value(value)) += count;
+	m_total_count += count;
+	m_min = std::min(m_min, value);
+	m_max = std::max(m_max, value);
+	m_sum += static_cast<double>(value) * static_cast<double>(count);
+}
+void Hdr_histogram::merge(const Hdr_histogram &other){
+	for(std::size_t i = 0; i < m_counts.size(); ++i){
+		m_counts.at(i) += other.m_counts.at(i);
+	}
+	m_total_count += other.m_total_count;
+	m_min = std::min(m_min, other.m_min);
+	m_max = std::max(m_max, other.m_max);
+	m_sum += other.m_sum;
+}
+void Hdr_histogram::clear() NOEXCEPT {
+	std::fill(m_counts.begin(), m_counts.end(), 0);
+	m_total_count = 0;
+	m_min = UINT64_MAX;
+	m_max = 0;
+	m_sum = 0;
+}
+
+boost::uint64_t Hdr_histogram::get_value_at_percentile(double percentile) const {
+	if(m_total_count == 0){
+		return 0;
+	}
+	if(percentile <= 0){
+		return m_min;
+	}
+	const double fraction = std::min(percentile, 100.0) / 100;
+	const boost::uint64_t target = std::max<boost::uint64_t>(static_cast<boost::uint64_t>(std::ceil(fraction * static_cast<double>(m_total_count))), 1);
+	boost::uint64_t accumulated = 0;
+	for(std::size_t i = 0; i < m_counts.size(); ++i){
+		accumulated += m_counts.at(i);
+		if(accumulated >= target){
+			return std::min(get_highest_value_at_index(i), m_max);
+		}
+	}
+	return m_max;
+}
+
+Json_object Hdr_histogram::dump(unsigned ticks_per_half_distance) const {
+	Json_array distribution;
+	if(m_total_count != 0){
+		// 每一列依次是值、百分位、小于等于这个值的样本数。
+		boost::uint64_t accumulated = 0;
+		std::size_t index = 0;
+		double percentile = 0;
+		for(unsigned level = 0; ; ++level){
+			const double half_distance = std::ldexp(100.0, -static_cast<int>(level) - 1);
+			const double end = 100 - half_distance;
+			const double step = half_distance / ticks_per_half_distance;
+			for(; percentile < end; percentile += step){
+				const boost::uint64_t value = get_value_at_percentile(percentile);
+				while((index < m_counts.size()) && (get_lowest_value_at_index(index) <= value)){
+					accumulated += m_counts.at(index);
+					++index;
+				}
+				Json_array row;
+				row.push_back(value);
+				row.push_back(percentile);
+				row.push_back(accumulated);
+				distribution.push_back(STD_MOVE_IDN(row));
+			}
+			percentile = end;
+			// 剩余的距离已经不足一个样本，再细分没有意义。
+			if(std::ldexp(1.0, static_cast<int>(level)) > static_cast<double>(m_total_count)){
+				break;
+			}
+		}
+		Json_array row;
+		row.push_back(m_max);
+		row.push_back(100.0);
+		row.push_back(m_total_count);
+		distribution.push_back(STD_MOVE_IDN(row));
+	}
+
+	Json_object obj;
+	obj.set(Rcnts::view("count"), m_total_count);
+	obj.set(Rcnts::view("min"), get_min());
+	obj.set(Rcnts::view("max"), get_max());
+	obj.set(Rcnts::view("mean"), get_mean());
+	obj.set(Rcnts::view("p50"), get_value_at_percentile(50));
+	obj.set(Rcnts::view("p90"), get_value_at_percentile(90));
+	obj.set(Rcnts::view("p99"), get_value_at_percentile(99));
+	obj.set(Rcnts::view("p999"), get_value_at_percentile(99.9));
+	obj.set(Rcnts::view("p9999"), get_value_at_percentile(99.99));
+	obj.set(Rcnts::view("distribution"), STD_MOVE_IDN(distribution));
+	return obj;
+}
+
+}
+}
@@ -0,0 +1,69 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2018, LH_Mouse. All wrongs reserved.
+
+#ifndef POSEIDON_LOADGEN_HDR_HISTOGRAM_HPP_
+#define POSEIDON_LOADGEN_HDR_HISTOGRAM_HPP_
+
+#include "../cxx_ver.hpp"
+#include "../json.hpp"
+#include <boost/container/vector.hpp>
+#include <boost/cstdint.hpp>
+
+namespace Poseidon {
+namespace Loadgen {
+
+// 高动态范围直方图。每个 2 的幂区间被均分为 128 个桶，因此任何值的相对误差都不超过 1/128，
+// 而内存占用是固定的，与样本数和值域无关。
+class Hdr_histogram {
+public:
+	enum {
+		sub_bucket_bits   = 8,
+		sub_bucket_count  = 1u << sub_bucket_bits,
+		sub_bucket_half   = sub_bucket_count / 2,
+		bucket_count      = (64 - sub_bucket_bits + 1) * sub_bucket_half + sub_bucket_half,
+	};
+
+private:
+	static std::size_t get_index_of_value(boost::uint64_t value) NOEXCEPT;
+	static boost::uint64_t get_lowest_value_at_index(std::size_t index) NOEXCEPT;
+	static boost::uint64_t get_highest_value_at_index(std::size_t index) NOEXCEPT;
+
+private:
+	boost::container::vector<boost::uint64_t> m_counts;
+	boost::uint64_t m_total_count;
+	boost::uint64_t m_min;
+	boost::uint64_t m_max;
+	double m_sum;
+
+public:
+	Hdr_histogram();
+
+public:
+	boost::uint64_t get_total_count() const {
+		return m_total_count;
+	}
+	boost::uint64_t get_min() const {
+		return m_total_count ? m_min : 0;
+	}
+	boost::uint64_t get_max() const {
+		return m_max;
+	}
+	double get_mean() const {
+		return m_total_count ? m_sum / static_cast<double>(m_total_count) : 0;
+	}
+
+	void record(boost::uint64_t value, boost::uint64_t count = 1);
+	void merge(const Hdr_histogram &other);
+	void clear() NOEXCEPT;
+
+	// percentile 的取值范围是 [0,100]。返回值是对应桶的上界，和 HdrHistogram 的约定一致。
+	boost::uint64_t get_value_at_percentile(double percentile) const;
+
+	// 输出摘要和百分位分布。分布的刻度在每次剩余距离减半时加密，越接近 100% 越密。
+	Json_object dump(unsigned ticks_per_half_distance = 5) const;
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,367 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2018, LH_Mouse. All wrongs reserved.
+
+#include "../precompiled.hpp"
+#include "controller.hpp"
+#include "connection.hpp"
+#include "../singletons/main_config.hpp"
+#include "../singletons/profile_depository.hpp"
+#include "../singletons/dns_daemon.hpp"
+#include "../singletons/job_dispatcher.hpp"
+#include "../singletons/timer_daemon.hpp"
+#include "../singletons/epoll_daemon.hpp"
+#include "../log.hpp"
+#include "../atomic.hpp"
+#include "../time.hpp"
+#include <boost/scoped_ptr.hpp>
+#include <signal.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace Poseidon;
+
+namespace {
+	volatile bool g_running = true;
+
+	void sigint_proc(int){
+		atomic_store(g_running, false, memory_order_release);
+	}
+	void finish_proc(){
+		atomic_store(g_running, false, memory_order_release);
+	}
+
+	template<typename T>
+	struct Raii_singleton_runner : NONCOPYABLE {
+		Raii_singleton_runner(){
+			T::start();
+		}
+		~Raii_singleton_runner(){
+			T::stop();
+		}
+	};
+
+	// 格式是 scheme://host[:port][/path]。
+	bool parse_url(Loadgen::Target &target, const char *str){
+		std::string url(str);
+		std::size_t pos = url.find("://");
+		if(pos == std::string::npos){
+			return false;
+		}
+		const AUTO(scheme, url.substr(0, pos));
+		boost::uint16_t default_port;
+		if(scheme == "cbpp"){
+			target.protocol = Loadgen::protocol_cbpp;
+			target.use_ssl = false;
+			default_port = 0;
+		} else if(scheme == "cbpps"){
+			target.protocol = Loadgen::protocol_cbpp;
+			target.use_ssl = true;
+			default_port = 0;
+		} else if(scheme == "http"){
+			target.protocol = Loadgen::protocol_http;
+			target.use_ssl = false;
+			default_port = 80;
+		} else if(scheme == "https"){
+			target.protocol = Loadgen::protocol_http;
+			target.use_ssl = true;
+			default_port = 443;
+		} else if(scheme == "ws"){
+			target.protocol = Loadgen::protocol_websocket;
+			target.use_ssl = false;
+			default_port = 80;
+		} else if(scheme == "wss"){
+			target.protocol = Loadgen::protocol_websocket;
+			target.use_ssl = true;
+			default_port = 443;
+		} else {
+			return false;
+		}
+		url.erase(0, pos + 3);
+
+		pos = url.find('/');
+		if(pos == std::string::npos){
+			target.path = "/";
+		} else {
+			target.path = url.substr(pos);
+			url.erase(pos);
+		}
+		// IPv6 地址写在方括号中。
+		pos = url.rfind(':');
+		if((pos != std::string::npos) && (url.find(']', pos) == std::string::npos)){
+			char *eptr;
+			const unsigned long port = std::strtoul(url.c_str() + pos + 1, &eptr, 10);
+			if((*eptr != 0) || (port == 0) || (port > 65535)){
+				return false;
+			}
+			target.port = static_cast<boost::uint16_t>(port);
+			url.erase(pos);
+		} else {
+			if(default_port == 0){
+				return false;
+			}
+			target.port = default_port;
+		}
+		if((url.size() >= 2) && (url[0] == '[') && (url[url.size() - 1] == ']')){
+			url = url.substr(1, url.size() - 2);
+		}
+		if(url.empty()){
+			return false;
+		}
+		target.host = STD_MOVE(url);
+		return true;
+	}
+
+	// 格式是 size[:weight][,size[:weight]...]。
+	bool parse_mix(boost::container::vector<Loadgen::Mix_element> &mix, const char *str){
+		mix.clear();
+		const char *read = str;
+		for(;;){
+			char *eptr;
+			Loadgen::Mix_element elem;
+			elem.size = std::strtoul(read, &eptr, 10);
+			if(eptr == read){
+				return false;
+			}
+			elem.weight = 1;
+			read = eptr;
+			if(*read == ':'){
+				++read;
+				const unsigned long weight = std::strtoul(read, &eptr, 10);
+				if((eptr == read) || (weight == 0) || (weight > 1000000)){
+					return false;
+				}
+				elem.weight = static_cast<unsigned>(weight);
+				read = eptr;
+			}
+			mix.push_back(elem);
+			if(*read == 0){
+				break;
+			}
+			if(*read != ','){
+				return false;
+			}
+			++read;
+		}
+		return true;
+	}
+
+	void print_summary(const char *url, const Loadgen::Controller &controller){
+		const AUTO_REF(stats, controller.get_statistics());
+		const AUTO_REF(latencies, controller.get_latencies());
+		const double seconds = controller.get_elapsed() / 1000;
+
+		::fprintf(stderr, "Target:        %s\n", url);
+		::fprintf(stderr, "Elapsed:       %.3f s\n", seconds);
+		::fprintf(stderr, "Connections:   %llu opened, %llu established, %llu lost, %llu failed to connect\n",
+			(unsigned long long)stats.connections_opened, (unsigned long long)stats.connections_established,
+			(unsigned long long)stats.connections_lost, (unsigned long long)stats.connect_failures);
+		::fprintf(stderr, "Requests:      %llu sent, %llu succeeded, %llu failed, %llu lost, %llu timed out, %llu unsent\n",
+			(unsigned long long)stats.requests_sent, (unsigned long long)stats.responses_succeeded,
+			(unsigned long long)stats.responses_failed, (unsigned long long)stats.requests_lost,
+			(unsigned long long)stats.requests_timed_out, (unsigned long long)stats.requests_unsent);
+		if(seconds > 0){
+			::fprintf(stderr, "Throughput:    %.1f requests/s, %.3f MiB/s sent, %.3f MiB/s received\n",
+				static_cast<double>(stats.responses_succeeded) / seconds,
+				static_cast<double>(stats.bytes_sent) / seconds / 1048576, static_cast<double>(stats.bytes_received) / seconds / 1048576);
+		}
+		::fprintf(stderr, "Latency (us):  min %.1f, mean %.1f, p50 %.1f, p90 %.1f, p99 %.1f, p99.9 %.1f, max %.1f\n",
+			static_cast<double>(latencies.get_min()) / 1000, latencies.get_mean() / 1000,
+			static_cast<double>(latencies.get_value_at_percentile(50)) / 1000, static_cast<double>(latencies.get_value_at_percentile(90)) / 1000,
+			static_cast<double>(latencies.get_value_at_percentile(99)) / 1000, static_cast<double>(latencies.get_value_at_percentile(99.9)) / 1000,
+			static_cast<double>(latencies.get_max()) / 1000);
+	}
+}
+
+int main(int argc, char **argv, char **/*envp*/){
+	bool all_logs = false;
+	int help = 0; // 1 = exit with EXIT_SUCCESS, * = exit with EXIT_FAILURE.
+	const char *url = NULLPTR;
+	const char *new_wd = NULLPTR;
+	const char *output_path = NULLPTR;
+	const char *mix_str = "128";
+
+	Loadgen::Target target;
+	target.verify_peer = true;
+	target.message_id = 100;
+
+	Loadgen::Options options;
+	options.connections = 16;
+	options.duration = 10000;
+	options.rate = 0;
+	options.pipeline_depth = 1;
+	options.drain_timeout = 5000;
+
+	int opt;
+	while((opt = ::getopt(argc, argv, "ac:d:hi:km:o:p:r:w:")) != -1){
+		switch(opt){
+		case 'a':
+			all_logs = true;
+			break;
+		case 'c':
+			options.connections = std::strtoul(optarg, NULLPTR, 10);
+			break;
+		case 'd':
+			options.duration = std::strtod(optarg, NULLPTR);
+			break;
+		case 'h':
+			help |= 1;
+			break;
+		case 'i':
+			target.message_id = static_cast<boost::uint16_t>(std::strtoul(optarg, NULLPTR, 10));
+			break;
+		case 'k':
+			target.verify_peer = false;
+			break;
+		case 'm':
+			mix_str = optarg;
+			break;
+		case 'o':
+			output_path = optarg;
+			break;
+		case 'p':
+			options.pipeline_depth = std::strtoul(optarg, NULLPTR, 10);
+			break;
+		case 'r':
+			options.rate = std::strtod(optarg, NULLPTR);
+			break;
+		case 'w':
+			options.drain_timeout = std::strtod(optarg, NULLPTR);
+			break;
+		default:
+			help |= 2;
+			break;
+		}
+	}
+	switch(argc - optind){
+	case 0:
+		if(!help){
+			::fprintf(stderr, "%s: no target URL specified\n", argv[0]);
+			help |= 2;
+		}
+		break;
+	case 1:
+		url = argv[optind];
+		break;
+	case 2:
+		url = argv[optind];
+		new_wd = argv[optind + 1];
+		break;
+	default:
+		::fprintf(stderr, "%s: too many arguments -- '%s'\n", argv[0], argv[optind + 2]);
+		help |= 2;
+		break;
+	}
+	if(url && !parse_url(target, url)){
+		::fprintf(stderr, "%s: invalid target URL -- '%s'\n", argv[0], url);
+		help |= 2;
+	}
+	if(!parse_mix(options.mix, mix_str)){
+		::fprintf(stderr, "%s: invalid message mix -- '%s'\n", argv[0], mix_str);
+		help |= 2;
+	}
+	if((options.connections == 0) || (options.duration <= 0) || (options.rate < 0) || (options.pipeline_depth == 0) || (options.drain_timeout < 0)){
+		::fprintf(stderr, "%s: invalid connection count, duration, rate, pipeline depth or drain timeout\n", argv[0]);
+		help |= 2;
+	}
+	if(help){
+		::fprintf(stdout,
+			//        1         2         3         4         5         6         7         8
+			// 345678901234567890123456789012345678901234567890123456789012345678901234567890
+			"Usage: %s [-ahk] [-c <n>] [-d <ms>] [-i <id>] [-m <mix>] [-o <file>]\n"
+			"          [-p <n>] [-r <rate>] [-w <ms>] <url> [<directory>]\n"
+			"  -a            do not mask trace, debug and info logs\n"
+			"  -c <n>        number of connections to open (16)\n"
+			"  -d <ms>       duration of the measurement in milliseconds (10000)\n"
+			"  -h            show this help message then exit\n"
+			"  -i <id>       message ID of CBPP requests (100)\n"
+			"  -k            do not verify the server certificate\n"
+			"  -m <mix>      payload sizes with optional weights, as in '64:8,1024:1'\n"
+			"                (128); HTTP sends GET for size 0 and POST otherwise\n"
+			"  -o <file>     write JSON results to this file instead of stdout\n"
+			"  -p <n>        maximum requests in flight on each connection (1)\n"
+			"  -r <rate>     total requests per second; 0 for closed loop (0)\n"
+			"  -w <ms>       time to wait for outstanding responses at the end (5000)\n"
+			"  <url>         cbpp[s]://host:port, http[s]://host[:port][/path] or\n"
+			"                ws[s]://host[:port][/path]\n"
+			"  <directory>   load 'main.conf' from this directory\n"
+			, argv[0]);
+		return (help == 1) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	Logger::set_thread_tag("P   "); // Primary
+	if(!all_logs){
+		Logger::set_mask(Logger::level_trace | Logger::level_debug | Logger::level_info, 0);
+	}
+
+	::signal(SIGINT, &sigint_proc);
+	::signal(SIGTERM, &sigint_proc);
+	::signal(SIGCHLD, SIG_IGN);
+	::signal(SIGPIPE, SIG_IGN);
+
+	// 控制器必须比 Job_dispatcher 活得更久，因为停止 Job_dispatcher 时剩余的回调仍然会被调用。
+	boost::scoped_ptr<Loadgen::Controller> controller;
+	try {
+		if(new_wd){
+			Main_config::set_run_path(new_wd);
+		}
+		Main_config::reload();
+
+#define START(x_)   const Raii_singleton_runner<x_> POSEIDON_UNIQUE_NAME
+
+		START(Profile_depository);
+		START(Dns_daemon);
+		START(Job_dispatcher);
+		START(Timer_daemon);
+		START(Epoll_daemon);
+
+		const AUTO(addr, Dns_daemon::look_up(target.host, target.port));
+		controller.reset(new Loadgen::Controller(target, addr, options, &finish_proc));
+		controller->start();
+		Job_dispatcher::do_modal(g_running);
+	} catch(std::exception &e){
+		POSEIDON_LOG_ERROR("std::exception thrown in main(): what = ", e.what());
+		return EXIT_FAILURE;
+	} catch(...){
+		POSEIDON_LOG_ERROR("Unknown exception thrown in main().");
+		return EXIT_FAILURE;
+	}
+
+	print_summary(url, *controller);
+
+	Json_array mix;
+	for(AUTO(it, options.mix.begin()); it != options.mix.end(); ++it){
+		Json_object elem;
+		elem.set(Rcnts::view("size"), it->size);
+		elem.set(Rcnts::view("weight"), it->weight);
+		mix.push_back(STD_MOVE_IDN(elem));
+	}
+	Json_object options_obj;
+	options_obj.set(Rcnts::view("connections"), options.connections);
+	options_obj.set(Rcnts::view("duration_ms"), options.duration);
+	options_obj.set(Rcnts::view("rate"), options.rate);
+	options_obj.set(Rcnts::view("pipeline_depth"), options.pipeline_depth);
+	options_obj.set(Rcnts::view("drain_timeout_ms"), options.drain_timeout);
+	options_obj.set(Rcnts::view("mix"), STD_MOVE_IDN(mix));
+
+	AUTO(root, controller->dump());
+	root.set(Rcnts::view("version"), PACKAGE_STRING);
+	root.set(Rcnts::view("timestamp"), get_utc_time());
+	root.set(Rcnts::view("target"), url);
+	root.set(Rcnts::view("options"), STD_MOVE_IDN(options_obj));
+
+	const std::string json = root.dump().dump_string();
+	std::FILE *const output = output_path ? std::fopen(output_path, "w") : stdout;
+	if(!output){
+		const int err_code = errno;
+		::fprintf(stderr, "%s: could not open '%s' for writing: %s\n", argv[0], output_path, ::strerror(err_code));
+		return EXIT_FAILURE;
+	}
+	std::fwrite(json.data(), 1, json.size(), output);
+	std::fputc('\n', output);
+	if(output != stdout){
+		std::fclose(output);
+	}
+	return EXIT_SUCCESS;
+}
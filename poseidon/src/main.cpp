@@ -31,7 +31,11 @@
 #include "atomic.hpp"
 #include "checked_arithmetic.hpp"
 #include "system_http_servlet_base.hpp"
+#include "ssl_factories.hpp"
+#include "ssl_filter.hpp"
 #include "json.hpp"
+#include "metrics.hpp"
+#include "stream_buffer.hpp"
 #include <signal.h>
 #include <unistd.h>
 #include <stdio.h>
@@ -187,6 +191,60 @@ namespace {
 		}
 	};
 
+	struct System_http_servlet_workhorse : public System_http_servlet_base {
+		const char * get_uri() const FINAL {
+			return "/poseidon/workhorse";
+		}
+		void handle_get(Json_object &resp) const FINAL {
+			resp.set(Rcnts::view("description"), "Retreive queue depths and steal counts of workhorse threads.");
+			static const char *const s_param_info[][2] = {
+				{ NULLPTR }
+			};
+			resp.set(Rcnts::view("parameters"), make_help(s_param_info));
+		}
+		void handle_post(Json_object &resp, Json_object /*req*/) const FINAL {
+			resp.set(Rcnts::view("work_stealing_enabled"), Workhorse_camp::is_work_stealing_enabled());
+			// .threads = statistics of each workhorse thread.
+			boost::container::vector<Workhorse_camp::Thread_statistics> stats;
+			Workhorse_camp::get_thread_statistics(stats);
+			Json_array arr;
+			for(AUTO(it, stats.begin()); it != stats.end(); ++it){
+				const AUTO_REF(elem, *it);
+				Json_object obj;
+				obj.set(Rcnts::view("queue_size"), elem.queue_size);
+				obj.set(Rcnts::view("stealable_size"), elem.stealable_size);
+				obj.set(Rcnts::view("jobs_executed"), elem.jobs_executed);
+				obj.set(Rcnts::view("jobs_stolen"), elem.jobs_stolen);
+				arr.push_back(STD_MOVE_IDN(obj));
+			}
+			resp.set(Rcnts::view("threads"), STD_MOVE_IDN(arr));
+		}
+	};
+
+	struct System_http_servlet_metrics : public System_http_servlet_base {
+		const char * get_uri() const FINAL {
+			return "/poseidon/metrics";
+		}
+		void handle_get(Json_object &resp) const FINAL {
+			resp.set(Rcnts::view("description"), "Retreive counters, gauges and histograms in Prometheus text format. Use GET for scraping.");
+			static const char *const s_param_info[][2] = {
+				{ NULLPTR }
+			};
+			resp.set(Rcnts::view("parameters"), make_help(s_param_info));
+		}
+		void handle_post(Json_object &resp, Json_object /*req*/) const FINAL {
+			// .text = all metrics in Prometheus text format.
+			Stream_buffer buffer;
+			Metric_base::render_all(buffer);
+			resp.set(Rcnts::view("text"), buffer.dump_string());
+		}
+		bool handle_get_raw(Stream_buffer &entity, std::string &content_type) const FINAL {
+			Metric_base::render_all(entity);
+			content_type = "text/plain; version=0.0.4; charset=utf-8";
+			return true;
+		}
+	};
+
 	struct System_http_servlet_profiler : public System_http_servlet_base {
 		const char * get_uri() const FINAL {
 			return "/poseidon/profiler";
@@ -234,6 +292,213 @@ namespace {
 		}
 	};
 
+	struct System_http_servlet_filesystem : public System_http_servlet_base {
+		const char * get_uri() const FINAL {
+			return "/poseidon/filesystem";
+		}
+		void handle_get(Json_object &resp) const FINAL {
+			resp.set(Rcnts::view("description"), "View statistics of the file block cache of the file system daemon.");
+			static const char *const s_param_info[][2] = {
+				{ "clear", "If set to `true`, all cached blocks will be purged." },
+				{ NULLPTR }
+			};
+			resp.set(Rcnts::view("parameters"), make_help(s_param_info));
+		}
+		void handle_post(Json_object &resp, Json_object req) const FINAL {
+			bool clear = false;
+			if(req.has("clear")){
+				try {
+					clear = req.get("clear").get<bool>();
+				} catch(std::exception &e){
+					POSEIDON_LOG_WARNING("std::exception thrown: ", e.what());
+					resp.set(Rcnts::view("error"), "Invalid parameter `clear`: It shall be a `Boolean`.");
+					return;
+				}
+			}
+
+			if(clear){
+				File_system_daemon::clear_cache();
+			}
+
+			// .cache = statistics of the file block cache.
+			const AUTO(stats, File_system_daemon::get_cache_statistics());
+			Json_object obj;
+			obj.set(Rcnts::view("hits"), stats.hits);
+			obj.set(Rcnts::view("misses"), stats.misses);
+			obj.set(Rcnts::view("hit_rate"), (stats.hits + stats.misses != 0) ? static_cast<double>(stats.hits) / static_cast<double>(stats.hits + stats.misses) : 0.0);
+			obj.set(Rcnts::view("entry_count"), stats.entry_count);
+			obj.set(Rcnts::view("size"), stats.size);
+			obj.set(Rcnts::view("max_size"), stats.max_size);
+			resp.set(Rcnts::view("cache"), STD_MOVE_IDN(obj));
+		}
+	};
+
+	struct System_http_servlet_dns : public System_http_servlet_base {
+		const char * get_uri() const FINAL {
+			return "/poseidon/dns";
+		}
+		void handle_get(Json_object &resp) const FINAL {
+			resp.set(Rcnts::view("description"), "View statistics of the resolver cache of the DNS daemon.");
+			static const char *const s_param_info[][2] = {
+				{ "clear", "If set to `true`, all cached results will be purged." },
+				{ NULLPTR }
+			};
+			resp.set(Rcnts::view("parameters"), make_help(s_param_info));
+		}
+		void handle_post(Json_object &resp, Json_object req) const FINAL {
+			bool clear = false;
+			if(req.has("clear")){
+				try {
+					clear = req.get("clear").get<bool>();
+				} catch(std::exception &e){
+					POSEIDON_LOG_WARNING("std::exception thrown: ", e.what());
+					resp.set(Rcnts::view("error"), "Invalid parameter `clear`: It shall be a `Boolean`.");
+					return;
+				}
+			}
+
+			if(clear){
+				Dns_daemon::clear_cache();
+			}
+
+			// .cache = statistics of the resolver cache.
+			const AUTO(stats, Dns_daemon::get_cache_statistics());
+			Json_object obj;
+			obj.set(Rcnts::view("hits"), stats.hits);
+			obj.set(Rcnts::view("negative_hits"), stats.negative_hits);
+			obj.set(Rcnts::view("misses"), stats.misses);
+			obj.set(Rcnts::view("coalesced_requests"), stats.coalesced_requests);
+			obj.set(Rcnts::view("entry_count"), stats.entry_count);
+			resp.set(Rcnts::view("cache"), STD_MOVE_IDN(obj));
+		}
+	};
+
+#ifdef ENABLE_MAGIC
+	struct System_http_servlet_magic : public System_http_servlet_base {
+		const char * get_uri() const FINAL {
+			return "/poseidon/magic";
+		}
+		void handle_get(Json_object &resp) const FINAL {
+			resp.set(Rcnts::view("description"), "View statistics of MIME type detection of the magic daemon.");
+			static const char *const s_param_info[][2] = {
+				{ "clear", "If set to `true`, all cached results will be purged." },
+				{ NULLPTR }
+			};
+			resp.set(Rcnts::view("parameters"), make_help(s_param_info));
+		}
+		void handle_post(Json_object &resp, Json_object req) const FINAL {
+			bool clear = false;
+			if(req.has("clear")){
+				try {
+					clear = req.get("clear").get<bool>();
+				} catch(std::exception &e){
+					POSEIDON_LOG_WARNING("std::exception thrown: ", e.what());
+					resp.set(Rcnts::view("error"), "Invalid parameter `clear`: It shall be a `Boolean`.");
+					return;
+				}
+			}
+
+			if(clear){
+				Magic_daemon::clear_cache();
+			}
+
+			// .magic = statistics of MIME type detection.
+			const AUTO(stats, Magic_daemon::get_statistics());
+			Json_object obj;
+			obj.set(Rcnts::view("signature_hits"), stats.signature_hits);
+			obj.set(Rcnts::view("cache_hits"), stats.cache_hits);
+			obj.set(Rcnts::view("cache_misses"), stats.cache_misses);
+			obj.set(Rcnts::view("cache_entry_count"), stats.cache_entry_count);
+			obj.set(Rcnts::view("cookie_count"), stats.cookie_count);
+			obj.set(Rcnts::view("idle_cookie_count"), stats.idle_cookie_count);
+			resp.set(Rcnts::view("magic"), STD_MOVE_IDN(obj));
+		}
+	};
+#endif
+
+	struct System_http_servlet_http_client : public System_http_servlet_base {
+		const char * get_uri() const FINAL {
+			return "/poseidon/http_client";
+		}
+		void handle_get(Json_object &resp) const FINAL {
+			resp.set(Rcnts::view("description"), "View statistics of the connection pool of the simple HTTP client daemon.");
+			static const char *const s_param_info[][2] = {
+				{ "clear", "If set to `true`, all idle connections will be closed." },
+				{ NULLPTR }
+			};
+			resp.set(Rcnts::view("parameters"), make_help(s_param_info));
+		}
+		void handle_post(Json_object &resp, Json_object req) const FINAL {
+			bool clear = false;
+			if(req.has("clear")){
+				try {
+					clear = req.get("clear").get<bool>();
+				} catch(std::exception &e){
+					POSEIDON_LOG_WARNING("std::exception thrown: ", e.what());
+					resp.set(Rcnts::view("error"), "Invalid parameter `clear`: It shall be a `Boolean`.");
+					return;
+				}
+			}
+
+			if(clear){
+				Simple_http_client_daemon::clear_pool();
+			}
+
+			// .pool = statistics of the connection pool.
+			const AUTO(stats, Simple_http_client_daemon::get_pool_statistics());
+			Json_object obj;
+			obj.set(Rcnts::view("connections_created"), stats.connections_created);
+			obj.set(Rcnts::view("connections_reused"), stats.connections_reused);
+			obj.set(Rcnts::view("requests_pipelined"), stats.requests_pipelined);
+			obj.set(Rcnts::view("stale_retries"), stats.stale_retries);
+			obj.set(Rcnts::view("idle_connections"), stats.idle_connections);
+			obj.set(Rcnts::view("active_connections"), stats.active_connections);
+			resp.set(Rcnts::view("pool"), STD_MOVE_IDN(obj));
+		}
+	};
+
+	struct System_http_servlet_ssl : public System_http_servlet_base {
+		const char * get_uri() const FINAL {
+			return "/poseidon/ssl";
+		}
+		void handle_get(Json_object &resp) const FINAL {
+			resp.set(Rcnts::view("description"), "View statistics of SSL handshakes and the SSL client session store.");
+			static const char *const s_param_info[][2] = {
+				{ "clear", "If set to `true`, all saved client sessions will be purged." },
+				{ NULLPTR }
+			};
+			resp.set(Rcnts::view("parameters"), make_help(s_param_info));
+		}
+		void handle_post(Json_object &resp, Json_object req) const FINAL {
+			bool clear = false;
+			if(req.has("clear")){
+				try {
+					clear = req.get("clear").get<bool>();
+				} catch(std::exception &e){
+					POSEIDON_LOG_WARNING("std::exception thrown: ", e.what());
+					resp.set(Rcnts::view("error"), "Invalid parameter `clear`: It shall be a `Boolean`.");
+					return;
+				}
+			}
+
+			if(clear){
+				Ssl_client_factory::clear_sessions();
+			}
+
+			// .handshakes = counts of full and resumed handshakes.
+			const AUTO(stats, Ssl_filter::get_handshake_statistics());
+			Json_object obj;
+			obj.set(Rcnts::view("full_accepted"), stats.full_accepted);
+			obj.set(Rcnts::view("resumed_accepted"), stats.resumed_accepted);
+			obj.set(Rcnts::view("full_connected"), stats.full_connected);
+			obj.set(Rcnts::view("resumed_connected"), stats.resumed_connected);
+			obj.set(Rcnts::view("kernel_tls_send"), stats.kernel_tls_send);
+			resp.set(Rcnts::view("handshakes"), STD_MOVE_IDN(obj));
+			// .client_session_count = number of saved client sessions.
+			resp.set(Rcnts::view("client_session_count"), Ssl_client_factory::get_session_count());
+		}
+	};
+
 	struct System_http_servlet_modules : public System_http_servlet_base {
 		const char * get_uri() const FINAL {
 			return "/poseidon/modules";
@@ -458,7 +723,16 @@ int main(int argc, char **argv, char **/*envp*/){
 		system_http_servlets.push_back(System_http_server::register_servlet(boost::make_shared<System_http_servlet_help>()));
 		system_http_servlets.push_back(System_http_server::register_servlet(boost::make_shared<System_http_servlet_logger>()));
 		system_http_servlets.push_back(System_http_server::register_servlet(boost::make_shared<System_http_servlet_network>()));
+		system_http_servlets.push_back(System_http_server::register_servlet(boost::make_shared<System_http_servlet_workhorse>()));
+		system_http_servlets.push_back(System_http_server::register_servlet(boost::make_shared<System_http_servlet_metrics>()));
 		system_http_servlets.push_back(System_http_server::register_servlet(boost::make_shared<System_http_servlet_profiler>()));
+		system_http_servlets.push_back(System_http_server::register_servlet(boost::make_shared<System_http_servlet_filesystem>()));
+		system_http_servlets.push_back(System_http_server::register_servlet(boost::make_shared<System_http_servlet_dns>()));
+#ifdef ENABLE_MAGIC
+		system_http_servlets.push_back(System_http_server::register_servlet(boost::make_shared<System_http_servlet_magic>()));
+#endif
+		system_http_servlets.push_back(System_http_server::register_servlet(boost::make_shared<System_http_servlet_http_client>()));
+		system_http_servlets.push_back(System_http_server::register_servlet(boost::make_shared<System_http_servlet_ssl>()));
 		system_http_servlets.push_back(System_http_server::register_servlet(boost::make_shared<System_http_servlet_modules>()));
 
 		if(!all_logs){
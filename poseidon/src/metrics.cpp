@@ -0,0 +1,246 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2018, LH_Mouse. All wrongs reserved.
+
+#include "precompiled.hpp"
+#include "metrics.hpp"
+#include "stream_buffer.hpp"
+#include "atomic.hpp"
+#include "mutex.hpp"
+#include "log.hpp"
+#include <stdio.h>
+
+namespace Poseidon {
+
+namespace {
+	// 指标可能在其他翻译单元的静态初始化过程中构造，因此这里只能使用常量初始化的指针，互斥锁则在第一次使用时构造。
+	Metric_base *g_head = 0; // XXX: NULLPTR
+	Metric_base *g_tail = 0; // XXX: NULLPTR
+
+	Mutex & get_registry_mutex(){
+		static Mutex s_mutex;
+		return s_mutex;
+	}
+
+	volatile std::size_t g_next_shard = 0;
+	__thread std::size_t t_shard_plus_one = 0;
+
+	// 每个线程在第一次写指标时分得一个分片编号，此后保持不变。
+	inline std::size_t get_shard_index() NOEXCEPT {
+		std::size_t shard_plus_one = t_shard_plus_one;
+		if(shard_plus_one == 0){
+			shard_plus_one = atomic_add(g_next_shard, 1, memory_order_relaxed) % Metric_counter::shard_count + 1;
+			t_shard_plus_one = shard_plus_one;
+		}
+		return shard_plus_one - 1;
+	}
+
+	void put_unsigned(Stream_buffer &buffer, boost::uint64_t value){
+		char str[64];
+		const int len = ::snprintf(str, sizeof(str), "%llu", static_cast<unsigned long long>(value));
+		buffer.put(str, static_cast<unsigned>(len));
+	}
+	void put_signed(Stream_buffer &buffer, boost::int64_t value){
+		char str[64];
+		const int len = ::snprintf(str, sizeof(str), "%lld", static_cast<long long>(value));
+		buffer.put(str, static_cast<unsigned>(len));
+	}
+	void put_double(Stream_buffer &buffer, double value){
+		char str[64];
+		const int len = ::snprintf(str, sizeof(str), "%.15g", value);
+		buffer.put(str, static_cast<unsigned>(len));
+	}
+	void put_help(Stream_buffer &buffer, const char *help){
+		for(const char *p = help; *p; ++p){
+			if(*p == '\\'){
+				buffer.put("\\\\");
+			} else if(*p == '\n'){
+				buffer.put("\\n");
+			} else {
+				buffer.put(*p);
+			}
+		}
+	}
+}
+
+void Metric_base::render_all(Stream_buffer &buffer){
+	const Mutex::Unique_lock lock(get_registry_mutex());
+	for(const Metric_base *metric = g_head; metric; metric = metric->m_next){
+		buffer.put("# HELP ");
+		buffer.put(metric->m_name);
+		buffer.put(' ');
+		put_help(buffer, metric->m_help);
+		buffer.put("\n# TYPE ");
+		buffer.put(metric->m_name);
+		buffer.put(' ');
+		buffer.put(metric->get_type());
+		buffer.put('\n');
+		metric->render_samples(buffer);
+	}
+}
+
+Metric_base::Metric_base(const char *name, const char *help)
+	: m_name(name), m_help(help)
+{
+	const Mutex::Unique_lock lock(get_registry_mutex());
+	m_prev = g_tail;
+	m_next = NULLPTR;
+	if(g_tail){
+		g_tail->m_next = this;
+	} else {
+		g_head = this;
+	}
+	g_tail = this;
+}
+Metric_base::~Metric_base(){
+	const Mutex::Unique_lock lock(get_registry_mutex());
+	if(m_prev){
+		m_prev->m_next = m_next;
+	} else {
+		g_head = m_next;
+	}
+	if(m_next){
+		m_next->m_prev = m_prev;
+	} else {
+		g_tail = m_prev;
+	}
+}
+
+Metric_counter::Metric_counter(const char *name, const char *help)
+	: Metric_base(name, help)
+{
+	for(std::size_t i = 0; i < shard_count; ++i){
+		m_shards[i].value = 0;
+	}
+}
+Metric_counter::~Metric_counter(){
+	//
+}
+
+const char * Metric_counter::get_type() const {
+	return "counter";
+}
+void Metric_counter::render_samples(Stream_buffer &buffer) const {
+	buffer.put(get_name());
+	buffer.put(' ');
+	put_unsigned(buffer, get());
+	buffer.put('\n');
+}
+
+void Metric_counter::add(boost::uint64_t delta) NOEXCEPT {
+	atomic_add(m_shards[get_shard_index()].value, delta, memory_order_relaxed);
+}
+boost::uint64_t Metric_counter::get() const NOEXCEPT {
+	boost::uint64_t sum = 0;
+	for(std::size_t i = 0; i < shard_count; ++i){
+		sum += atomic_load(m_shards[i].value, memory_order_relaxed);
+	}
+	return sum;
+}
+
+Metric_gauge::Metric_gauge(const char *name, const char *help)
+	: Metric_base(name, help)
+	, m_value(0)
+{
+	//
+}
+Metric_gauge::~Metric_gauge(){
+	//
+}
+
+const char * Metric_gauge::get_type() const {
+	return "gauge";
+}
+void Metric_gauge::render_samples(Stream_buffer &buffer) const {
+	buffer.put(get_name());
+	buffer.put(' ');
+	put_signed(buffer, get());
+	buffer.put('\n');
+}
+
+void Metric_gauge::set(boost::int64_t value) NOEXCEPT {
+	atomic_store(m_value, value, memory_order_relaxed);
+}
+void Metric_gauge::add(boost::int64_t delta) NOEXCEPT {
+	atomic_add(m_value, delta, memory_order_relaxed);
+}
+void Metric_gauge::subtract(boost::int64_t delta) NOEXCEPT {
+	atomic_sub(m_value, delta, memory_order_relaxed);
+}
+boost::int64_t Metric_gauge::get() const NOEXCEPT {
+	return atomic_load(m_value, memory_order_relaxed);
+}
+
+Metric_histogram::Metric_histogram(const char *name, const char *help, double scale, const boost::uint64_t *bounds_begin, const boost::uint64_t *bounds_end)
+	: Metric_base(name, help)
+	, m_scale(scale), m_bounds(bounds_begin, bounds_end)
+{
+	for(std::size_t i = 1; i < m_bounds.size(); ++i){
+		if(m_bounds.at(i - 1) >= m_bounds.at(i)){
+			POSEIDON_LOG_FATAL("Histogram bounds are not strictly increasing: name = ", name);
+			std::terminate();
+		}
+	}
+	// 每个分片包含各个桶的计数（最后一个是 +Inf 桶）和总和，并按缓存行对齐。
+	const std::size_t cells_per_line = 64 / sizeof(boost::uint64_t);
+	m_stride = (m_bounds.size() + 2 + cells_per_line - 1) / cells_per_line * cells_per_line;
+	// new[] 只保证基本的对齐，因此多分配一个缓存行，从第一个对齐的位置开始使用。
+	const std::size_t cell_count = m_stride * Metric_counter::shard_count + cells_per_line;
+	m_cells.reset(new volatile boost::uint64_t[cell_count]);
+	volatile boost::uint64_t *const cells = m_cells.get();
+	for(std::size_t i = 0; i < cell_count; ++i){
+		cells[i] = 0;
+	}
+	const std::size_t misalignment = reinterpret_cast<boost::uintptr_t>(cells) % 64 / sizeof(boost::uint64_t);
+	m_first_cell = cells + (cells_per_line - misalignment) % cells_per_line;
+}
+Metric_histogram::~Metric_histogram(){
+	//
+}
+
+const char * Metric_histogram::get_type() const {
+	return "histogram";
+}
+void Metric_histogram::render_samples(Stream_buffer &buffer) const {
+	const std::size_t bucket_count = m_bounds.size() + 1;
+	boost::container::vector<boost::uint64_t> counts(bucket_count);
+	boost::uint64_t sum = 0;
+	for(std::size_t shard = 0; shard < Metric_counter::shard_count; ++shard){
+		const volatile boost::uint64_t *const cells = m_first_cell + shard * m_stride;
+		for(std::size_t i = 0; i < bucket_count; ++i){
+			counts.at(i) += atomic_load(cells[i], memory_order_relaxed);
+		}
+		sum += atomic_load(cells[bucket_count], memory_order_relaxed);
+	}
+	boost::uint64_t cumulative = 0;
+	for(std::size_t i = 0; i < bucket_count; ++i){
+		cumulative += counts.at(i);
+		buffer.put(get_name());
+		if(i < m_bounds.size()){
+			buffer.put("_bucket{le=\"");
+			put_double(buffer, static_cast<double>(m_bounds.at(i)) * m_scale);
+			buffer.put("\"}");
+		} else {
+			buffer.put("_bucket{le=\"+Inf\"}");
+		}
+		buffer.put(' ');
+		put_unsigned(buffer, cumulative);
+		buffer.put('\n');
+	}
+	buffer.put(get_name());
+	buffer.put("_sum ");
+	put_double(buffer, static_cast<double>(sum) * m_scale);
+	buffer.put('\n');
+	buffer.put(get_name());
+	buffer.put("_count ");
+	put_unsigned(buffer, cumulative);
+	buffer.put('\n');
+}
+
+void Metric_histogram::observe(boost::uint64_t value) NOEXCEPT {
+	const std::size_t index = static_cast<std::size_t>(std::lower_bound(m_bounds.begin(), m_bounds.end(), value) - m_bounds.begin());
+	volatile boost::uint64_t *const cells = m_first_cell + get_shard_index() * m_stride;
+	atomic_add(cells[index], 1, memory_order_relaxed);
+	atomic_add(cells[m_bounds.size() + 1], value, memory_order_relaxed);
+}
+
+}
@@ -0,0 +1,124 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2018, LH_Mouse. All wrongs reserved.
+
+#ifndef POSEIDON_METRICS_HPP_
+#define POSEIDON_METRICS_HPP_
+
+#include "cxx_ver.hpp"
+#include "cxx_util.hpp"
+#include <boost/cstdint.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/container/vector.hpp>
+#include <cstddef>
+
+namespace Poseidon {
+
+class Stream_buffer;
+
+// 所有指标在构造时自动登记，析构时自动注销，一般定义为命名空间作用域的对象。
+// 名字和说明必须是字符串字面量（或至少和指标本身寿命相同）。
+class Metric_base : NONCOPYABLE {
+public:
+	// 以 Prometheus 文本格式输出所有已登记的指标。
+	static void render_all(Stream_buffer &buffer);
+
+private:
+	const char *const m_name;
+	const char *const m_help;
+
+	Metric_base *m_prev;
+	Metric_base *m_next;
+
+protected:
+	Metric_base(const char *name, const char *help);
+
+public:
+	virtual ~Metric_base();
+
+protected:
+	virtual const char * get_type() const = 0;
+	virtual void render_samples(Stream_buffer &buffer) const = 0;
+
+public:
+	const char * get_name() const {
+		return m_name;
+	}
+	const char * get_help() const {
+		return m_help;
+	}
+};
+
+// 计数器只增不减。每个线程只写自己的分片，读取时再求和，因此热路径上没有竞争。
+class Metric_counter : public Metric_base {
+public:
+	enum {
+		shard_count = 16,
+	};
+
+private:
+	struct Shard {
+		volatile boost::uint64_t value;
+		char padding[64 - sizeof(boost::uint64_t)];
+	};
+
+private:
+	Shard m_shards[shard_count];
+
+public:
+	Metric_counter(const char *name, const char *help);
+	~Metric_counter() OVERRIDE;
+
+protected:
+	const char * get_type() const OVERRIDE;
+	void render_samples(Stream_buffer &buffer) const OVERRIDE;
+
+public:
+	void add(boost::uint64_t delta = 1) NOEXCEPT;
+	boost::uint64_t get() const NOEXCEPT;
+};
+
+// 仪表可增可减，也可以直接设定。
+class Metric_gauge : public Metric_base {
+private:
+	volatile boost::int64_t m_value;
+
+public:
+	Metric_gauge(const char *name, const char *help);
+	~Metric_gauge() OVERRIDE;
+
+protected:
+	const char * get_type() const OVERRIDE;
+	void render_samples(Stream_buffer &buffer) const OVERRIDE;
+
+public:
+	void set(boost::int64_t value) NOEXCEPT;
+	void add(boost::int64_t delta) NOEXCEPT;
+	void subtract(boost::int64_t delta) NOEXCEPT;
+	boost::int64_t get() const NOEXCEPT;
+};
+
+// 直方图。记录的值是整数（例如微秒），输出时乘以 scale 换算为基本单位（例如秒）。
+// bounds 是各个桶的上界（包含），必须严格递增；另有一个隐含的 +Inf 桶。
+class Metric_histogram : public Metric_base {
+private:
+	const double m_scale;
+	boost::container::vector<boost::uint64_t> m_bounds;
+	std::size_t m_stride;
+	boost::scoped_array<volatile boost::uint64_t> m_cells;
+	volatile boost::uint64_t *m_first_cell; // 指向 m_cells 中第一个按缓存行对齐的元素。
+
+public:
+	Metric_histogram(const char *name, const char *help, double scale, const boost::uint64_t *bounds_begin, const boost::uint64_t *bounds_end);
+	~Metric_histogram() OVERRIDE;
+
+protected:
+	const char * get_type() const OVERRIDE;
+	void render_samples(Stream_buffer &buffer) const OVERRIDE;
+
+public:
+	void observe(boost::uint64_t value) NOEXCEPT;
+};
+
+}
+
+#endif
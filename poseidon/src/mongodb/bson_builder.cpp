@@ -251,5 +251,20 @@ void Bson_builder::build_json(std::ostream &os, bool as_array) const {
 	os <<json;
 }
 
+std::string bson_data_to_json(const void *data, std::size_t size){
+	POSEIDON_PROFILE_ME;
+
+	::bson_t bt_storage;
+	POSEIDON_THROW_UNLESS(::bson_init_static(&bt_storage, static_cast<const boost::uint8_t *>(data), size), Basic_exception, Rcnts::view("BSON builder: bson_init_static() failed"));
+	const Unique_handle<Bson_closer> bt_guard(&bt_storage);
+	const AUTO(bt, bt_guard.get());
+
+	const AUTO(json, ::bson_as_json(bt, NULLPTR));
+	POSEIDON_THROW_UNLESS(json, Basic_exception, Rcnts::view("BSON builder: Failed to convert BSON to JSON"));
+	const Unique_handle<Bson_string_deleter> json_guard(json);
+
+	return std::string(json);
+}
+
 }
 }
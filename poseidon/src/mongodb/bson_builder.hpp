@@ -117,6 +117,9 @@ inline std::ostream & operator<<(std::ostream &os, const Bson_builder &rhs){
 	return os;
 }
 
+// 把已经编码的 BSON 文档转换为 JSON。
+extern std::string bson_data_to_json(const void *data, std::size_t size);
+
 inline Bson_builder bson_scalar_boolean(Rcnts name, bool value){
 	Bson_builder ret;
 	ret.append_boolean(STD_MOVE(name), value);
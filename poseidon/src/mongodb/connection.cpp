@@ -147,15 +147,20 @@ namespace {
 		void execute_bson(const Bson_builder &bson) OVERRIDE {
 			POSEIDON_PROFILE_ME;
 
+			POSEIDON_LOG_DEBUG("Sending query to MongoDB server: ", bson.build_json());
 			AUTO(query_data, bson.build(false));
+			execute_raw_bson(query_data.squash(), query_data.size());
+		}
+		void execute_raw_bson(const void *data, std::size_t size) OVERRIDE {
+			POSEIDON_PROFILE_ME;
+
 			::bson_t query_storage;
-			POSEIDON_THROW_ASSERT(::bson_init_static(&query_storage, static_cast<const boost::uint8_t *>(query_data.squash()), query_data.size()));
+			POSEIDON_THROW_ASSERT(::bson_init_static(&query_storage, static_cast<const boost::uint8_t *>(data), size));
 			const Unique_handle<Bson_closer> query_guard(&query_storage);
 			const AUTO(query_bt, query_guard.get());
 
 			discard_result();
 
-			POSEIDON_LOG_DEBUG("Sending query to MongoDB server: ", bson.build_json());
 			::bson_t reply_storage;
 			::bson_error_t err;
 			bool success = ::mongoc_client_command_simple(m_client.get(), m_database.get(), query_bt, NULLPTR, &reply_storage, &err);
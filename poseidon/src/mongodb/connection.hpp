@@ -27,6 +27,8 @@ public:
 
 public:
 	virtual void execute_bson(const Bson_builder &bson) = 0;
+	// data 是已经编码的 BSON 文档，例如 Bson_builder::build() 的结果。
+	virtual void execute_raw_bson(const void *data, std::size_t size) = 0;
 	virtual void discard_result() NOEXCEPT = 0;
 
 	virtual bool fetch_document() = 0;
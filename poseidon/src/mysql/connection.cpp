@@ -39,6 +39,41 @@ namespace {
 		}
 	};
 
+	bool decode_boolean(const char *data, std::size_t size){
+		return (size != 0) && (std::strcmp(data, "0") != 0);
+	}
+	boost::int64_t decode_signed(const char *data, std::size_t /* size */){
+		char *eptr;
+		const boost::int64_t value = ::strtoll(data, &eptr, 0);
+		POSEIDON_THROW_UNLESS(*eptr == 0, Basic_exception, Rcnts::view("Could not convert field data to `long long`"));
+		return value;
+	}
+	boost::uint64_t decode_unsigned(const char *data, std::size_t /* size */){
+		char *eptr;
+		const boost::uint64_t value = ::strtoull(data, &eptr, 0);
+		POSEIDON_THROW_UNLESS(*eptr == 0, Basic_exception, Rcnts::view("Could not convert field data to `unsigned long long`"));
+		return value;
+	}
+	double decode_double(const char *data, std::size_t /* size */){
+		char *eptr;
+		const double value = ::strtod(data, &eptr);
+		POSEIDON_THROW_UNLESS(*eptr == 0, Basic_exception, Rcnts::view("Could not convert field data to `double`"));
+		return value;
+	}
+	std::string decode_string(const char *data, std::size_t size){
+		return std::string(data, size);
+	}
+	boost::uint64_t decode_datetime(const char *data, std::size_t /* size */){
+		return scan_time(data);
+	}
+	Uuid decode_uuid(const char *data, std::size_t size){
+		POSEIDON_THROW_UNLESS(size == 36, Basic_exception, Rcnts::view("Invalid UUID string length"));
+		return Uuid(*reinterpret_cast<const char (*)[36]>(data));
+	}
+	Stream_buffer decode_blob(const char *data, std::size_t size){
+		return Stream_buffer(data, size);
+	}
+
 	class Delegated_connection FINAL : public Connection {
 	private:
 		Rcnts m_schema;
@@ -90,6 +125,22 @@ namespace {
 			size = m_lengths[it->second];
 			return true;
 		}
+		bool find_field_and_check(const char *&data, std::size_t &size, std::size_t index) const {
+			if(!m_row){
+				POSEIDON_LOG_WARNING("No more results available.");
+				return false;
+			}
+			if(index >= m_fields.size()){
+				POSEIDON_LOG_WARNING("Field index out of range: index = ", index);
+				return false;
+			}
+			data = m_row[index];
+			if(!data){
+				return false;
+			}
+			size = m_lengths[index];
+			return true;
+		}
 
 	public:
 		void execute_sql_explicit(const char *sql, std::size_t len) OVERRIDE {
@@ -152,7 +203,7 @@ namespace {
 			const char *data;
 			std::size_t size;
 			if(find_field_and_check(data, size, name)){
-				value = (size != 0) && (std::strcmp(data, "0") != 0);
+				value = decode_boolean(data, size);
 			}
 			return value;
 		}
@@ -164,9 +215,7 @@ namespace {
 			const char *data;
 			std::size_t size;
 			if(find_field_and_check(data, size, name)){
-				char *eptr;
-				value = ::strtoll(data, &eptr, 0);
-				POSEIDON_THROW_UNLESS(*eptr == 0, Basic_exception, Rcnts::view("Could not convert field data to `long long`"));
+				value = decode_signed(data, size);
 			}
 			return value;
 		}
@@ -178,9 +227,7 @@ namespace {
 			const char *data;
 			std::size_t size;
 			if(find_field_and_check(data, size, name)){
-				char *eptr;
-				value = ::strtoull(data, &eptr, 0);
-				POSEIDON_THROW_UNLESS(*eptr == 0, Basic_exception, Rcnts::view("Could not convert field data to `unsigned long long`"));
+				value = decode_unsigned(data, size);
 			}
 			return value;
 		}
@@ -192,9 +239,7 @@ namespace {
 			const char *data;
 			std::size_t size;
 			if(find_field_and_check(data, size, name)){
-				char *eptr;
-				value = ::strtod(data, &eptr);
-				POSEIDON_THROW_UNLESS(*eptr == 0, Basic_exception, Rcnts::view("Could not convert field data to `double`"));
+				value = decode_double(data, size);
 			}
 			return value;
 		}
@@ -206,7 +251,7 @@ namespace {
 			const char *data;
 			std::size_t size;
 			if(find_field_and_check(data, size, name)){
-				value.assign(data, size);
+				value = decode_string(data, size);
 			}
 			return value;
 		}
@@ -218,7 +263,7 @@ namespace {
 			const char *data;
 			std::size_t size;
 			if(find_field_and_check(data, size, name)){
-				value = scan_time(data);
+				value = decode_datetime(data, size);
 			}
 			return value;
 		}
@@ -230,8 +275,7 @@ namespace {
 			const char *data;
 			std::size_t size;
 			if(find_field_and_check(data, size, name)){
-				POSEIDON_THROW_UNLESS(size == 36, Basic_exception, Rcnts::view("Invalid UUID string length"));
-				value.from_string(*reinterpret_cast<const char (*)[36]>(data));
+				value = decode_uuid(data, size);
 			}
 			return value;
 		}
@@ -243,7 +287,88 @@ namespace {
 			const char *data;
 			std::size_t size;
 			if(find_field_and_check(data, size, name)){
-				value.put(data, size);
+				value = decode_blob(data, size);
+			}
+			return value;
+		}
+
+		std::size_t get_field_index(const char *name) const OVERRIDE {
+			const AUTO(it, m_fields.find(name));
+			if(it == m_fields.end()){
+				return static_cast<std::size_t>(-1);
+			}
+			return it->second;
+		}
+
+		bool get_boolean_at(std::size_t index) const OVERRIDE {
+			bool value = false;
+			const char *data;
+			std::size_t size;
+			if(find_field_and_check(data, size, index)){
+				value = decode_boolean(data, size);
+			}
+			return value;
+		}
+		boost::int64_t get_signed_at(std::size_t index) const OVERRIDE {
+			boost::int64_t value = 0;
+			const char *data;
+			std::size_t size;
+			if(find_field_and_check(data, size, index)){
+				value = decode_signed(data, size);
+			}
+			return value;
+		}
+		boost::uint64_t get_unsigned_at(std::size_t index) const OVERRIDE {
+			boost::uint64_t value = 0;
+			const char *data;
+			std::size_t size;
+			if(find_field_and_check(data, size, index)){
+				value = decode_unsigned(data, size);
+			}
+			return value;
+		}
+		double get_double_at(std::size_t index) const OVERRIDE {
+			double value = 0;
+			const char *data;
+			std::size_t size;
+			if(find_field_and_check(data, size, index)){
+				value = decode_double(data, size);
+			}
+			return value;
+		}
+		std::string get_string_at(std::size_t index) const OVERRIDE {
+			std::string value;
+			const char *data;
+			std::size_t size;
+			if(find_field_and_check(data, size, index)){
+				value = decode_string(data, size);
+			}
+			return value;
+		}
+		boost::uint64_t get_datetime_at(std::size_t index) const OVERRIDE {
+			boost::uint64_t value = 0;
+			const char *data;
+			std::size_t size;
+			if(find_field_and_check(data, size, index)){
+				value = decode_datetime(data, size);
+			}
+			return value;
+		}
+		Uuid get_uuid_at(std::size_t index) const OVERRIDE {
+			Uuid value;
+			const char *data;
+			std::size_t size;
+			if(find_field_and_check(data, size, index)){
+				value = decode_uuid(data, size);
+			}
+			return value;
+		}
+		Stream_buffer get_blob_at(std::size_t index) const OVERRIDE {
+			Stream_buffer value;
+			const char *data;
+			std::size_t size;
+			if(find_field_and_check(data, size, index)){
+				value = decode_blob(data, size);
 			}
 			return value;
 		}
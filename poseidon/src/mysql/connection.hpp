@@ -39,6 +39,19 @@ public:
 	virtual Uuid get_uuid(const char *name) const = 0;
 	virtual Stream_buffer get_blob(const char *name) const = 0;
 
+	// 返回当前结果集中指定字段的下标，没有这个字段时返回 -1。
+	// 按下标读取可以避免每一行都按名字查找字段，适合读取大量的行。
+	virtual std::size_t get_field_index(const char *name) const = 0;
+
+	virtual bool get_boolean_at(std::size_t index) const = 0;
+	virtual boost::int64_t get_signed_at(std::size_t index) const = 0;
+	virtual boost::uint64_t get_unsigned_at(std::size_t index) const = 0;
+	virtual double get_double_at(std::size_t index) const = 0;
+	virtual std::string get_string_at(std::size_t index) const = 0;
+	virtual boost::uint64_t get_datetime_at(std::size_t index) const = 0;
+	virtual Uuid get_uuid_at(std::size_t index) const = 0;
+	virtual Stream_buffer get_blob_at(std::size_t index) const = 0;
+
 	void execute_sql(const char *sql, std::size_t len){
 		execute_sql_explicit(sql, len);
 	}
@@ -7,10 +7,16 @@
 #include "../singletons/mysql_daemon.hpp"
 #include "../atomic.hpp"
 #include "../log.hpp"
+#include "../metrics.hpp"
+#include <ostream>
 
 namespace Poseidon {
 namespace Mysql {
 
+namespace {
+	Metric_counter g_coalesced_saves("poseidon_mysql_coalesced_saves_total", "Invalidations of auto-saving MySQL objects that have been merged into an already queued save.");
+}
+
 template class Object_base::Field<bool>;
 template class Object_base::Field<boost::int64_t>;
 template class Object_base::Field<boost::uint64_t>;
@@ -38,6 +44,13 @@ try {
 	if(!is_auto_saving_enabled()){
 		return false;
 	}
+	if(get_combined_write_stamp() && !Mysql_daemon::is_journal_enabled()){
+		// 队列中已经有一个尚未执行的保存操作。数据库线程先清除合并标记，然后才在持有对象锁的情况下生成 SQL 语句，
+		// 而修改字段时也持有对象锁，因此这里看到合并标记，说明这次修改一定会被包含在那条语句中。
+		// 启用日志时每次修改都必须入队，以便记入日志；执行时这些操作仍然会被合并。
+		g_coalesced_saves.add();
+		return true;
+	}
 	Mysql_daemon::enqueue_for_saving(virtual_shared_from_this<Object_base>(), true, false);
 	return true;
 } catch(std::exception &e){
@@ -55,6 +68,35 @@ void Object_base::set_combined_write_stamp(void *stamp) const NOEXCEPT {
 	atomic_store(m_combined_write_stamp, stamp, memory_order_release);
 }
 
+bool Object_base::is_persistent() const NOEXCEPT {
+	return atomic_load(m_persistent, memory_order_consume);
+}
+void Object_base::set_persistent(bool persistent) const NOEXCEPT {
+	atomic_store(m_persistent, persistent, memory_order_release);
+}
+
+void Object_base::generate_save_sql(std::ostream &os, bool to_replace) const {
+	if(to_replace){
+		os <<"REPLACE";
+	} else {
+		os <<"INSERT";
+	}
+	os <<" INTO `" <<get_table() <<"` SET ";
+	generate_sql(os);
+}
+std::string Object_base::generate_primary_key() const {
+	return std::string();
+}
+bool Object_base::has_dirty_fields() const {
+	return true;
+}
+void Object_base::resolve_field_indices(const boost::shared_ptr<const Connection> & /* conn */, boost::container::vector<std::size_t> &indices) const {
+	indices.clear();
+}
+void Object_base::fetch_indexed(const boost::shared_ptr<const Connection> &conn, const boost::container::vector<std::size_t> & /* indices */){
+	fetch(conn);
+}
+
 // Non-member functions.
 void enqueue_for_saving(const boost::shared_ptr<Object_base> &obj){
 	Mysql_daemon::enqueue_for_saving(obj, true, true);
@@ -16,6 +16,7 @@
 #include <boost/shared_ptr.hpp>
 #include <boost/function.hpp>
 #include <boost/cstdint.hpp>
+#include <boost/container/vector.hpp>
 #include <boost/type_traits/is_base_of.hpp>
 #include <boost/utility/enable_if.hpp>
 #include "../rcnts.hpp"
@@ -24,6 +25,7 @@
 #include "../virtual_shared_from_this.hpp"
 #include "../uuid.hpp"
 #include "../stream_buffer.hpp"
+#include "../buffer_streams.hpp"
 
 namespace Poseidon {
 namespace Mysql {
@@ -36,13 +38,14 @@ public:
 private:
 	mutable volatile bool m_auto_saves;
 	mutable void *volatile m_combined_write_stamp;
+	mutable volatile bool m_persistent; // 数据库中已经有这一行。
 
 protected:
 	mutable Recursive_mutex m_mutex;
 
 public:
 	Object_base()
-		: m_auto_saves(false), m_combined_write_stamp(NULLPTR)
+		: m_auto_saves(false), m_combined_write_stamp(NULLPTR), m_persistent(false)
 	{
 		//
 	}
@@ -59,9 +62,26 @@ public:
 	void * get_combined_write_stamp() const NOEXCEPT;
 	void set_combined_write_stamp(void *stamp) const NOEXCEPT;
 
+	bool is_persistent() const NOEXCEPT;
+	void set_persistent(bool persistent) const NOEXCEPT;
+
 	virtual const char * get_table() const = 0;
 	virtual void generate_sql(std::ostream &os) const = 0;
 	virtual void fetch(const boost::shared_ptr<const Connection> &conn) = 0;
+
+	// 生成用于保存的完整 SQL 语句。默认生成 REPLACE（或 INSERT）整行，末尾可能有多余的逗号。
+	// 生成的派生类会在声明了主键时改为只 UPDATE 被修改过的字段，没有字段被修改时什么都不生成，并清除所有字段的修改标记。
+	virtual void generate_save_sql(std::ostream &os, bool to_replace) const;
+
+	// 生成形如 `a` = 1 AND `b` = 'x' 的主键条件，用作对象缓存的键。默认返回空字符串，表示没有声明主键，不能缓存。
+	virtual std::string generate_primary_key() const;
+	// 是否有字段被修改过但尚未保存。默认返回 true。
+	virtual bool has_dirty_fields() const;
+
+	// 在当前结果集中按字段名查找各个字段的下标，每个结果集只需要查找一次。默认什么都不做。
+	virtual void resolve_field_indices(const boost::shared_ptr<const Connection> &conn, boost::container::vector<std::size_t> &indices) const;
+	// 按 resolve_field_indices() 得到的下标读取当前行。默认调用 fetch()。
+	virtual void fetch_indexed(const boost::shared_ptr<const Connection> &conn, const boost::container::vector<std::size_t> &indices);
 };
 
 template<typename ValueT>
@@ -69,10 +89,11 @@ class Object_base::Field : NONCOPYABLE {
 private:
 	Object_base *const m_parent;
 	ValueT m_value;
+	mutable bool m_dirty; // 由 m_parent->m_mutex 保护。
 
 public:
 	explicit Field(Object_base *parent, ValueT value = ValueT())
-		: m_parent(parent), m_value(STD_MOVE_IDN(value))
+		: m_parent(parent), m_value(STD_MOVE_IDN(value)), m_dirty(true)
 	{
 		//
 	}
@@ -88,12 +109,20 @@ public:
 	void set(ValueT value, bool invalidates_parent = true){
 		const Recursive_mutex::Unique_lock lock(m_parent->m_mutex);
 		m_value = STD_MOVE_IDN(value);
+		m_dirty = true;
 
 		if(invalidates_parent){
 			m_parent->invalidate();
 		}
 	}
 
+	bool unlocked_is_dirty() const {
+		return m_dirty;
+	}
+	void unlocked_set_dirty(bool dirty) const {
+		m_dirty = dirty;
+	}
+
 public:
 	operator const ValueT &() const {
 		return unlocked_get();
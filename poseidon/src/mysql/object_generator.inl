@@ -13,6 +13,9 @@
 #  error OBJECT_FIELDS is undefined.
 #endif
 
+// OBJECT_PRIMARY_KEY 是可选的，由 KEY_FIELD(id_) 组成，其中 id_ 必须出现在 OBJECT_FIELDS 中。
+// 声明主键之后，保存时只 UPDATE 被修改过的字段。
+
 #ifndef POSEIDON_MYSQL_OBJECT_BASE_HPP_
 #  error Please #include <poseidon/mysql/object_base.hpp> first.
 #endif
@@ -90,6 +93,11 @@ public:
 	const char *get_table() const OVERRIDE;
 	void generate_sql(::std::ostream &os_) const OVERRIDE;
 	void fetch(const ::boost::shared_ptr<const ::Poseidon::Mysql::Connection> &conn_) OVERRIDE;
+	void resolve_field_indices(const ::boost::shared_ptr<const ::Poseidon::Mysql::Connection> &conn_, ::boost::container::vector< ::std::size_t> &indices_) const OVERRIDE;
+	void fetch_indexed(const ::boost::shared_ptr<const ::Poseidon::Mysql::Connection> &conn_, const ::boost::container::vector< ::std::size_t> &indices_) OVERRIDE;
+	void generate_save_sql(::std::ostream &os_, bool to_replace_) const OVERRIDE;
+	::std::string generate_primary_key() const OVERRIDE;
+	bool has_dirty_fields() const OVERRIDE;
 };
 
 #ifdef MYSQL_OBJECT_EMIT_EXTERNAL_DEFINITIONS
@@ -240,6 +248,241 @@ void OBJECT_NAME::fetch(const ::boost::shared_ptr<const ::Poseidon::Mysql::Conne
 #define FIELD_BLOB(id_)                   id_.set(conn_->get_blob     ( POSEIDON_STRINGIFY(id_) ), false);
 
 	OBJECT_FIELDS
+
+#undef FIELD_BOOLEAN
+#undef FIELD_SIGNED
+#undef FIELD_UNSIGNED
+#undef FIELD_DOUBLE
+#undef FIELD_STRING
+#undef FIELD_DATETIME
+#undef FIELD_UUID
+#undef FIELD_BLOB
+
+#define FIELD_BOOLEAN(id_)                id_.unlocked_set_dirty(false);
+#define FIELD_SIGNED(id_)                 id_.unlocked_set_dirty(false);
+#define FIELD_UNSIGNED(id_)               id_.unlocked_set_dirty(false);
+#define FIELD_DOUBLE(id_)                 id_.unlocked_set_dirty(false);
+#define FIELD_STRING(id_)                 id_.unlocked_set_dirty(false);
+#define FIELD_DATETIME(id_)               id_.unlocked_set_dirty(false);
+#define FIELD_UUID(id_)                   id_.unlocked_set_dirty(false);
+#define FIELD_BLOB(id_)                   id_.unlocked_set_dirty(false);
+
+	OBJECT_FIELDS
+
+	set_persistent(true);
+}
+void OBJECT_NAME::resolve_field_indices(const ::boost::shared_ptr<const ::Poseidon::Mysql::Connection> &conn_, ::boost::container::vector< ::std::size_t> &indices_) const {
+	POSEIDON_PROFILE_ME;
+
+	indices_.clear();
+
+#undef FIELD_BOOLEAN
+#undef FIELD_SIGNED
+#undef FIELD_UNSIGNED
+#undef FIELD_DOUBLE
+#undef FIELD_STRING
+#undef FIELD_DATETIME
+#undef FIELD_UUID
+#undef FIELD_BLOB
+
+#define FIELD_BOOLEAN(id_)                indices_.push_back(conn_->get_field_index( POSEIDON_STRINGIFY(id_) ));
+#define FIELD_SIGNED(id_)                 indices_.push_back(conn_->get_field_index( POSEIDON_STRINGIFY(id_) ));
+#define FIELD_UNSIGNED(id_)               indices_.push_back(conn_->get_field_index( POSEIDON_STRINGIFY(id_) ));
+#define FIELD_DOUBLE(id_)                 indices_.push_back(conn_->get_field_index( POSEIDON_STRINGIFY(id_) ));
+#define FIELD_STRING(id_)                 indices_.push_back(conn_->get_field_index( POSEIDON_STRINGIFY(id_) ));
+#define FIELD_DATETIME(id_)               indices_.push_back(conn_->get_field_index( POSEIDON_STRINGIFY(id_) ));
+#define FIELD_UUID(id_)                   indices_.push_back(conn_->get_field_index( POSEIDON_STRINGIFY(id_) ));
+#define FIELD_BLOB(id_)                   indices_.push_back(conn_->get_field_index( POSEIDON_STRINGIFY(id_) ));
+
+	OBJECT_FIELDS
+}
+void OBJECT_NAME::fetch_indexed(const ::boost::shared_ptr<const ::Poseidon::Mysql::Connection> &conn_, const ::boost::container::vector< ::std::size_t> &indices_){
+	const ::Poseidon::Recursive_mutex::Unique_lock lock_(m_mutex);
+
+	::std::size_t index_ = 0;
+
+#undef FIELD_BOOLEAN
+#undef FIELD_SIGNED
+#undef FIELD_UNSIGNED
+#undef FIELD_DOUBLE
+#undef FIELD_STRING
+#undef FIELD_DATETIME
+#undef FIELD_UUID
+#undef FIELD_BLOB
+
+#define FIELD_BOOLEAN(id_)                id_.set(conn_->get_boolean_at ( indices_.at(index_++) ), false);
+#define FIELD_SIGNED(id_)                 id_.set(conn_->get_signed_at  ( indices_.at(index_++) ), false);
+#define FIELD_UNSIGNED(id_)               id_.set(conn_->get_unsigned_at( indices_.at(index_++) ), false);
+#define FIELD_DOUBLE(id_)                 id_.set(conn_->get_double_at  ( indices_.at(index_++) ), false);
+#define FIELD_STRING(id_)                 id_.set(conn_->get_string_at  ( indices_.at(index_++) ), false);
+#define FIELD_DATETIME(id_)               id_.set(conn_->get_datetime_at( indices_.at(index_++) ), false);
+#define FIELD_UUID(id_)                   id_.set(conn_->get_uuid_at    ( indices_.at(index_++) ), false);
+#define FIELD_BLOB(id_)                   id_.set(conn_->get_blob_at    ( indices_.at(index_++) ), false);
+
+	OBJECT_FIELDS
+
+#undef FIELD_BOOLEAN
+#undef FIELD_SIGNED
+#undef FIELD_UNSIGNED
+#undef FIELD_DOUBLE
+#undef FIELD_STRING
+#undef FIELD_DATETIME
+#undef FIELD_UUID
+#undef FIELD_BLOB
+
+#define FIELD_BOOLEAN(id_)                id_.unlocked_set_dirty(false);
+#define FIELD_SIGNED(id_)                 id_.unlocked_set_dirty(false);
+#define FIELD_UNSIGNED(id_)               id_.unlocked_set_dirty(false);
+#define FIELD_DOUBLE(id_)                 id_.unlocked_set_dirty(false);
+#define FIELD_STRING(id_)                 id_.unlocked_set_dirty(false);
+#define FIELD_DATETIME(id_)               id_.unlocked_set_dirty(false);
+#define FIELD_UUID(id_)                   id_.unlocked_set_dirty(false);
+#define FIELD_BLOB(id_)                   id_.unlocked_set_dirty(false);
+
+	OBJECT_FIELDS
+
+	set_persistent(true);
+}
+void OBJECT_NAME::generate_save_sql(::std::ostream &os_, bool to_replace_) const {
+	POSEIDON_PROFILE_ME;
+
+	const ::Poseidon::Recursive_mutex::Unique_lock lock_(m_mutex);
+
+	// 如果数据库中可能还没有这一行，或者主键被修改过，就只能写入整行。
+	bool partial_ = false;
+#ifdef OBJECT_PRIMARY_KEY
+	bool has_key_ = false;
+	partial_ = to_replace_ && is_persistent();
+
+#undef KEY_FIELD
+#define KEY_FIELD(id_)                    has_key_ = true; partial_ = partial_ && !id_.unlocked_is_dirty();
+
+	OBJECT_PRIMARY_KEY
+	partial_ = partial_ && has_key_;
+#endif
+
+	if(!partial_){
+		::Poseidon::Mysql::Object_base::generate_save_sql(os_, to_replace_);
+
+#undef FIELD_BOOLEAN
+#undef FIELD_SIGNED
+#undef FIELD_UNSIGNED
+#undef FIELD_DOUBLE
+#undef FIELD_STRING
+#undef FIELD_DATETIME
+#undef FIELD_UUID
+#undef FIELD_BLOB
+
+#define FIELD_BOOLEAN(id_)                id_.unlocked_set_dirty(false);
+#define FIELD_SIGNED(id_)                 id_.unlocked_set_dirty(false);
+#define FIELD_UNSIGNED(id_)               id_.unlocked_set_dirty(false);
+#define FIELD_DOUBLE(id_)                 id_.unlocked_set_dirty(false);
+#define FIELD_STRING(id_)                 id_.unlocked_set_dirty(false);
+#define FIELD_DATETIME(id_)               id_.unlocked_set_dirty(false);
+#define FIELD_UUID(id_)                   id_.unlocked_set_dirty(false);
+#define FIELD_BLOB(id_)                   id_.unlocked_set_dirty(false);
+
+		OBJECT_FIELDS
+		return;
+	}
+
+#ifdef OBJECT_PRIMARY_KEY
+	if(!has_dirty_fields()){
+		// 没有字段被修改过，什么都不用做。
+		return;
+	}
+
+	const char *sep_ = "";
+
+#undef FIELD_BOOLEAN
+#undef FIELD_SIGNED
+#undef FIELD_UNSIGNED
+#undef FIELD_DOUBLE
+#undef FIELD_STRING
+#undef FIELD_DATETIME
+#undef FIELD_UUID
+#undef FIELD_BLOB
+
+#define FIELD_BOOLEAN(id_)                if(id_.unlocked_is_dirty()){ os_ <<sep_ <<"`" POSEIDON_STRINGIFY(id_) "` = " <<id_.unlocked_get(); sep_ = ", "; id_.unlocked_set_dirty(false); }
+#define FIELD_SIGNED(id_)                 if(id_.unlocked_is_dirty()){ os_ <<sep_ <<"`" POSEIDON_STRINGIFY(id_) "` = " <<id_.unlocked_get(); sep_ = ", "; id_.unlocked_set_dirty(false); }
+#define FIELD_UNSIGNED(id_)               if(id_.unlocked_is_dirty()){ os_ <<sep_ <<"`" POSEIDON_STRINGIFY(id_) "` = " <<id_.unlocked_get(); sep_ = ", "; id_.unlocked_set_dirty(false); }
+#define FIELD_DOUBLE(id_)                 if(id_.unlocked_is_dirty()){ os_ <<sep_ <<"`" POSEIDON_STRINGIFY(id_) "` = " <<id_.unlocked_get(); sep_ = ", "; id_.unlocked_set_dirty(false); }
+#define FIELD_STRING(id_)                 if(id_.unlocked_is_dirty()){ os_ <<sep_ <<"`" POSEIDON_STRINGIFY(id_) "` = " << ::Poseidon::Mysql::String_escaper(id_.unlocked_get()); sep_ = ", "; id_.unlocked_set_dirty(false); }
+#define FIELD_DATETIME(id_)               if(id_.unlocked_is_dirty()){ os_ <<sep_ <<"`" POSEIDON_STRINGIFY(id_) "` = " << ::Poseidon::Mysql::Date_time_formatter(id_.unlocked_get()); sep_ = ", "; id_.unlocked_set_dirty(false); }
+#define FIELD_UUID(id_)                   if(id_.unlocked_is_dirty()){ os_ <<sep_ <<"`" POSEIDON_STRINGIFY(id_) "` = " << ::Poseidon::Mysql::Uuid_formatter(id_.unlocked_get()); sep_ = ", "; id_.unlocked_set_dirty(false); }
+#define FIELD_BLOB(id_)                   if(id_.unlocked_is_dirty()){ os_ <<sep_ <<"`" POSEIDON_STRINGIFY(id_) "` = " << ::Poseidon::Mysql::String_escaper(id_.unlocked_get()); sep_ = ", "; id_.unlocked_set_dirty(false); }
+
+	os_ <<"UPDATE `" <<get_table() <<"` SET ";
+	OBJECT_FIELDS
+
+	os_ <<" WHERE " <<generate_primary_key();
+#endif
+}
+::std::string OBJECT_NAME::generate_primary_key() const {
+	POSEIDON_PROFILE_ME;
+
+#ifdef OBJECT_PRIMARY_KEY
+	const ::Poseidon::Recursive_mutex::Unique_lock lock_(m_mutex);
+
+	// 主键字段在 OBJECT_FIELDS 中的位置决定了它的类型，因此这里遍历所有字段，逐个判断是否属于主键。
+	::Poseidon::Buffer_ostream os_;
+	const char *sep_ = "";
+	const void *field_ = NULLPTR;
+
+#undef KEY_FIELD
+#define KEY_FIELD(id_)                    || (static_cast<const void *>(&id_) == field_)
+
+#undef FIELD_BOOLEAN
+#undef FIELD_SIGNED
+#undef FIELD_UNSIGNED
+#undef FIELD_DOUBLE
+#undef FIELD_STRING
+#undef FIELD_DATETIME
+#undef FIELD_UUID
+#undef FIELD_BLOB
+
+#define FIELD_BOOLEAN(id_)                field_ = &id_; if(false OBJECT_PRIMARY_KEY){ os_ <<sep_ <<"`" POSEIDON_STRINGIFY(id_) "` = " <<id_.unlocked_get(); sep_ = " AND "; }
+#define FIELD_SIGNED(id_)                 field_ = &id_; if(false OBJECT_PRIMARY_KEY){ os_ <<sep_ <<"`" POSEIDON_STRINGIFY(id_) "` = " <<id_.unlocked_get(); sep_ = " AND "; }
+#define FIELD_UNSIGNED(id_)               field_ = &id_; if(false OBJECT_PRIMARY_KEY){ os_ <<sep_ <<"`" POSEIDON_STRINGIFY(id_) "` = " <<id_.unlocked_get(); sep_ = " AND "; }
+#define FIELD_DOUBLE(id_)                 field_ = &id_; if(false OBJECT_PRIMARY_KEY){ os_ <<sep_ <<"`" POSEIDON_STRINGIFY(id_) "` = " <<id_.unlocked_get(); sep_ = " AND "; }
+#define FIELD_STRING(id_)                 field_ = &id_; if(false OBJECT_PRIMARY_KEY){ os_ <<sep_ <<"`" POSEIDON_STRINGIFY(id_) "` = " << ::Poseidon::Mysql::String_escaper(id_.unlocked_get()); sep_ = " AND "; }
+#define FIELD_DATETIME(id_)               field_ = &id_; if(false OBJECT_PRIMARY_KEY){ os_ <<sep_ <<"`" POSEIDON_STRINGIFY(id_) "` = " << ::Poseidon::Mysql::Date_time_formatter(id_.unlocked_get()); sep_ = " AND "; }
+#define FIELD_UUID(id_)                   field_ = &id_; if(false OBJECT_PRIMARY_KEY){ os_ <<sep_ <<"`" POSEIDON_STRINGIFY(id_) "` = " << ::Poseidon::Mysql::Uuid_formatter(id_.unlocked_get()); sep_ = " AND "; }
+#define FIELD_BLOB(id_)                   field_ = &id_; if(false OBJECT_PRIMARY_KEY){ os_ <<sep_ <<"`" POSEIDON_STRINGIFY(id_) "` = " << ::Poseidon::Mysql::String_escaper(id_.unlocked_get()); sep_ = " AND "; }
+
+	OBJECT_FIELDS
+	return os_.get_buffer().dump_string();
+#else
+	return ::std::string();
+#endif
+}
+bool OBJECT_NAME::has_dirty_fields() const {
+	POSEIDON_PROFILE_ME;
+
+	const ::Poseidon::Recursive_mutex::Unique_lock lock_(m_mutex);
+
+	bool dirty_ = false;
+
+#undef FIELD_BOOLEAN
+#undef FIELD_SIGNED
+#undef FIELD_UNSIGNED
+#undef FIELD_DOUBLE
+#undef FIELD_STRING
+#undef FIELD_DATETIME
+#undef FIELD_UUID
+#undef FIELD_BLOB
+
+#define FIELD_BOOLEAN(id_)                dirty_ = dirty_ || id_.unlocked_is_dirty();
+#define FIELD_SIGNED(id_)                 dirty_ = dirty_ || id_.unlocked_is_dirty();
+#define FIELD_UNSIGNED(id_)               dirty_ = dirty_ || id_.unlocked_is_dirty();
+#define FIELD_DOUBLE(id_)                 dirty_ = dirty_ || id_.unlocked_is_dirty();
+#define FIELD_STRING(id_)                 dirty_ = dirty_ || id_.unlocked_is_dirty();
+#define FIELD_DATETIME(id_)               dirty_ = dirty_ || id_.unlocked_is_dirty();
+#define FIELD_UUID(id_)                   dirty_ = dirty_ || id_.unlocked_is_dirty();
+#define FIELD_BLOB(id_)                   dirty_ = dirty_ || id_.unlocked_is_dirty();
+
+	OBJECT_FIELDS
+	return dirty_;
 }
 
 #pragma GCC diagnostic pop
@@ -247,3 +490,4 @@ void OBJECT_NAME::fetch(const ::boost::shared_ptr<const ::Poseidon::Mysql::Conne
 
 #undef OBJECT_NAME
 #undef OBJECT_FIELDS
+#undef OBJECT_PRIMARY_KEY
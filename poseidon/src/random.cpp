@@ -4,32 +4,153 @@
 #include "precompiled.hpp"
 #include "random.hpp"
 #include "atomic.hpp"
+#include "system_exception.hpp"
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/syscall.h>
 
 namespace Poseidon {
 
 namespace {
-	volatile boost::uint64_t s_seed;
+	// 每次 fork() 之后递增，子进程中的线程据此重新播种，以免和父进程产生相同的序列。
+	volatile unsigned long g_generation = 1;
+
+	void on_fork_child() NOEXCEPT {
+		atomic_add(g_generation, 1, memory_order_relaxed);
+	}
+
+	struct Fork_handler_registrar {
+		Fork_handler_registrar(){
+			::pthread_atfork(NULLPTR, NULLPTR, &on_fork_child);
+		}
+	} const g_fork_handler_registrar;
+
+	// 返回 false 表示系统不支持 getrandom()，此时调用者应当回退到 /dev/urandom。
+	bool get_entropy_syscall(unsigned char *data, std::size_t size){
+#ifdef SYS_getrandom
+		std::size_t offset = 0;
+		while(offset < size){
+			const long result = ::syscall(SYS_getrandom, data + offset, size - offset, 0);
+			if(result < 0){
+				const int err_code = errno;
+				if(err_code == EINTR){
+					continue;
+				}
+				if((err_code == ENOSYS) && (offset == 0)){
+					return false;
+				}
+				POSEIDON_THROW(System_exception, err_code);
+			}
+			offset += static_cast<std::size_t>(result);
+		}
+		return true;
+#else
+		(void)data;
+		(void)size;
+		return false;
+#endif
+	}
+	void get_entropy(void *data, std::size_t size){
+		if(get_entropy_syscall(static_cast<unsigned char *>(data), size)){
+			return;
+		}
+		const int fd = ::open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+		POSEIDON_THROW_UNLESS(fd >= 0, System_exception);
+		std::size_t offset = 0;
+		while(offset < size){
+			const ::ssize_t result = ::read(fd, static_cast<unsigned char *>(data) + offset, size - offset);
+			if(result <= 0){
+				const int err_code = (result == 0) ? EIO : errno;
+				if(err_code == EINTR){
+					continue;
+				}
+				::close(fd);
+				POSEIDON_THROW(System_exception, err_code);
+			}
+			offset += static_cast<std::size_t>(result);
+		}
+		::close(fd);
+	}
+
+	// xoshiro256** by David Blackman and Sebastiano Vigna
+	__thread boost::uint64_t t_state[4];
+	__thread unsigned long t_generation;
+
+	inline boost::uint64_t rotl(boost::uint64_t x, int k) NOEXCEPT {
+		return (x << k) | (x >> (64 - k));
+	}
+	inline boost::uint64_t splitmix64(boost::uint64_t &x) NOEXCEPT {
+		boost::uint64_t z = (x += 0x9E3779B97F4A7C15u);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9u;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBu;
+		return z ^ (z >> 31);
+	}
+
+	__attribute__((__noinline__)) void reseed() NOEXCEPT {
+		boost::uint64_t seed[4];
+		try {
+			get_entropy(seed, sizeof(seed));
+		} catch(std::exception &){
+			// 没有可用的熵源时退而求其次，种子不需要密码学强度。
+			boost::uint64_t x = __builtin_ia32_rdtsc() ^ static_cast<boost::uint64_t>(::syscall(SYS_gettid)) ^ reinterpret_cast<boost::uintptr_t>(&seed);
+			for(unsigned i = 0; i < 4; ++i){
+				seed[i] = splitmix64(x);
+			}
+		}
+		// 全零的状态是不动点。
+		if((seed[0] | seed[1] | seed[2] | seed[3]) == 0){
+			seed[0] = 1;
+		}
+		for(unsigned i = 0; i < 4; ++i){
+			t_state[i] = seed[i];
+		}
+		t_generation = atomic_load(g_generation, memory_order_relaxed);
+	}
+
+	inline boost::uint64_t next() NOEXCEPT {
+		if(__builtin_expect(t_generation != atomic_load(g_generation, memory_order_relaxed), false)){
+			reseed();
+		}
+		boost::uint64_t *const s = t_state;
+		const boost::uint64_t result = rotl(s[1] * 5, 7) * 9;
+		const boost::uint64_t t = s[1] << 17;
+		s[2] ^= s[0];
+		s[3] ^= s[1];
+		s[1] ^= s[2];
+		s[0] ^= s[3];
+		s[2] ^= t;
+		s[3] = rotl(s[3], 45);
+		return result;
+	}
 }
 
 boost::uint32_t random_uint32(){
-	boost::uint64_t old_seed, new_seed;
-	{
-		old_seed = atomic_load(s_seed, memory_order_relaxed);
-		do {
-			new_seed = old_seed;
-			new_seed ^= __builtin_ia32_rdtsc();
-			// MMIX by Donald Knuth
-			new_seed *= 6364136223846793005u;
-			new_seed += 1442695040888963407u;
-		} while(!atomic_compare_exchange(s_seed, old_seed, new_seed, memory_order_relaxed, memory_order_relaxed));
-	}
-	return static_cast<boost::uint32_t>(new_seed >> 32);
+	return static_cast<boost::uint32_t>(next() >> 32);
 }
 boost::uint64_t random_uint64(){
-	return (static_cast<boost::uint64_t>(random_uint32()) << 32) + random_uint32();
+	return next();
 }
 double random_double(){
-	return static_cast<double>(static_cast<boost::int64_t>(random_uint64() >> 1)) / 0x1p63;
+	return static_cast<double>(static_cast<boost::int64_t>(next() >> 11)) / 0x1p53;
+}
+
+void random_fill(void *data, std::size_t size){
+	unsigned char *write = static_cast<unsigned char *>(data);
+	std::size_t remaining = size;
+	while(remaining >= 8){
+		const boost::uint64_t word = next();
+		std::memcpy(write, &word, 8);
+		write += 8;
+		remaining -= 8;
+	}
+	if(remaining != 0){
+		const boost::uint64_t word = next();
+		std::memcpy(write, &word, remaining);
+	}
+}
+void random_fill_secure(void *data, std::size_t size){
+	get_entropy(data, size);
 }
 
 }
@@ -6,12 +6,18 @@
 
 #include <boost/cstdint.hpp>
 #include "cxx_ver.hpp"
+#include <cstddef>
 
 namespace Poseidon {
 
+// 每个线程独立的 xoshiro256** 生成器，种子取自 getrandom()。速度快但不适用于密码学用途。
 extern boost::uint32_t random_uint32();
 extern boost::uint64_t random_uint64();
 extern double random_double();
+extern void random_fill(void *data, std::size_t size);
+
+// 直接从内核获取随机数，用于生成密钥、随机数 (nonce) 等。速度较慢。
+extern void random_fill_secure(void *data, std::size_t size);
 
 struct Random_bit_generator_uint32 {
 	typedef boost::uint32_t result_type;
@@ -4,144 +4,218 @@
 #include "precompiled.hpp"
 #include "sha1.hpp"
 #include "endian.hpp"
-#include <x86intrin.h>
+#include "cpu_features.hpp"
+#if defined(__i386__) || defined(__x86_64__)
+#  include <x86intrin.h>
+#endif
 
 namespace Poseidon {
 
 namespace {
 	CONSTEXPR const boost::array<boost::uint32_t, 5> g_sha1_reg_init = {{ 0x67452301u, 0xEFCDAB89u, 0x98BADCFEu, 0x10325476u, 0xC3D2E1F0u }};
-}
 
-Sha1_streambuf::Sha1_streambuf()
-	: m_reg(g_sha1_reg_init), m_bytes(0)
-{
-	//
-}
-Sha1_streambuf::~Sha1_streambuf(){
-	//
-}
-
-void Sha1_streambuf::eat_chunk(){
-	// https://en.wikipedia.org/wiki/SHA-1
-	boost::array<boost::uint32_t, 80> w;
-	for(std::size_t i = 0; i < 16; ++i){
-		w[i] = load_be(reinterpret_cast<const boost::uint32_t *>(m_chunk.data())[i]);
-	}
-	for(std::size_t i = 16; i < 32; ++i){
-		w[i] = __rold(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
-	}
-	for(std::size_t i = 32; i < 80; ++i){
-		w[i] = __rold(w[i - 6] ^ w[i - 16] ^ w[i - 28] ^ w[i - 32], 2);
+	inline boost::uint32_t rotl(boost::uint32_t value, unsigned bits){
+		return (value << bits) | (value >> (32 - bits));
 	}
 
-	boost::uint32_t a = m_reg[0];
-	boost::uint32_t b = m_reg[1];
-	boost::uint32_t c = m_reg[2];
-	boost::uint32_t d = m_reg[3];
-	boost::uint32_t e = m_reg[4];
+	void eat_chunk_generic(boost::uint32_t *reg, const char *data){
+		// https://en.wikipedia.org/wiki/SHA-1
+		boost::array<boost::uint32_t, 80> w;
+		// 输入未必对齐，先复制出来。
+		std::memcpy(w.data(), data, 64);
+		for(std::size_t i = 0; i < 16; ++i){
+			w[i] = load_be(w[i]);
+		}
+		for(std::size_t i = 16; i < 32; ++i){
+			w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+		}
+		for(std::size_t i = 32; i < 80; ++i){
+			w[i] = rotl(w[i - 6] ^ w[i - 16] ^ w[i - 28] ^ w[i - 32], 2);
+		}
+
+		boost::uint32_t a = reg[0];
+		boost::uint32_t b = reg[1];
+		boost::uint32_t c = reg[2];
+		boost::uint32_t d = reg[3];
+		boost::uint32_t e = reg[4];
 
-	boost::uint32_t f, k;
+		boost::uint32_t f, k;
 
 #define SHA1_STEP(i_, spec_, a_, b_, c_, d_, e_)	\
 	spec_(a_, b_, c_, d_, e_);	\
-	e_ += __rold(a_, 5) + f + k + w[i_];	\
-	b_ = __rold(b_, 30);
+	e_ += rotl(a_, 5) + f + k + w[i_];	\
+	b_ = rotl(b_, 30);
 
 #define SHA1_SPEC_0(a_, b_, c_, d_, e_) (f = d_ ^ (b_ & (c_ ^ d_)), k = 0x5A827999)
 #define SHA1_SPEC_1(a_, b_, c_, d_, e_) (f = b_ ^ c_ ^ d_, k = 0x6ED9EBA1)
 #define SHA1_SPEC_2(a_, b_, c_, d_, e_) (f = (b_ & (c_ | d_)) | (c_ & d_), k = 0x8F1BBCDC)
 #define SHA1_SPEC_3(a_, b_, c_, d_, e_) (f = b_ ^ c_ ^ d_, k = 0xCA62C1D6)
 
-	SHA1_STEP( 0, SHA1_SPEC_0, a, b, c, d, e)
-	SHA1_STEP( 1, SHA1_SPEC_0, e, a, b, c, d)
-	SHA1_STEP( 2, SHA1_SPEC_0, d, e, a, b, c)
-	SHA1_STEP( 3, SHA1_SPEC_0, c, d, e, a, b)
-	SHA1_STEP( 4, SHA1_SPEC_0, b, c, d, e, a)
-	SHA1_STEP( 5, SHA1_SPEC_0, a, b, c, d, e)
-	SHA1_STEP( 6, SHA1_SPEC_0, e, a, b, c, d)
-	SHA1_STEP( 7, SHA1_SPEC_0, d, e, a, b, c)
-	SHA1_STEP( 8, SHA1_SPEC_0, c, d, e, a, b)
-	SHA1_STEP( 9, SHA1_SPEC_0, b, c, d, e, a)
-	SHA1_STEP(10, SHA1_SPEC_0, a, b, c, d, e)
-	SHA1_STEP(11, SHA1_SPEC_0, e, a, b, c, d)
-	SHA1_STEP(12, SHA1_SPEC_0, d, e, a, b, c)
-	SHA1_STEP(13, SHA1_SPEC_0, c, d, e, a, b)
-	SHA1_STEP(14, SHA1_SPEC_0, b, c, d, e, a)
-	SHA1_STEP(15, SHA1_SPEC_0, a, b, c, d, e)
-	SHA1_STEP(16, SHA1_SPEC_0, e, a, b, c, d)
-	SHA1_STEP(17, SHA1_SPEC_0, d, e, a, b, c)
-	SHA1_STEP(18, SHA1_SPEC_0, c, d, e, a, b)
-	SHA1_STEP(19, SHA1_SPEC_0, b, c, d, e, a)
-
-	SHA1_STEP(20, SHA1_SPEC_1, a, b, c, d, e)
-	SHA1_STEP(21, SHA1_SPEC_1, e, a, b, c, d)
-	SHA1_STEP(22, SHA1_SPEC_1, d, e, a, b, c)
-	SHA1_STEP(23, SHA1_SPEC_1, c, d, e, a, b)
-	SHA1_STEP(24, SHA1_SPEC_1, b, c, d, e, a)
-	SHA1_STEP(25, SHA1_SPEC_1, a, b, c, d, e)
-	SHA1_STEP(26, SHA1_SPEC_1, e, a, b, c, d)
-	SHA1_STEP(27, SHA1_SPEC_1, d, e, a, b, c)
-	SHA1_STEP(28, SHA1_SPEC_1, c, d, e, a, b)
-	SHA1_STEP(29, SHA1_SPEC_1, b, c, d, e, a)
-	SHA1_STEP(30, SHA1_SPEC_1, a, b, c, d, e)
-	SHA1_STEP(31, SHA1_SPEC_1, e, a, b, c, d)
-	SHA1_STEP(32, SHA1_SPEC_1, d, e, a, b, c)
-	SHA1_STEP(33, SHA1_SPEC_1, c, d, e, a, b)
-	SHA1_STEP(34, SHA1_SPEC_1, b, c, d, e, a)
-	SHA1_STEP(35, SHA1_SPEC_1, a, b, c, d, e)
-	SHA1_STEP(36, SHA1_SPEC_1, e, a, b, c, d)
-	SHA1_STEP(37, SHA1_SPEC_1, d, e, a, b, c)
-	SHA1_STEP(38, SHA1_SPEC_1, c, d, e, a, b)
-	SHA1_STEP(39, SHA1_SPEC_1, b, c, d, e, a)
-
-	SHA1_STEP(40, SHA1_SPEC_2, a, b, c, d, e)
-	SHA1_STEP(41, SHA1_SPEC_2, e, a, b, c, d)
-	SHA1_STEP(42, SHA1_SPEC_2, d, e, a, b, c)
-	SHA1_STEP(43, SHA1_SPEC_2, c, d, e, a, b)
-	SHA1_STEP(44, SHA1_SPEC_2, b, c, d, e, a)
-	SHA1_STEP(45, SHA1_SPEC_2, a, b, c, d, e)
-	SHA1_STEP(46, SHA1_SPEC_2, e, a, b, c, d)
-	SHA1_STEP(47, SHA1_SPEC_2, d, e, a, b, c)
-	SHA1_STEP(48, SHA1_SPEC_2, c, d, e, a, b)
-	SHA1_STEP(49, SHA1_SPEC_2, b, c, d, e, a)
-	SHA1_STEP(50, SHA1_SPEC_2, a, b, c, d, e)
-	SHA1_STEP(51, SHA1_SPEC_2, e, a, b, c, d)
-	SHA1_STEP(52, SHA1_SPEC_2, d, e, a, b, c)
-	SHA1_STEP(53, SHA1_SPEC_2, c, d, e, a, b)
-	SHA1_STEP(54, SHA1_SPEC_2, b, c, d, e, a)
-	SHA1_STEP(55, SHA1_SPEC_2, a, b, c, d, e)
-	SHA1_STEP(56, SHA1_SPEC_2, e, a, b, c, d)
-	SHA1_STEP(57, SHA1_SPEC_2, d, e, a, b, c)
-	SHA1_STEP(58, SHA1_SPEC_2, c, d, e, a, b)
-	SHA1_STEP(59, SHA1_SPEC_2, b, c, d, e, a)
-
-	SHA1_STEP(60, SHA1_SPEC_3, a, b, c, d, e)
-	SHA1_STEP(61, SHA1_SPEC_3, e, a, b, c, d)
-	SHA1_STEP(62, SHA1_SPEC_3, d, e, a, b, c)
-	SHA1_STEP(63, SHA1_SPEC_3, c, d, e, a, b)
-	SHA1_STEP(64, SHA1_SPEC_3, b, c, d, e, a)
-	SHA1_STEP(65, SHA1_SPEC_3, a, b, c, d, e)
-	SHA1_STEP(66, SHA1_SPEC_3, e, a, b, c, d)
-	SHA1_STEP(67, SHA1_SPEC_3, d, e, a, b, c)
-	SHA1_STEP(68, SHA1_SPEC_3, c, d, e, a, b)
-	SHA1_STEP(69, SHA1_SPEC_3, b, c, d, e, a)
-	SHA1_STEP(70, SHA1_SPEC_3, a, b, c, d, e)
-	SHA1_STEP(71, SHA1_SPEC_3, e, a, b, c, d)
-	SHA1_STEP(72, SHA1_SPEC_3, d, e, a, b, c)
-	SHA1_STEP(73, SHA1_SPEC_3, c, d, e, a, b)
-	SHA1_STEP(74, SHA1_SPEC_3, b, c, d, e, a)
-	SHA1_STEP(75, SHA1_SPEC_3, a, b, c, d, e)
-	SHA1_STEP(76, SHA1_SPEC_3, e, a, b, c, d)
-	SHA1_STEP(77, SHA1_SPEC_3, d, e, a, b, c)
-	SHA1_STEP(78, SHA1_SPEC_3, c, d, e, a, b)
-	SHA1_STEP(79, SHA1_SPEC_3, b, c, d, e, a)
-
-	m_reg[0] += a;
-	m_reg[1] += b;
-	m_reg[2] += c;
-	m_reg[3] += d;
-	m_reg[4] += e;
-	m_bytes += 64;
+		SHA1_STEP( 0, SHA1_SPEC_0, a, b, c, d, e)
+		SHA1_STEP( 1, SHA1_SPEC_0, e, a, b, c, d)
+		SHA1_STEP( 2, SHA1_SPEC_0, d, e, a, b, c)
+		SHA1_STEP( 3, SHA1_SPEC_0, c, d, e, a, b)
+		SHA1_STEP( 4, SHA1_SPEC_0, b, c, d, e, a)
+		SHA1_STEP( 5, SHA1_SPEC_0, a, b, c, d, e)
+		SHA1_STEP( 6, SHA1_SPEC_0, e, a, b, c, d)
+		SHA1_STEP( 7, SHA1_SPEC_0, d, e, a, b, c)
+		SHA1_STEP( 8, SHA1_SPEC_0, c, d, e, a, b)
+		SHA1_STEP( 9, SHA1_SPEC_0, b, c, d, e, a)
+		SHA1_STEP(10, SHA1_SPEC_0, a, b, c, d, e)
+		SHA1_STEP(11, SHA1_SPEC_0, e, a, b, c, d)
+		SHA1_STEP(12, SHA1_SPEC_0, d, e, a, b, c)
+		SHA1_STEP(13, SHA1_SPEC_0, c, d, e, a, b)
+		SHA1_STEP(14, SHA1_SPEC_0, b, c, d, e, a)
+		SHA1_STEP(15, SHA1_SPEC_0, a, b, c, d, e)
+		SHA1_STEP(16, SHA1_SPEC_0, e, a, b, c, d)
+		SHA1_STEP(17, SHA1_SPEC_0, d, e, a, b, c)
+		SHA1_STEP(18, SHA1_SPEC_0, c, d, e, a, b)
+		SHA1_STEP(19, SHA1_SPEC_0, b, c, d, e, a)
+
+		SHA1_STEP(20, SHA1_SPEC_1, a, b, c, d, e)
+		SHA1_STEP(21, SHA1_SPEC_1, e, a, b, c, d)
+		SHA1_STEP(22, SHA1_SPEC_1, d, e, a, b, c)
+		SHA1_STEP(23, SHA1_SPEC_1, c, d, e, a, b)
+		SHA1_STEP(24, SHA1_SPEC_1, b, c, d, e, a)
+		SHA1_STEP(25, SHA1_SPEC_1, a, b, c, d, e)
+		SHA1_STEP(26, SHA1_SPEC_1, e, a, b, c, d)
+		SHA1_STEP(27, SHA1_SPEC_1, d, e, a, b, c)
+		SHA1_STEP(28, SHA1_SPEC_1, c, d, e, a, b)
+		SHA1_STEP(29, SHA1_SPEC_1, b, c, d, e, a)
+		SHA1_STEP(30, SHA1_SPEC_1, a, b, c, d, e)
+		SHA1_STEP(31, SHA1_SPEC_1, e, a, b, c, d)
+		SHA1_STEP(32, SHA1_SPEC_1, d, e, a, b, c)
+		SHA1_STEP(33, SHA1_SPEC_1, c, d, e, a, b)
+		SHA1_STEP(34, SHA1_SPEC_1, b, c, d, e, a)
+		SHA1_STEP(35, SHA1_SPEC_1, a, b, c, d, e)
+		SHA1_STEP(36, SHA1_SPEC_1, e, a, b, c, d)
+		SHA1_STEP(37, SHA1_SPEC_1, d, e, a, b, c)
+		SHA1_STEP(38, SHA1_SPEC_1, c, d, e, a, b)
+		SHA1_STEP(39, SHA1_SPEC_1, b, c, d, e, a)
+
+		SHA1_STEP(40, SHA1_SPEC_2, a, b, c, d, e)
+		SHA1_STEP(41, SHA1_SPEC_2, e, a, b, c, d)
+		SHA1_STEP(42, SHA1_SPEC_2, d, e, a, b, c)
+		SHA1_STEP(43, SHA1_SPEC_2, c, d, e, a, b)
+		SHA1_STEP(44, SHA1_SPEC_2, b, c, d, e, a)
+		SHA1_STEP(45, SHA1_SPEC_2, a, b, c, d, e)
+		SHA1_STEP(46, SHA1_SPEC_2, e, a, b, c, d)
+		SHA1_STEP(47, SHA1_SPEC_2, d, e, a, b, c)
+		SHA1_STEP(48, SHA1_SPEC_2, c, d, e, a, b)
+		SHA1_STEP(49, SHA1_SPEC_2, b, c, d, e, a)
+		SHA1_STEP(50, SHA1_SPEC_2, a, b, c, d, e)
+		SHA1_STEP(51, SHA1_SPEC_2, e, a, b, c, d)
+		SHA1_STEP(52, SHA1_SPEC_2, d, e, a, b, c)
+		SHA1_STEP(53, SHA1_SPEC_2, c, d, e, a, b)
+		SHA1_STEP(54, SHA1_SPEC_2, b, c, d, e, a)
+		SHA1_STEP(55, SHA1_SPEC_2, a, b, c, d, e)
+		SHA1_STEP(56, SHA1_SPEC_2, e, a, b, c, d)
+		SHA1_STEP(57, SHA1_SPEC_2, d, e, a, b, c)
+		SHA1_STEP(58, SHA1_SPEC_2, c, d, e, a, b)
+		SHA1_STEP(59, SHA1_SPEC_2, b, c, d, e, a)
+
+		SHA1_STEP(60, SHA1_SPEC_3, a, b, c, d, e)
+		SHA1_STEP(61, SHA1_SPEC_3, e, a, b, c, d)
+		SHA1_STEP(62, SHA1_SPEC_3, d, e, a, b, c)
+		SHA1_STEP(63, SHA1_SPEC_3, c, d, e, a, b)
+		SHA1_STEP(64, SHA1_SPEC_3, b, c, d, e, a)
+		SHA1_STEP(65, SHA1_SPEC_3, a, b, c, d, e)
+		SHA1_STEP(66, SHA1_SPEC_3, e, a, b, c, d)
+		SHA1_STEP(67, SHA1_SPEC_3, d, e, a, b, c)
+		SHA1_STEP(68, SHA1_SPEC_3, c, d, e, a, b)
+		SHA1_STEP(69, SHA1_SPEC_3, b, c, d, e, a)
+		SHA1_STEP(70, SHA1_SPEC_3, a, b, c, d, e)
+		SHA1_STEP(71, SHA1_SPEC_3, e, a, b, c, d)
+		SHA1_STEP(72, SHA1_SPEC_3, d, e, a, b, c)
+		SHA1_STEP(73, SHA1_SPEC_3, c, d, e, a, b)
+		SHA1_STEP(74, SHA1_SPEC_3, b, c, d, e, a)
+		SHA1_STEP(75, SHA1_SPEC_3, a, b, c, d, e)
+		SHA1_STEP(76, SHA1_SPEC_3, e, a, b, c, d)
+		SHA1_STEP(77, SHA1_SPEC_3, d, e, a, b, c)
+		SHA1_STEP(78, SHA1_SPEC_3, c, d, e, a, b)
+		SHA1_STEP(79, SHA1_SPEC_3, b, c, d, e, a)
+
+		reg[0] += a;
+		reg[1] += b;
+		reg[2] += c;
+		reg[3] += d;
+		reg[4] += e;
+	}
+
+#if defined(__i386__) || defined(__x86_64__)
+	// Intel SHA Extensions，每四轮一组，消息调度与轮函数交错进行。
+#define SHA1_NI_GROUP(g_)	\
+	if((g_) == 0){	\
+		e[0] = _mm_add_epi32(e[0], msg[0]);	\
+	} else {	\
+		e[(g_) % 2] = _mm_sha1nexte_epu32(e[(g_) % 2], msg[(g_) % 4]);	\
+	}	\
+	e[((g_) + 1) % 2] = abcd;	\
+	if((3 <= (g_)) && ((g_) <= 18)){	\
+		msg[((g_) + 1) % 4] = _mm_sha1msg2_epu32(msg[((g_) + 1) % 4], msg[(g_) % 4]);	\
+	}	\
+	abcd = _mm_sha1rnds4_epu32(abcd, e[(g_) % 2], (g_) / 5);	\
+	if((1 <= (g_)) && ((g_) <= 16)){	\
+		msg[((g_) + 3) % 4] = _mm_sha1msg1_epu32(msg[((g_) + 3) % 4], msg[(g_) % 4]);	\
+	}	\
+	if((2 <= (g_)) && ((g_) <= 17)){	\
+		msg[((g_) + 2) % 4] = _mm_xor_si128(msg[((g_) + 2) % 4], msg[(g_) % 4]);	\
+	}
+
+	__attribute__((__target__("sha,sse4.1,ssse3")))
+	void eat_chunks_sha_ni(boost::uint32_t *reg, const char *data, std::size_t count){
+		const __m128i bswap = _mm_set_epi64x(0x0001020304050607, 0x08090A0B0C0D0E0F);
+
+		__m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(reg)), 0x1B);
+		__m128i e0 = _mm_set_epi32(static_cast<int>(reg[4]), 0, 0, 0);
+		for(std::size_t i = 0; i < count; ++i){
+			const char *const chunk = data + i * 64;
+			const __m128i abcd_save = abcd;
+			const __m128i e0_save = e0;
+
+			__m128i msg[4], e[2];
+			for(unsigned j = 0; j < 4; ++j){
+				msg[j] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(chunk + j * 16)), bswap);
+			}
+			e[0] = e0;
+			e[1] = _mm_setzero_si128();
+
+			SHA1_NI_GROUP( 0) SHA1_NI_GROUP( 1) SHA1_NI_GROUP( 2) SHA1_NI_GROUP( 3) SHA1_NI_GROUP( 4)
+			SHA1_NI_GROUP( 5) SHA1_NI_GROUP( 6) SHA1_NI_GROUP( 7) SHA1_NI_GROUP( 8) SHA1_NI_GROUP( 9)
+			SHA1_NI_GROUP(10) SHA1_NI_GROUP(11) SHA1_NI_GROUP(12) SHA1_NI_GROUP(13) SHA1_NI_GROUP(14)
+			SHA1_NI_GROUP(15) SHA1_NI_GROUP(16) SHA1_NI_GROUP(17) SHA1_NI_GROUP(18) SHA1_NI_GROUP(19)
+
+			e0 = _mm_sha1nexte_epu32(e[0], e0_save);
+			abcd = _mm_add_epi32(abcd, abcd_save);
+		}
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(reg), _mm_shuffle_epi32(abcd, 0x1B));
+		reg[4] = static_cast<boost::uint32_t>(_mm_extract_epi32(e0, 3));
+	}
+#endif
+}
+
+Sha1_streambuf::Sha1_streambuf()
+	: m_reg(g_sha1_reg_init), m_bytes(0)
+{
+	//
+}
+Sha1_streambuf::~Sha1_streambuf(){
+	//
+}
+
+void Sha1_streambuf::eat_chunks(const char *data, std::size_t count){
+#if defined(__i386__) || defined(__x86_64__)
+	const AUTO_REF(features, get_cpu_features());
+	if(features.sha && features.sse4_1 && features.ssse3){
+		eat_chunks_sha_ni(m_reg.data(), data, count);
+		m_bytes += count * 64;
+		return;
+	}
+#endif
+	for(std::size_t i = 0; i < count; ++i){
+		eat_chunk_generic(m_reg.data(), data + i * 64);
+	}
+	m_bytes += count * 64;
 }
 
 void Sha1_streambuf::reset() NOEXCEPT {
@@ -151,7 +225,7 @@ void Sha1_streambuf::reset() NOEXCEPT {
 }
 Sha1_streambuf::int_type Sha1_streambuf::overflow(Sha1_streambuf::int_type c){
 	if(pptr() == m_chunk.end()){
-		eat_chunk();
+		eat_chunks(m_chunk.data(), 1);
 		setp(NULLPTR, NULLPTR);
 	}
 	if(traits_type::eq_int_type(c, traits_type::eof())){
@@ -163,6 +237,44 @@ Sha1_streambuf::int_type Sha1_streambuf::overflow(Sha1_streambuf::int_type c){
 	return c;
 }
 
+std::streamsize Sha1_streambuf::xsputn(const char *s, std::streamsize n){
+	if(n <= 0){
+		return 0;
+	}
+	put(s, static_cast<std::size_t>(n));
+	return n;
+}
+
+void Sha1_streambuf::put(const void *data, std::size_t size){
+	const char *read = static_cast<const char *>(data);
+	std::size_t remaining = size;
+	if(pptr()){
+		// 先填满当前块。
+		const std::size_t avail = static_cast<std::size_t>(m_chunk.end() - pptr());
+		const std::size_t n = std::min(avail, remaining);
+		std::memcpy(pptr(), read, n);
+		pbump(static_cast<int>(n));
+		read += n;
+		remaining -= n;
+		if(pptr() != m_chunk.end()){
+			return;
+		}
+		eat_chunks(m_chunk.data(), 1);
+		setp(NULLPTR, NULLPTR);
+	}
+	const std::size_t count = remaining / 64;
+	if(count != 0){
+		eat_chunks(read, count);
+		read += count * 64;
+		remaining -= count * 64;
+	}
+	if(remaining != 0){
+		setp(m_chunk.begin(), m_chunk.end());
+		std::memcpy(pptr(), read, remaining);
+		pbump(static_cast<int>(remaining));
+	}
+}
+
 Sha1 Sha1_streambuf::finalize(){
 	boost::uint64_t bytes = m_bytes;
 	if(pptr()){
@@ -174,7 +286,7 @@ Sha1 Sha1_streambuf::finalize(){
 	store_be(bits, bytes * 8);
 	xsputn(reinterpret_cast<const char *>(&bits), sizeof(bits));
 	if(pptr() == m_chunk.end()){
-		eat_chunk();
+		eat_chunks(m_chunk.data(), 1);
 	}
 
 	Sha1 sha1;
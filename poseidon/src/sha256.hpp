@@ -31,12 +31,16 @@ public:
 	~Sha256_streambuf() OVERRIDE;
 
 private:
-	void eat_chunk();
+	void eat_chunks(const char *data, std::size_t count);
 
 protected:
 	int_type overflow(int_type c = traits_type::eof()) OVERRIDE;
+	std::streamsize xsputn(const char *s, std::streamsize n) OVERRIDE;
 
 public:
+	// 批量输入，完整的块直接从 data 中处理，不经过逐字符的 streambuf 接口。
+	void put(const void *data, std::size_t size);
+
 	void reset() NOEXCEPT;
 	Sha256 finalize();
 };
@@ -12,6 +12,10 @@
 #include "../ip_port.hpp"
 #include "../raii.hpp"
 #include "../profiler.hpp"
+#include "../time.hpp"
+#include "../checked_arithmetic.hpp"
+#include "../multi_index_map.hpp"
+#include "main_config.hpp"
 #include <netdb.h>
 #include <unistd.h>
 
@@ -29,7 +33,7 @@ namespace {
 		}
 	};
 
-	Sock_addr real_dns_look_up(const std::string &host_raw, boost::uint16_t port_raw, bool prefer_ipv4){
+	int real_dns_look_up(Sock_addr &sock_addr, const std::string &host_raw, boost::uint16_t port_raw, bool prefer_ipv4){
 		Unique_handle<Addrinfo_freeer> res;
 		std::string host;
 		if(!host_raw.empty() && (host_raw.begin()[0] == '[') && (host_raw.end()[-1] == ']')){
@@ -44,7 +48,7 @@ namespace {
 		if(gai_code != 0){
 			const char *const err_msg = ::gai_strerror(gai_code);
 			POSEIDON_LOG_DEBUG("DNS lookup failure: host:port = ", host, ":", port, ", gai_code = ", gai_code, ", err_msg = ", err_msg);
-			POSEIDON_THROW(Exception, Rcnts(err_msg));
+			return gai_code;
 		}
 		POSEIDON_THROW_ASSERT(res.reset(res_ptr));
 
@@ -69,44 +73,157 @@ namespace {
 		if(!res_ptr){
 			res_ptr = res.get();
 		}
-		Sock_addr sock_addr(res_ptr->ai_addr, res_ptr->ai_addrlen);
+		sock_addr = Sock_addr(res_ptr->ai_addr, res_ptr->ai_addrlen);
 		POSEIDON_LOG_DEBUG("DNS lookup success: host:port = ", host, ":", port, ", result = ", Ip_port(sock_addr));
+		return 0;
+	}
+
+	struct Lookup_key {
+		std::string host;
+		boost::uint16_t port;
+		bool prefer_ipv4;
+	};
+	bool operator<(const Lookup_key &lhs, const Lookup_key &rhs){
+		const int cmp = lhs.host.compare(rhs.host);
+		if(cmp != 0){
+			return cmp < 0;
+		}
+		if(lhs.port != rhs.port){
+			return lhs.port < rhs.port;
+		}
+		return lhs.prefer_ipv4 < rhs.prefer_ipv4;
+	}
+
+	volatile boost::uint64_t g_cache_ttl = 0;
+	volatile boost::uint64_t g_negative_cache_ttl = 0;
+	volatile std::size_t g_cache_max_count = 0;
+
+	// getaddrinfo() 不提供记录的 TTL，因此使用配置文件中的固定值。
+	struct Cache_element {
+		// Invariants.
+		Lookup_key key;
+		int gai_code;
+		Sock_addr sock_addr;
+		// Indices.
+		boost::uint64_t expiry_time;
+	};
+	POSEIDON_MULTI_INDEX_MAP(Cache_map, Cache_element,
+		POSEIDON_UNIQUE_MEMBER_INDEX(key)
+		POSEIDON_MULTI_MEMBER_INDEX(expiry_time)
+	);
+
+	Mutex g_cache_mutex;
+	Cache_map g_cache_map;
+	volatile boost::uint64_t g_cache_hits = 0;
+	volatile boost::uint64_t g_cache_negative_hits = 0;
+	volatile boost::uint64_t g_cache_misses = 0;
+	volatile boost::uint64_t g_coalesced_requests = 0;
+
+	bool find_in_cache(int &gai_code, Sock_addr &sock_addr, const Lookup_key &key){
+		POSEIDON_PROFILE_ME;
+
+		const AUTO(now, get_fast_mono_clock());
+		const Mutex::Unique_lock lock(g_cache_mutex);
+		const AUTO(it, g_cache_map.find<0>(key));
+		if(it == g_cache_map.end<0>()){
+			return false;
+		}
+		if(it->expiry_time < now){
+			g_cache_map.erase<0>(it);
+			return false;
+		}
+		gai_code = it->gai_code;
+		sock_addr = it->sock_addr;
+		return true;
+	}
+	void insert_into_cache(const Lookup_key &key, int gai_code, const Sock_addr &sock_addr){
+		POSEIDON_PROFILE_ME;
+
+		boost::uint64_t ttl;
+		if(gai_code == 0){
+			ttl = atomic_load(g_cache_ttl, memory_order_consume);
+		} else if((gai_code != EAI_SYSTEM) && (gai_code != EAI_MEMORY)){
+			ttl = atomic_load(g_negative_cache_ttl, memory_order_consume);
+		} else {
+			ttl = 0;
+		}
+		const AUTO(max_count, atomic_load(g_cache_max_count, memory_order_consume));
+		if((ttl == 0) || (max_count == 0)){
+			return;
+		}
+		const AUTO(now, get_fast_mono_clock());
+		Cache_element elem = { key, gai_code, sock_addr, saturated_add(now, ttl) };
+		const Mutex::Unique_lock lock(g_cache_mutex);
+		g_cache_map.erase<0>(key);
+		// 先清除过期的记录，如果仍然超出数量上限，再清除最早过期的。
+		while(!g_cache_map.empty() && ((g_cache_map.begin<1>()->expiry_time < now) || (g_cache_map.size() >= max_count))){
+			g_cache_map.erase<1>(g_cache_map.begin<1>());
+		}
+		g_cache_map.insert(STD_MOVE(elem));
+	}
+
+	Sock_addr cached_dns_look_up(const std::string &host, boost::uint16_t port, bool prefer_ipv4){
+		const Lookup_key key = { host, port, prefer_ipv4 };
+		int gai_code;
+		Sock_addr sock_addr;
+		if(find_in_cache(gai_code, sock_addr, key)){
+			if(gai_code == 0){
+				atomic_add(g_cache_hits, 1, memory_order_relaxed);
+				return sock_addr;
+			}
+			atomic_add(g_cache_negative_hits, 1, memory_order_relaxed);
+		} else {
+			atomic_add(g_cache_misses, 1, memory_order_relaxed);
+			gai_code = real_dns_look_up(sock_addr, host, port, prefer_ipv4);
+			insert_into_cache(key, gai_code, sock_addr);
+		}
+		if(gai_code != 0){
+			POSEIDON_THROW(Exception, Rcnts(::gai_strerror(gai_code)));
+		}
 		return sock_addr;
 	}
 
 	volatile bool g_running = false;
-	Thread g_thread;
+	boost::container::vector<boost::shared_ptr<Thread> > g_threads;
 
+	// 对同一地址的并发请求只解析一次。
 	struct Request_element {
-		boost::weak_ptr<Promise_container<Sock_addr> > weak_promise;
-		std::string host;
-		boost::uint16_t port;
-		bool prefer_ipv4;
+		Lookup_key key;
+		boost::container::vector<boost::weak_ptr<Promise_container<Sock_addr> > > weak_promises;
 	};
 
 	Mutex g_mutex;
 	Condition_variable g_new_request;
-	boost::container::deque<Request_element> g_queue;
+	boost::container::deque<boost::shared_ptr<Request_element> > g_queue;
+	boost::container::map<Lookup_key, boost::shared_ptr<Request_element> > g_pending_requests;
 
 	bool pump_one_element() NOEXCEPT {
 		POSEIDON_PROFILE_ME;
 
-		Request_element *elem;
+		boost::shared_ptr<Request_element> elem;
 		{
 			const Mutex::Unique_lock lock(g_mutex);
 			if(g_queue.empty()){
 				return false;
 			}
-			if(g_queue.front().weak_promise.expired()){
-				g_queue.pop_front();
+			elem = STD_MOVE(g_queue.front());
+			g_queue.pop_front();
+			bool expired = true;
+			for(AUTO(it, elem->weak_promises.begin()); it != elem->weak_promises.end(); ++it){
+				if(!it->expired()){
+					expired = false;
+					break;
+				}
+			}
+			if(expired){
+				g_pending_requests.erase(elem->key);
 				return true;
 			}
-			elem = &g_queue.front();
 		}
 		Sock_addr sock_addr;
 		STD_EXCEPTION_PTR except;
 		try {
-			sock_addr = real_dns_look_up(elem->host, elem->port, elem->prefer_ipv4);
+			sock_addr = cached_dns_look_up(elem->key.host, elem->key.port, elem->key.prefer_ipv4);
 		} catch(std::exception &e){
 			POSEIDON_LOG_WARNING("std::exception thrown: what = ", e.what());
 			except = STD_CURRENT_EXCEPTION();
@@ -114,16 +231,21 @@ namespace {
 			POSEIDON_LOG_WARNING("Unknown exception thrown.");
 			except = STD_CURRENT_EXCEPTION();
 		}
-		const AUTO(promise, elem->weak_promise.lock());
-		if(promise){
+		{
+			const Mutex::Unique_lock lock(g_mutex);
+			g_pending_requests.erase(elem->key);
+		}
+		for(AUTO(it, elem->weak_promises.begin()); it != elem->weak_promises.end(); ++it){
+			const AUTO(promise, it->lock());
+			if(!promise){
+				continue;
+			}
 			if(except){
-				promise->set_exception(STD_MOVE(except), false);
+				promise->set_exception(except, false);
 			} else {
-				promise->set_success(STD_MOVE(sock_addr), false);
+				promise->set_success(sock_addr, false);
 			}
 		}
-		const Mutex::Unique_lock lock(g_mutex);
-		g_queue.pop_front();
 		return true;
 	}
 
@@ -157,7 +279,19 @@ void Dns_daemon::start(){
 	}
 	POSEIDON_LOG(Logger::special_major | Logger::level_info, "Starting DNS daemon...");
 
-	Thread(&thread_proc, Rcnts::view("   D"), Rcnts::view("DNS")).swap(g_thread);
+	atomic_store(g_cache_ttl, Main_config::get<boost::uint64_t>("dns_cache_ttl", 60000), memory_order_release);
+	atomic_store(g_negative_cache_ttl, Main_config::get<boost::uint64_t>("dns_negative_cache_ttl", 5000), memory_order_release);
+	atomic_store(g_cache_max_count, Main_config::get<std::size_t>("dns_cache_max_count", 1024), memory_order_release);
+
+	const AUTO(thread_count, Main_config::get<std::size_t>("dns_thread_count", 2));
+	if(thread_count == 0){
+		POSEIDON_LOG_FATAL("You shall not set `dns_thread_count` in `main.conf` to zero.");
+		std::terminate();
+	}
+	g_threads.resize(thread_count);
+	for(std::size_t i = 0; i < g_threads.size(); ++i){
+		g_threads.at(i) = boost::make_shared<Thread>(&thread_proc, Rcnts::view("   D"), Rcnts::view("DNS"));
+	}
 }
 void Dns_daemon::stop(){
 	if(atomic_exchange(g_running, false, memory_order_acq_rel) == false){
@@ -165,29 +299,75 @@ void Dns_daemon::stop(){
 	}
 	POSEIDON_LOG(Logger::special_major | Logger::level_info, "Stopping DNS daemon...");
 
-	if(g_thread.joinable()){
-		g_thread.join();
+	{
+		const Mutex::Unique_lock lock(g_mutex);
+		g_new_request.broadcast();
+	}
+	for(std::size_t i = 0; i < g_threads.size(); ++i){
+		const AUTO_REF(thread, g_threads.at(i));
+		if(thread->joinable()){
+			thread->join();
+		}
 	}
+	g_threads.clear();
 
 	const Mutex::Unique_lock lock(g_mutex);
 	g_queue.clear();
+	g_pending_requests.clear();
+}
+
+Dns_daemon::Cache_statistics Dns_daemon::get_cache_statistics(){
+	Cache_statistics stats;
+	stats.hits = atomic_load(g_cache_hits, memory_order_relaxed);
+	stats.negative_hits = atomic_load(g_cache_negative_hits, memory_order_relaxed);
+	stats.misses = atomic_load(g_cache_misses, memory_order_relaxed);
+	stats.coalesced_requests = atomic_load(g_coalesced_requests, memory_order_relaxed);
+	const Mutex::Unique_lock lock(g_cache_mutex);
+	stats.entry_count = g_cache_map.size();
+	return stats;
+}
+void Dns_daemon::clear_cache(){
+	const Mutex::Unique_lock lock(g_cache_mutex);
+	g_cache_map.clear();
 }
 
 Sock_addr Dns_daemon::look_up(const std::string &host, boost::uint16_t port, bool prefer_ipv4){
 	POSEIDON_PROFILE_ME;
 
-	return real_dns_look_up(host, port, prefer_ipv4);
+	return cached_dns_look_up(host, port, prefer_ipv4);
 }
 
 boost::shared_ptr<const Promise_container<Sock_addr> > Dns_daemon::enqueue_for_looking_up(std::string host, boost::uint16_t port, bool prefer_ipv4){
 	POSEIDON_PROFILE_ME;
 
 	AUTO(promise, boost::make_shared<Promise_container<Sock_addr> >());
+	Lookup_key key = { STD_MOVE(host), port, prefer_ipv4 };
+	int gai_code;
+	Sock_addr sock_addr;
+	if(find_in_cache(gai_code, sock_addr, key)){
+		if(gai_code == 0){
+			atomic_add(g_cache_hits, 1, memory_order_relaxed);
+			promise->set_success(STD_MOVE(sock_addr));
+		} else {
+			atomic_add(g_cache_negative_hits, 1, memory_order_relaxed);
+			promise->set_exception(STD_MAKE_EXCEPTION_PTR(Exception(__FILE__, __LINE__, __func__, Rcnts(::gai_strerror(gai_code)))));
+		}
+		return STD_MOVE_IDN(promise);
+	}
 	{
 		const Mutex::Unique_lock lock(g_mutex);
-		Request_element elem = { promise, STD_MOVE(host), port, prefer_ipv4 };
-		g_queue.push_back(STD_MOVE(elem));
-		g_new_request.signal();
+		AUTO(it, g_pending_requests.find(key));
+		if(it != g_pending_requests.end()){
+			it->second->weak_promises.push_back(promise);
+			atomic_add(g_coalesced_requests, 1, memory_order_relaxed);
+		} else {
+			AUTO(elem, boost::make_shared<Request_element>());
+			elem->key = STD_MOVE(key);
+			elem->weak_promises.push_back(promise);
+			g_pending_requests.insert(std::make_pair(elem->key, elem));
+			g_queue.push_back(STD_MOVE(elem));
+			g_new_request.signal();
+		}
 	}
 	return STD_MOVE_IDN(promise);
 }
@@ -19,9 +19,21 @@ private:
 	Dns_daemon();
 
 public:
+	struct Cache_statistics {
+		boost::uint64_t hits;
+		boost::uint64_t negative_hits;
+		boost::uint64_t misses;
+		boost::uint64_t coalesced_requests;
+		std::size_t entry_count;
+	};
+
 	static void start();
 	static void stop();
 
+	// 解析结果缓存。
+	static Cache_statistics get_cache_statistics();
+	static void clear_cache();
+
 	// 同步接口。
 	static Sock_addr look_up(const std::string &host, boost::uint16_t port, bool prefer_ipv4 = true);
 
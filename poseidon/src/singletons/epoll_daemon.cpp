@@ -9,6 +9,8 @@
 #include "../atomic.hpp"
 #include "../time.hpp"
 #include "../socket_base.hpp"
+#include "../tcp_server_base.hpp"
+#include "../mutex.hpp"
 #include "../profiler.hpp"
 #include "../recursive_mutex.hpp"
 #include "../raii.hpp"
@@ -185,6 +187,12 @@ namespace {
 		} else {
 			POSEIDON_LOG_DEBUG("Socket read error: socket = ", socket, ", typeid = ", typeid(*socket).name(), ", err_code = ", err_code, " (", get_error_desc(err_code), ")");
 			socket->force_shutdown();
+			// 不要再轮询这个套接字了，否则如果它已经被关闭过，我们会一直空转。
+			const Recursive_mutex::Unique_lock lock(g_mutex);
+			const AUTO(it, g_socket_map.find<0>(socket.get()));
+			if(it != g_socket_map.end<0>()){
+				g_socket_map.set_key<0, 1>(it, -1ull);
+			}
 		}
 		return true;
 	}
@@ -235,6 +243,12 @@ namespace {
 		} else {
 			POSEIDON_LOG_DEBUG("Socket write error: socket = ", socket, ", typeid = ", typeid(*socket).name(), ", err_code = ", err_code, " (", get_error_desc(err_code), ")");
 			socket->force_shutdown();
+			// 不要再轮询这个套接字了，否则如果它已经被关闭过，我们会一直空转。
+			const Recursive_mutex::Unique_lock lock(g_mutex);
+			const AUTO(it, g_socket_map.find<0>(socket.get()));
+			if(it != g_socket_map.end<0>()){
+				g_socket_map.set_key<0, 2>(it, -1ull);
+			}
 		}
 		return true;
 	}
@@ -276,6 +290,162 @@ namespace {
 		return true;
 	}
 
+	class Accept_thread : NONCOPYABLE {
+	private:
+		struct Listener_element {
+			boost::weak_ptr<Tcp_server_base> weak_server;
+			boost::shared_ptr<Unique_file> listener;
+			std::size_t batch_size;
+		};
+
+	private:
+		Thread m_thread;
+		volatile bool m_running;
+		Unique_file m_epoll;
+
+		mutable Mutex m_mutex;
+		boost::container::map<int, Listener_element> m_listeners;
+
+	public:
+		Accept_thread()
+			: m_running(false)
+		{
+			POSEIDON_THROW_UNLESS(m_epoll.reset(::epoll_create(16)), System_exception);
+		}
+
+	private:
+		void pump_one_listener(int fd) NOEXCEPT {
+			POSEIDON_PROFILE_ME;
+
+			boost::shared_ptr<Tcp_server_base> server;
+			boost::shared_ptr<Unique_file> listener; // 其他线程可能会同时关闭这个套接字。
+			std::size_t batch_size;
+			{
+				const Mutex::Unique_lock lock(m_mutex);
+				const AUTO(it, m_listeners.find(fd));
+				if(it == m_listeners.end()){
+					return;
+				}
+				server = it->second.weak_server.lock();
+				if(!server || server->has_been_shutdown_read()){
+					POSEIDON_LOG(Logger::special_major | Logger::level_debug, "Closing listener: fd = ", fd);
+					m_listeners.erase(it);
+					return;
+				}
+				listener = it->second.listener;
+				batch_size = it->second.batch_size;
+			}
+			try {
+				const int err_code = server->accept_and_process(listener->get(), batch_size);
+				POSEIDON_LOG_TRACE("Listener accept result: fd = ", fd, ", err_code = ", err_code, ", batch_size = ", batch_size);
+			} catch(std::exception &e){
+				POSEIDON_LOG_WARNING("std::exception thrown: what = ", e.what());
+			} catch(...){
+				POSEIDON_LOG_WARNING("Unknown exception thrown.");
+			}
+			const Mutex::Unique_lock lock(m_mutex);
+			const AUTO(it, m_listeners.find(fd));
+			if(it != m_listeners.end()){
+				it->second.batch_size = batch_size;
+			}
+		}
+
+	public:
+		void purge_expired_listeners() NOEXCEPT
+		try {
+			POSEIDON_PROFILE_ME;
+
+			// 服务器的析构函数也会调用这个函数，因此不能在持有锁的情况下释放服务器。
+			boost::container::vector<boost::shared_ptr<Tcp_server_base> > servers;
+			const Mutex::Unique_lock lock(m_mutex);
+			servers.reserve(m_listeners.size());
+			AUTO(it, m_listeners.begin());
+			while(it != m_listeners.end()){
+				servers.push_back(it->second.weak_server.lock());
+				const AUTO_REF(server, servers.back());
+				if(server && !server->has_been_shutdown_read()){
+					++it;
+					continue;
+				}
+				POSEIDON_LOG(Logger::special_major | Logger::level_debug, "Closing listener: fd = ", it->first);
+				it = m_listeners.erase(it);
+			}
+		} catch(std::exception &e){
+			POSEIDON_LOG_ERROR("std::exception thrown: what = ", e.what());
+		}
+
+	private:
+		void thread_proc(){
+			POSEIDON_PROFILE_ME;
+			POSEIDON_LOG(Logger::special_major | Logger::level_info, "Accept thread started.");
+
+			for(;;){
+				if(!atomic_load(m_running, memory_order_consume)){
+					break;
+				}
+				boost::array< ::epoll_event, 64> events;
+				const int result = ::epoll_wait(m_epoll.get(), events.data(), static_cast<int>(events.size()), 100);
+				if(result < 0){
+					const int err_code = errno;
+					if(err_code != EINTR){
+						POSEIDON_LOG_ERROR("::epoll_wait() failed! errno was ", err_code, " (", get_error_desc(err_code), ")");
+					}
+					continue;
+				}
+				if(result == 0){
+					purge_expired_listeners();
+					continue;
+				}
+				for(unsigned i = 0; i < static_cast<unsigned>(result); ++i){
+					pump_one_listener(events[i].data.fd);
+				}
+			}
+
+			POSEIDON_LOG(Logger::special_major | Logger::level_info, "Accept thread stopped.");
+		}
+
+	public:
+		void start(){
+			const Mutex::Unique_lock lock(m_mutex);
+			atomic_store(m_running, true, memory_order_release);
+			Thread(boost::bind(&Accept_thread::thread_proc, this), Rcnts::view("   N"), Rcnts::view("Accept")).swap(m_thread);
+		}
+		void stop(){
+			atomic_store(m_running, false, memory_order_release);
+		}
+		void safe_join(){
+			if(m_thread.joinable()){
+				m_thread.join();
+			}
+
+			const Mutex::Unique_lock lock(m_mutex);
+			m_listeners.clear();
+		}
+
+		void add_listener(const boost::shared_ptr<Tcp_server_base> &server, Move<Unique_file> listener){
+			POSEIDON_PROFILE_ME;
+
+			Listener_element elem = { server, boost::make_shared<Unique_file>(), 16 };
+			elem.listener->reset(STD_MOVE(listener));
+			const int fd = elem.listener->get();
+			const Mutex::Unique_lock lock(m_mutex);
+			const AUTO(result, m_listeners.insert(std::make_pair(fd, elem)));
+			POSEIDON_THROW_UNLESS(result.second, Exception, Rcnts::view("Listener is already in epoll"));
+			try {
+				// 使用水平触发，每次唤醒只接受一批连接。
+				::epoll_event event = { };
+				event.events = static_cast<boost::uint32_t>(EPOLLIN);
+				event.data.fd = fd;
+				POSEIDON_THROW_UNLESS(::epoll_ctl(m_epoll.get(), EPOLL_CTL_ADD, fd, &event) == 0, System_exception);
+			} catch(...){
+				m_listeners.erase(result.first);
+				throw;
+			}
+		}
+	};
+
+	boost::container::vector<boost::shared_ptr<Accept_thread> > g_accept_threads;
+
 	void thread_proc(){
 		POSEIDON_PROFILE_ME;
 		POSEIDON_LOG(Logger::special_major | Logger::level_info, "Epoll daemon started.");
@@ -314,6 +484,15 @@ void Epoll_daemon::start(){
 
 	POSEIDON_THROW_UNLESS(g_epoll.reset(::epoll_create(100)), System_exception);
 	Thread(&thread_proc, Rcnts::view("   N"), Rcnts::view("Network")).swap(g_thread);
+
+	const AUTO(accept_thread_count, Main_config::get<std::size_t>("tcp_accept_thread_count", 0));
+	g_accept_threads.resize(accept_thread_count);
+	for(std::size_t i = 0; i < g_accept_threads.size(); ++i){
+		POSEIDON_LOG(Logger::special_major | Logger::level_debug, "Creating new accept thread ", i);
+		const AUTO(thread, boost::make_shared<Accept_thread>());
+		thread->start();
+		g_accept_threads.at(i) = thread;
+	}
 }
 void Epoll_daemon::stop(){
 	if(atomic_exchange(g_running, false, memory_order_acq_rel) == false){
@@ -321,6 +500,15 @@ void Epoll_daemon::stop(){
 	}
 	POSEIDON_LOG(Logger::special_major | Logger::level_info, "Stopping epoll daemon...");
 
+	for(std::size_t i = 0; i < g_accept_threads.size(); ++i){
+		g_accept_threads.at(i)->stop();
+	}
+	for(std::size_t i = 0; i < g_accept_threads.size(); ++i){
+		POSEIDON_LOG(Logger::special_major | Logger::level_debug, "Stopping accept thread ", i);
+		g_accept_threads.at(i)->safe_join();
+	}
+	g_accept_threads.clear();
+
 	if(g_thread.joinable()){
 		g_thread.join();
 	}
@@ -362,6 +550,24 @@ bool Epoll_daemon::mark_socket_writable(const Socket_base *ptr) NOEXCEPT {
 	return true;
 }
 
+std::size_t Epoll_daemon::get_accept_thread_count(){
+	return g_accept_threads.size();
+}
+void Epoll_daemon::add_listener(const boost::shared_ptr<Tcp_server_base> &server, Move<Unique_file> listener, std::size_t thread_hint){
+	POSEIDON_PROFILE_ME;
+	POSEIDON_THROW_UNLESS(!g_accept_threads.empty(), Exception, Rcnts::view("Accept threads are not enabled"));
+
+	const AUTO_REF(thread, g_accept_threads.at(thread_hint % g_accept_threads.size()));
+	thread->add_listener(server, STD_MOVE(listener));
+}
+void Epoll_daemon::purge_listeners() NOEXCEPT {
+	POSEIDON_PROFILE_ME;
+
+	for(std::size_t i = 0; i < g_accept_threads.size(); ++i){
+		g_accept_threads.at(i)->purge_expired_listeners();
+	}
+}
+
 void Epoll_daemon::snapshot(boost::container::vector<Epoll_daemon::Snapshot_element> &ret){
 	POSEIDON_PROFILE_ME;
 
@@ -6,6 +6,7 @@
 
 #include "../cxx_ver.hpp"
 #include "../ip_port.hpp"
+#include "../raii.hpp"
 #include <boost/shared_ptr.hpp>
 #include <boost/container/vector.hpp>
 #include <boost/cstdint.hpp>
@@ -13,6 +14,7 @@
 namespace Poseidon {
 
 class Socket_base;
+class Tcp_server_base;
 
 class Epoll_daemon {
 public:
@@ -35,6 +37,12 @@ public:
 	static void add_socket(const boost::shared_ptr<Socket_base> &socket, bool take_ownership = false);
 	static bool mark_socket_writable(const Socket_base *ptr) NOEXCEPT;
 
+	// 在独立的 accept 线程上监听属于同一个服务器的其他套接字（SO_REUSEPORT 分组）。
+	static std::size_t get_accept_thread_count();
+	static void add_listener(const boost::shared_ptr<Tcp_server_base> &server, Move<Unique_file> listener, std::size_t thread_hint);
+	// 立即关闭所有已经关闭或者析构的服务器的套接字，不再让内核把新连接分配给它们。
+	static void purge_listeners() NOEXCEPT;
+
 	static void snapshot(boost::container::vector<Snapshot_element> &ret);
 };
 
@@ -4,26 +4,37 @@
 #include "../precompiled.hpp"
 #include "event_dispatcher.hpp"
 #include "job_dispatcher.hpp"
+#include "main_config.hpp"
 #include "../event_base.hpp"
 #include "../log.hpp"
+#include "../atomic.hpp"
 #include "../mutex.hpp"
 #include "../job_base.hpp"
 #include "../profiler.hpp"
+#include <boost/unordered_map.hpp>
 
 namespace Poseidon {
 
 typedef Event_dispatcher::Event_listener_callback Event_listener_callback;
 
+namespace {
+	void remove_expired_listeners(std::size_t type_id) NOEXCEPT;
+}
+
 class Event_listener : NONCOPYABLE {
 private:
-	Event_listener_callback m_callback;
+	const std::size_t m_type_id;
+	const Event_listener_callback m_callback;
 
 public:
-	explicit Event_listener(Event_listener_callback callback)
-		: m_callback(STD_MOVE_IDN(callback))
+	Event_listener(std::size_t type_id, Event_listener_callback callback)
+		: m_type_id(type_id), m_callback(STD_MOVE_IDN(callback))
 	{
 		//
 	}
+	~Event_listener(){
+		remove_expired_listeners(m_type_id);
+	}
 
 public:
 	const Event_listener_callback & get_callback() const {
@@ -32,15 +43,96 @@ public:
 };
 
 namespace {
-	struct Type_info_comparator {
-		bool operator()(const std::type_info *lhs, const std::type_info *rhs) const NOEXCEPT {
-			return (*lhs).before(*rhs);
-		}
+	typedef boost::container::vector<boost::weak_ptr<const Event_listener> > Listener_vector;
+
+	// 注册表是不可变的。写者复制一份，修改之后整体替换；读者只需要原子地取得当前的注册表，不需要加锁。
+	struct Registry {
+		// 同一类型在不同的模块中可能有不同的 type_info 对象，因此可能有多个地址对应同一个编号。
+		boost::unordered_map<const std::type_info *, std::size_t> ids_by_address;
+		// 以编号为下标。
+		boost::container::vector<boost::shared_ptr<const Listener_vector> > listeners_by_id;
 	};
-	typedef boost::container::flat_multimap<const std::type_info *, boost::weak_ptr<const Event_listener>, Type_info_comparator> Listener_map;
 
+	volatile bool g_single_job = false;
+
+	// 写者之间用这个互斥锁同步。
 	Mutex g_mutex;
-	Listener_map g_listeners;
+	boost::container::map<std::string, std::size_t> g_ids_by_name;
+	boost::shared_ptr<const Registry> g_registry = boost::make_shared<Registry>();
+
+	boost::shared_ptr<const Registry> get_registry(){
+		return boost::atomic_load(&g_registry);
+	}
+	void set_registry(boost::shared_ptr<const Registry> registry){
+		boost::atomic_store(&g_registry, registry);
+	}
+
+	// 必须在持有 g_mutex 时调用。
+	std::size_t allocate_type_id(boost::shared_ptr<Registry> &registry, const std::type_info &type_info);
+
+	// 编号一旦分配就不会改变，直到 stop() 被调用。
+	std::size_t find_type_id(const std::type_info &type_info){
+		{
+			const AUTO(registry, get_registry());
+			const AUTO(it, registry->ids_by_address.find(&type_info));
+			if(it != registry->ids_by_address.end()){
+				return it->second;
+			}
+		}
+		// 慢速路径：按名字查找，找到之后记下这个地址。
+		// 没有响应器的类型也分配一个编号，这样之后触发同一类型的事件时不需要再加锁。
+		const Mutex::Unique_lock lock(g_mutex);
+		AUTO(registry, boost::make_shared<Registry>(*get_registry()));
+		const std::size_t type_id = allocate_type_id(registry, type_info);
+		set_registry(STD_MOVE_IDN(registry));
+		return type_id;
+	}
+	std::size_t allocate_type_id(boost::shared_ptr<Registry> &registry, const std::type_info &type_info){
+		const AUTO(result, g_ids_by_name.emplace(type_info.name(), registry->listeners_by_id.size()));
+		const std::size_t type_id = result.first->second;
+		if(result.second){
+			registry->listeners_by_id.push_back(boost::make_shared<Listener_vector>());
+		}
+		registry->ids_by_address[&type_info] = type_id;
+		return type_id;
+	}
+
+	void remove_expired_listeners(std::size_t type_id) NOEXCEPT
+	try {
+		const Mutex::Unique_lock lock(g_mutex);
+		const AUTO(old_registry, get_registry());
+		if(type_id >= old_registry->listeners_by_id.size()){
+			// 已经被 stop() 清除。
+			return;
+		}
+		const AUTO_REF(old_listeners, *(old_registry->listeners_by_id.at(type_id)));
+		AUTO(listeners, boost::make_shared<Listener_vector>());
+		listeners->reserve(old_listeners.size());
+		for(AUTO(it, old_listeners.begin()); it != old_listeners.end(); ++it){
+			if(!it->expired()){
+				listeners->push_back(*it);
+			}
+		}
+		AUTO(registry, boost::make_shared<Registry>(*old_registry));
+		registry->listeners_by_id.at(type_id) = STD_MOVE_IDN(listeners);
+		set_registry(STD_MOVE_IDN(registry));
+	} catch(std::exception &e){
+		// 失效的响应器会被读者跳过，留在注册表中并不影响正确性。
+		POSEIDON_LOG_WARNING("std::exception thrown: what = ", e.what());
+	}
+
+	// 把事件依次投递给多个响应器。每个响应器抛出的异常都单独处理，不影响其他响应器。
+	void deliver(const boost::container::vector<boost::shared_ptr<const Event_listener> > &listeners, const boost::shared_ptr<Event_base> &event){
+		for(AUTO(it, listeners.begin()); it != listeners.end(); ++it){
+			try {
+				(*it)->get_callback()(event);
+			} catch(std::exception &e){
+				POSEIDON_LOG_WARNING("std::exception thrown: what = ", e.what());
+			} catch(...){
+				POSEIDON_LOG_WARNING("Unknown exception thrown");
+			}
+		}
+	}
 
 	class Event_job : public Job_base {
 	private:
@@ -68,30 +160,75 @@ namespace {
 			listener->get_callback()(m_event);
 		}
 	};
+
+	// 一个任务投递给所有响应器。
+	class Batched_event_job : public Job_base {
+	private:
+		const boost::container::vector<boost::weak_ptr<const Event_listener> > m_weak_listeners;
+		const boost::shared_ptr<Event_base> m_event;
+
+	public:
+		Batched_event_job(const boost::container::vector<boost::shared_ptr<const Event_listener> > &listeners, boost::shared_ptr<Event_base> event)
+			: m_weak_listeners(listeners.begin(), listeners.end()), m_event(STD_MOVE(event))
+		{
+			//
+		}
+
+	protected:
+		boost::weak_ptr<const void> get_category() const OVERRIDE {
+			return m_event;
+		}
+		void perform() OVERRIDE {
+			POSEIDON_PROFILE_ME;
+
+			boost::container::vector<boost::shared_ptr<const Event_listener> > listeners;
+			listeners.reserve(m_weak_listeners.size());
+			for(AUTO(it, m_weak_listeners.begin()); it != m_weak_listeners.end(); ++it){
+				AUTO(listener, it->lock());
+				if(listener){
+					listeners.push_back(STD_MOVE_IDN(listener));
+				}
+			}
+			deliver(listeners, m_event);
+		}
+	};
 }
 
 void Event_dispatcher::start(){
 	POSEIDON_LOG(Logger::special_major | Logger::level_info, "Starting event dispatcher...");
 
-	//
+	atomic_store(g_single_job, Main_config::get<bool>("event_async_single_job", false), memory_order_release);
 }
 void Event_dispatcher::stop(){
 	POSEIDON_LOG(Logger::special_major | Logger::level_info, "Stopping event dispatcher...");
 
 	const Mutex::Unique_lock lock(g_mutex);
-	g_listeners.clear();
+	g_ids_by_name.clear();
+	set_registry(boost::make_shared<Registry>());
+}
+
+void Event_dispatcher::clear_cache() NOEXCEPT
+try {
+	const Mutex::Unique_lock lock(g_mutex);
+	AUTO(registry, boost::make_shared<Registry>(*get_registry()));
+	registry->ids_by_address.clear();
+	set_registry(STD_MOVE_IDN(registry));
+} catch(std::exception &e){
+	POSEIDON_LOG_WARNING("std::exception thrown: what = ", e.what());
 }
 
 void Event_dispatcher::get_listeners(boost::container::vector<boost::shared_ptr<const Event_listener> > &ret, const std::type_info &type_info){
 	POSEIDON_PROFILE_ME;
 
-	const Mutex::Unique_lock lock(g_mutex);
-	const AUTO(range, g_listeners.equal_range(&type_info));
-	ret.reserve(ret.size() + static_cast<std::size_t>(std::distance(range.first, range.second)));
-	bool expired;
-	for(AUTO(it, range.first); it != range.second; expired ? (it = g_listeners.erase(it)) : ++it){
-		AUTO(listener, it->second.lock());
-		expired = !listener;
+	const std::size_t type_id = find_type_id(type_info);
+	const AUTO(registry, get_registry());
+	if(type_id >= registry->listeners_by_id.size()){
+		return;
+	}
+	const AUTO_REF(listeners, *(registry->listeners_by_id.at(type_id)));
+	ret.reserve(ret.size() + listeners.size());
+	for(AUTO(it, listeners.begin()); it != listeners.end(); ++it){
+		AUTO(listener, it->lock());
 		if(listener){
 			ret.push_back(STD_MOVE_IDN(listener));
 		}
@@ -101,12 +238,17 @@ void Event_dispatcher::get_listeners(boost::container::vector<boost::shared_ptr<
 boost::shared_ptr<const Event_listener> Event_dispatcher::register_listener_explicit(const std::type_info &type_info, Event_listener_callback callback){
 	POSEIDON_PROFILE_ME;
 
-	AUTO(listener, boost::make_shared<Event_listener>(STD_MOVE_IDN(callback)));
-	{
-		const Mutex::Unique_lock lock(g_mutex);
-		g_listeners.emplace(&type_info, listener);
-	}
-	return STD_MOVE_IDN(listener);
+	// 析构函数需要加锁，因此 listener 必须在锁之前定义。
+	boost::shared_ptr<const Event_listener> listener;
+	const Mutex::Unique_lock lock(g_mutex);
+	AUTO(registry, boost::make_shared<Registry>(*get_registry()));
+	const std::size_t type_id = allocate_type_id(registry, type_info);
+	listener = boost::make_shared<Event_listener>(type_id, STD_MOVE_IDN(callback));
+	AUTO(listeners, boost::make_shared<Listener_vector>(*(registry->listeners_by_id.at(type_id))));
+	listeners->push_back(listener);
+	registry->listeners_by_id.at(type_id) = STD_MOVE_IDN(listeners);
+	set_registry(STD_MOVE_IDN(registry));
+	return listener;
 }
 
 void Event_dispatcher::sync_raise(const boost::shared_ptr<Event_base> &event){
@@ -124,6 +266,13 @@ void Event_dispatcher::async_raise(const boost::shared_ptr<Event_base> &event, c
 
 	boost::container::vector<boost::shared_ptr<const Event_listener> > listeners;
 	get_listeners(listeners, typeid(*event));
+	if(listeners.empty()){
+		return;
+	}
+	if(atomic_load(g_single_job, memory_order_consume) && (listeners.size() > 1)){
+		Job_dispatcher::enqueue(boost::make_shared<Batched_event_job>(listeners, event), withdrawn);
+		return;
+	}
 	for(AUTO(it, listeners.begin()); it != listeners.end(); ++it){
 		AUTO_REF(listener, *it);
 		Job_dispatcher::enqueue(boost::make_shared<Event_job>(STD_MOVE_IDN(listener), event), withdrawn);
@@ -28,6 +28,9 @@ public:
 	static void start();
 	static void stop();
 
+	// 清除 type_info 地址到编号的缓存，已经分配的编号不变。卸载模块之后调用，防止新的类型复用已卸载的地址。
+	static void clear_cache() NOEXCEPT;
+
 	static void get_listeners(boost::container::vector<boost::shared_ptr<const Event_listener> > &ret, const std::type_info &type_inf);
 
 	// 返回的 shared_ptr 是该响应器的唯一持有者。
@@ -6,7 +6,9 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <sys/uio.h>
 #include <unistd.h>
+#include "main_config.hpp"
 #include "../thread.hpp"
 #include "../mutex.hpp"
 #include "../condition_variable.hpp"
@@ -16,13 +18,81 @@
 #include "../raii.hpp"
 #include "../promise.hpp"
 #include "../profiler.hpp"
+#include "../multi_index_map.hpp"
 
 namespace Poseidon {
 
 template class Promise_container<File_block_read>;
 
 namespace {
-	File_block_read real_load(const std::string &path, boost::uint64_t begin, boost::uint64_t limit, bool throws_if_does_not_exist){
+	volatile std::size_t g_cache_max_size = 0;
+	volatile std::size_t g_cache_max_block_size = 0;
+
+	// 文件块缓存。键为路径和读取范围，按最后访问时间淘汰。
+	struct Block_cache_key {
+		std::string path;
+		boost::uint64_t begin;
+		boost::uint64_t limit;
+	};
+	bool operator<(const Block_cache_key &lhs, const Block_cache_key &rhs){
+		const int cmp = lhs.path.compare(rhs.path);
+		if(cmp != 0){
+			return cmp < 0;
+		}
+		if(lhs.begin != rhs.begin){
+			return lhs.begin < rhs.begin;
+		}
+		return lhs.limit < rhs.limit;
+	}
+
+	struct Block_cache_element {
+		// Invariants.
+		Block_cache_key key;
+		::dev_t dev;
+		::ino_t ino;
+		boost::uint64_t mtime;
+		File_block_read block;
+		// Indices.
+		boost::uint64_t access_stamp;
+	};
+	POSEIDON_MULTI_INDEX_MAP(Block_cache_map, Block_cache_element,
+		POSEIDON_UNIQUE_MEMBER_INDEX(key)
+		POSEIDON_MULTI_MEMBER_INDEX(access_stamp)
+	);
+
+	Mutex g_cache_mutex;
+	Block_cache_map g_cache_map;
+	std::size_t g_cache_size = 0;
+	boost::uint64_t g_cache_stamp = 0;
+	volatile boost::uint64_t g_cache_hits = 0;
+	volatile boost::uint64_t g_cache_misses = 0;
+
+	boost::uint64_t get_mtime_ns(const struct ::stat &stat_buf){
+		return static_cast<boost::uint64_t>(stat_buf.st_mtim.tv_sec) * 1000000000 + static_cast<boost::uint64_t>(stat_buf.st_mtim.tv_nsec);
+	}
+
+	// 必须在持有 g_cache_mutex 时调用。
+	void erase_cached_block(Block_cache_map::iterator it){
+		g_cache_size -= it->block.data.size();
+		g_cache_map.erase(it);
+	}
+	void invalidate_cached_blocks(const std::string &path){
+		POSEIDON_PROFILE_ME;
+
+		if(atomic_load(g_cache_max_size, memory_order_consume) == 0){
+			return;
+		}
+		const Block_cache_key key_begin = { path, 0, 0 };
+		const Mutex::Unique_lock lock(g_cache_mutex);
+		AUTO(it, g_cache_map.lower_bound<0>(key_begin));
+		while((it != g_cache_map.end<0>()) && (it->key.path == path)){
+			const AUTO(next, boost::next(it));
+			erase_cached_block(it);
+			it = next;
+		}
+	}
+
+	File_block_read real_load(const std::string &path, boost::uint64_t begin, boost::uint64_t limit, bool throws_if_does_not_exist, struct ::stat *stat_ret = NULLPTR){
 		File_block_read block = { };
 
 		int flags = O_RDONLY;
@@ -41,20 +111,17 @@ namespace {
 			POSEIDON_LOG_ERROR("Failed to retrieve file information: path = ", path, ", err_code = ", err_code);
 			POSEIDON_THROW(System_exception, err_code);
 		}
-		if(begin != 0){
-			if(::lseek(file.get(), static_cast< ::off_t>(begin), SEEK_SET) == (::off_t)-1){
-				const int err_code = errno;
-				POSEIDON_LOG_ERROR("Failed to seek file: path = ", path, ", err_code = ", err_code);
-				POSEIDON_THROW(System_exception, err_code);
-			}
+		if(stat_ret){
+			*stat_ret = stat_buf;
 		}
 
 		block.size_total = static_cast<boost::uint64_t>(stat_buf.st_size);
 		block.begin = begin;
 
-		std::size_t bytes_read = 0;
+		boost::uint64_t bytes_read = 0;
+		// 文件可能在 fstat() 之后被追加或者截断，或者不是普通文件（例如 /proc 下的文件），因此一直读取到 EOF 为止。
 		for(;;){
-			char temp[16384];
+			char temp[65536];
 			std::size_t avail;
 			if(limit == File_system_daemon::limit_eof){
 				avail = sizeof(temp);
@@ -64,12 +131,15 @@ namespace {
 			if(avail == 0){
 				break;
 			}
-			const ::ssize_t result = ::read(file.get(), temp, avail);
+			const ::ssize_t result = ::pread(file.get(), temp, avail, static_cast< ::off_t>(begin + bytes_read));
 			if(result == 0){
 				break;
 			}
 			if(result < 0){
 				const int err_code = errno;
+				if(err_code == EINTR){
+					continue;
+				}
 				POSEIDON_LOG_ERROR("Error loading file: path = ", path, ", err_code = ", err_code);
 				POSEIDON_THROW(System_exception, err_code);
 			}
@@ -80,6 +150,55 @@ namespace {
 		POSEIDON_LOG_DEBUG("Finished loading file: path = ", path, ", bytes_read = ", bytes_read);
 		return block;
 	}
+	File_block_read real_load_cached(const std::string &path, boost::uint64_t begin, boost::uint64_t limit, bool throws_if_does_not_exist){
+		const AUTO(cache_max_size, atomic_load(g_cache_max_size, memory_order_consume));
+		if(cache_max_size == 0){
+			return real_load(path, begin, limit, throws_if_does_not_exist);
+		}
+
+		// 使用 mtime、inode 和文件大小来检测缓存是否过期。
+		struct ::stat stat_buf;
+		if((::stat(path.c_str(), &stat_buf) == 0) && S_ISREG(stat_buf.st_mode)){
+			const Block_cache_key key = { path, begin, limit };
+			const Mutex::Unique_lock lock(g_cache_mutex);
+			const AUTO(it, g_cache_map.find<0>(key));
+			if(it != g_cache_map.end<0>()){
+				if((it->dev == stat_buf.st_dev) && (it->ino == stat_buf.st_ino) && (it->mtime == get_mtime_ns(stat_buf)) && (it->block.size_total == static_cast<boost::uint64_t>(stat_buf.st_size))){
+					g_cache_map.set_key<0, 1>(it, ++g_cache_stamp);
+					atomic_add(g_cache_hits, 1, memory_order_relaxed);
+					POSEIDON_LOG_TRACE("File block cache hit: path = ", path, ", begin = ", begin, ", limit = ", limit);
+					return it->block;
+				}
+				erase_cached_block(it);
+			}
+		}
+		atomic_add(g_cache_misses, 1, memory_order_relaxed);
+
+		struct ::stat stat_loaded = { };
+		AUTO(block, real_load(path, begin, limit, throws_if_does_not_exist, &stat_loaded));
+		if(!S_ISREG(stat_loaded.st_mode)){
+			return block;
+		}
+		const AUTO(block_size, block.data.size());
+		if((block_size > atomic_load(g_cache_max_block_size, memory_order_consume)) || (block_size > cache_max_size)){
+			return block;
+		}
+		Block_cache_element elem = { { path, begin, limit }, stat_loaded.st_dev, stat_loaded.st_ino, get_mtime_ns(stat_loaded), block };
+		const Mutex::Unique_lock lock(g_cache_mutex);
+		const AUTO(old_it, g_cache_map.find<0>(elem.key));
+		if(old_it != g_cache_map.end<0>()){
+			erase_cached_block(old_it);
+		}
+		while(!g_cache_map.empty() && (cache_max_size - g_cache_size < block_size)){
+			const AUTO(lru_it, g_cache_map.begin<1>());
+			g_cache_size -= lru_it->block.data.size();
+			g_cache_map.erase<1>(lru_it);
+		}
+		elem.access_stamp = ++g_cache_stamp;
+		g_cache_map.insert(STD_MOVE(elem));
+		g_cache_size += block_size;
+		return block;
+	}
 	void real_save(const std::string &path, Stream_buffer data, boost::uint64_t begin, bool throws_if_exists){
 		int flags = O_CREAT | O_WRONLY;
 		if(begin == File_system_daemon::offset_append){
@@ -96,32 +215,47 @@ namespace {
 			POSEIDON_LOG_ERROR("Failed to save file: path = ", path, ", err_code = ", err_code);
 			POSEIDON_THROW(System_exception, err_code);
 		}
-		if(!(flags & (O_APPEND | O_TRUNC)) && (begin != 0)){
-			if(::lseek(file.get(), static_cast< ::off_t>(begin), SEEK_SET) == (::off_t)-1){
-				const int err_code = errno;
-				POSEIDON_LOG_ERROR("Failed to seek file: path = ", path, ", err_code = ", err_code);
-				POSEIDON_THROW(System_exception, err_code);
-			}
-		}
 
-		std::size_t bytes_written = 0;
-		for(;;){
-			char temp[16384];
-			std::size_t avail = data.get(temp, sizeof(temp));
-			if(avail == 0){
-				break;
+		const bool positional = !(flags & (O_APPEND | O_TRUNC));
+		boost::uint64_t bytes_written = 0;
+		while(!data.empty()){
+			// 把多个块合并到一次系统调用中写入。
+			::iovec vecs[64];
+			int count = 0;
+			Stream_buffer::Enumeration_cookie cookie;
+			void *chunk_data;
+			std::size_t chunk_size;
+			while((count < static_cast<int>(sizeof(vecs) / sizeof(vecs[0]))) && data.enumerate_chunk(&chunk_data, &chunk_size, cookie)){
+				if(chunk_size == 0){
+					continue;
+				}
+				vecs[count].iov_base = chunk_data;
+				vecs[count].iov_len = chunk_size;
+				++count;
+			}
+			::ssize_t result;
+			if(positional){
+				result = ::pwritev(file.get(), vecs, count, static_cast< ::off_t>(begin + bytes_written));
+			} else {
+				result = ::writev(file.get(), vecs, count);
 			}
-			::ssize_t result = ::write(file.get(), temp, avail);
 			if(result < 0){
 				const int err_code = errno;
+				if(err_code == EINTR){
+					continue;
+				}
 				POSEIDON_LOG_ERROR("Error saving file: path = ", path, ", err_code = ", err_code);
 				POSEIDON_THROW(System_exception, err_code);
 			}
-			bytes_written += avail;
+			data.discard(static_cast<std::size_t>(result));
+			bytes_written += static_cast<std::size_t>(result);
 		}
+		invalidate_cached_blocks(path);
 		POSEIDON_LOG_DEBUG("Finished saving file: path = ", path, ", bytes_written = ", bytes_written);
 	}
 	void real_remove(const std::string &path, bool throws_if_does_not_exist){
+		invalidate_cached_blocks(path);
+
 		if(::unlink(path.c_str()) != 0){
 			const int err_code = errno;
 			if(!throws_if_does_not_exist && (err_code == ENOENT)){
@@ -132,6 +266,9 @@ namespace {
 		}
 	}
 	void real_rename(const std::string &path, const std::string &new_path){
+		invalidate_cached_blocks(path);
+		invalidate_cached_blocks(new_path);
+
 		if(::rename(path.c_str(), new_path.c_str()) != 0){
 			const int err_code = errno;
 			POSEIDON_LOG_ERROR("Failed to rename file: path = ", path, ", err_code = ", err_code);
@@ -185,6 +322,10 @@ namespace {
 		virtual boost::shared_ptr<Promise> get_promise() const {
 			return m_weak_promise.lock();
 		}
+		// 删除、重命名和目录操作会影响其他路径，必须和之前、之后提交的所有操作保持先后顺序。
+		virtual bool is_ordered_globally() const {
+			return false;
+		}
 		virtual void execute() = 0;
 	};
 
@@ -211,7 +352,7 @@ namespace {
 				POSEIDON_LOG_DEBUG("Discarding isolated loading operation: path = ", get_path());
 				return;
 			}
-			AUTO(block, real_load(get_path(), m_begin, m_limit, m_throws_if_does_not_exist));
+			AUTO(block, real_load_cached(get_path(), m_begin, m_limit, m_throws_if_does_not_exist));
 			m_promised_block->set_success(STD_MOVE(block));
 		}
 	};
@@ -251,6 +392,9 @@ namespace {
 		}
 
 	public:
+		bool is_ordered_globally() const OVERRIDE {
+			return true;
+		}
 		void execute() OVERRIDE {
 			POSEIDON_PROFILE_ME;
 
@@ -271,6 +415,9 @@ namespace {
 		}
 
 	public:
+		bool is_ordered_globally() const OVERRIDE {
+			return true;
+		}
 		void execute() OVERRIDE {
 			POSEIDON_PROFILE_ME;
 
@@ -291,6 +438,9 @@ namespace {
 		}
 
 	public:
+		bool is_ordered_globally() const OVERRIDE {
+			return true;
+		}
 		void execute() OVERRIDE {
 			POSEIDON_PROFILE_ME;
 
@@ -311,6 +461,9 @@ namespace {
 		}
 
 	public:
+		bool is_ordered_globally() const OVERRIDE {
+			return true;
+		}
 		void execute() OVERRIDE {
 			POSEIDON_PROFILE_ME;
 
@@ -318,80 +471,207 @@ namespace {
 		}
 	};
 
-	volatile bool g_running = false;
-	Thread g_thread;
+	// 需要全局排序的操作在每个线程的队列中各放入一个栅栏。其余线程都到达栅栏之后这个操作才执行，执行完毕之后其余线程才继续。
+	// 栅栏总是在持有 g_router_mutex 的情况下放入所有队列，因此每个线程看到的栅栏顺序都相同，不会死锁。
+	class Fence : NONCOPYABLE {
+	private:
+		mutable Mutex m_mutex;
+		mutable Condition_variable m_cond;
+		std::size_t m_pending; // 尚未到达栅栏的其余线程数。
+		bool m_released;
 
-	struct Operation_queue_element {
-		boost::shared_ptr<Operation_base> operation;
+	public:
+		explicit Fence(std::size_t pending)
+			: m_pending(pending), m_released(false)
+		{
+			//
+		}
+
+	public:
+		void arrive_and_wait(){
+			Mutex::Unique_lock lock(m_mutex);
+			--m_pending;
+			m_cond.broadcast();
+			while(!m_released){
+				m_cond.wait(lock);
+			}
+		}
+		void wait_for_others(){
+			Mutex::Unique_lock lock(m_mutex);
+			while((m_pending != 0) && !m_released){
+				m_cond.wait(lock);
+			}
+		}
+		void release() NOEXCEPT {
+			const Mutex::Unique_lock lock(m_mutex);
+			m_released = true;
+			m_cond.broadcast();
+		}
 	};
 
-	Mutex g_mutex;
-	Condition_variable g_new_operation;
-	boost::container::deque<Operation_queue_element> g_operations;
+	class File_system_thread : NONCOPYABLE {
+	private:
+		struct Operation_queue_element {
+			boost::shared_ptr<Operation_base> operation; // 为空表示这是其他线程上的操作的栅栏。
+			boost::shared_ptr<Fence> fence;
+		};
 
-	bool pump_one_element() NOEXCEPT {
-		POSEIDON_PROFILE_ME;
+	private:
+		Thread m_thread;
+		volatile bool m_running;
 
-		Operation_queue_element *elem;
+		mutable Mutex m_mutex;
+		mutable Condition_variable m_new_operation;
+		boost::container::deque<Operation_queue_element> m_queue;
+
+	public:
+		File_system_thread()
+			: m_running(false)
+			, m_queue()
 		{
-			const Mutex::Unique_lock lock(g_mutex);
-			if(g_operations.empty()){
-				return false;
+			//
+		}
+
+	private:
+		bool pump_one_operation() NOEXCEPT {
+			POSEIDON_PROFILE_ME;
+
+			Operation_queue_element *elem;
+			{
+				const Mutex::Unique_lock lock(m_mutex);
+				if(m_queue.empty()){
+					return false;
+				}
+				elem = &m_queue.front();
 			}
-			elem = &g_operations.front();
-		}
-		STD_EXCEPTION_PTR except;
-		try {
-			elem->operation->execute();
-		} catch(std::exception &e){
-			POSEIDON_LOG_WARNING("std::exception thrown: what = ", e.what());
-			except = STD_CURRENT_EXCEPTION();
-		} catch(...){
-			POSEIDON_LOG_WARNING("Unknown exception thrown.");
-			except = STD_CURRENT_EXCEPTION();
-		}
-		const AUTO(promise, elem->operation->get_promise());
-		if(promise){
-			if(except){
-				promise->set_exception(STD_MOVE(except), false);
-			} else {
-				promise->set_success(false);
+			if(!elem->operation){
+				elem->fence->arrive_and_wait();
+				const Mutex::Unique_lock lock(m_mutex);
+				m_queue.pop_front();
+				return true;
+			}
+			if(elem->fence){
+				elem->fence->wait_for_others();
+			}
+			STD_EXCEPTION_PTR except;
+			try {
+				elem->operation->execute();
+			} catch(std::exception &e){
+				POSEIDON_LOG_WARNING("std::exception thrown: what = ", e.what());
+				except = STD_CURRENT_EXCEPTION();
+			} catch(...){
+				POSEIDON_LOG_WARNING("Unknown exception thrown.");
+				except = STD_CURRENT_EXCEPTION();
 			}
+			const AUTO(promise, elem->operation->get_promise());
+			if(promise){
+				if(except){
+					promise->set_exception(STD_MOVE(except), false);
+				} else {
+					promise->set_success(false);
+				}
+			}
+			if(elem->fence){
+				elem->fence->release();
+			}
+			const Mutex::Unique_lock lock(m_mutex);
+			m_queue.pop_front();
+			return true;
 		}
-		const Mutex::Unique_lock lock(g_mutex);
-		g_operations.pop_front();
-		return true;
-	}
 
-	void thread_proc(){
-		POSEIDON_PROFILE_ME;
-		POSEIDON_LOG(Logger::special_major | Logger::level_info, "File_system daemon started.");
+		void thread_proc(){
+			POSEIDON_PROFILE_ME;
+			POSEIDON_LOG(Logger::special_major | Logger::level_info, "File_system thread started.");
+
+			unsigned timeout = 0;
+			for(;;){
+				bool busy;
+				do {
+					busy = pump_one_operation();
+					timeout = std::min(timeout * 2u + 1u, !busy * 100u);
+				} while(busy);
+
+				Mutex::Unique_lock lock(m_mutex);
+				if(!atomic_load(m_running, memory_order_consume)){
+					break;
+				}
+				m_new_operation.timed_wait(lock, timeout);
+			}
 
-		unsigned timeout = 0;
-		for(;;){
-			bool busy;
-			do {
-				busy = pump_one_element();
-				timeout = std::min(timeout * 2u + 1u, !busy * 100u);
-			} while(busy);
-
-			Mutex::Unique_lock lock(g_mutex);
-			if(!atomic_load(g_running, memory_order_consume)){
-				break;
+			POSEIDON_LOG(Logger::special_major | Logger::level_info, "File_system thread stopped.");
+		}
+
+	public:
+		void start(){
+			const Mutex::Unique_lock lock(m_mutex);
+			Thread(boost::bind(&File_system_thread::thread_proc, this), Rcnts::view(" F  "), Rcnts::view("Filesystem")).swap(m_thread);
+			atomic_store(m_running, true, memory_order_release);
+		}
+		void stop(){
+			atomic_store(m_running, false, memory_order_release);
+		}
+		void safe_join(){
+			if(m_thread.joinable()){
+				m_thread.join();
 			}
-			g_new_operation.timed_wait(lock, timeout);
+
+			const Mutex::Unique_lock lock(m_mutex);
+			m_queue.clear();
 		}
 
-		POSEIDON_LOG(Logger::special_major | Logger::level_info, "File_system daemon stopped.");
-	}
+		void add_operation(boost::shared_ptr<Operation_base> operation, boost::shared_ptr<Fence> fence = boost::shared_ptr<Fence>()){
+			POSEIDON_PROFILE_ME;
+
+			const Mutex::Unique_lock lock(m_mutex);
+			POSEIDON_THROW_UNLESS(atomic_load(m_running, memory_order_consume), Exception, Rcnts::view("File_system thread is being shut down"));
+			Operation_queue_element elem = { STD_MOVE(operation), STD_MOVE(fence) };
+			m_queue.push_back(STD_MOVE(elem));
+			m_new_operation.signal();
+		}
+	};
+
+	volatile bool g_running = false;
+
+	Mutex g_router_mutex;
+	boost::container::vector<boost::shared_ptr<File_system_thread> > g_threads;
 
 	void submit_operation(boost::shared_ptr<Operation_base> operation){
 		POSEIDON_PROFILE_ME;
 
-		const Mutex::Unique_lock lock(g_mutex);
-		Operation_queue_element elem = { STD_MOVE(operation) };
-		g_operations.push_back(STD_MOVE(elem));
-		g_new_operation.signal();
+		if(operation->is_ordered_globally()){
+			const Mutex::Unique_lock lock(g_router_mutex);
+			POSEIDON_THROW_UNLESS(!g_threads.empty(), Basic_exception, Rcnts::view("File_system support is not enabled"));
+			if(g_threads.size() == 1){
+				g_threads.front()->add_operation(STD_MOVE(operation));
+				return;
+			}
+			const AUTO(fence, boost::make_shared<Fence>(g_threads.size() - 1));
+			try {
+				for(std::size_t i = 1; i < g_threads.size(); ++i){
+					g_threads.at(i)->add_operation(boost::shared_ptr<Operation_base>(), fence);
+				}
+				g_threads.front()->add_operation(STD_MOVE(operation), fence);
+			} catch(...){
+				// 已经放入队列的栅栏不能永远等待下去。
+				fence->release();
+				throw;
+			}
+			return;
+		}
+
+		// 同一路径上的操作总是交给同一个线程，以保证其执行顺序。
+		const AUTO_REF(path, operation->get_path());
+		boost::uint32_t hash = 2166136261u;
+		for(AUTO(it, path.begin()); it != path.end(); ++it){
+			hash = (hash ^ static_cast<unsigned char>(*it)) * 16777619u;
+		}
+		boost::shared_ptr<File_system_thread> thread;
+		{
+			const Mutex::Unique_lock lock(g_router_mutex);
+			POSEIDON_THROW_UNLESS(!g_threads.empty(), Basic_exception, Rcnts::view("File_system support is not enabled"));
+			thread = g_threads.at(hash % g_threads.size());
+		}
+		thread->add_operation(STD_MOVE(operation));
 	}
 }
 
@@ -402,7 +682,28 @@ void File_system_daemon::start(){
 	}
 	POSEIDON_LOG(Logger::special_major | Logger::level_info, "Starting File_system daemon...");
 
-	Thread(&thread_proc, Rcnts::view(" F  "), Rcnts::view("Filesystem")).swap(g_thread);
+	atomic_store(g_cache_max_block_size, Main_config::get<std::size_t>("filesystem_cache_max_block_size", 1048576), memory_order_release);
+	atomic_store(g_cache_max_size, Main_config::get<std::size_t>("filesystem_cache_max_size", 16777216), memory_order_release);
+
+	const AUTO(thread_count, Main_config::get<std::size_t>("filesystem_thread_count", 2));
+	if(thread_count == 0){
+		POSEIDON_LOG_FATAL("You shall not set `filesystem_thread_count` in `main.conf` to zero.");
+		std::terminate();
+	}
+	boost::container::vector<boost::shared_ptr<File_system_thread> > threads;
+	threads.resize(thread_count);
+	for(std::size_t i = 0; i < threads.size(); ++i){
+		POSEIDON_LOG(Logger::special_major | Logger::level_debug, "Creating new file_system thread ", i);
+		const AUTO(thread, boost::make_shared<File_system_thread>());
+		thread->start();
+		threads.at(i) = thread;
+	}
+	{
+		const Mutex::Unique_lock lock(g_router_mutex);
+		g_threads.swap(threads);
+	}
+
+	POSEIDON_LOG(Logger::special_major | Logger::level_info, "File_system daemon started.");
 }
 void File_system_daemon::stop(){
 	if(atomic_exchange(g_running, false, memory_order_acq_rel) == false){
@@ -410,18 +711,47 @@ void File_system_daemon::stop(){
 	}
 	POSEIDON_LOG(Logger::special_major | Logger::level_info, "Stopping File_system daemon...");
 
-	if(g_thread.joinable()){
-		g_thread.join();
+	// 先摘下所有线程，之后提交的操作会失败，而不会访问正在销毁的线程。
+	boost::container::vector<boost::shared_ptr<File_system_thread> > threads;
+	{
+		const Mutex::Unique_lock lock(g_router_mutex);
+		threads.swap(g_threads);
+	}
+	for(std::size_t i = 0; i < threads.size(); ++i){
+		threads.at(i)->stop();
 	}
+	for(std::size_t i = 0; i < threads.size(); ++i){
+		POSEIDON_LOG(Logger::special_major | Logger::level_debug, "Stopping file_system thread ", i);
+		threads.at(i)->safe_join();
+	}
+	threads.clear();
+
+	atomic_store(g_cache_max_size, 0, memory_order_release);
+	File_system_daemon::clear_cache();
 
-	const Mutex::Unique_lock lock(g_mutex);
-	g_operations.clear();
+	POSEIDON_LOG(Logger::special_major | Logger::level_info, "File_system daemon stopped.");
+}
+
+File_system_daemon::Cache_statistics File_system_daemon::get_cache_statistics(){
+	Cache_statistics stats;
+	stats.hits = atomic_load(g_cache_hits, memory_order_relaxed);
+	stats.misses = atomic_load(g_cache_misses, memory_order_relaxed);
+	stats.max_size = atomic_load(g_cache_max_size, memory_order_relaxed);
+	const Mutex::Unique_lock lock(g_cache_mutex);
+	stats.entry_count = g_cache_map.size();
+	stats.size = g_cache_size;
+	return stats;
+}
+void File_system_daemon::clear_cache(){
+	const Mutex::Unique_lock lock(g_cache_mutex);
+	g_cache_map.clear();
+	g_cache_size = 0;
 }
 
 File_block_read File_system_daemon::load(const std::string &path, boost::uint64_t begin, boost::uint64_t limit, bool throws_if_does_not_exist){
 	POSEIDON_PROFILE_ME;
 
-	return real_load(path, begin, limit, throws_if_does_not_exist);
+	return real_load_cached(path, begin, limit, throws_if_does_not_exist);
 }
 void File_system_daemon::save(const std::string &path, Stream_buffer data, boost::uint64_t begin, bool throws_if_exists){
 	POSEIDON_PROFILE_ME;
@@ -29,6 +29,14 @@ public:
 		offset_truncate  = -3ull,
 	};
 
+	struct Cache_statistics {
+		boost::uint64_t hits;
+		boost::uint64_t misses;
+		std::size_t entry_count;
+		std::size_t size;
+		std::size_t max_size;
+	};
+
 private:
 	File_system_daemon();
 
@@ -36,6 +44,10 @@ public:
 	static void start();
 	static void stop();
 
+	// 文件块缓存。
+	static Cache_statistics get_cache_statistics();
+	static void clear_cache();
+
 	// 同步接口。
 	static File_block_read load(const std::string &path, boost::uint64_t begin = 0, boost::uint64_t limit = limit_eof, bool throws_if_does_not_exist = true);
 	static void save(const std::string &path, Stream_buffer data, boost::uint64_t begin = offset_truncate, bool throws_if_exists = false);
@@ -45,6 +57,7 @@ public:
 	static void rmdir(const std::string &path, bool throws_if_does_not_exist = true);
 
 	// 异步接口。
+	// 同一路径上的操作按提交顺序执行；不同路径上的操作可能被分派到不同线程而并发执行。
 	static boost::shared_ptr<const Promise_container<File_block_read> > enqueue_for_loading(std::string path, boost::uint64_t begin = 0, boost::uint64_t limit = limit_eof, bool throws_if_does_not_exist = true);
 	static boost::shared_ptr<const Promise> enqueue_for_saving(std::string path, Stream_buffer data, boost::uint64_t begin = offset_truncate, bool throws_if_exists = false);
 	static boost::shared_ptr<const Promise> enqueue_for_removing(std::string path, bool throws_if_does_not_exist = true);
@@ -17,10 +17,15 @@
 #include "../condition_variable.hpp"
 #include "../time.hpp"
 #include "../checked_arithmetic.hpp"
+#include "../metrics.hpp"
 
 namespace Poseidon {
 
 namespace {
+	Metric_counter g_jobs_enqueued("poseidon_jobs_enqueued_total", "Jobs that have been enqueued into the job dispatcher.");
+	Metric_gauge g_jobs_pending("poseidon_jobs_pending", "Jobs that have been enqueued and not yet completed, including suspended ones.");
+	Metric_gauge g_fiber_count("poseidon_fibers", "Fibers that exist in the job dispatcher, one for each category with pending jobs.");
+
 	enum Fiber_state {
 		fiber_state_ready      = 0,
 		fiber_state_running    = 1,
@@ -106,6 +111,7 @@ namespace {
 		explicit Fiber_control(Initializer){
 			state = fiber_state_ready;
 			g_stack_allocator.allocate(stack);
+			g_fiber_count.add(1);
 #ifndef NDEBUG
 			std::memset(&inner, 0xCC, sizeof(outer));
 			std::memset(&outer, 0xCC, sizeof(outer));
@@ -114,6 +120,7 @@ namespace {
 		~Fiber_control(){
 			assert(state == fiber_state_ready);
 			g_stack_allocator.deallocate(stack);
+			g_fiber_count.subtract(1);
 #ifndef NDEBUG
 			std::memset(&inner, 0xCC, sizeof(outer));
 			std::memset(&outer, 0xCC, sizeof(outer));
@@ -212,6 +219,7 @@ namespace {
 		if(fiber->state == fiber_state_ready){
 			const Recursive_mutex::Unique_lock queue_lock(fiber->queue_mutex);
 			fiber->queue.pop_front();
+			g_jobs_pending.subtract(1);
 		}
 		return true;
 	}
@@ -299,6 +307,8 @@ void Job_dispatcher::enqueue(boost::shared_ptr<Job_base> job, boost::shared_ptr<
 		Job_element elem = { STD_MOVE(job), STD_MOVE(withdrawn) };
 		fiber->queue.push_back(STD_MOVE(elem));
 	}
+	g_jobs_enqueued.add();
+	g_jobs_pending.add(1);
 	g_new_job.signal();
 }
 void Job_dispatcher::yield(boost::shared_ptr<const Promise> promise, bool insignificant){
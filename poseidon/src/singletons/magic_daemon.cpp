@@ -8,7 +8,9 @@
 #include "../atomic.hpp"
 #include "../system_exception.hpp"
 #include "../raii.hpp"
+#include "../mutex.hpp"
 #include "../profiler.hpp"
+#include "../multi_index_map.hpp"
 #include <magic.h>
 
 namespace Poseidon {
@@ -37,7 +39,415 @@ namespace {
 	}
 
 	volatile bool g_running = false;
-	Unique_handle<Magic_closer> g_cookie;
+	volatile bool g_signature_check = false;
+	volatile std::size_t g_cache_max_count = 0;
+	volatile std::size_t g_cache_prefix_size = 0;
+
+	volatile boost::uint64_t g_signature_hits = 0;
+	volatile boost::uint64_t g_cache_hits = 0;
+	volatile boost::uint64_t g_cache_misses = 0;
+
+	// libmagic 的句柄不是线程安全的，而且 magic_buffer() 的结果在下一次调用时失效。
+	// 每次调用借用一个空闲的句柄，用完归还；没有空闲的句柄时打开一个新的。
+	Mutex g_pool_mutex;
+	std::string g_database;
+	boost::container::vector< ::magic_t> g_idle_cookies;
+	std::size_t g_cookie_count = 0;
+
+	class Cookie_lease : NONCOPYABLE {
+	private:
+		::magic_t m_cookie;
+
+	public:
+		Cookie_lease()
+			: m_cookie(NULLPTR)
+		{
+			std::string database;
+			{
+				const Mutex::Unique_lock lock(g_pool_mutex);
+				if(!g_idle_cookies.empty()){
+					m_cookie = g_idle_cookies.back();
+					g_idle_cookies.pop_back();
+					return;
+				}
+				database = g_database;
+			}
+			// 加载数据库比较慢，不要持有锁。
+			POSEIDON_LOG_DEBUG("Opening new libmagic cookie: database = ", database);
+			m_cookie = open_database(database.c_str()).release();
+			const Mutex::Unique_lock lock(g_pool_mutex);
+			++g_cookie_count;
+		}
+		~Cookie_lease(){
+			const Mutex::Unique_lock lock(g_pool_mutex);
+			if(atomic_load(g_running, memory_order_consume)){
+				try {
+					g_idle_cookies.push_back(m_cookie);
+					return;
+				} catch(std::exception &e){
+					POSEIDON_LOG_WARNING("std::exception thrown: what = ", e.what());
+				}
+			}
+			--g_cookie_count;
+			::magic_close(m_cookie);
+		}
+
+	public:
+		::magic_t get() const {
+			return m_cookie;
+		}
+	};
+
+	// magic_buffer() 返回的字符串属于句柄，因此复制一份。MIME 类型的种类很少，这里的集合不会太大。
+	Mutex g_intern_mutex;
+	boost::container::set<std::string> g_interned_strings;
+
+	const char * intern(const char *str){
+		const Mutex::Unique_lock lock(g_intern_mutex);
+		return g_interned_strings.insert(std::string(str)).first->c_str();
+	}
+
+	bool is_json_space(unsigned char ch){
+		return (ch == ' ') || (ch == '\t') || (ch == '\r') || (ch == '\n');
+	}
+	bool is_json_digit(unsigned char ch){
+		return ('0' <= ch) && (ch <= '9');
+	}
+
+	// 按照 RFC 8259 严格校验。Json_reader 接受单引号、多余的逗号等扩展语法，libmagic 不认为那些是 JSON。
+	class Strict_json_validator {
+	private:
+		enum {
+			max_depth = 64,
+		};
+
+	private:
+		const unsigned char *m_read;
+		const unsigned char *const m_end;
+		unsigned m_depth;
+
+	public:
+		Strict_json_validator(const unsigned char *begin, const unsigned char *end)
+			: m_read(begin), m_end(end), m_depth(0)
+		{
+			//
+		}
+
+	private:
+		bool peek(unsigned char ch) const {
+			return (m_read != m_end) && (*m_read == ch);
+		}
+		bool accept(unsigned char ch){
+			if(!peek(ch)){
+				return false;
+			}
+			++m_read;
+			return true;
+		}
+		void skip_spaces(){
+			while((m_read != m_end) && is_json_space(*m_read)){
+				++m_read;
+			}
+		}
+		bool accept_digits(){
+			const AUTO(begin, m_read);
+			while((m_read != m_end) && is_json_digit(*m_read)){
+				++m_read;
+			}
+			return m_read != begin;
+		}
+
+		bool accept_literal(const char *str){
+			const std::size_t len = std::strlen(str);
+			if((static_cast<std::size_t>(m_end - m_read) < len) || (std::memcmp(m_read, str, len) != 0)){
+				return false;
+			}
+			m_read += len;
+			return true;
+		}
+		bool accept_number(){
+			accept('-');
+			if(!accept('0') && !accept_digits()){
+				return false;
+			}
+			if(accept('.') && !accept_digits()){
+				return false;
+			}
+			if(accept('e') || accept('E')){
+				if(!accept('+')){
+					accept('-');
+				}
+				if(!accept_digits()){
+					return false;
+				}
+			}
+			return true;
+		}
+		bool accept_string(){
+			if(!accept('\"')){
+				return false;
+			}
+			for(;;){
+				if(m_read == m_end){
+					return false;
+				}
+				const unsigned char ch = *(m_read++);
+				if(ch == '\"'){
+					return true;
+				}
+				if(ch < 0x20){
+					return false;
+				}
+				if(ch != '\\'){
+					continue;
+				}
+				if(m_read == m_end){
+					return false;
+				}
+				const unsigned char esc = *(m_read++);
+				if((esc != 0) && std::strchr("\"\\/bfnrt", esc)){
+					continue;
+				}
+				if((esc != 'u') || (m_end - m_read < 4)){
+					return false;
+				}
+				for(unsigned i = 0; i < 4; ++i){
+					if(!std::isxdigit(*(m_read++))){
+						return false;
+					}
+				}
+			}
+		}
+		bool accept_array(){
+			if(!accept('[')){
+				return false;
+			}
+			skip_spaces();
+			if(accept(']')){
+				return true;
+			}
+			for(;;){
+				if(!accept_value()){
+					return false;
+				}
+				skip_spaces();
+				if(accept(']')){
+					return true;
+				}
+				if(!accept(',')){
+					return false;
+				}
+				skip_spaces();
+			}
+		}
+		bool accept_object(){
+			if(!accept('{')){
+				return false;
+			}
+			skip_spaces();
+			if(accept('}')){
+				return true;
+			}
+			for(;;){
+				if(!accept_string()){
+					return false;
+				}
+				skip_spaces();
+				if(!accept(':')){
+					return false;
+				}
+				skip_spaces();
+				if(!accept_value()){
+					return false;
+				}
+				skip_spaces();
+				if(accept('}')){
+					return true;
+				}
+				if(!accept(',')){
+					return false;
+				}
+				skip_spaces();
+			}
+		}
+		bool accept_value(){
+			if(m_read == m_end){
+				return false;
+			}
+			switch(*m_read){
+			case '{':
+			case '[': {
+				// 嵌套太深时交给 libmagic 处理。
+				if(m_depth >= max_depth){
+					return false;
+				}
+				++m_depth;
+				const bool ok = (*m_read == '{') ? accept_object() : accept_array();
+				--m_depth;
+				return ok; }
+			case '\"':
+				return accept_string();
+			case 't':
+				return accept_literal("true");
+			case 'f':
+				return accept_literal("false");
+			case 'n':
+				return accept_literal("null");
+			default:
+				return accept_number();
+			}
+		}
+
+	public:
+		bool validate(){
+			skip_spaces();
+			if(!accept_value()){
+				return false;
+			}
+			skip_spaces();
+			return m_read == m_end;
+		}
+	};
+
+	bool has_prefix(const unsigned char *data, std::size_t size, const char *signature, std::size_t length){
+		return (size >= length) && (std::memcmp(data, signature, length) == 0);
+	}
+
+	// 识别常见格式的文件签名，结果与 libmagic 一致。不能确定时返回空指针，交给 libmagic 处理。
+	const char * check_signature(const unsigned char *data, std::size_t size){
+		if(has_prefix(data, size, "\x89PNG\r\n\x1A\n", 8)){
+			return "image/png";
+		}
+		if(has_prefix(data, size, "\xFF\xD8\xFF", 3)){
+			return "image/jpeg";
+		}
+		if(has_prefix(data, size, "GIF87a", 6) || has_prefix(data, size, "GIF89a", 6)){
+			return "image/gif";
+		}
+		if((size >= 12) && has_prefix(data, size, "RIFF", 4) && has_prefix(data + 8, 4, "WEBP", 4)){
+			return "image/webp";
+		}
+		if(has_prefix(data, size, "%PDF-", 5)){
+			return "application/pdf";
+		}
+		if(has_prefix(data, size, "\x1F\x8B\x08", 3)){
+			return "application/gzip";
+		}
+		if(has_prefix(data, size, "7z\xBC\xAF\x27\x1C", 6)){
+			return "application/x-7z-compressed";
+		}
+		if(has_prefix(data, size, "PK\x03\x04", 4)){
+			// Office 文档、ODF、EPUB 和 JAR 都是 ZIP 格式，libmagic 根据第一个文件名区分它们。
+			if(size < 30){
+				return NULLPTR;
+			}
+			const std::size_t name_length = data[26] | static_cast<std::size_t>(data[27]) << 8;
+			if(size - 30 < name_length){
+				return NULLPTR;
+			}
+			if(has_prefix(data + 30, name_length, "[Content_Types].xml", 19) || has_prefix(data + 30, name_length, "mimetype", 8) || has_prefix(data + 30, name_length, "META-INF", 8)){
+				return NULLPTR;
+			}
+			return "application/zip";
+		}
+		if(has_prefix(data, size, "PK\x05\x06", 4)){
+			return "application/zip";
+		}
+
+		// 对象和数组形式的 JSON 需要完整解析，这和 libmagic 的行为一致。
+		// 先排除明显不是 JSON 的数据，例如以 { 开头的 RTF 文档。
+		std::size_t begin = 0, end = size;
+		while((begin < end) && is_json_space(data[begin])){
+			++begin;
+		}
+		while((begin < end) && is_json_space(data[end - 1])){
+			--end;
+		}
+		if((end - begin < 2) || (size > 1048576)){
+			return NULLPTR;
+		}
+		std::size_t next = begin + 1;
+		while((next < end) && is_json_space(data[next])){
+			++next;
+		}
+		bool plausible;
+		if(data[begin] == '{'){
+			plausible = (data[end - 1] == '}') && ((data[next] == '\"') || (data[next] == '}'));
+		} else if(data[begin] == '['){
+			plausible = (data[end - 1] == ']') && std::strchr("{[\"-0123456789tfn]", data[next]);
+		} else {
+			plausible = false;
+		}
+		if(plausible && Strict_json_validator(data + begin, data + end).validate()){
+			return "application/json";
+		}
+		return NULLPTR;
+	}
+
+	// 只有不超过 libmagic_cache_prefix_size 的数据会被缓存，因此键覆盖了全部数据。
+	struct Cache_key {
+		std::size_t size;
+		// 开头的字节原样保存，其余的字节只保存散列值。
+		unsigned char head[16];
+		boost::uint64_t hash;
+	};
+	bool operator<(const Cache_key &lhs, const Cache_key &rhs){
+		if(lhs.size != rhs.size){
+			return lhs.size < rhs.size;
+		}
+		if(lhs.hash != rhs.hash){
+			return lhs.hash < rhs.hash;
+		}
+		return std::memcmp(lhs.head, rhs.head, sizeof(lhs.head)) < 0;
+	}
+
+	Cache_key make_cache_key(const unsigned char *data, std::size_t size){
+		Cache_key key = { size };
+		std::memcpy(key.head, data, std::min(size, sizeof(key.head)));
+		// FNV-1a
+		boost::uint64_t hash = 14695981039346656037ull;
+		for(std::size_t i = 0; i < size; ++i){
+			hash = (hash ^ data[i]) * 1099511628211ull;
+		}
+		key.hash = hash;
+		return key;
+	}
+
+	struct Cache_element {
+		// Invariants.
+		Cache_key key;
+		const char *mime_type;
+		// Indices.
+		boost::uint64_t access_stamp;
+	};
+	POSEIDON_MULTI_INDEX_MAP(Cache_map, Cache_element,
+		POSEIDON_UNIQUE_MEMBER_INDEX(key)
+		POSEIDON_MULTI_MEMBER_INDEX(access_stamp)
+	);
+
+	Mutex g_cache_mutex;
+	Cache_map g_cache_map;
+	boost::uint64_t g_cache_stamp = 0;
+
+	const char * find_in_cache(const Cache_key &key){
+		const Mutex::Unique_lock lock(g_cache_mutex);
+		const AUTO(it, g_cache_map.find<0>(key));
+		if(it == g_cache_map.end<0>()){
+			return NULLPTR;
+		}
+		g_cache_map.set_key<0, 1>(it, ++g_cache_stamp);
+		return it->mime_type;
+	}
+	void insert_into_cache(const Cache_key &key, const char *mime_type, std::size_t max_count){
+		Cache_element elem = { key, mime_type };
+		const Mutex::Unique_lock lock(g_cache_mutex);
+		g_cache_map.erase<0>(key);
+		while(!g_cache_map.empty() && (g_cache_map.size() >= max_count)){
+			g_cache_map.erase<1>(g_cache_map.begin<1>());
+		}
+		elem.access_stamp = ++g_cache_stamp;
+		g_cache_map.insert(STD_MOVE(elem));
+	}
 }
 
 void Magic_daemon::start(){
@@ -47,9 +457,18 @@ void Magic_daemon::start(){
 	}
 	POSEIDON_LOG(Logger::special_major | Logger::level_info, "Starting magic daemon...");
 
-	const AUTO_REF(database, Main_config::get<std::string>("magic_database", "/usr/share/misc/magic"));
+	atomic_store(g_signature_check, Main_config::get<bool>("libmagic_signature_check", true), memory_order_release);
+	atomic_store(g_cache_max_count, Main_config::get<std::size_t>("libmagic_cache_max_count", 1024), memory_order_release);
+	atomic_store(g_cache_prefix_size, Main_config::get<std::size_t>("libmagic_cache_prefix_size", 8192), memory_order_release);
+
+	const AUTO_REF(database, Main_config::get<std::string>("libmagic_database", "/usr/share/misc/magic"));
 	POSEIDON_LOG_INFO("Loading magic database: ", database);
-	open_database(database.c_str()).swap(g_cookie);
+	// 先打开一个句柄，尽早发现配置错误。
+	AUTO(cookie, open_database(database.c_str()));
+	const Mutex::Unique_lock lock(g_pool_mutex);
+	g_database = database;
+	g_idle_cookies.push_back(cookie.release());
+	g_cookie_count = 1;
 }
 void Magic_daemon::stop(){
 	if(atomic_exchange(g_running, false, memory_order_acq_rel) == false){
@@ -57,15 +476,78 @@ void Magic_daemon::stop(){
 	}
 	POSEIDON_LOG(Logger::special_major | Logger::level_info, "Stopping magic daemon...");
 
-	g_cookie.reset();
+	{
+		const Mutex::Unique_lock lock(g_pool_mutex);
+		for(std::size_t i = 0; i < g_idle_cookies.size(); ++i){
+			::magic_close(g_idle_cookies.at(i));
+		}
+		g_cookie_count -= g_idle_cookies.size();
+		g_idle_cookies.clear();
+	}
+	clear_cache();
+}
+
+Magic_daemon::Statistics Magic_daemon::get_statistics(){
+	Statistics stats;
+	stats.signature_hits = atomic_load(g_signature_hits, memory_order_relaxed);
+	stats.cache_hits = atomic_load(g_cache_hits, memory_order_relaxed);
+	stats.cache_misses = atomic_load(g_cache_misses, memory_order_relaxed);
+	{
+		const Mutex::Unique_lock lock(g_cache_mutex);
+		stats.cache_entry_count = g_cache_map.size();
+	}
+	{
+		const Mutex::Unique_lock lock(g_pool_mutex);
+		stats.cookie_count = g_cookie_count;
+		stats.idle_cookie_count = g_idle_cookies.size();
+	}
+	return stats;
+}
+void Magic_daemon::clear_cache(){
+	const Mutex::Unique_lock lock(g_cache_mutex);
+	g_cache_map.clear();
 }
 
 const char * Magic_daemon::guess_mime_type(const void *data, std::size_t size){
 	POSEIDON_PROFILE_ME;
 
 	POSEIDON_THROW_ASSERT(data);
-	POSEIDON_THROW_ASSERT(g_cookie);
-	return checked_look_up(g_cookie.get(), data, size);
+	POSEIDON_THROW_ASSERT(atomic_load(g_running, memory_order_consume));
+
+	const AUTO(bytes, static_cast<const unsigned char *>(data));
+	if(atomic_load(g_signature_check, memory_order_consume)){
+		const AUTO(mime_type, check_signature(bytes, size));
+		if(mime_type){
+			atomic_add(g_signature_hits, 1, memory_order_relaxed);
+			return mime_type;
+		}
+	}
+
+	AUTO(max_count, atomic_load(g_cache_max_count, memory_order_consume));
+	if(size > atomic_load(g_cache_prefix_size, memory_order_consume)){
+		// 更长的数据可能只在末尾不同，不使用缓存。
+		max_count = 0;
+	}
+	Cache_key key = { };
+	if(max_count != 0){
+		key = make_cache_key(bytes, size);
+		const AUTO(mime_type, find_in_cache(key));
+		if(mime_type){
+			atomic_add(g_cache_hits, 1, memory_order_relaxed);
+			return mime_type;
+		}
+	}
+	atomic_add(g_cache_misses, 1, memory_order_relaxed);
+
+	const char *mime_type;
+	{
+		const Cookie_lease lease;
+		mime_type = intern(checked_look_up(lease.get(), data, size));
+	}
+	if(max_count != 0){
+		insert_into_cache(key, mime_type, max_count);
+	}
+	return mime_type;
 }
 
 }
@@ -4,6 +4,7 @@
 #ifndef POSEIDON_SYSTEM_MAGIC_DAEMON_HPP_
 #define POSEIDON_SYSTEM_MAGIC_DAEMON_HPP_
 
+#include <boost/cstdint.hpp>
 #include <cstddef>
 
 namespace Poseidon {
@@ -13,9 +14,22 @@ private:
 	Magic_daemon();
 
 public:
+	struct Statistics {
+		boost::uint64_t signature_hits; // 由文件签名直接识别，没有调用 libmagic。
+		boost::uint64_t cache_hits;
+		boost::uint64_t cache_misses;   // 调用了 libmagic。
+		std::size_t cache_entry_count;
+		std::size_t cookie_count;       // 已经打开的 libmagic 句柄数。
+		std::size_t idle_cookie_count;
+	};
+
 	static void start();
 	static void stop();
 
+	static Statistics get_statistics();
+	static void clear_cache();
+
+	// 线程安全。返回的字符串在进程退出前一直有效。
 	static const char * guess_mime_type(const void *data, std::size_t size);
 };
 
@@ -6,6 +6,7 @@
 #include <boost/type_traits/decay.hpp>
 #include <dlfcn.h>
 #include "main_config.hpp"
+#include "event_dispatcher.hpp"
 #include "../recursive_mutex.hpp"
 #include "../log.hpp"
 #include "../profiler.hpp"
@@ -128,6 +129,7 @@ void Module_depository::stop(){
 
 	const Recursive_mutex::Unique_lock lock(g_mutex);
 	g_module_map.clear();
+	Event_dispatcher::clear_cache();
 }
 
 void * Module_depository::load(const std::string &path){
@@ -189,6 +191,8 @@ bool Module_depository::unload(void *base_address) NOEXCEPT {
 	}
 	POSEIDON_LOG(Logger::special_major | Logger::level_info, "Unloading module: base_address = ", base_address, ", real_path = ", it->module->get_real_path());
 	g_module_map.erase<1>(it);
+	// 模块中的 type_info 对象已经失效，它们的地址可能被之后加载的模块复用。
+	Event_dispatcher::clear_cache();
 	return true;
 }
 
@@ -21,10 +21,15 @@
 #include "../errno.hpp"
 #include "../buffer_streams.hpp"
 #include "../checked_arithmetic.hpp"
+#include "../metrics.hpp"
+#include "../write_journal.hpp"
+#include "../system_exception.hpp"
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <dirent.h>
+#include <algorithm>
 #include <libmongoc-1.0/mongoc.h>
 
 namespace Poseidon {
@@ -32,6 +37,13 @@ namespace Poseidon {
 typedef Mongodb_daemon::Query_callback Query_callback;
 
 namespace {
+	// 单位为微秒。
+	const boost::uint64_t s_operation_duration_bounds[] = { 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000, 5000000 };
+
+	Metric_gauge g_queue_size("poseidon_mongodb_queue_size", "MongoDB operations that have been enqueued and not yet completed.");
+	Metric_histogram g_operation_duration("poseidon_mongodb_operation_duration_seconds", "Time spent executing MongoDB operations, including failed attempts.", 1.0e-6, s_operation_duration_bounds, s_operation_duration_bounds + COUNT_OF(s_operation_duration_bounds));
+	Metric_counter g_operation_failures("poseidon_mongodb_operation_failures_total", "MongoDB operation attempts that have thrown an exception.");
+
 	boost::shared_ptr<Mongodb::Connection> real_create_connection(bool from_slave, const boost::shared_ptr<Mongodb::Connection> &master_conn){
 		std::string server_addr;
 		boost::uint16_t server_port = 0;
@@ -58,7 +70,7 @@ namespace {
 	// 对于日志文件的写操作应当互斥。
 	Mutex g_dump_mutex;
 
-	void dump_bson_to_file(const Mongodb::Bson_builder &query, unsigned long err_code, const char *err_msg) NOEXCEPT
+	void dump_json_to_file(const std::string &json, unsigned long err_code, const char *err_msg) NOEXCEPT
 	try {
 		POSEIDON_PROFILE_ME;
 
@@ -90,10 +102,10 @@ namespace {
 		Buffer_ostream os;
 		len = format_time(temp, sizeof(temp), local_now, false);
 		os <<"// " <<temp <<": err_code = " <<err_code <<", err_msg = " <<err_msg <<std::endl;
-		if(query.empty()){
+		if(json.empty()){
 			os <<"// <low level access>";
 		} else {
-			os <<"db.runCommand(" <<query <<");";
+			os <<"db.runCommand(" <<json <<");";
 		}
 		os <<std::endl <<std::endl;
 		const AUTO(str, os.get_buffer().dump_string());
@@ -110,6 +122,92 @@ namespace {
 	} catch(std::exception &e){
 		POSEIDON_LOG_ERROR("Error writing BSON dump: what = ", e.what());
 	}
+	void dump_bson_to_file(const Mongodb::Bson_builder &query, unsigned long err_code, const char *err_msg) NOEXCEPT
+	try {
+		dump_json_to_file(query.empty() ? std::string() : query.build_json(), err_code, err_msg);
+	} catch(std::exception &e){
+		POSEIDON_LOG_ERROR("Error writing BSON dump: what = ", e.what());
+	}
+
+	// 写操作日志，每个线程一个文件。
+	struct Directory_closer {
+		CONSTEXPR ::DIR * operator()() const NOEXCEPT {
+			return NULLPTR;
+		}
+		void operator()(::DIR *dir) const NOEXCEPT {
+			::closedir(dir);
+		}
+	};
+
+	std::string make_journal_path(const std::string &journal_dir, std::size_t index){
+		char temp[64];
+		const std::size_t len = (unsigned)std::sprintf(temp, "/mongodb_%03u.journal", (unsigned)index);
+		std::string path;
+		path.reserve(journal_dir.size() + len);
+		path.assign(journal_dir);
+		path.append(temp, len);
+		return path;
+	}
+	bool is_journal_file_name(const std::string &name){
+		static const char s_prefix[] = "mongodb_";
+		static const char s_suffix[] = ".journal";
+		if(name.size() < sizeof(s_prefix) - 1 + sizeof(s_suffix) - 1){
+			return false;
+		}
+		return (name.compare(0, sizeof(s_prefix) - 1, s_prefix) == 0) && (name.compare(name.size() - (sizeof(s_suffix) - 1), sizeof(s_suffix) - 1, s_suffix) == 0);
+	}
+
+	// 日志中保存的是 BSON 原始数据。
+	void replay_journal_bson(const boost::shared_ptr<Mongodb::Connection> &conn, const std::string &data){
+		unsigned long err_code = 0;
+		char err_msg[4096];
+		err_msg[0] = 0;
+		try {
+			conn->execute_raw_bson(data.data(), data.size());
+		} catch(Mongodb::Exception &e){
+			POSEIDON_LOG_ERROR("Mongodb::Exception thrown: code = ", e.get_code(), ", what = ", e.what());
+			err_code = e.get_code();
+			::snprintf(err_msg, sizeof(err_msg), "Mongodb::Exception: %s", e.what());
+		} catch(std::exception &e){
+			POSEIDON_LOG_ERROR("std::exception thrown: what = ", e.what());
+			err_code = MONGOC_ERROR_PROTOCOL_ERROR;
+			::snprintf(err_msg, sizeof(err_msg), "std::exception: %s", e.what());
+		}
+		conn->discard_result();
+		if(err_msg[0] != 0){
+			dump_json_to_file(Mongodb::bson_data_to_json(data.data(), data.size()), err_code, err_msg);
+		}
+	}
+	// 上次没有正常退出时，日志中可能还有尚未完成的写操作。回放失败的命令转储到 mongodb_dump_dir 中。
+	void replay_journals(const std::string &journal_dir, const boost::shared_ptr<Mongodb::Connection> &conn){
+		boost::container::vector<std::string> paths;
+		{
+			Unique_handle<Directory_closer> dir;
+			if(!dir.reset(::opendir(journal_dir.c_str()))){
+				const int err_code = errno;
+				POSEIDON_LOG_ERROR("Failed to open MongoDB journal directory: journal_dir = ", journal_dir, ", err_code = ", err_code);
+				POSEIDON_THROW(System_exception, err_code);
+			}
+			const ::dirent *entry;
+			while((entry = ::readdir(dir.get()))){
+				const std::string name = entry->d_name;
+				if(!is_journal_file_name(name)){
+					continue;
+				}
+				paths.push_back(journal_dir + '/' + name);
+			}
+		}
+		std::sort(paths.begin(), paths.end());
+		for(AUTO(it, paths.begin()); it != paths.end(); ++it){
+			const AUTO(count, Write_journal::replay(*it, boost::bind(&replay_journal_bson, conn, _1)));
+			POSEIDON_LOG(Logger::special_major | Logger::level_info, "Replayed MongoDB journal: path = ", *it, ", commands = ", count);
+			if(::unlink(it->c_str()) != 0){
+				const int err_code = errno;
+				POSEIDON_LOG_ERROR("Failed to remove MongoDB journal: path = ", *it, ", err_code = ", err_code);
+				POSEIDON_THROW(System_exception, err_code);
+			}
+		}
+	}
 
 	// 数据库线程操作。
 	class Operation_base : NONCOPYABLE {
@@ -141,6 +239,11 @@ namespace {
 		virtual const char * get_collection() const = 0;
 		virtual void generate_bson(Mongodb::Bson_builder &query) const = 0;
 		virtual void execute(const boost::shared_ptr<Mongodb::Connection> &conn, const Mongodb::Bson_builder &query) = 0;
+
+		// 写操作在排队时记入日志。日志中的命令必须可以独立执行。
+		virtual bool generate_journal_bson(std::string & /* data */) const {
+			return false;
+		}
 	};
 
 	class Save_operation : public Operation_base {
@@ -166,13 +269,13 @@ namespace {
 		const char * get_collection() const OVERRIDE {
 			return m_object->get_collection();
 		}
-		void generate_bson(Mongodb::Bson_builder &query) const OVERRIDE {
+		void generate_save_bson(Mongodb::Bson_builder &query, bool to_replace) const {
 			Mongodb::Bson_builder q;
 			{
 				Mongodb::Bson_builder doc;
 				m_object->generate_document(doc);
 				AUTO(pkey, m_object->generate_primary_key());
-				if(m_to_replace && !pkey.empty()){
+				if(to_replace && !pkey.empty()){
 					Mongodb::Bson_builder upd;
 					upd.append_object(Rcnts::view("q"), Mongodb::bson_scalar_string(Rcnts::view("_id"), STD_MOVE(pkey)));
 					upd.append_object(Rcnts::view("u"), STD_MOVE(doc));
@@ -188,6 +291,16 @@ namespace {
 			}
 			query = q;
 		}
+		void generate_bson(Mongodb::Bson_builder &query) const OVERRIDE {
+			generate_save_bson(query, m_to_replace);
+		}
+		bool generate_journal_bson(std::string &data) const OVERRIDE {
+			// 崩溃之前这条命令可能已经执行了但是没有被确认，因此有主键时 insert 也写成 upsert，使回放是幂等的。
+			Mongodb::Bson_builder q;
+			generate_save_bson(q, true);
+			data = q.build().dump_string();
+			return true;
+		}
 		void execute(const boost::shared_ptr<Mongodb::Connection> &conn, const Mongodb::Bson_builder &query) OVERRIDE {
 			POSEIDON_PROFILE_ME;
 
@@ -260,6 +373,10 @@ namespace {
 		void generate_bson(Mongodb::Bson_builder &query) const OVERRIDE {
 			query = m_query;
 		}
+		bool generate_journal_bson(std::string &data) const OVERRIDE {
+			data = m_query.build().dump_string();
+			return true;
+		}
 		void execute(const boost::shared_ptr<Mongodb::Connection> &conn, const Mongodb::Bson_builder &query) OVERRIDE {
 			POSEIDON_PROFILE_ME;
 
@@ -389,6 +506,7 @@ namespace {
 			boost::shared_ptr<Operation_base> operation;
 			boost::uint64_t due_time;
 			std::size_t retry_count;
+			boost::uint64_t journal_seq;
 		};
 
 	private:
@@ -400,15 +518,32 @@ namespace {
 		volatile bool m_urgent; // 无视延迟写入，一次性处理队列中所有操作。
 		boost::container::deque<Operation_queue_element> m_queue;
 
+		boost::scoped_ptr<Write_journal> m_journal;
+
 	public:
-		Mongodb_thread()
+		explicit Mongodb_thread(std::size_t index)
 			: m_running(false)
 			, m_urgent(false)
 		{
-			//
+			const AUTO_REF(journal_dir, Main_config::get<std::string>("mongodb_journal_dir"));
+			if(!journal_dir.empty()){
+				const AUTO(compact_size, Main_config::get<boost::uint64_t>("mongodb_journal_compact_size", 16777216));
+				m_journal.reset(new Write_journal(make_journal_path(journal_dir, index), compact_size));
+			}
 		}
 
 	private:
+		void flush_journal() NOEXCEPT {
+			if(!m_journal){
+				return;
+			}
+			try {
+				m_journal->flush();
+			} catch(std::exception &e){
+				POSEIDON_LOG_ERROR("Error flushing MongoDB journal: what = ", e.what());
+			}
+		}
+
 		bool pump_one_operation(boost::shared_ptr<Mongodb::Connection> &master_conn, boost::shared_ptr<Mongodb::Connection> &slave_conn) NOEXCEPT {
 			POSEIDON_PROFILE_ME;
 
@@ -448,6 +583,7 @@ namespace {
 				}
 			}
 			if(execute_it){
+				const AUTO(begin_time, get_hi_res_mono_clock());
 				try {
 					operation->generate_bson(query);
 					POSEIDON_LOG_DEBUG("Executing MongoDB query: collection = ", operation->get_collection(), ", query = ", query);
@@ -469,8 +605,10 @@ namespace {
 					::strcpy(err_msg, "Unknown exception");
 				}
 				conn->discard_result();
+				g_operation_duration.observe(static_cast<boost::uint64_t>(std::max(get_hi_res_mono_clock() - begin_time, 0.0) * 1000));
 			}
 			if(except){
+				g_operation_failures.add();
 				const AUTO(max_retry_count, Main_config::get<std::size_t>("mongodb_max_retry_count", 3));
 				const AUTO(retry_count, ++(elem->retry_count));
 				if(retry_count < max_retry_count){
@@ -491,8 +629,12 @@ namespace {
 					promise->set_success(false);
 				}
 			}
+			if(elem->journal_seq != 0){
+				m_journal->acknowledge(elem->journal_seq);
+			}
 			const Mutex::Unique_lock lock(m_mutex);
 			m_queue.pop_front();
+			g_queue_size.subtract(1);
 			return true;
 		}
 
@@ -502,8 +644,10 @@ namespace {
 
 			boost::shared_ptr<Mongodb::Connection> master_conn, slave_conn;
 			unsigned timeout = 0;
+			boost::uint64_t next_journal_flush_time = 0;
 			for(;;){
 				const AUTO(reconnect_delay, Main_config::get<boost::uint64_t>("mongodb_reconn_delay", 5000));
+				const AUTO(journal_flush_interval, Main_config::get<boost::uint64_t>("mongodb_journal_flush_interval", 100));
 				bool busy;
 				do {
 					while(!master_conn){
@@ -534,6 +678,13 @@ namespace {
 					}
 					busy = pump_one_operation(master_conn, slave_conn);
 					timeout = std::min<unsigned>(timeout * 2u + 1u, !busy * 100u);
+
+					// 成组提交：空闲时或者每隔一段时间才同步一次日志。
+					const AUTO(now, get_fast_mono_clock());
+					if(!busy || (now >= next_journal_flush_time)){
+						flush_journal();
+						next_journal_flush_time = saturated_add(now, journal_flush_interval);
+					}
 				} while(busy);
 
 				Mutex::Unique_lock lock(m_mutex);
@@ -543,6 +694,11 @@ namespace {
 				m_new_operation.timed_wait(lock, timeout);
 			}
 
+			flush_journal();
+			if(m_journal && (m_journal->get_unacknowledged_count() == 0)){
+				// 所有操作都已经完成，日志不再需要。
+				::unlink(m_journal->get_path().c_str());
+			}
 			POSEIDON_LOG(Logger::special_major | Logger::level_info, "MongoDB thread stopped.");
 		}
 
@@ -600,10 +756,17 @@ namespace {
 			// 有紧急操作时无视写入延迟，这个逻辑不在这里处理。
 			const AUTO(due_time, saturated_add(now, save_delay));
 
+			std::string journal_data;
+			const bool journaled = m_journal && operation->generate_journal_bson(journal_data);
+
 			const Mutex::Unique_lock lock(m_mutex);
 			POSEIDON_THROW_UNLESS(atomic_load(m_running, memory_order_consume), Exception, Rcnts::view("MongoDB thread is being shut down"));
 			Operation_queue_element elem = { STD_MOVE(operation), due_time };
+			if(journaled){
+				elem.journal_seq = m_journal->append(STD_MOVE(journal_data));
+			}
 			m_queue.push_back(STD_MOVE(elem));
+			g_queue_size.add(1);
 			if(combinable_object){
 				const AUTO(old_write_stamp, combinable_object->get_combined_write_stamp());
 				if(!old_write_stamp){
@@ -654,7 +817,7 @@ namespace {
 				AUTO_REF(test_thread, g_threads.at(i));
 				if(!test_thread){
 					POSEIDON_LOG(Logger::special_major | Logger::level_debug, "Creating new MongoDB thread ", i, " for collection ", collection);
-					thread = boost::make_shared<Mongodb_thread>();
+					thread = boost::make_shared<Mongodb_thread>(i);
 					thread->start();
 					test_thread = thread;
 					route.thread = thread;
@@ -742,6 +905,18 @@ void Mongodb_daemon::start(){
 				std::terminate();
 			}
 		}
+
+		const AUTO(journal_dir, Main_config::get<std::string>("mongodb_journal_dir"));
+		if(!journal_dir.empty()){
+			POSEIDON_LOG(Logger::special_major | Logger::level_info, "Replaying MongoDB journals...");
+			try {
+				replay_journals(journal_dir, master_conn);
+			} catch(std::exception &e){
+				POSEIDON_LOG_FATAL("Could not replay MongoDB journals: ", e.what());
+				POSEIDON_LOG_WARNING("To disable MongoDB journal, set `mongodb_journal_dir` in `main.conf` to an empty string.");
+				std::terminate();
+			}
+		}
 	}
 	g_threads.resize(max_thread_count);
 
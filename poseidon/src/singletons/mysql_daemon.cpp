@@ -20,10 +20,16 @@
 #include "../errno.hpp"
 #include "../buffer_streams.hpp"
 #include "../checked_arithmetic.hpp"
+#include "../metrics.hpp"
+#include "../multi_index_map.hpp"
+#include "../write_journal.hpp"
+#include "../system_exception.hpp"
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <dirent.h>
+#include <algorithm>
 #include <mysql/mysqld_error.h>
 #include <mysql/errmsg.h>
 
@@ -32,6 +38,18 @@ namespace Poseidon {
 typedef Mysql_daemon::Query_callback Query_callback;
 
 namespace {
+	// 单位为微秒。
+	const boost::uint64_t s_operation_duration_bounds[] = { 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000, 5000000 };
+
+	Metric_gauge g_queue_size("poseidon_mysql_queue_size", "MySQL operations that have been enqueued and not yet completed.");
+	Metric_histogram g_operation_duration("poseidon_mysql_operation_duration_seconds", "Time spent executing MySQL operations, including failed attempts.", 1.0e-6, s_operation_duration_bounds, s_operation_duration_bounds + COUNT_OF(s_operation_duration_bounds));
+	Metric_counter g_operation_failures("poseidon_mysql_operation_failures_total", "MySQL operation attempts that have thrown an exception.");
+	Metric_counter g_saves_enqueued("poseidon_mysql_saves_enqueued_total", "Save operations that have been enqueued, not including coalesced ones.");
+	Metric_gauge g_cache_size("poseidon_mysql_object_cache_size", "MySQL objects in the object cache, including those being loaded.");
+	Metric_counter g_cache_hits("poseidon_mysql_object_cache_hits_total", "Cached loads that have been served from the object cache.");
+	Metric_counter g_cache_misses("poseidon_mysql_object_cache_misses_total", "Cached loads that have been sent to the database.");
+	Metric_counter g_cache_evictions("poseidon_mysql_object_cache_evictions_total", "MySQL objects that have been evicted from the object cache.");
+
 	boost::shared_ptr<Mysql::Connection> real_create_connection(bool from_slave, const boost::shared_ptr<Mysql::Connection> &master_conn){
 		std::string server_addr;
 		boost::uint16_t server_port = 0;
@@ -111,6 +129,80 @@ namespace {
 		POSEIDON_LOG_ERROR("Error writing SQL dump: what = ", e.what());
 	}
 
+	// 写操作日志，每个线程一个文件。
+	volatile bool g_journal_enabled = false;
+
+	struct Directory_closer {
+		CONSTEXPR ::DIR * operator()() const NOEXCEPT {
+			return NULLPTR;
+		}
+		void operator()(::DIR *dir) const NOEXCEPT {
+			::closedir(dir);
+		}
+	};
+
+	std::string make_journal_path(const std::string &journal_dir, std::size_t index){
+		char temp[64];
+		const std::size_t len = (unsigned)std::sprintf(temp, "/mysql_%03u.journal", (unsigned)index);
+		std::string path;
+		path.reserve(journal_dir.size() + len);
+		path.assign(journal_dir);
+		path.append(temp, len);
+		return path;
+	}
+	bool is_journal_file_name(const std::string &name){
+		static const char s_prefix[] = "mysql_";
+		static const char s_suffix[] = ".journal";
+		if(name.size() < sizeof(s_prefix) - 1 + sizeof(s_suffix) - 1){
+			return false;
+		}
+		return (name.compare(0, sizeof(s_prefix) - 1, s_prefix) == 0) && (name.compare(name.size() - (sizeof(s_suffix) - 1), sizeof(s_suffix) - 1, s_suffix) == 0);
+	}
+
+	void replay_journal_sql(const boost::shared_ptr<Mysql::Connection> &conn, const std::string &query){
+		POSEIDON_LOG_DEBUG("Replaying SQL: query = ", query);
+		try {
+			conn->execute_sql(query);
+		} catch(Mysql::Exception &e){
+			POSEIDON_LOG_ERROR("Mysql::Exception thrown: code = ", e.get_code(), ", what = ", e.what());
+			dump_sql_to_file(query, e.get_code(), e.what());
+		} catch(std::exception &e){
+			POSEIDON_LOG_ERROR("std::exception thrown: what = ", e.what());
+			dump_sql_to_file(query, ER_UNKNOWN_ERROR, e.what());
+		}
+		conn->discard_result();
+	}
+	// 上次没有正常退出时，日志中可能还有尚未完成的写操作。回放失败的语句转储到 mysql_dump_dir 中。
+	void replay_journals(const std::string &journal_dir, const boost::shared_ptr<Mysql::Connection> &conn){
+		boost::container::vector<std::string> paths;
+		{
+			Unique_handle<Directory_closer> dir;
+			if(!dir.reset(::opendir(journal_dir.c_str()))){
+				const int err_code = errno;
+				POSEIDON_LOG_ERROR("Failed to open MySQL journal directory: journal_dir = ", journal_dir, ", err_code = ", err_code);
+				POSEIDON_THROW(System_exception, err_code);
+			}
+			const ::dirent *entry;
+			while((entry = ::readdir(dir.get()))){
+				const std::string name = entry->d_name;
+				if(!is_journal_file_name(name)){
+					continue;
+				}
+				paths.push_back(journal_dir + '/' + name);
+			}
+		}
+		std::sort(paths.begin(), paths.end());
+		for(AUTO(it, paths.begin()); it != paths.end(); ++it){
+			const AUTO(count, Write_journal::replay(*it, boost::bind(&replay_journal_sql, conn, _1)));
+			POSEIDON_LOG(Logger::special_major | Logger::level_info, "Replayed MySQL journal: path = ", *it, ", statements = ", count);
+			if(::unlink(it->c_str()) != 0){
+				const int err_code = errno;
+				POSEIDON_LOG_ERROR("Failed to remove MySQL journal: path = ", *it, ", err_code = ", err_code);
+				POSEIDON_THROW(System_exception, err_code);
+			}
+		}
+	}
+
 	// 数据库线程操作。
 	class Operation_base : NONCOPYABLE {
 	private:
@@ -139,8 +231,14 @@ namespace {
 		virtual bool should_use_slave() const = 0;
 		virtual boost::shared_ptr<const Mysql::Object_base> get_combinable_object() const = 0;
 		virtual const char * get_table() const = 0;
+		// 只能由数据库线程在执行操作时调用。
 		virtual void generate_sql(std::string &query) const = 0;
 		virtual void execute(const boost::shared_ptr<Mysql::Connection> &conn, const std::string &query) = 0;
+
+		// 写操作在排队时记入日志。日志中的语句必须可以独立执行。
+		virtual bool generate_journal_sql(std::string & /* query */) const {
+			return false;
+		}
 	};
 
 	class Save_operation : public Operation_base {
@@ -148,10 +246,15 @@ namespace {
 		boost::shared_ptr<const Mysql::Object_base> m_object;
 		bool m_to_replace;
 
+		// 生成 SQL 语句会清除字段的修改标记，因此重试时必须使用同一条语句。
+		mutable bool m_generated;
+		mutable std::string m_query;
+
 	public:
 		Save_operation(const boost::shared_ptr<Promise> &promise, boost::shared_ptr<const Mysql::Object_base> object, bool to_replace)
 			: Operation_base(promise)
 			, m_object(STD_MOVE(object)), m_to_replace(to_replace)
+			, m_generated(false), m_query()
 		{
 			//
 		}
@@ -167,21 +270,39 @@ namespace {
 			return m_object->get_table();
 		}
 		void generate_sql(std::string &query) const OVERRIDE {
-			Buffer_ostream os;
-			if(m_to_replace){
-				os <<"REPLACE";
-			} else {
-				os <<"INSERT";
+			if(!m_generated){
+				Buffer_ostream os;
+				m_object->generate_save_sql(os, m_to_replace);
+				m_query = os.get_buffer().dump_string();
+				m_query.erase(m_query.find_last_not_of(" ,") + 1);
+				m_generated = true;
 			}
-			os <<" INTO `" <<get_table() <<"` SET ";
-			m_object->generate_sql(os);
+			query = m_query;
+		}
+		bool generate_journal_sql(std::string &query) const OVERRIDE {
+			// 日志中总是写入整行，回放时不依赖修改标记。
+			// 崩溃之前这条语句可能已经执行了但是没有被确认，因此 INSERT 也写成 REPLACE，使回放是幂等的。
+			Buffer_ostream os;
+			m_object->Mysql::Object_base::generate_save_sql(os, true);
 			query = os.get_buffer().dump_string();
 			query.erase(query.find_last_not_of(" ,") + 1);
+			return true;
 		}
 		void execute(const boost::shared_ptr<Mysql::Connection> &conn, const std::string &query) OVERRIDE {
 			POSEIDON_PROFILE_ME;
 
-			conn->execute_sql(query);
+			if(query.empty()){
+				POSEIDON_LOG_TRACE("No fields have been modified: table = ", get_table());
+				return;
+			}
+			try {
+				conn->execute_sql(query);
+			} catch(...){
+				// 修改标记已经被清除了。如果这条语句最终没有执行成功，下次保存时必须写入整行。
+				m_object->set_persistent(false);
+				throw;
+			}
+			m_object->set_persistent(true);
 		}
 	};
 
@@ -255,6 +376,10 @@ namespace {
 
 			conn->execute_sql(query);
 		}
+		bool generate_journal_sql(std::string &query) const OVERRIDE {
+			query = m_query;
+			return true;
+		}
 	};
 
 	class Batch_load_operation : public Operation_base {
@@ -302,6 +427,156 @@ namespace {
 		}
 	};
 
+	// 并行加载的各段共用一个上下文。所有的段都被销毁之后才设定 promise，第一个失败的段的异常被保留。
+	class Parallel_load_context : NONCOPYABLE {
+	private:
+		const boost::weak_ptr<Promise> m_weak_promise;
+
+		mutable Mutex m_mutex;
+		STD_EXCEPTION_PTR m_except;
+
+	public:
+		explicit Parallel_load_context(const boost::shared_ptr<Promise> &promise)
+			: m_weak_promise(promise)
+		{
+			//
+		}
+		~Parallel_load_context(){
+			const AUTO(promise, m_weak_promise.lock());
+			if(!promise){
+				return;
+			}
+			if(m_except){
+				promise->set_exception(STD_MOVE(m_except), false);
+			} else {
+				promise->set_success(false);
+			}
+		}
+
+	public:
+		boost::shared_ptr<Promise> get_promise() const {
+			return m_weak_promise.lock();
+		}
+		void set_exception(STD_EXCEPTION_PTR except){
+			const Mutex::Unique_lock lock(m_mutex);
+			if(!m_except){
+				m_except = STD_MOVE_IDN(except);
+			}
+		}
+	};
+
+	class Parallel_load_operation : public Operation_base {
+	private:
+		const boost::shared_ptr<Promise> m_promise; // 这一段自己的结果。
+		const boost::shared_ptr<Parallel_load_context> m_context;
+		Mysql_daemon::Chunk_callback m_callback;
+		Mysql_daemon::Object_factory m_factory;
+		const char *m_table;
+		std::string m_key_column;
+		boost::int64_t m_key_begin;
+		boost::int64_t m_key_end;
+		// 失败重试时从已经交付的最后一个键（含）继续，这样才能检查紧随其后的一行是否和它重复。这一行本身不会再次交付。
+		bool m_has_delivered;
+		boost::int64_t m_last_delivered_key;
+
+	public:
+		Parallel_load_operation(const boost::shared_ptr<Promise> &promise, boost::shared_ptr<Parallel_load_context> context, Mysql_daemon::Chunk_callback callback, Mysql_daemon::Object_factory factory,
+			const char *table, std::string key_column, boost::int64_t key_begin, boost::int64_t key_end)
+			: Operation_base(promise)
+			, m_promise(promise), m_context(STD_MOVE(context)), m_callback(STD_MOVE_IDN(callback)), m_factory(STD_MOVE_IDN(factory))
+			, m_table(table), m_key_column(STD_MOVE(key_column)), m_key_begin(key_begin), m_key_end(key_end)
+			, m_has_delivered(false), m_last_delivered_key(0)
+		{
+			//
+		}
+		~Parallel_load_operation() OVERRIDE {
+			if(!m_promise->would_throw()){
+				return;
+			}
+			try {
+				m_promise->check_and_rethrow();
+			} catch(...){
+				m_context->set_exception(STD_CURRENT_EXCEPTION());
+			}
+		}
+
+	private:
+		void deliver(boost::container::vector<boost::shared_ptr<Mysql::Object_base> > &objects, boost::int64_t last_key){
+			POSEIDON_PROFILE_ME;
+
+			m_callback(objects);
+			objects.clear();
+			m_has_delivered = true;
+			m_last_delivered_key = last_key;
+		}
+
+	protected:
+		bool should_use_slave() const OVERRIDE {
+			return true;
+		}
+		boost::shared_ptr<const Mysql::Object_base> get_combinable_object() const OVERRIDE {
+			return VAL_INIT; // 不能合并。
+		}
+		const char * get_table() const OVERRIDE {
+			return m_table;
+		}
+		void generate_sql(std::string &query) const OVERRIDE {
+			Buffer_ostream os;
+			os <<"SELECT * FROM `" <<m_table <<"` WHERE `" <<m_key_column <<"` >= " <<(m_has_delivered ? m_last_delivered_key : m_key_begin)
+			   <<" AND `" <<m_key_column <<"` < " <<m_key_end <<" ORDER BY `" <<m_key_column <<"`";
+			query = os.get_buffer().dump_string();
+		}
+		void execute(const boost::shared_ptr<Mysql::Connection> &conn, const std::string &query) OVERRIDE {
+			POSEIDON_PROFILE_ME;
+
+			if(!m_context->get_promise()){
+				POSEIDON_LOG_WARNING("Discarding isolated MySQL query: table = ", get_table(), ", query = ", query);
+				return;
+			}
+			const AUTO(chunk_size, Main_config::get<std::size_t>("mysql_parallel_load_chunk_size", 1000));
+
+			conn->execute_sql(query);
+			const boost::shared_ptr<const Mysql::Connection> const_conn = conn;
+			const AUTO(key_index, conn->get_field_index(m_key_column.c_str()));
+			POSEIDON_THROW_UNLESS(key_index != static_cast<std::size_t>(-1), Basic_exception, Rcnts::view("Key column not found in result set"));
+
+			// 字段下标在第一行时查找，之后的行直接按下标读取。
+			boost::container::vector<std::size_t> indices;
+			bool indices_resolved = false;
+			boost::container::vector<boost::shared_ptr<Mysql::Object_base> > objects;
+			objects.reserve(chunk_size);
+			bool has_last_key = m_has_delivered;
+			boost::int64_t last_key = m_last_delivered_key;
+			bool skip_delivered = m_has_delivered;
+			while(conn->fetch_row()){
+				const boost::int64_t key = conn->get_signed_at(key_index);
+				if(skip_delivered){
+					skip_delivered = false;
+					if(key == last_key){
+						// 这是上次已经交付的最后一行。
+						continue;
+					}
+				}
+				POSEIDON_THROW_UNLESS(!has_last_key || (key > last_key), Basic_exception, Rcnts::view("Duplicate key found, key_column must be unique"));
+				has_last_key = true;
+				last_key = key;
+				AUTO(object, m_factory());
+				if(!indices_resolved){
+					object->resolve_field_indices(const_conn, indices);
+					indices_resolved = true;
+				}
+				object->fetch_indexed(const_conn, indices);
+				objects.push_back(STD_MOVE(object));
+				if(objects.size() >= chunk_size){
+					deliver(objects, last_key);
+				}
+			}
+			if(!objects.empty()){
+				deliver(objects, last_key);
+			}
+		}
+	};
+
 	class Low_level_access_operation : public Operation_base {
 	private:
 		Query_callback m_callback;
@@ -379,6 +654,7 @@ namespace {
 			boost::shared_ptr<Operation_base> operation;
 			boost::uint64_t due_time;
 			std::size_t retry_count;
+			boost::uint64_t journal_seq;
 		};
 
 	private:
@@ -390,15 +666,32 @@ namespace {
 		volatile bool m_urgent; // 无视延迟写入，一次性处理队列中所有操作。
 		boost::container::deque<Operation_queue_element> m_queue;
 
+		boost::scoped_ptr<Write_journal> m_journal;
+
 	public:
-		Mysql_thread()
+		explicit Mysql_thread(std::size_t index)
 			: m_running(false)
 			, m_urgent(false), m_queue()
 		{
-			//
+			const AUTO_REF(journal_dir, Main_config::get<std::string>("mysql_journal_dir"));
+			if(!journal_dir.empty()){
+				const AUTO(compact_size, Main_config::get<boost::uint64_t>("mysql_journal_compact_size", 16777216));
+				m_journal.reset(new Write_journal(make_journal_path(journal_dir, index), compact_size));
+			}
 		}
 
 	private:
+		void flush_journal() NOEXCEPT {
+			if(!m_journal){
+				return;
+			}
+			try {
+				m_journal->flush();
+			} catch(std::exception &e){
+				POSEIDON_LOG_ERROR("Error flushing MySQL journal: what = ", e.what());
+			}
+		}
+
 		bool pump_one_operation(boost::shared_ptr<Mysql::Connection> &master_conn, boost::shared_ptr<Mysql::Connection> &slave_conn) NOEXCEPT {
 			POSEIDON_PROFILE_ME;
 
@@ -433,11 +726,13 @@ namespace {
 				if(!old_write_stamp){
 					execute_it = true;
 				} else if(old_write_stamp == elem){
+					// 必须在生成 SQL 语句之前清除合并标记，参见 Mysql::Object_base::invalidate()。
 					combinable_object->set_combined_write_stamp(NULLPTR);
 					execute_it = true;
 				}
 			}
 			if(execute_it){
+				const AUTO(begin_time, get_hi_res_mono_clock());
 				try {
 					operation->generate_sql(query);
 					POSEIDON_LOG_DEBUG("Executing SQL: table = ", operation->get_table(), ", query = ", query);
@@ -459,8 +754,10 @@ namespace {
 					::strcpy(err_msg, "Unknown exception");
 				}
 				conn->discard_result();
+				g_operation_duration.observe(static_cast<boost::uint64_t>(std::max(get_hi_res_mono_clock() - begin_time, 0.0) * 1000));
 			}
 			if(except){
+				g_operation_failures.add();
 				const AUTO(max_retry_count, Main_config::get<std::size_t>("mysql_max_retry_count", 3));
 				const AUTO(retry_count, ++(elem->retry_count));
 				if(retry_count < max_retry_count){
@@ -481,8 +778,12 @@ namespace {
 					promise->set_success(false);
 				}
 			}
+			if(elem->journal_seq != 0){
+				m_journal->acknowledge(elem->journal_seq);
+			}
 			const Mutex::Unique_lock lock(m_mutex);
 			m_queue.pop_front();
+			g_queue_size.subtract(1);
 			return true;
 		}
 
@@ -492,8 +793,10 @@ namespace {
 
 			boost::shared_ptr<Mysql::Connection> master_conn, slave_conn;
 			unsigned timeout = 0;
+			boost::uint64_t next_journal_flush_time = 0;
 			for(;;){
 				const AUTO(reconnect_delay, Main_config::get<boost::uint64_t>("mysql_reconn_delay", 5000));
+				const AUTO(journal_flush_interval, Main_config::get<boost::uint64_t>("mysql_journal_flush_interval", 100));
 				bool busy;
 				do {
 					while(!master_conn){
@@ -524,6 +827,13 @@ namespace {
 					}
 					busy = pump_one_operation(master_conn, slave_conn);
 					timeout = std::min<unsigned>(timeout * 2u + 1u, !busy * 100u);
+
+					// 成组提交：空闲时或者每隔一段时间才同步一次日志。
+					const AUTO(now, get_fast_mono_clock());
+					if(!busy || (now >= next_journal_flush_time)){
+						flush_journal();
+						next_journal_flush_time = saturated_add(now, journal_flush_interval);
+					}
 				} while(busy);
 
 				Mutex::Unique_lock lock(m_mutex);
@@ -533,6 +843,11 @@ namespace {
 				m_new_operation.timed_wait(lock, timeout);
 			}
 
+			flush_journal();
+			if(m_journal && (m_journal->get_unacknowledged_count() == 0)){
+				// 所有操作都已经完成，日志不再需要。
+				::unlink(m_journal->get_path().c_str());
+			}
 			POSEIDON_LOG(Logger::special_major | Logger::level_info, "MySQL thread stopped.");
 		}
 
@@ -556,18 +871,22 @@ namespace {
 		void wait_till_idle(){
 			for(;;){
 				std::size_t pending_objects;
-				std::string current_sql;
+				std::string current_table;
 				{
 					const Mutex::Unique_lock lock(m_mutex);
 					pending_objects = m_queue.size();
 					if(pending_objects == 0){
 						break;
 					}
-					m_queue.front().operation->generate_sql(current_sql);
+					// 不能在这里生成 SQL 语句，那样会清除字段的修改标记。
+					const AUTO(table, m_queue.front().operation->get_table());
+					if(table){
+						current_table = table;
+					}
 					atomic_store(m_urgent, true, memory_order_release);
 					m_new_operation.signal();
 				}
-				POSEIDON_LOG(Logger::special_major | Logger::level_info, "Waiting for SQL queries to complete: pending_objects = ", pending_objects, ", current_sql = ", current_sql);
+				POSEIDON_LOG(Logger::special_major | Logger::level_info, "Waiting for SQL queries to complete: pending_objects = ", pending_objects, ", current_table = ", current_table);
 
 				::timespec req;
 				req.tv_sec = 0;
@@ -590,10 +909,17 @@ namespace {
 			// 有紧急操作时无视写入延迟，这个逻辑不在这里处理。
 			const AUTO(due_time, saturated_add(now, save_delay));
 
+			std::string journal_sql;
+			const bool journaled = m_journal && operation->generate_journal_sql(journal_sql);
+
 			const Mutex::Unique_lock lock(m_mutex);
 			POSEIDON_THROW_UNLESS(atomic_load(m_running, memory_order_consume), Exception, Rcnts::view("MySQL thread is being shut down"));
 			Operation_queue_element elem = { STD_MOVE(operation), due_time };
+			if(journaled){
+				elem.journal_seq = m_journal->append(STD_MOVE(journal_sql));
+			}
 			m_queue.push_back(STD_MOVE(elem));
+			g_queue_size.add(1);
 			if(combinable_object){
 				const AUTO(old_write_stamp, combinable_object->get_combined_write_stamp());
 				if(!old_write_stamp){
@@ -644,7 +970,7 @@ namespace {
 				AUTO_REF(test_thread, g_threads.at(i));
 				if(!test_thread){
 					POSEIDON_LOG(Logger::special_major | Logger::level_debug, "Creating new MySQL thread ", i, " for table ", table);
-					thread = boost::make_shared<Mysql_thread>();
+					thread = boost::make_shared<Mysql_thread>(i);
 					thread->start();
 					test_thread = thread;
 					route.thread = thread;
@@ -669,6 +995,26 @@ namespace {
 		operation->set_probe(STD_MOVE(probe));
 		thread->add_operation(STD_MOVE(operation), urgent);
 	}
+	// 不经过路由，直接把操作交给指定的线程，必要时创建该线程。
+	void add_operation_by_index(std::size_t index, boost::shared_ptr<Operation_base> operation, bool urgent){
+		POSEIDON_PROFILE_ME;
+		POSEIDON_THROW_UNLESS(!g_threads.empty(), Basic_exception, Rcnts::view("MySQL support is not enabled"));
+
+		boost::shared_ptr<Mysql_thread> thread;
+		{
+			const Mutex::Unique_lock lock(g_router_mutex);
+
+			const AUTO(i, index % g_threads.size());
+			AUTO_REF(test_thread, g_threads.at(i));
+			if(!test_thread){
+				POSEIDON_LOG(Logger::special_major | Logger::level_debug, "Creating new MySQL thread ", i);
+				test_thread = boost::make_shared<Mysql_thread>(i);
+				test_thread->start();
+			}
+			thread = test_thread;
+		}
+		thread->add_operation(STD_MOVE(operation), urgent);
+	}
 	void add_operation_all(boost::shared_ptr<Operation_base> operation, bool urgent){
 		POSEIDON_PROFILE_ME;
 		POSEIDON_THROW_UNLESS(!g_threads.empty(), Basic_exception, Rcnts::view("MySQL support is not enabled"));
@@ -682,6 +1028,70 @@ namespace {
 			thread->add_operation(operation, urgent);
 		}
 	}
+
+	// 对象缓存。
+	struct Cache_element {
+		// Invariants.
+		std::string key;
+		boost::shared_ptr<Mysql::Object_base> object;
+		boost::shared_ptr<const Promise> promise;
+		// Indices.
+		boost::uint64_t access_stamp;
+	};
+	POSEIDON_MULTI_INDEX_MAP(Cache_map, Cache_element,
+		POSEIDON_UNIQUE_MEMBER_INDEX(key)
+		POSEIDON_MULTI_MEMBER_INDEX(access_stamp)
+	);
+
+	// 每次淘汰最多检查这么多个对象。
+	const std::size_t s_cache_scan_limit = 64;
+
+	volatile std::size_t g_cache_max_count = 0;
+
+	Mutex g_cache_mutex;
+	Cache_map g_cache_map;
+	boost::uint64_t g_cache_stamp = 0;
+
+	std::string make_cache_key(const char *table, const std::string &primary_key){
+		std::string key;
+		key.reserve(std::strlen(table) + 1 + primary_key.size());
+		key += table;
+		key += '\0';
+		key += primary_key;
+		return key;
+	}
+	std::string generate_primary_key(const Mysql::Object_base &object){
+		AUTO(primary_key, object.generate_primary_key());
+		POSEIDON_THROW_UNLESS(!primary_key.empty(), Basic_exception, Rcnts::view("No primary key has been declared for this MySQL object"));
+		return primary_key;
+	}
+	bool has_load_failed(const Promise &promise){
+		return promise.is_satisfied() && promise.would_throw();
+	}
+
+	// 必须在持有 g_cache_mutex 时调用。
+	// 只有被缓存独占（没有其他人持有，也没有尚未完成的操作）的对象才能淘汰。被修改过的对象先保存，保存完成之后再淘汰。
+	// 不能淘汰的对象被移到最近使用的一端。
+	void shrink_cache(std::size_t max_count){
+		std::size_t scan_count = std::min(g_cache_map.size(), s_cache_scan_limit);
+		while((g_cache_map.size() > max_count) && (scan_count != 0)){
+			--scan_count;
+			const AUTO(it, g_cache_map.begin<1>());
+			if(!it->promise->is_satisfied() || (it->object.use_count() > 1)){
+				g_cache_map.set_key<1, 1>(it, ++g_cache_stamp);
+				continue;
+			}
+			if(!it->promise->would_throw() && it->object->has_dirty_fields()){
+				POSEIDON_LOG_DEBUG("Saving dirty MySQL object before eviction: table = ", it->object->get_table());
+				Mysql_daemon::enqueue_for_saving(it->object, true, false);
+				g_cache_map.set_key<1, 1>(it, ++g_cache_stamp);
+				continue;
+			}
+			g_cache_map.erase<1>(it);
+			g_cache_evictions.add();
+		}
+		g_cache_size.set(static_cast<boost::int64_t>(g_cache_map.size()));
+	}
 }
 
 void Mysql_daemon::start(){
@@ -732,8 +1142,22 @@ void Mysql_daemon::start(){
 				std::terminate();
 			}
 		}
+
+		const AUTO(journal_dir, Main_config::get<std::string>("mysql_journal_dir"));
+		if(!journal_dir.empty()){
+			POSEIDON_LOG(Logger::special_major | Logger::level_info, "Replaying MySQL journals...");
+			try {
+				replay_journals(journal_dir, master_conn);
+			} catch(std::exception &e){
+				POSEIDON_LOG_FATAL("Could not replay MySQL journals: ", e.what());
+				POSEIDON_LOG_WARNING("To disable MySQL journal, set `mysql_journal_dir` in `main.conf` to an empty string.");
+				std::terminate();
+			}
+			atomic_store(g_journal_enabled, true, memory_order_release);
+		}
 	}
 	g_threads.resize(max_thread_count);
+	atomic_store(g_cache_max_count, Main_config::get<std::size_t>("mysql_object_cache_max_count", 65536), memory_order_release);
 
 	POSEIDON_LOG(Logger::special_major | Logger::level_info, "MySQL daemon started.");
 }
@@ -743,6 +1167,20 @@ void Mysql_daemon::stop(){
 	}
 	POSEIDON_LOG(Logger::special_major | Logger::level_info, "Stopping MySQL daemon...");
 
+	// 缓存中被修改过的对象必须在线程退出之前保存。
+	atomic_store(g_cache_max_count, 0, memory_order_release);
+	{
+		const Mutex::Unique_lock lock(g_cache_mutex);
+		for(AUTO(it, g_cache_map.begin<0>()); it != g_cache_map.end<0>(); ++it){
+			if(!it->promise->would_throw() && it->object->has_dirty_fields()){
+				try {
+					enqueue_for_saving(it->object, true, true);
+				} catch(std::exception &e){
+					POSEIDON_LOG_ERROR("Failed to save MySQL object: table = ", it->object->get_table(), ", what = ", e.what());
+				}
+			}
+		}
+	}
 	for(std::size_t i = 0; i < g_threads.size(); ++i){
 		const AUTO_REF(thread, g_threads.at(i));
 		if(!thread){
@@ -762,10 +1200,17 @@ void Mysql_daemon::stop(){
 
 	POSEIDON_LOG(Logger::special_major | Logger::level_info, "MySQL daemon stopped.");
 
+	atomic_store(g_journal_enabled, false, memory_order_release);
+	clear_cache();
+
 	const Mutex::Unique_lock lock(g_router_mutex);
 	g_threads.clear();
 }
 
+bool Mysql_daemon::is_journal_enabled(){
+	return atomic_load(g_journal_enabled, memory_order_consume);
+}
+
 boost::shared_ptr<Mysql::Connection> Mysql_daemon::create_connection(bool from_slave){
 	return real_create_connection(from_slave, VAL_INIT);
 }
@@ -785,6 +1230,7 @@ boost::shared_ptr<const Promise> Mysql_daemon::enqueue_for_saving(boost::shared_
 	const char *const table = object->get_table();
 	AUTO(operation, boost::make_shared<Save_operation>(promise, STD_MOVE(object), to_replace));
 	add_operation_by_table(table, STD_MOVE_IDN(operation), urgent);
+	g_saves_enqueued.add();
 	return STD_MOVE_IDN(promise);
 }
 boost::shared_ptr<const Promise> Mysql_daemon::enqueue_for_loading(boost::shared_ptr<Mysql::Object_base> object, std::string query){
@@ -815,6 +1261,38 @@ boost::shared_ptr<const Promise> Mysql_daemon::enqueue_for_batch_loading(Query_c
 	return STD_MOVE_IDN(promise);
 }
 
+boost::shared_ptr<const Promise> Mysql_daemon::enqueue_for_parallel_loading(Chunk_callback callback, Object_factory factory, const char *key_column, boost::int64_t key_begin, boost::int64_t key_end, std::size_t partition_count){
+	POSEIDON_PROFILE_ME;
+	POSEIDON_THROW_UNLESS(key_begin <= key_end, Basic_exception, Rcnts::view("Invalid key range"));
+
+	const char *const table = factory()->get_table();
+	if(partition_count == 0){
+		partition_count = std::max<std::size_t>(g_threads.size(), 1);
+	}
+	// 用无符号数计算，避免溢出。
+	const AUTO(key_span, static_cast<boost::uint64_t>(key_end) - static_cast<boost::uint64_t>(key_begin));
+	if(partition_count > key_span){
+		partition_count = static_cast<std::size_t>(key_span);
+	}
+	POSEIDON_LOG_DEBUG("Parallel loading: table = ", table, ", key_column = ", key_column, ", key_begin = ", key_begin, ", key_end = ", key_end, ", partition_count = ", partition_count);
+
+	AUTO(promise, boost::make_shared<Promise>());
+	{
+		// 所有的段都被销毁之后 context 才会设定 promise。key_span 为零时这里直接设定。
+		const AUTO(context, boost::make_shared<Parallel_load_context>(promise));
+		boost::uint64_t offset = 0;
+		for(std::size_t i = 0; i < partition_count; ++i){
+			const AUTO(size, key_span / partition_count + (i < key_span % partition_count));
+			const AUTO(begin, static_cast<boost::int64_t>(static_cast<boost::uint64_t>(key_begin) + offset));
+			offset += size;
+			const AUTO(end, static_cast<boost::int64_t>(static_cast<boost::uint64_t>(key_begin) + offset));
+			AUTO(operation, boost::make_shared<Parallel_load_operation>(boost::make_shared<Promise>(), context, callback, factory, table, std::string(key_column), begin, end));
+			add_operation_by_index(i, STD_MOVE_IDN(operation), true);
+		}
+	}
+	return STD_MOVE_IDN(promise);
+}
+
 void Mysql_daemon::enqueue_for_low_level_access(const boost::shared_ptr<Promise> &promise, Query_callback callback, const char *table_hint, bool from_slave){
 	const char *const table = table_hint;
 	AUTO(operation, boost::make_shared<Low_level_access_operation>(promise, STD_MOVE(callback), table_hint, from_slave));
@@ -828,4 +1306,88 @@ boost::shared_ptr<const Promise> Mysql_daemon::enqueue_for_waiting_for_all_async
 	return STD_MOVE_IDN(promise);
 }
 
+boost::shared_ptr<const Promise> Mysql_daemon::enqueue_for_loading_cached(boost::shared_ptr<Mysql::Object_base> &object){
+	POSEIDON_PROFILE_ME;
+
+	const char *const table = object->get_table();
+	const AUTO(primary_key, generate_primary_key(*object));
+	std::string query;
+	query.reserve(64 + primary_key.size());
+	query += "SELECT * FROM `";
+	query += table;
+	query += "` WHERE ";
+	query += primary_key;
+
+	const AUTO(max_count, atomic_load(g_cache_max_count, memory_order_consume));
+	if(max_count == 0){
+		g_cache_misses.add();
+		return enqueue_for_loading(object, STD_MOVE(query));
+	}
+	AUTO(key, make_cache_key(table, primary_key));
+	const Mutex::Unique_lock lock(g_cache_mutex);
+	const AUTO(it, g_cache_map.find<0>(key));
+	if(it != g_cache_map.end<0>()){
+		if(!has_load_failed(*(it->promise))){
+			// 正在加载或者已经加载完成。并发的加载共用同一个 Promise。
+			g_cache_hits.add();
+			g_cache_map.set_key<0, 1>(it, ++g_cache_stamp);
+			object = it->object;
+			return it->promise;
+		}
+		// 上次加载失败了（例如数据库中没有这一行），重新加载。
+		g_cache_map.erase<0>(it);
+	}
+	g_cache_misses.add();
+	AUTO(promise, enqueue_for_loading(object, STD_MOVE(query)));
+	Cache_element elem = { STD_MOVE(key), object, promise };
+	elem.access_stamp = ++g_cache_stamp;
+	g_cache_map.insert(STD_MOVE(elem));
+	shrink_cache(max_count);
+	return promise;
+}
+bool Mysql_daemon::insert_into_cache(const boost::shared_ptr<Mysql::Object_base> &object){
+	POSEIDON_PROFILE_ME;
+
+	const char *const table = object->get_table();
+	const AUTO(primary_key, generate_primary_key(*object));
+
+	const AUTO(max_count, atomic_load(g_cache_max_count, memory_order_consume));
+	if(max_count == 0){
+		// 缓存被禁用。
+		return true;
+	}
+	AUTO(promise, boost::make_shared<Promise>());
+	promise->set_success();
+	Cache_element elem = { make_cache_key(table, primary_key), object, STD_MOVE_IDN(promise) };
+	const Mutex::Unique_lock lock(g_cache_mutex);
+	elem.access_stamp = ++g_cache_stamp;
+	if(!g_cache_map.insert(STD_MOVE(elem)).second){
+		return false;
+	}
+	shrink_cache(max_count);
+	return true;
+}
+void Mysql_daemon::erase_from_cache(const Mysql::Object_base &object){
+	POSEIDON_PROFILE_ME;
+
+	const char *const table = object.get_table();
+	const AUTO(primary_key, generate_primary_key(object));
+
+	const AUTO(key, make_cache_key(table, primary_key));
+	const Mutex::Unique_lock lock(g_cache_mutex);
+	g_cache_map.erase<0>(key);
+	g_cache_size.set(static_cast<boost::int64_t>(g_cache_map.size()));
+}
+void Mysql_daemon::clear_cache(){
+	POSEIDON_PROFILE_ME;
+
+	Cache_map cache_map;
+	{
+		const Mutex::Unique_lock lock(g_cache_mutex);
+		cache_map.swap(g_cache_map);
+		g_cache_size.set(0);
+	}
+	// 对象在锁外析构。
+}
+
 }
@@ -6,9 +6,15 @@
 
 #include "../cxx_ver.hpp"
 #include "../mysql/fwd.hpp"
+#include "../exception.hpp"
 #include <boost/shared_ptr.hpp>
 #include <boost/function.hpp>
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/container/vector.hpp>
 #include <string>
+#include <cstddef>
 
 namespace Poseidon {
 
@@ -20,10 +26,32 @@ private:
 
 public:
 	typedef boost::function<void (const boost::shared_ptr<Mysql::Connection> &)> Query_callback;
+	typedef boost::function<boost::shared_ptr<Mysql::Object_base> ()> Object_factory;
+	typedef boost::function<void (boost::container::vector<boost::shared_ptr<Mysql::Object_base> > &)> Chunk_callback;
+
+private:
+	template<typename ObjectT>
+	static boost::shared_ptr<Mysql::Object_base> create_typed_object(){
+		return boost::make_shared<ObjectT>();
+	}
+	template<typename ObjectT>
+	static void forward_typed_chunk(const boost::function<void (boost::container::vector<boost::shared_ptr<ObjectT> > &)> &callback, boost::container::vector<boost::shared_ptr<Mysql::Object_base> > &objects){
+		boost::container::vector<boost::shared_ptr<ObjectT> > typed;
+		typed.reserve(objects.size());
+		for(AUTO(it, objects.begin()); it != objects.end(); ++it){
+			typed.push_back(boost::static_pointer_cast<ObjectT>(*it));
+		}
+		callback(typed);
+	}
+
+public:
 
 	static void start();
 	static void stop();
 
+	// 如果为 true，写操作在排队时记入日志，因此保存操作不会在入队时合并。
+	static bool is_journal_enabled();
+
 	// 同步接口。
 	static boost::shared_ptr<Mysql::Connection> create_connection(bool from_slave = false);
 
@@ -35,9 +63,38 @@ public:
 	static boost::shared_ptr<const Promise> enqueue_for_deleting(const char *table_hint, std::string query);
 	static boost::shared_ptr<const Promise> enqueue_for_batch_loading(Query_callback callback, const char *table_hint, std::string query);
 
+	// 并行加载。把 key_column（必须是值唯一的整数列，一般为主键；遇到重复的键时这一段失败）在 [key_begin, key_end) 中的行均分为 partition_count 段（为零时等于线程数），分别由不同的线程和连接加载。
+	// 每一行用 factory 创建一个对象，字段下标在每个结果集中只查找一次。对象每凑满 mysql_parallel_load_chunk_size 个交给 callback 一次。
+	// callback 在数据库线程中调用，不同的段可能并发调用。同一段中的行按 key_column 升序交付，失败重试时从上次交付的位置继续。
+	// 所有的段都结束之后 promise 才被设定。各段不经过按表路由，因此看不到其他线程中尚未执行的写操作。
+	static boost::shared_ptr<const Promise> enqueue_for_parallel_loading(Chunk_callback callback, Object_factory factory, const char *key_column, boost::int64_t key_begin, boost::int64_t key_end, std::size_t partition_count = 0);
+
 	static void enqueue_for_low_level_access(const boost::shared_ptr<Promise> &promise, Query_callback callback, const char *table_hint, bool from_slave = false);
 
 	static boost::shared_ptr<const Promise> enqueue_for_waiting_for_all_async_operations();
+
+	// 对象缓存。以表名和主键为键，只能用于声明了主键的对象。
+	// 调用前只需要设定 object 的主键字段。如果缓存中已经有同一主键的对象（可能正在加载），object 被替换为该对象，否则将其放入缓存并从数据库中加载。
+	// 被淘汰的对象如果有字段被修改过，会先保存再淘汰。
+	static boost::shared_ptr<const Promise> enqueue_for_loading_cached(boost::shared_ptr<Mysql::Object_base> &object);
+	// 把新创建的对象放入缓存。如果缓存中已经有同一主键的对象，返回 false。
+	static bool insert_into_cache(const boost::shared_ptr<Mysql::Object_base> &object);
+	static void erase_from_cache(const Mysql::Object_base &object);
+	static void clear_cache();
+
+	template<typename ObjectT>
+	static boost::shared_ptr<const Promise> enqueue_for_loading_cached(boost::shared_ptr<ObjectT> &object){
+		boost::shared_ptr<Mysql::Object_base> base = object;
+		AUTO(promise, enqueue_for_loading_cached(base));
+		AUTO(derived, boost::dynamic_pointer_cast<ObjectT>(base));
+		POSEIDON_THROW_ASSERT(derived);
+		object = STD_MOVE_IDN(derived);
+		return promise;
+	}
+	template<typename ObjectT>
+	static boost::shared_ptr<const Promise> enqueue_for_parallel_loading(boost::function<void (boost::container::vector<boost::shared_ptr<ObjectT> > &)> callback, const char *key_column, boost::int64_t key_begin, boost::int64_t key_end, std::size_t partition_count = 0){
+		return enqueue_for_parallel_loading(boost::bind(&forward_typed_chunk<ObjectT>, STD_MOVE_IDN(callback), _1), &create_typed_object<ObjectT>, key_column, key_begin, key_end, partition_count);
+	}
 };
 
 }
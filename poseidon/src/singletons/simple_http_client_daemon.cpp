@@ -7,6 +7,7 @@
 #include "dns_daemon.hpp"
 #include "job_dispatcher.hpp"
 #include "epoll_daemon.hpp"
+#include "timer_daemon.hpp"
 #include "../log.hpp"
 #include "../atomic.hpp"
 #include "../profiler.hpp"
@@ -15,9 +16,13 @@
 #include "../system_exception.hpp"
 #include "../errno.hpp"
 #include "../checked_arithmetic.hpp"
+#include "../time.hpp"
 #include "../http/exception.hpp"
 #include "../http/low_level_client.hpp"
 #include "../http/urlencoded.hpp"
+#include <boost/container/deque.hpp>
+#include <boost/container/map.hpp>
+#include <boost/bind.hpp>
 #include <poll.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -38,6 +43,21 @@ namespace {
 		}
 	}
 
+	// 幂等的请求在复用的连接失败之后可以安全地重发；其他请求可能已经被对端处理过，只能把错误交给调用者。
+	bool is_idempotent(Http::Verb verb){
+		switch(verb){
+		case Http::verb_get:
+		case Http::verb_head:
+		case Http::verb_put:
+		case Http::verb_delete:
+		case Http::verb_trace:
+		case Http::verb_options:
+			return true;
+		default:
+			return false;
+		}
+	}
+
 	bool check_redirect(Simple_http_request &request, const Http::Response_headers &respones_headers){
 		POSEIDON_PROFILE_ME;
 
@@ -147,7 +167,148 @@ namespace {
 		return params;
 	}
 
-	void poll_internal(const boost::shared_ptr<Socket_base> &socket){
+	std::string make_origin(const Simple_http_client_params &params){
+		char str[16];
+		const unsigned len = (unsigned)std::sprintf(str, ":%u", (unsigned)params.port);
+		std::string origin;
+		origin.reserve(16 + params.host.size());
+		origin += params.use_ssl ? "https://" : "http://";
+		origin += params.host;
+		origin.append(str, len);
+		return origin;
+	}
+
+	class Simple_http_client : public Http::Low_level_client {
+	public:
+		// 已经发出、尚未收到完整响应的请求。同一连接上的响应按请求的顺序到达。
+		struct Request_state {
+			boost::shared_ptr<Promise> promise;
+			Http::Response_headers response_headers;
+			Stream_buffer response_entity;
+			bool headers_received;
+			bool finished;
+		};
+
+	private:
+		const std::string m_origin;
+
+		mutable Mutex m_mutex;
+		boost::container::deque<boost::shared_ptr<Request_state> > m_pending;
+		bool m_reusable;
+		boost::uint64_t m_idle_since;
+
+	public:
+		// 以下成员受 g_pool_mutex 保护。
+		std::size_t m_users;
+
+	public:
+		Simple_http_client(const Sock_addr &sock_addr, bool use_ssl, std::string origin)
+			: Http::Low_level_client(sock_addr, use_ssl)
+			, m_origin(STD_MOVE(origin)), m_pending(), m_reusable(true), m_idle_since(0)
+			, m_users(0)
+		{
+			//
+		}
+
+	protected:
+		void on_close(int err_code) OVERRIDE {
+			boost::container::deque<boost::shared_ptr<Request_state> > pending;
+			{
+				const Mutex::Unique_lock lock(m_mutex);
+				m_reusable = false;
+				pending.swap(m_pending);
+			}
+			for(AUTO(it, pending.begin()); it != pending.end(); ++it){
+				const AUTO_REF(promise, (*it)->promise);
+				if(promise){
+					promise->set_success(false);
+				}
+			}
+			return Http::Low_level_client::on_close(err_code);
+		}
+
+		void on_low_level_response_headers(Http::Response_headers response_headers, boost::uint64_t content_length) OVERRIDE {
+			const Mutex::Unique_lock lock(m_mutex);
+			POSEIDON_THROW_UNLESS(!m_pending.empty(), Exception, Rcnts::view("Unexpected HTTP response"));
+			const AUTO_REF(state, m_pending.front());
+			// 以关闭连接标识结束的响应之后无法复用该连接。
+			if(!Http::is_keep_alive_enabled(response_headers) || (content_length == content_length_until_eof)){
+				m_reusable = false;
+			}
+			state->response_headers = STD_MOVE(response_headers);
+			state->headers_received = true;
+		}
+		void on_low_level_response_entity(boost::uint64_t /*entity_offset*/, Stream_buffer entity) OVERRIDE {
+			const Mutex::Unique_lock lock(m_mutex);
+			POSEIDON_THROW_UNLESS(!m_pending.empty(), Exception, Rcnts::view("Unexpected HTTP response"));
+			m_pending.front()->response_entity.splice(entity);
+		}
+		boost::shared_ptr<Http::Upgraded_session_base> on_low_level_response_end(boost::uint64_t /*content_length*/, Option_map /*headers*/) OVERRIDE {
+			boost::shared_ptr<Request_state> state;
+			bool reusable;
+			{
+				const Mutex::Unique_lock lock(m_mutex);
+				POSEIDON_THROW_UNLESS(!m_pending.empty(), Exception, Rcnts::view("Unexpected HTTP response"));
+				state = STD_MOVE(m_pending.front());
+				m_pending.pop_front();
+				state->finished = true;
+				reusable = m_reusable;
+				if(m_pending.empty()){
+					m_idle_since = get_fast_mono_clock();
+				}
+			}
+			if(!reusable){
+				shutdown_read();
+				shutdown_write();
+			}
+			const AUTO_REF(promise, state->promise);
+			if(promise){
+				promise->set_success(false);
+			}
+			return VAL_INIT;
+		}
+
+	public:
+		const std::string &get_origin() const {
+			return m_origin;
+		}
+		bool is_reusable() const {
+			const Mutex::Unique_lock lock(m_mutex);
+			return m_reusable && !has_been_shutdown_read() && !has_been_shutdown_write();
+		}
+		bool is_idle() const {
+			const Mutex::Unique_lock lock(m_mutex);
+			return m_pending.empty();
+		}
+		boost::uint64_t get_idle_since() const {
+			const Mutex::Unique_lock lock(m_mutex);
+			return m_idle_since;
+		}
+
+		// 如果连接已被关闭，返回空指针。
+		boost::shared_ptr<Request_state> send(Http::Request_headers request_headers, Stream_buffer request_entity, boost::shared_ptr<Promise> promise, bool keep_alive){
+			request_headers.headers.set(Rcnts::view("Connection"), keep_alive ? "Keep-Alive" : "Close");
+			request_headers.headers.erase("Expect");
+			AUTO(state, boost::make_shared<Request_state>());
+			state->promise = STD_MOVE(promise);
+			state->headers_received = false;
+			state->finished = false;
+			// 发送和入队必须是原子的，否则流水线上的响应可能会错位。
+			const Mutex::Unique_lock lock(m_mutex);
+			if(!keep_alive){
+				m_reusable = false;
+			}
+			m_pending.push_back(state);
+			if(!Http::Low_level_client::send(STD_MOVE(request_headers), STD_MOVE(request_entity))){
+				m_pending.pop_back();
+				m_reusable = false;
+				return VAL_INIT;
+			}
+			return state;
+		}
+	};
+
+	void poll_internal(const boost::shared_ptr<Socket_base> &socket, const boost::shared_ptr<Simple_http_client::Request_state> &state){
 		POSEIDON_PROFILE_ME;
 
 		bool readable = false, writable = false;
@@ -197,61 +358,167 @@ namespace {
 				socket->mark_shutdown();
 				socket->on_close(err_code);
 			}
-		} while(!socket->has_been_shutdown_read());
+		} while(!state->finished && !socket->has_been_shutdown_read());
 	}
 
-	class Simple_http_client : public Http::Low_level_client, public Promise {
-	private:
-		Http::Response_headers m_response_headers;
-		Stream_buffer m_response_entity;
-		bool m_finished;
+	typedef boost::container::multimap<std::string, boost::shared_ptr<Simple_http_client> > Client_map;
 
-	public:
-		Simple_http_client(const Sock_addr &sock_addr, bool use_ssl)
-			: Http::Low_level_client(sock_addr, use_ssl)
-			, m_response_headers(), m_response_entity(), m_finished(false)
-		{
-			//
+	Mutex g_pool_mutex;
+	// 异步接口：所有可复用的连接，包括正在使用的。
+	Client_map g_async_clients;
+	// 同步接口：空闲的连接。
+	Client_map g_sync_idle_clients;
+	boost::shared_ptr<Timer> g_prune_timer;
+
+	volatile boost::uint64_t g_connections_created = 0;
+	volatile boost::uint64_t g_connections_reused = 0;
+	volatile boost::uint64_t g_requests_pipelined = 0;
+	volatile boost::uint64_t g_stale_retries = 0;
+
+	std::size_t get_max_idle_connections(){
+		return Main_config::get<std::size_t>("simple_http_client_max_idle_connections", 4);
+	}
+	boost::uint64_t get_idle_timeout(){
+		return Main_config::get<boost::uint64_t>("simple_http_client_idle_timeout", 30000);
+	}
+
+	// 调用者必须持有 g_pool_mutex。
+	void erase_client(Client_map &clients, const boost::shared_ptr<Simple_http_client> &client){
+		AUTO(range, clients.equal_range(client->get_origin()));
+		for(AUTO(it, range.first); it != range.second; ++it){
+			if(it->second == client){
+				clients.erase(it);
+				break;
+			}
 		}
+	}
 
-	protected:
-		void on_close(int err_code) OVERRIDE {
-			Promise::set_success(false);
-			return Http::Low_level_client::on_close(err_code);
+	// 返回空指针表示需要新建连接。
+	boost::shared_ptr<Simple_http_client> acquire_async_client(const std::string &origin, bool pipelinable){
+		POSEIDON_PROFILE_ME;
+
+		const AUTO(max_pipeline_depth, Main_config::get<std::size_t>("simple_http_client_max_pipeline_depth", 1));
+
+		const Mutex::Unique_lock lock(g_pool_mutex);
+		boost::shared_ptr<Simple_http_client> busy_client;
+		AUTO(range, g_async_clients.equal_range(origin));
+		AUTO(it, range.first);
+		while(it != range.second){
+			const AUTO(client, it->second);
+			if(!client->is_reusable()){
+				it = g_async_clients.erase(it);
+				continue;
+			}
+			if(client->m_users == 0){
+				client->set_timeout(-1ull);
+				client->m_users = 1;
+				atomic_add(g_connections_reused, 1, memory_order_relaxed);
+				return client;
+			}
+			if(pipelinable && !busy_client && (client->m_users < max_pipeline_depth)){
+				busy_client = client;
+			}
+			++it;
+		}
+		if(busy_client){
+			busy_client->m_users += 1;
+			atomic_add(g_connections_reused, 1, memory_order_relaxed);
+			atomic_add(g_requests_pipelined, 1, memory_order_relaxed);
 		}
+		return busy_client;
+	}
+	void register_async_client(const boost::shared_ptr<Simple_http_client> &client){
+		const Mutex::Unique_lock lock(g_pool_mutex);
+		client->m_users = 1;
+		g_async_clients.emplace(client->get_origin(), client);
+	}
+	void release_async_client(const boost::shared_ptr<Simple_http_client> &client){
+		POSEIDON_PROFILE_ME;
 
-		void on_low_level_response_headers(Http::Response_headers response_headers, boost::uint64_t /*content_length*/) OVERRIDE {
-			m_response_headers = STD_MOVE(response_headers);
-			m_finished = true;
+		const Mutex::Unique_lock lock(g_pool_mutex);
+		client->m_users -= 1;
+		if(!client->is_reusable()){
+			erase_client(g_async_clients, client);
+			return;
 		}
-		void on_low_level_response_entity(boost::uint64_t /*entity_offset*/, Stream_buffer entity) OVERRIDE {
-			m_response_entity.splice(entity);
+		if(client->m_users != 0){
+			return;
 		}
-		boost::shared_ptr<Http::Upgraded_session_base> on_low_level_response_end(boost::uint64_t /*content_length*/, Option_map /*headers*/) OVERRIDE {
-			shutdown_read();
-			shutdown_write();
-			return VAL_INIT;
+		std::size_t idle_count = 0;
+		AUTO(range, g_async_clients.equal_range(client->get_origin()));
+		for(AUTO(it, range.first); it != range.second; ++it){
+			idle_count += (it->second->m_users == 0);
 		}
+		if(idle_count > get_max_idle_connections()){
+			POSEIDON_LOG_DEBUG("Too many idle connections: origin = ", client->get_origin());
+			erase_client(g_async_clients, client);
+			client->shutdown_read();
+			client->shutdown_write();
+			return;
+		}
+		client->set_timeout(get_idle_timeout());
+	}
 
-	public:
-		bool send(Http::Request_headers request_headers, Stream_buffer request_entity){
-			request_headers.headers.set(Rcnts::view("Connection"), "Close");
-			request_headers.headers.erase("Expect");
-			POSEIDON_THROW_UNLESS(Http::Low_level_client::send(STD_MOVE(request_headers), STD_MOVE(request_entity)), Exception, Rcnts::view("Failed to send data to remote server"));
-			return true;
+	boost::shared_ptr<Simple_http_client> acquire_sync_client(const std::string &origin){
+		POSEIDON_PROFILE_ME;
+
+		const AUTO(now, get_fast_mono_clock());
+		const AUTO(idle_timeout, get_idle_timeout());
+
+		const Mutex::Unique_lock lock(g_pool_mutex);
+		AUTO(range, g_sync_idle_clients.equal_range(origin));
+		while(range.first != range.second){
+			const AUTO(client, range.first->second);
+			range.first = g_sync_idle_clients.erase(range.first);
+			if(!client->is_reusable() || (saturated_sub(now, client->get_idle_since()) >= idle_timeout)){
+				continue;
+			}
+			// 空闲连接上有数据可读，说明对端已经关闭了连接。
+			::pollfd pset = { client->get_fd(), POLLIN };
+			if(::poll(&pset, 1, 0) != 0){
+				continue;
+			}
+			atomic_add(g_connections_reused, 1, memory_order_relaxed);
+			return client;
 		}
+		return VAL_INIT;
+	}
+	void release_sync_client(const boost::shared_ptr<Simple_http_client> &client){
+		POSEIDON_PROFILE_ME;
 
-		// WARNING: Only call these functions after `has_been_shutdown_read()` returns `true` to avoid race conditions!
-		Http::Response_headers & get_response_headers(){
-			return m_response_headers;
+		if(!client->is_reusable() || !client->is_idle()){
+			return;
 		}
-		Stream_buffer & get_response_entity(){
-			return m_response_entity;
+		const Mutex::Unique_lock lock(g_pool_mutex);
+		if(g_sync_idle_clients.count(client->get_origin()) >= get_max_idle_connections()){
+			return;
 		}
-		bool is_finished() const {
-			return m_finished;
+		g_sync_idle_clients.emplace(client->get_origin(), client);
+	}
+
+	void prune_timer_proc(boost::uint64_t now){
+		POSEIDON_PROFILE_ME;
+
+		const AUTO(idle_timeout, get_idle_timeout());
+
+		const Mutex::Unique_lock lock(g_pool_mutex);
+		AUTO(it, g_async_clients.begin());
+		while(it != g_async_clients.end()){
+			if(!it->second->is_reusable()){
+				it = g_async_clients.erase(it);
+				continue;
+			}
+			++it;
 		}
-	};
+		it = g_sync_idle_clients.begin();
+		while(it != g_sync_idle_clients.end()){
+			if(!it->second->is_reusable() || (saturated_sub(now, it->second->get_idle_since()) >= idle_timeout)){
+				it = g_sync_idle_clients.erase(it);
+				continue;
+			}
+			++it;
+		}
+	}
 
 	class Async_perform_job : public Job_base {
 	private:
@@ -276,7 +543,7 @@ namespace {
 			Simple_http_response response;
 			STD_EXCEPTION_PTR except;
 			try {
-				boost::shared_ptr<Simple_http_client> client;
+				boost::shared_ptr<Simple_http_client::Request_state> state;
 
 				const bool should_check_redirect = can_be_redirected(request);
 				const AUTO(max_redirect_count, Main_config::get<std::size_t>("simple_http_client_max_redirect_count", 10));
@@ -285,18 +552,53 @@ namespace {
 					const AUTO(verb, request.request_headers.verb);
 					POSEIDON_LOG_DEBUG("Trying: ", Http::get_string_from_verb(verb), " ", request.request_headers.uri);
 					AUTO(params, parse_simple_http_client_params(should_check_redirect ? request.request_headers : STD_MOVE_IDN(request.request_headers)));
-					const AUTO(promised_sock_addr, Dns_daemon::enqueue_for_looking_up(params.host, params.port));
-					Job_dispatcher::yield(promised_sock_addr, true);
-					const AUTO_REF(sock_addr, promised_sock_addr->get());
-					client = boost::make_shared<Simple_http_client>(sock_addr, params.use_ssl);
-					client->set_no_delay(true);
-					client->send(STD_MOVE(params.request_headers), should_check_redirect ? request.request_entity : STD_MOVE_IDN(request.request_entity));
-					Epoll_daemon::add_socket(client);
-					Job_dispatcher::yield(client, true);
-					POSEIDON_THROW_UNLESS(client->is_finished() || (verb == Http::verb_head), Exception, Rcnts::view("Connection was closed prematurely"));
-				} while(should_check_redirect && (--retry_count_remaining != 0) && check_redirect(request, client->get_response_headers()));
-
-				Simple_http_response temp = { STD_MOVE(client->get_response_headers()), STD_MOVE(client->get_response_entity()) };
+					Stream_buffer request_entity = should_check_redirect ? request.request_entity : STD_MOVE_IDN(request.request_entity);
+					// HEAD 响应没有实体，但是可能带有 Content-Length，因此不能复用连接。
+					const bool keep_alive = (verb != Http::verb_head) && (get_max_idle_connections() != 0);
+					const AUTO(origin, make_origin(params));
+					bool may_reuse = keep_alive;
+					for(;;){
+						boost::shared_ptr<Simple_http_client> client;
+						if(may_reuse){
+							client = acquire_async_client(origin, verb == Http::verb_get);
+						}
+						const bool reused = !!client;
+						if(!reused){
+							const AUTO(promised_sock_addr, Dns_daemon::enqueue_for_looking_up(params.host, params.port));
+							Job_dispatcher::yield(promised_sock_addr, true);
+							const AUTO_REF(sock_addr, promised_sock_addr->get());
+							client = boost::make_shared<Simple_http_client>(sock_addr, params.use_ssl, origin);
+							client->set_no_delay(true);
+							atomic_add(g_connections_created, 1, memory_order_relaxed);
+							if(keep_alive){
+								register_async_client(client);
+							}
+						}
+						const AUTO(promise, boost::make_shared<Promise>());
+						state = client->send(reused ? params.request_headers : STD_MOVE_IDN(params.request_headers), reused ? request_entity : STD_MOVE_IDN(request_entity), promise, keep_alive);
+						if(!reused){
+							Epoll_daemon::add_socket(client);
+						}
+						if(state){
+							Job_dispatcher::yield(promise, true);
+						}
+						if(keep_alive){
+							release_async_client(client);
+						}
+						if(reused && is_idempotent(verb) && (!state || !state->headers_received)){
+							// 复用的连接可能已经被对端关闭。换一个新连接重试一次。
+							POSEIDON_LOG_DEBUG("Retrying on a new connection: origin = ", origin);
+							atomic_add(g_stale_retries, 1, memory_order_relaxed);
+							may_reuse = false;
+							continue;
+						}
+						break;
+					}
+					POSEIDON_THROW_UNLESS(state, Exception, Rcnts::view("Failed to send data to remote server"));
+					POSEIDON_THROW_UNLESS(state->finished || (verb == Http::verb_head), Exception, Rcnts::view("Connection was closed prematurely"));
+				} while(should_check_redirect && (--retry_count_remaining != 0) && check_redirect(request, state->response_headers));
+
+				Simple_http_response temp = { STD_MOVE(state->response_headers), STD_MOVE(state->response_entity) };
 				response = STD_MOVE(temp);
 			} catch(std::exception &e){
 				POSEIDON_LOG_DEBUG("std::exception thrown: what = ", e.what());
@@ -326,7 +628,8 @@ void Simple_http_client_daemon::start(){
 	}
 	POSEIDON_LOG(Logger::special_major | Logger::level_info, "Starting simple HTTP client daemon...");
 
-	//
+	const AUTO(idle_timeout, get_idle_timeout());
+	g_prune_timer = Timer_daemon::register_low_level_timer(idle_timeout, idle_timeout, boost::bind(&prune_timer_proc, _2));
 }
 void Simple_http_client_daemon::stop(){
 	if(atomic_exchange(g_running, false, memory_order_acq_rel) == false){
@@ -334,13 +637,53 @@ void Simple_http_client_daemon::stop(){
 	}
 	POSEIDON_LOG(Logger::special_major | Logger::level_info, "Stopping simple HTTP client daemon...");
 
-	//
+	g_prune_timer.reset();
+	clear_pool();
+}
+
+Simple_http_client_daemon::Pool_statistics Simple_http_client_daemon::get_pool_statistics(){
+	Pool_statistics stats = { };
+	stats.connections_created = atomic_load(g_connections_created, memory_order_relaxed);
+	stats.connections_reused = atomic_load(g_connections_reused, memory_order_relaxed);
+	stats.requests_pipelined = atomic_load(g_requests_pipelined, memory_order_relaxed);
+	stats.stale_retries = atomic_load(g_stale_retries, memory_order_relaxed);
+	const Mutex::Unique_lock lock(g_pool_mutex);
+	for(AUTO(it, g_async_clients.begin()); it != g_async_clients.end(); ++it){
+		if(it->second->m_users == 0){
+			stats.idle_connections += 1;
+		} else {
+			stats.active_connections += 1;
+		}
+	}
+	stats.idle_connections += g_sync_idle_clients.size();
+	return stats;
+}
+void Simple_http_client_daemon::clear_pool(){
+	Client_map async_clients, sync_idle_clients;
+	{
+		const Mutex::Unique_lock lock(g_pool_mutex);
+		// 正在使用的连接不受影响，它们只是不会再被复用。
+		AUTO(it, g_async_clients.begin());
+		while(it != g_async_clients.end()){
+			if(it->second->m_users == 0){
+				async_clients.emplace(it->first, STD_MOVE(it->second));
+				it = g_async_clients.erase(it);
+				continue;
+			}
+			++it;
+		}
+		sync_idle_clients.swap(g_sync_idle_clients);
+	}
+	for(AUTO(it, async_clients.begin()); it != async_clients.end(); ++it){
+		it->second->shutdown_read();
+		it->second->shutdown_write();
+	}
 }
 
 Simple_http_response Simple_http_client_daemon::perform(Simple_http_request request){
 	POSEIDON_PROFILE_ME;
 
-	boost::shared_ptr<Simple_http_client> client;
+	boost::shared_ptr<Simple_http_client::Request_state> state;
 
 	const bool should_check_redirect = can_be_redirected(request);
 	const AUTO(max_redirect_count, Main_config::get<std::size_t>("simple_http_client_max_redirect_count", 10));
@@ -349,15 +692,44 @@ Simple_http_response Simple_http_client_daemon::perform(Simple_http_request requ
 		const AUTO(verb, request.request_headers.verb);
 		POSEIDON_LOG_DEBUG("Trying: ", Http::get_string_from_verb(verb), " ", request.request_headers.uri);
 		AUTO(params, parse_simple_http_client_params(should_check_redirect ? request.request_headers : STD_MOVE_IDN(request.request_headers)));
-		const AUTO(sock_addr, Dns_daemon::look_up(params.host, params.port));
-		client = boost::make_shared<Simple_http_client>(sock_addr, params.use_ssl);
-		client->set_no_delay(true);
-		client->send(STD_MOVE(params.request_headers), should_check_redirect ? request.request_entity : STD_MOVE_IDN(request.request_entity));
-		poll_internal(client);
-		POSEIDON_THROW_UNLESS(client->is_finished() || (verb == Http::verb_head), Exception, Rcnts::view("Connection was closed prematurely"));
-	} while(should_check_redirect && (--retry_count_remaining != 0) && check_redirect(request, client->get_response_headers()));
-
-	Simple_http_response response = { STD_MOVE(client->get_response_headers()), STD_MOVE(client->get_response_entity()) };
+		Stream_buffer request_entity = should_check_redirect ? request.request_entity : STD_MOVE_IDN(request.request_entity);
+		// HEAD 响应没有实体，但是可能带有 Content-Length，因此不能复用连接。
+		const bool keep_alive = (verb != Http::verb_head) && (get_max_idle_connections() != 0);
+		const AUTO(origin, make_origin(params));
+		bool may_reuse = keep_alive;
+		for(;;){
+			boost::shared_ptr<Simple_http_client> client;
+			if(may_reuse){
+				client = acquire_sync_client(origin);
+			}
+			const bool reused = !!client;
+			if(!reused){
+				const AUTO(sock_addr, Dns_daemon::look_up(params.host, params.port));
+				client = boost::make_shared<Simple_http_client>(sock_addr, params.use_ssl, origin);
+				client->set_no_delay(true);
+				atomic_add(g_connections_created, 1, memory_order_relaxed);
+			}
+			state = client->send(reused ? params.request_headers : STD_MOVE_IDN(params.request_headers), reused ? request_entity : STD_MOVE_IDN(request_entity), VAL_INIT, keep_alive);
+			if(state){
+				poll_internal(client, state);
+			}
+			if(keep_alive){
+				release_sync_client(client);
+			}
+			if(reused && is_idempotent(verb) && (!state || !state->headers_received)){
+				// 复用的连接可能已经被对端关闭。换一个新连接重试一次。
+				POSEIDON_LOG_DEBUG("Retrying on a new connection: origin = ", origin);
+				atomic_add(g_stale_retries, 1, memory_order_relaxed);
+				may_reuse = false;
+				continue;
+			}
+			break;
+		}
+		POSEIDON_THROW_UNLESS(state, Exception, Rcnts::view("Failed to send data to remote server"));
+		POSEIDON_THROW_UNLESS(state->finished || (verb == Http::verb_head), Exception, Rcnts::view("Connection was closed prematurely"));
+	} while(should_check_redirect && (--retry_count_remaining != 0) && check_redirect(request, state->response_headers));
+
+	Simple_http_response response = { STD_MOVE(state->response_headers), STD_MOVE(state->response_entity) };
 	return response;
 }
 
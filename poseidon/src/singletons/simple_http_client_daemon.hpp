@@ -34,9 +34,22 @@ private:
 	Simple_http_client_daemon();
 
 public:
+	struct Pool_statistics {
+		boost::uint64_t connections_created;
+		boost::uint64_t connections_reused;
+		boost::uint64_t requests_pipelined;
+		boost::uint64_t stale_retries;
+		std::size_t idle_connections;
+		std::size_t active_connections;
+	};
+
 	static void start();
 	static void stop();
 
+	// 按源（协议、主机和端口）复用的连接池。
+	static Pool_statistics get_pool_statistics();
+	static void clear_pool();
+
 	// 同步接口。
 	static Simple_http_response perform(Simple_http_request request);
 
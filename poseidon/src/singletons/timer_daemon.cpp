@@ -14,11 +14,16 @@
 #include "../job_base.hpp"
 #include "../profiler.hpp"
 #include "../checked_arithmetic.hpp"
+#include "../metrics.hpp"
 
 namespace Poseidon {
 
 typedef Timer_daemon::Timer_callback Timer_callback;
 
+namespace {
+	Metric_gauge g_timer_count("poseidon_timers", "Timers that have been created and not yet destroyed.");
+}
+
 class Timer : NONCOPYABLE {
 private:
 	boost::uint64_t m_period;
@@ -30,7 +35,10 @@ public:
 	Timer(boost::uint64_t period, Timer_callback callback, bool low_level)
 		: m_period(period), m_stamp(0), m_callback(STD_MOVE_IDN(callback)), m_low_level(low_level)
 	{
-		//
+		g_timer_count.add(1);
+	}
+	~Timer(){
+		g_timer_count.subtract(1);
 	}
 
 public:
@@ -20,25 +20,177 @@ namespace Poseidon {
 typedef Workhorse_camp::Job_procedure Job_procedure;
 
 namespace {
-	class Workhorse_thread : NONCOPYABLE {
+	struct Job_queue_element {
+		boost::weak_ptr<Promise> weak_promise;
+		Job_procedure procedure;
+	};
+
+	void run_job(Job_queue_element &elem) NOEXCEPT {
+		POSEIDON_PROFILE_ME;
+
+		STD_EXCEPTION_PTR except;
+		try {
+			elem.procedure();
+		} catch(std::exception &e){
+			POSEIDON_LOG_WARNING("std::exception thrown: what = ", e.what());
+			except = STD_CURRENT_EXCEPTION();
+		} catch(...){
+			POSEIDON_LOG_WARNING("Unknown exception thrown");
+			except = STD_CURRENT_EXCEPTION();
+		}
+		const AUTO(promise, elem.weak_promise.lock());
+		if(promise){
+			if(except){
+				promise->set_exception(STD_MOVE(except), false);
+			} else {
+				promise->set_success(false);
+			}
+		}
+	}
+
+	// Chase-Lev 双端队列。只有所有者线程可以在底部压入和弹出，其它线程只能从顶部窃取。
+	class Stealing_deque : NONCOPYABLE {
 	private:
-		struct Job_queue_element {
-			boost::weak_ptr<Promise> weak_promise;
-			Job_procedure procedure;
+		struct Ring {
+			std::size_t mask;
+			boost::container::vector<Job_queue_element *> slots;
 		};
 
+	private:
+		volatile std::ptrdiff_t m_top;
+		volatile std::ptrdiff_t m_bottom;
+		Ring *volatile m_ring;
+		// 窃取者可能还在读取旧的环形缓冲区，因此直到析构时才释放它们。
+		boost::container::vector<boost::shared_ptr<Ring> > m_rings;
+
+	public:
+		Stealing_deque()
+			: m_top(0), m_bottom(0), m_ring(NULLPTR), m_rings()
+		{
+			m_ring = grow(NULLPTR, 64);
+		}
+		~Stealing_deque(){
+			Job_queue_element *elem;
+			while((elem = pop())){
+				delete elem;
+			}
+		}
+
+	private:
+		Ring *grow(const Ring *old_ring, std::size_t capacity){
+			AUTO(ring, boost::make_shared<Ring>());
+			ring->mask = capacity - 1;
+			ring->slots.resize(capacity);
+			if(old_ring){
+				const AUTO(top, atomic_load(m_top, memory_order_relaxed));
+				const AUTO(bottom, atomic_load(m_bottom, memory_order_relaxed));
+				for(AUTO(i, top); i < bottom; ++i){
+					ring->slots[static_cast<std::size_t>(i) & ring->mask] = old_ring->slots[static_cast<std::size_t>(i) & old_ring->mask];
+				}
+			}
+			m_rings.push_back(ring);
+			return ring.get();
+		}
+
+	public:
+		std::size_t size() const NOEXCEPT {
+			const AUTO(bottom, atomic_load(m_bottom, memory_order_relaxed));
+			const AUTO(top, atomic_load(m_top, memory_order_relaxed));
+			return (bottom > top) ? static_cast<std::size_t>(bottom - top) : 0;
+		}
+
+		// 以下三个函数只能由所有者线程调用。
+		void reserve(std::size_t count){
+			const AUTO(ring, atomic_load(m_ring, memory_order_relaxed));
+			std::size_t capacity = ring->mask + 1;
+			const std::size_t min_capacity = size() + count;
+			if(min_capacity <= capacity){
+				return;
+			}
+			do {
+				capacity *= 2;
+			} while(capacity < min_capacity);
+			atomic_store(m_ring, grow(ring, capacity), memory_order_release);
+		}
+		void push(Job_queue_element *elem){
+			reserve(1);
+			const AUTO(bottom, atomic_load(m_bottom, memory_order_relaxed));
+			const AUTO(ring, atomic_load(m_ring, memory_order_relaxed));
+			atomic_store(ring->slots[static_cast<std::size_t>(bottom) & ring->mask], elem, memory_order_relaxed);
+			atomic_fence(memory_order_release);
+			atomic_store(m_bottom, bottom + 1, memory_order_relaxed);
+		}
+		Job_queue_element *pop() NOEXCEPT {
+			const AUTO(bottom, atomic_load(m_bottom, memory_order_relaxed) - 1);
+			const AUTO(ring, atomic_load(m_ring, memory_order_relaxed));
+			atomic_store(m_bottom, bottom, memory_order_relaxed);
+			atomic_fence(memory_order_seq_cst);
+			AUTO(top, atomic_load(m_top, memory_order_relaxed));
+			if(top > bottom){
+				atomic_store(m_bottom, bottom + 1, memory_order_relaxed);
+				return NULLPTR;
+			}
+			Job_queue_element *elem = atomic_load(ring->slots[static_cast<std::size_t>(bottom) & ring->mask], memory_order_relaxed);
+			if(top == bottom){
+				// 这是最后一个元素，需要和窃取者竞争。
+				if(!atomic_compare_exchange(m_top, top, top + 1, memory_order_seq_cst, memory_order_relaxed)){
+					elem = NULLPTR;
+				}
+				atomic_store(m_bottom, bottom + 1, memory_order_relaxed);
+			}
+			return elem;
+		}
+
+		// 这个函数可以由任意线程调用。竞争失败时也返回空指针。
+		Job_queue_element *steal() NOEXCEPT {
+			AUTO(top, atomic_load(m_top, memory_order_acquire));
+			atomic_fence(memory_order_seq_cst);
+			const AUTO(bottom, atomic_load(m_bottom, memory_order_acquire));
+			if(top >= bottom){
+				return NULLPTR;
+			}
+			const AUTO(ring, atomic_load(m_ring, memory_order_consume));
+			Job_queue_element *const elem = atomic_load(ring->slots[static_cast<std::size_t>(top) & ring->mask], memory_order_relaxed);
+			if(!atomic_compare_exchange(m_top, top, top + 1, memory_order_seq_cst, memory_order_relaxed)){
+				return NULLPTR;
+			}
+			return elem;
+		}
+	};
+
+	class Workhorse_thread;
+
+	volatile bool g_running = false;
+	volatile bool g_work_stealing_enabled = false;
+
+	Mutex g_router_mutex;
+	// 启用工作窃取时，所有线程在启动时创建，直到全部线程退出之前不会修改，因此窃取者无需加锁即可访问。
+	boost::container::vector<boost::shared_ptr<Workhorse_thread> > g_threads;
+
+	__thread Workhorse_thread *t_current_thread;
+
+	class Workhorse_thread : NONCOPYABLE {
 	private:
 		Thread m_thread;
 		volatile bool m_running;
 
 		mutable Mutex m_mutex;
 		mutable Condition_variable m_new_job;
+		// 只能由这个线程执行的任务。
 		boost::container::deque<Job_queue_element> m_queue;
+		// 其它线程投递过来的可窃取任务，由这个线程转移到 m_stealable 中。
+		boost::container::deque<Job_queue_element> m_inbox;
+		volatile bool m_sleeping;
+
+		Stealing_deque m_stealable;
+		volatile boost::uint64_t m_jobs_executed;
+		volatile boost::uint64_t m_jobs_stolen;
 
 	public:
 		Workhorse_thread()
 			: m_running(false)
-			, m_queue()
+			, m_queue(), m_inbox(), m_sleeping(false)
+			, m_stealable(), m_jobs_executed(0), m_jobs_stolen(0)
 		{
 			//
 		}
@@ -55,48 +207,117 @@ namespace {
 				}
 				elem = &m_queue.front();
 			}
+			run_job(*elem);
+			atomic_add(m_jobs_executed, 1, memory_order_relaxed);
+			const Mutex::Unique_lock lock(m_mutex);
+			m_queue.pop_front();
+			return true;
+		}
 
-			STD_EXCEPTION_PTR except;
-			try {
-				elem->procedure();
-			} catch(std::exception &e){
-				POSEIDON_LOG_WARNING("std::exception thrown: what = ", e.what());
-				except = STD_CURRENT_EXCEPTION();
-			} catch(...){
-				POSEIDON_LOG_WARNING("Unknown exception thrown");
-				except = STD_CURRENT_EXCEPTION();
-			}
-			const AUTO(promise, elem->weak_promise.lock());
-			if(promise){
-				if(except){
-					promise->set_exception(STD_MOVE(except), false);
-				} else {
-					promise->set_success(false);
+		Job_queue_element *steal_from_others() NOEXCEPT {
+			const std::size_t count = g_threads.size();
+			const std::size_t start = random_uint32() % count;
+			for(std::size_t i = 0; i < count; ++i){
+				Workhorse_thread *const thread = g_threads[(start + i) % count].get();
+				if(thread == this){
+					continue;
+				}
+				const AUTO(elem, thread->m_stealable.steal());
+				if(elem){
+					atomic_add(m_jobs_stolen, 1, memory_order_relaxed);
+					return elem;
 				}
 			}
-			const Mutex::Unique_lock lock(m_mutex);
-			m_queue.pop_front();
+			return NULLPTR;
+		}
+		bool pump_one_isolated_job(){
+			POSEIDON_PROFILE_ME;
+
+			Job_queue_element *elem = m_stealable.pop();
+			if(!elem){
+				boost::container::deque<Job_queue_element> inbox;
+				{
+					const Mutex::Unique_lock lock(m_mutex);
+					inbox.swap(m_inbox);
+				}
+				if(!inbox.empty()){
+					// 逆序压入，这样所有者线程弹出的顺序和投递的顺序相同。
+					m_stealable.reserve(inbox.size());
+					for(AUTO(it, inbox.rbegin()); it != inbox.rend(); ++it){
+						m_stealable.push(new Job_queue_element(STD_MOVE(*it)));
+					}
+					elem = m_stealable.pop();
+					if(m_stealable.size() != 0){
+						wake_one_other(this);
+					}
+				}
+			}
+			if(!elem){
+				elem = steal_from_others();
+			}
+			if(!elem){
+				return false;
+			}
+			run_job(*elem);
+			delete elem;
+			atomic_add(m_jobs_executed, 1, memory_order_relaxed);
 			return true;
 		}
 
+		bool has_stealable_jobs_elsewhere() const NOEXCEPT {
+			for(std::size_t i = 0; i < g_threads.size(); ++i){
+				const Workhorse_thread *const thread = g_threads[i].get();
+				if((thread != this) && (thread->m_stealable.size() != 0)){
+					return true;
+				}
+			}
+			return false;
+		}
+		bool is_idle_unlocked() const NOEXCEPT {
+			return m_queue.empty() && m_inbox.empty() && (m_stealable.size() == 0);
+		}
+
 		void thread_proc(){
 			POSEIDON_PROFILE_ME;
 			POSEIDON_LOG(Logger::special_major | Logger::level_info, "Workhorse thread started.");
 
+			t_current_thread = this;
+			const bool work_stealing_enabled = atomic_load(g_work_stealing_enabled, memory_order_consume);
 			unsigned timeout = 0;
 			for(;;){
 				bool busy;
 				do {
 					busy = pump_one_job();
+					if(work_stealing_enabled){
+						busy |= pump_one_isolated_job();
+					}
 					timeout = std::min<unsigned>(timeout * 2u + 1u, !busy * 100u);
 				} while(busy);
 
 				Mutex::Unique_lock lock(m_mutex);
-				if(m_queue.empty() && !atomic_load(m_running, memory_order_consume)){
+				if(is_idle_unlocked() && !atomic_load(m_running, memory_order_consume)){
 					break;
 				}
-				m_new_job.timed_wait(lock, timeout);
+				if(!work_stealing_enabled){
+					m_new_job.timed_wait(lock, timeout);
+					continue;
+				}
+				// 先声明将要睡眠，再检查其它线程的任务。投递任务的一方先压入任务，再检查是否有线程在睡眠。
+				// 两边都使用顺序一致的内存序，因此至少有一方能看到对方，不会丢失唤醒。
+				atomic_store(m_sleeping, true, memory_order_seq_cst);
+				lock.unlock();
+				atomic_fence(memory_order_seq_cst);
+				if(has_stealable_jobs_elsewhere()){
+					atomic_store(m_sleeping, false, memory_order_relaxed);
+					continue;
+				}
+				lock.lock();
+				while(atomic_load(m_sleeping, memory_order_relaxed) && is_idle_unlocked() && atomic_load(m_running, memory_order_consume)){
+					m_new_job.wait(lock);
+				}
+				atomic_store(m_sleeping, false, memory_order_relaxed);
 			}
+			t_current_thread = NULLPTR;
 
 			POSEIDON_LOG(Logger::special_major | Logger::level_info, "Workhorse thread stopped.");
 		}
@@ -108,7 +329,9 @@ namespace {
 			atomic_store(m_running, true, memory_order_release);
 		}
 		void stop(){
+			const Mutex::Unique_lock lock(m_mutex);
 			atomic_store(m_running, false, memory_order_release);
+			m_new_job.signal();
 		}
 		void safe_join(){
 			wait_till_idle();
@@ -123,7 +346,7 @@ namespace {
 				std::size_t pending_objects;
 				{
 					const Mutex::Unique_lock lock(m_mutex);
-					pending_objects = m_queue.size();
+					pending_objects = m_queue.size() + m_inbox.size() + m_stealable.size();
 					if(pending_objects == 0){
 						break;
 					}
@@ -138,10 +361,42 @@ namespace {
 			}
 		}
 
-		std::size_t get_queue_size() const {
+		// 如果这个线程正在睡眠则唤醒它。
+		bool wake_if_sleeping() NOEXCEPT {
+			if(!atomic_load(m_sleeping, memory_order_seq_cst)){
+				return false;
+			}
+			const Mutex::Unique_lock lock(m_mutex);
+			if(!atomic_load(m_sleeping, memory_order_relaxed)){
+				return false;
+			}
+			atomic_store(m_sleeping, false, memory_order_relaxed);
+			m_new_job.signal();
+			return true;
+		}
+		static void wake_one_other(const Workhorse_thread *self) NOEXCEPT {
+			atomic_fence(memory_order_seq_cst);
+			const std::size_t count = g_threads.size();
+			const std::size_t start = random_uint32() % count;
+			for(std::size_t i = 0; i < count; ++i){
+				Workhorse_thread *const thread = g_threads[(start + i) % count].get();
+				if((thread != self) && thread->wake_if_sleeping()){
+					break;
+				}
+			}
+		}
+
+		bool is_sleeping() const NOEXCEPT {
+			return atomic_load(m_sleeping, memory_order_relaxed);
+		}
+		void get_statistics(Workhorse_camp::Thread_statistics &stats) const {
 			const Mutex::Unique_lock lock(m_mutex);
-			return m_queue.size();
+			stats.queue_size = m_queue.size();
+			stats.stealable_size = m_inbox.size() + m_stealable.size();
+			stats.jobs_executed = atomic_load(m_jobs_executed, memory_order_relaxed);
+			stats.jobs_stolen = atomic_load(m_jobs_stolen, memory_order_relaxed);
 		}
+
 		void add_job(const boost::shared_ptr<Promise> &promise, Job_procedure procedure){
 			POSEIDON_PROFILE_ME;
 
@@ -151,31 +406,67 @@ namespace {
 			m_queue.push_back(STD_MOVE(elem));
 			m_new_job.signal();
 		}
+		void add_isolated_job(const boost::shared_ptr<Promise> &promise, Job_procedure procedure){
+			POSEIDON_PROFILE_ME;
+
+			Job_queue_element elem = { promise, STD_MOVE_IDN(procedure) };
+			if(t_current_thread == this){
+				// 工作者线程上投递的任务直接压入自己的队列，空闲的线程可以把它偷走。
+				m_stealable.reserve(1);
+				m_stealable.push(new Job_queue_element(STD_MOVE(elem)));
+				wake_one_other(this);
+				return;
+			}
+			const Mutex::Unique_lock lock(m_mutex);
+			POSEIDON_THROW_UNLESS(atomic_load(m_running, memory_order_consume), Exception, Rcnts::view("Workhorse thread is being shut down"));
+			m_inbox.push_back(STD_MOVE(elem));
+			atomic_store(m_sleeping, false, memory_order_relaxed);
+			m_new_job.signal();
+		}
 	};
 
-	volatile bool g_running = false;
+	boost::shared_ptr<Workhorse_thread> get_thread_using_seed(boost::uint64_t seed){
+		POSEIDON_THROW_UNLESS(!g_threads.empty(), Basic_exception, Rcnts::view("Workhorse support is not enabled"));
 
-	Mutex g_router_mutex;
-	boost::container::vector<boost::shared_ptr<Workhorse_thread> > g_threads;
+		const Mutex::Unique_lock lock(g_router_mutex);
+		std::size_t i = static_cast<std::size_t>(seed % g_threads.size());
+		AUTO(thread, g_threads.at(i));
+		if(!thread){
+			POSEIDON_LOG(Logger::special_major | Logger::level_debug, "Creating new workhorse thread ", i);
+			thread = boost::make_shared<Workhorse_thread>();
+			thread->start();
+			g_threads.at(i) = thread;
+		}
+		return thread;
+	}
 
 	void add_job_using_seed(const boost::shared_ptr<Promise> &promise, Job_procedure procedure, boost::uint64_t seed){
 		POSEIDON_PROFILE_ME;
+
+		const AUTO(thread, get_thread_using_seed(seed));
+		assert(thread);
+		thread->add_job(promise, STD_MOVE_IDN(procedure));
+	}
+	void add_isolated_job(const boost::shared_ptr<Promise> &promise, Job_procedure procedure){
+		POSEIDON_PROFILE_ME;
 		POSEIDON_THROW_UNLESS(!g_threads.empty(), Basic_exception, Rcnts::view("Workhorse support is not enabled"));
 
-		boost::shared_ptr<Workhorse_thread> thread;
-		{
-			const Mutex::Unique_lock lock(g_router_mutex);
-			std::size_t i = static_cast<std::size_t>(seed % g_threads.size());
-			thread = g_threads.at(i);
-			if(!thread){
-				POSEIDON_LOG(Logger::special_major | Logger::level_debug, "Creating new workhorse thread ", i);
-				thread = boost::make_shared<Workhorse_thread>();
-				thread->start();
-				g_threads.at(i) = thread;
+		if(t_current_thread){
+			t_current_thread->add_isolated_job(promise, STD_MOVE_IDN(procedure));
+			return;
+		}
+		// 优先投递给正在睡眠的线程。如果所有线程都在忙，随机挑一个，其它线程空闲下来后会把任务偷走。
+		const std::size_t count = g_threads.size();
+		const std::size_t start = random_uint32() % count;
+		Workhorse_thread *thread = g_threads[start].get();
+		for(std::size_t i = 0; i < count; ++i){
+			Workhorse_thread *const candidate = g_threads[(start + i) % count].get();
+			if(candidate->is_sleeping()){
+				thread = candidate;
+				break;
 			}
 		}
-		assert(thread);
-		thread->add_job(promise, STD_MOVE_IDN(procedure));
+		thread->add_isolated_job(promise, STD_MOVE_IDN(procedure));
 	}
 }
 
@@ -191,7 +482,19 @@ void Workhorse_camp::start(){
 		POSEIDON_LOG_FATAL("You shall not set `workhorse_max_thread_count` in `main.conf` to zero.");
 		std::terminate();
 	}
+	const AUTO(work_stealing_enabled, Main_config::get<bool>("workhorse_work_stealing_enabled", false));
+	atomic_store(g_work_stealing_enabled, work_stealing_enabled, memory_order_release);
 	g_threads.resize(max_thread_count);
+	if(work_stealing_enabled){
+		// 窃取者需要遍历所有线程，因此一次性创建全部线程。
+		for(std::size_t i = 0; i < g_threads.size(); ++i){
+			g_threads.at(i) = boost::make_shared<Workhorse_thread>();
+		}
+		for(std::size_t i = 0; i < g_threads.size(); ++i){
+			POSEIDON_LOG(Logger::special_major | Logger::level_debug, "Creating new workhorse thread ", i);
+			g_threads.at(i)->start();
+		}
+	}
 
 	POSEIDON_LOG(Logger::special_major | Logger::level_info, "Workhorse daemon started.");
 }
@@ -224,7 +527,27 @@ void Workhorse_camp::stop(){
 	g_threads.clear();
 }
 
+bool Workhorse_camp::is_work_stealing_enabled(){
+	return atomic_load(g_work_stealing_enabled, memory_order_consume);
+}
+void Workhorse_camp::get_thread_statistics(boost::container::vector<Workhorse_camp::Thread_statistics> &ret){
+	const Mutex::Unique_lock lock(g_router_mutex);
+	ret.reserve(ret.size() + g_threads.size());
+	for(std::size_t i = 0; i < g_threads.size(); ++i){
+		const AUTO_REF(thread, g_threads.at(i));
+		Thread_statistics stats = { };
+		if(thread){
+			thread->get_statistics(stats);
+		}
+		ret.push_back(stats);
+	}
+}
+
 void Workhorse_camp::enqueue_isolated(const boost::shared_ptr<Promise> &promise, Job_procedure procedure){
+	if(atomic_load(g_work_stealing_enabled, memory_order_consume)){
+		add_isolated_job(promise, STD_MOVE_IDN(procedure));
+		return;
+	}
 	add_job_using_seed(promise, STD_MOVE_IDN(procedure), random_uint32());
 }
 void Workhorse_camp::enqueue(const boost::shared_ptr<Promise> &promise, Job_procedure procedure, std::size_t thread_hint){
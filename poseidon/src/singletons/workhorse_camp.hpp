@@ -7,6 +7,8 @@
 #include "../cxx_ver.hpp"
 #include <boost/shared_ptr.hpp>
 #include <boost/function.hpp>
+#include <boost/container/vector.hpp>
+#include <boost/cstdint.hpp>
 #include <string>
 
 namespace Poseidon {
@@ -14,6 +16,17 @@ namespace Poseidon {
 class Promise;
 
 class Workhorse_camp {
+public:
+	struct Thread_statistics {
+		// 只能由该线程执行的任务数。
+		std::size_t queue_size;
+		// 可以被其它线程窃取的任务数。
+		std::size_t stealable_size;
+		boost::uint64_t jobs_executed;
+		// 该线程从其它线程窃取的任务数。
+		boost::uint64_t jobs_stolen;
+	};
+
 private:
 	Workhorse_camp();
 
@@ -23,6 +36,10 @@ public:
 	static void start();
 	static void stop();
 
+	static bool is_work_stealing_enabled();
+	static void get_thread_statistics(boost::container::vector<Thread_statistics> &ret);
+
+	// 启用工作窃取时，这些任务可以被任意空闲的线程执行。
 	static void enqueue_isolated(const boost::shared_ptr<Promise> &promise, Job_procedure procedure);
 	// 具有相同 thread_hint 的任务保证由同一个线程执行。
 	static void enqueue(const boost::shared_ptr<Promise> &promise, Job_procedure procedure, std::size_t thread_hint);
@@ -8,7 +8,23 @@
 #include "log.hpp"
 #include "profiler.hpp"
 #include "singletons/main_config.hpp"
+#include "sock_addr.hpp"
+#include "ip_port.hpp"
+#include "mutex.hpp"
+#include "atomic.hpp"
+#include "time.hpp"
+#include "checked_arithmetic.hpp"
+#include "multi_index_map.hpp"
+#include <boost/container/deque.hpp>
 #include <openssl/ssl.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#  include <openssl/core_names.h>
+#  include <openssl/params.h>
+#else
+#  include <openssl/hmac.h>
+#endif
 
 namespace Poseidon {
 
@@ -41,6 +57,203 @@ void init_ssl_once(){
 #endif
 
 namespace {
+	// 会话票据密钥，所有服务端共享。最新的密钥在最前面，只用最新的密钥加密。
+	struct Ticket_key {
+		unsigned char name[16];
+		unsigned char aes_key[32];
+		unsigned char hmac_key[32];
+		boost::uint64_t created_time;
+	};
+
+	Mutex g_ticket_key_mutex;
+	boost::container::deque<Ticket_key> g_ticket_keys;
+	volatile boost::uint64_t g_ticket_key_rotation_period = 0;
+	volatile boost::uint64_t g_ticket_key_lifetime = 0;
+
+	bool find_ticket_key(Ticket_key &key, bool &is_current, const unsigned char *name){
+		POSEIDON_PROFILE_ME;
+
+		const AUTO(now, get_fast_mono_clock());
+		const AUTO(rotation_period, atomic_load(g_ticket_key_rotation_period, memory_order_relaxed));
+		const AUTO(lifetime, atomic_load(g_ticket_key_lifetime, memory_order_relaxed));
+		const Mutex::Unique_lock lock(g_ticket_key_mutex);
+		while(!g_ticket_keys.empty() && (saturated_add(g_ticket_keys.back().created_time, lifetime) < now)){
+			POSEIDON_LOG_DEBUG("Discarding expired SSL session ticket key.");
+			g_ticket_keys.pop_back();
+		}
+		if(!name){
+			if(g_ticket_keys.empty() || (saturated_add(g_ticket_keys.front().created_time, rotation_period) <= now)){
+				POSEIDON_LOG_DEBUG("Generating new SSL session ticket key.");
+				Ticket_key new_key;
+				if((::RAND_bytes(new_key.name, sizeof(new_key.name)) != 1) || (::RAND_bytes(new_key.aes_key, sizeof(new_key.aes_key)) != 1) || (::RAND_bytes(new_key.hmac_key, sizeof(new_key.hmac_key)) != 1)){
+					POSEIDON_LOG_ERROR("::RAND_bytes() failed");
+					return false;
+				}
+				new_key.created_time = now;
+				g_ticket_keys.push_front(new_key);
+			}
+			key = g_ticket_keys.front();
+			is_current = true;
+			return true;
+		}
+		for(AUTO(it, g_ticket_keys.begin()); it != g_ticket_keys.end(); ++it){
+			if(std::memcmp(it->name, name, sizeof(it->name)) == 0){
+				key = *it;
+				is_current = (it == g_ticket_keys.begin());
+				return true;
+			}
+		}
+		return false;
+	}
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	typedef ::EVP_MAC_CTX Ticket_mac_ctx;
+
+	bool init_ticket_mac(Ticket_mac_ctx *mac_ctx, unsigned char *hmac_key, std::size_t hmac_key_size){
+		::OSSL_PARAM params[3];
+		params[0] = ::OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, hmac_key, hmac_key_size);
+		params[1] = ::OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, const_cast<char *>("SHA256"), 0);
+		params[2] = ::OSSL_PARAM_construct_end();
+		return ::EVP_MAC_CTX_set_params(mac_ctx, params) == 1;
+	}
+#else
+	typedef ::HMAC_CTX Ticket_mac_ctx;
+
+	bool init_ticket_mac(Ticket_mac_ctx *mac_ctx, unsigned char *hmac_key, std::size_t hmac_key_size){
+		return ::HMAC_Init_ex(mac_ctx, hmac_key, static_cast<int>(hmac_key_size), ::EVP_sha256(), NULLPTR) == 1;
+	}
+#endif
+
+	// 返回 -1 表示出错，0 表示找不到密钥（进行完整握手），1 表示成功，2 表示成功但需要更新票据。
+	int ticket_key_callback(::SSL */*ssl*/, unsigned char *key_name, unsigned char *iv, ::EVP_CIPHER_CTX *cipher_ctx, Ticket_mac_ctx *mac_ctx, int enc){
+		try {
+			Ticket_key key;
+			bool is_current;
+			if(enc){
+				if(!find_ticket_key(key, is_current, NULLPTR)){
+					return -1;
+				}
+				if(::RAND_bytes(iv, ::EVP_CIPHER_iv_length(::EVP_aes_256_cbc())) != 1){
+					return -1;
+				}
+				std::memcpy(key_name, key.name, sizeof(key.name));
+				if(::EVP_EncryptInit_ex(cipher_ctx, ::EVP_aes_256_cbc(), NULLPTR, key.aes_key, iv) != 1){
+					return -1;
+				}
+			} else {
+				if(!find_ticket_key(key, is_current, key_name)){
+					return 0;
+				}
+				if(::EVP_DecryptInit_ex(cipher_ctx, ::EVP_aes_256_cbc(), NULLPTR, key.aes_key, iv) != 1){
+					return -1;
+				}
+			}
+			if(!init_ticket_mac(mac_ctx, key.hmac_key, sizeof(key.hmac_key))){
+				return -1;
+			}
+			return is_current ? 1 : 2;
+		} catch(std::exception &e){
+			POSEIDON_LOG_ERROR("std::exception thrown: what = ", e.what());
+			return -1;
+		}
+	}
+
+	// 客户端会话。
+	struct Client_session_key {
+		Ip_port peer;
+		bool verify_peer;
+	};
+	bool operator<(const Client_session_key &lhs, const Client_session_key &rhs){
+		if(lhs.peer < rhs.peer){
+			return true;
+		}
+		if(rhs.peer < lhs.peer){
+			return false;
+		}
+		return lhs.verify_peer < rhs.verify_peer;
+	}
+
+	struct Client_session_element {
+		// Invariants.
+		Client_session_key key;
+		boost::shared_ptr< ::SSL_SESSION> session;
+		// Indices.
+		boost::uint64_t expiry_time;
+	};
+	POSEIDON_MULTI_INDEX_MAP(Client_session_map, Client_session_element,
+		POSEIDON_UNIQUE_MEMBER_INDEX(key)
+		POSEIDON_MULTI_MEMBER_INDEX(expiry_time)
+	);
+
+	volatile std::size_t g_client_session_max_count = 0;
+	Mutex g_client_session_mutex;
+	Client_session_map g_client_session_map;
+
+	void free_client_session_key(void */*parent*/, void *ptr, ::CRYPTO_EX_DATA */*ad*/, int /*idx*/, long /*argl*/, void */*argp*/){
+		delete static_cast<Client_session_key *>(ptr);
+	}
+	int get_client_session_key_index(){
+		static const int s_index = ::SSL_get_ex_new_index(0, NULLPTR, NULLPTR, NULLPTR, &free_client_session_key);
+		return s_index;
+	}
+
+	boost::shared_ptr< ::SSL_SESSION> find_client_session(const Client_session_key &key){
+		POSEIDON_PROFILE_ME;
+
+		const AUTO(now, get_fast_mono_clock());
+		const Mutex::Unique_lock lock(g_client_session_mutex);
+		const AUTO(it, g_client_session_map.find<0>(key));
+		if(it == g_client_session_map.end<0>()){
+			return VAL_INIT;
+		}
+		if(it->expiry_time < now){
+			g_client_session_map.erase<0>(it);
+			return VAL_INIT;
+		}
+		return it->session;
+	}
+
+	// OpenSSL 在握手完成（TLS 1.3 中是收到票据）时调用。返回 1 表示接管了 session 的所有权。
+	int on_new_client_session(::SSL *ssl, ::SSL_SESSION *session){
+		const AUTO(key, static_cast<const Client_session_key *>(::SSL_get_ex_data(ssl, get_client_session_key_index())));
+		if(!key){
+			return 0;
+		}
+		try {
+			Client_session_element elem = { *key, boost::shared_ptr< ::SSL_SESSION>(session, &::SSL_SESSION_free) };
+			elem.expiry_time = saturated_add(get_fast_mono_clock(), static_cast<boost::uint64_t>(std::max<long>(::SSL_SESSION_get_timeout(session), 0)) * 1000);
+			POSEIDON_LOG_DEBUG("Saving SSL client session: peer = ", key->peer, ", verify_peer = ", key->verify_peer);
+
+			const AUTO(max_count, atomic_load(g_client_session_max_count, memory_order_relaxed));
+			const Mutex::Unique_lock lock(g_client_session_mutex);
+			const AUTO(it, g_client_session_map.find<0>(*key));
+			if(it != g_client_session_map.end<0>()){
+				g_client_session_map.erase<0>(it);
+			}
+			g_client_session_map.insert(elem);
+			while(g_client_session_map.size() > max_count){
+				g_client_session_map.erase<1>(g_client_session_map.begin<1>());
+			}
+		} catch(std::exception &e){
+			POSEIDON_LOG_ERROR("std::exception thrown: what = ", e.what());
+		}
+		// 即使出错，session 也已经被 shared_ptr 释放了。
+		return 1;
+	}
+
+	void enable_kernel_tls(::SSL_CTX *ssl_ctx){
+		const AUTO(kernel_tls_enabled, Main_config::get<bool>("ssl_kernel_tls_enabled", false));
+		if(!kernel_tls_enabled){
+			return;
+		}
+#ifdef SSL_OP_ENABLE_KTLS
+		// 内核不支持时 OpenSSL 会自动退化为用户态加密。
+		::SSL_CTX_set_options(ssl_ctx, SSL_OP_ENABLE_KTLS);
+#else
+		POSEIDON_LOG_WARNING("Kernel TLS is not supported by this OpenSSL version.");
+#endif
+	}
+
 	Unique_ssl_ctx create_server_ssl_ctx(const char *certificate, const char *private_key){
 		POSEIDON_PROFILE_ME;
 
@@ -50,6 +263,11 @@ namespace {
 		POSEIDON_THROW_UNLESS(ssl_ctx.reset(::SSL_CTX_new(::SSLv23_server_method())), Exception, Rcnts::view("::SSLv23_server_method() failed"));
 		::SSL_CTX_set_options(ssl_ctx.get(), SSL_OP_NO_SSLv2);
 		::SSL_CTX_set_options(ssl_ctx.get(), SSL_OP_NO_SSLv3);
+#ifdef SSL_OP_IGNORE_UNEXPECTED_EOF
+		// 我们会主动关闭读端，这时 OpenSSL 3 默认会发送致命的 decode_error 警告。
+		::SSL_CTX_set_options(ssl_ctx.get(), SSL_OP_IGNORE_UNEXPECTED_EOF);
+#endif
+		enable_kernel_tls(ssl_ctx.get());
 		if(certificate && *certificate){
 			POSEIDON_LOG_INFO("Loading server certificate: ", certificate);
 			POSEIDON_THROW_UNLESS(::SSL_CTX_use_certificate_chain_file(ssl_ctx.get(), certificate) == 1, Exception, Rcnts::view("::SSL_CTX_use_certificate_file() failed"));
@@ -64,6 +282,26 @@ namespace {
 		} else {
 			::SSL_CTX_set_verify(ssl_ctx.get(), SSL_VERIFY_NONE, NULLPTR);
 		}
+
+		const AUTO(session_cache_size, Main_config::get<long>("ssl_session_cache_size", 20480));
+		const AUTO(session_timeout, Main_config::get<boost::uint64_t>("ssl_session_timeout", 300000));
+		const AUTO(ticket_key_rotation_period, Main_config::get<boost::uint64_t>("ssl_ticket_key_rotation_period", 3600000));
+		POSEIDON_LOG_INFO("Setting SSL session cache: size = ", session_cache_size, ", timeout = ", session_timeout, ", ticket_key_rotation_period = ", ticket_key_rotation_period);
+		::SSL_CTX_set_session_cache_mode(ssl_ctx.get(), SSL_SESS_CACHE_SERVER);
+		::SSL_CTX_sess_set_cache_size(ssl_ctx.get(), session_cache_size);
+		::SSL_CTX_set_timeout(ssl_ctx.get(), static_cast<long>(std::max<boost::uint64_t>(session_timeout / 1000, 1)));
+		if(ticket_key_rotation_period == 0){
+			::SSL_CTX_set_options(ssl_ctx.get(), SSL_OP_NO_TICKET);
+		} else {
+			// 旧密钥在轮换之后还要能解密尚未过期的票据。
+			atomic_store(g_ticket_key_rotation_period, ticket_key_rotation_period, memory_order_relaxed);
+			atomic_store(g_ticket_key_lifetime, saturated_add(ticket_key_rotation_period, session_timeout), memory_order_relaxed);
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+			POSEIDON_THROW_UNLESS(::SSL_CTX_set_tlsext_ticket_key_evp_cb(ssl_ctx.get(), &ticket_key_callback) == 1, Exception, Rcnts::view("::SSL_CTX_set_tlsext_ticket_key_evp_cb() failed"));
+#else
+			POSEIDON_THROW_UNLESS(::SSL_CTX_set_tlsext_ticket_key_cb(ssl_ctx.get(), &ticket_key_callback) == 1, Exception, Rcnts::view("::SSL_CTX_set_tlsext_ticket_key_cb() failed"));
+#endif
+		}
 		return ssl_ctx;
 	}
 
@@ -76,6 +314,11 @@ namespace {
 		POSEIDON_THROW_UNLESS(ssl_ctx.reset(::SSL_CTX_new(::SSLv23_client_method())), Exception, Rcnts::view("::SSLv23_client_method() failed"));
 		::SSL_CTX_set_options(ssl_ctx.get(), SSL_OP_NO_SSLv2);
 		::SSL_CTX_set_options(ssl_ctx.get(), SSL_OP_NO_SSLv3);
+#ifdef SSL_OP_IGNORE_UNEXPECTED_EOF
+		// 我们会主动关闭读端，这时 OpenSSL 3 默认会发送致命的 decode_error 警告。
+		::SSL_CTX_set_options(ssl_ctx.get(), SSL_OP_IGNORE_UNEXPECTED_EOF);
+#endif
+		enable_kernel_tls(ssl_ctx.get());
 		if(verify_peer){
 			const AUTO(ssl_cert_directory, Main_config::get<std::string>("ssl_cert_directory", "/etc/ssl/certs"));
 			POSEIDON_LOG_INFO("Loading trusted CA certificates: ", ssl_cert_directory);
@@ -84,6 +327,8 @@ namespace {
 		} else {
 			::SSL_CTX_set_verify(ssl_ctx.get(), SSL_VERIFY_NONE, NULLPTR);
 		}
+		::SSL_CTX_set_session_cache_mode(ssl_ctx.get(), SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+		::SSL_CTX_sess_set_new_cb(ssl_ctx.get(), &on_new_client_session);
 		return ssl_ctx;
 	}
 }
@@ -103,10 +348,20 @@ void Ssl_server_factory::create_ssl_filter(boost::scoped_ptr<Ssl_filter> &ssl_fi
 	ssl_filter.reset(new Ssl_filter(STD_MOVE(ssl), Ssl_filter::to_accept, fd));
 }
 
+std::size_t Ssl_client_factory::get_session_count(){
+	const Mutex::Unique_lock lock(g_client_session_mutex);
+	return g_client_session_map.size();
+}
+void Ssl_client_factory::clear_sessions(){
+	const Mutex::Unique_lock lock(g_client_session_mutex);
+	g_client_session_map.clear();
+}
+
 Ssl_client_factory::Ssl_client_factory(bool verify_peer)
-	: m_ssl_ctx(create_client_ssl_ctx(verify_peer))
+	: m_ssl_ctx(create_client_ssl_ctx(verify_peer)), m_verify_peer(verify_peer)
 {
-	//
+	const AUTO(client_session_max_count, Main_config::get<std::size_t>("ssl_client_session_cache_size", 1024));
+	atomic_store(g_client_session_max_count, client_session_max_count, memory_order_relaxed);
 }
 Ssl_client_factory::~Ssl_client_factory(){
 	//
@@ -118,4 +373,25 @@ void Ssl_client_factory::create_ssl_filter(boost::scoped_ptr<Ssl_filter> &ssl_fi
 	ssl_filter.reset(new Ssl_filter(STD_MOVE(ssl), Ssl_filter::to_connect, fd));
 }
 
+void Ssl_client_factory::create_ssl_filter(boost::scoped_ptr<Ssl_filter> &ssl_filter, int fd, const Sock_addr &peer_addr){
+	Unique_ssl ssl;
+	POSEIDON_THROW_UNLESS(ssl.reset(::SSL_new(m_ssl_ctx.get())), Exception, Rcnts::view("::SSL_new() failed"));
+	const int key_index = get_client_session_key_index();
+	POSEIDON_THROW_UNLESS(key_index >= 0, Exception, Rcnts::view("::SSL_get_ex_new_index() failed"));
+	const Client_session_key key = { Ip_port(peer_addr), m_verify_peer };
+	const AUTO(session, find_client_session(key));
+	if(session){
+		POSEIDON_LOG_DEBUG("Reusing SSL client session: peer = ", key.peer, ", verify_peer = ", key.verify_peer);
+		if(::SSL_set_session(ssl.get(), session.get()) != 1){
+			POSEIDON_LOG_WARNING("::SSL_set_session() failed");
+		}
+	}
+	const AUTO(key_copy, new Client_session_key(key));
+	if(::SSL_set_ex_data(ssl.get(), key_index, key_copy) != 1){
+		delete key_copy;
+		POSEIDON_THROW(Exception, Rcnts::view("::SSL_set_ex_data() failed"));
+	}
+	ssl_filter.reset(new Ssl_filter(STD_MOVE(ssl), Ssl_filter::to_connect, fd));
+}
+
 }
@@ -8,12 +8,14 @@
 #include "cxx_util.hpp"
 #include "ssl_raii.hpp"
 #include <boost/scoped_ptr.hpp>
+#include <cstddef>
 
 namespace Poseidon {
 
 extern void init_ssl_once();
 
 class Ssl_filter;
+class Sock_addr;
 
 class Ssl_server_factory : NONCOPYABLE {
 private:
@@ -28,8 +30,14 @@ public:
 };
 
 class Ssl_client_factory : NONCOPYABLE {
+public:
+	// 客户端会话按照对端地址和是否验证证书保存，所有工厂共享。
+	static std::size_t get_session_count();
+	static void clear_sessions();
+
 private:
 	const Unique_ssl_ctx m_ssl_ctx;
+	const bool m_verify_peer;
 
 public:
 	explicit Ssl_client_factory(bool verify_peer);
@@ -37,6 +45,8 @@ public:
 
 public:
 	void create_ssl_filter(boost::scoped_ptr<Ssl_filter> &ssl_filter, int fd);
+	// 如果有之前保存的会话，则尝试恢复。
+	void create_ssl_filter(boost::scoped_ptr<Ssl_filter> &ssl_filter, int fd, const Sock_addr &peer_addr);
 };
 
 }
@@ -6,13 +6,21 @@
 #include "exception.hpp"
 #include "log.hpp"
 #include "profiler.hpp"
+#include "atomic.hpp"
 #include <sys/socket.h>
+#include <sys/sendfile.h>
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 
 namespace Poseidon {
 
 namespace {
+	volatile boost::uint64_t g_full_accepted = 0;
+	volatile boost::uint64_t g_resumed_accepted = 0;
+	volatile boost::uint64_t g_full_connected = 0;
+	volatile boost::uint64_t g_resumed_connected = 0;
+	volatile boost::uint64_t g_kernel_tls_send = 0;
+
 	void dump_error_queue(){
 		unsigned long e;
 		while((e = ::ERR_get_error()) != 0){
@@ -46,8 +54,19 @@ namespace {
 	}
 }
 
+Ssl_filter::Handshake_statistics Ssl_filter::get_handshake_statistics() NOEXCEPT {
+	Handshake_statistics stats;
+	stats.full_accepted = atomic_load(g_full_accepted, memory_order_relaxed);
+	stats.resumed_accepted = atomic_load(g_resumed_accepted, memory_order_relaxed);
+	stats.full_connected = atomic_load(g_full_connected, memory_order_relaxed);
+	stats.resumed_connected = atomic_load(g_resumed_connected, memory_order_relaxed);
+	stats.kernel_tls_send = atomic_load(g_kernel_tls_send, memory_order_relaxed);
+	return stats;
+}
+
 Ssl_filter::Ssl_filter(Move<Unique_ssl> ssl, Ssl_filter::Direction dir, int fd)
-	: m_ssl(STD_MOVE(ssl))
+	: m_ssl(STD_MOVE(ssl)), m_dir(dir)
+	, m_handshake_completed(false), m_kernel_tls_send(false)
 {
 	if(dir == to_connect){
 		::SSL_set_connect_state(m_ssl.get());
@@ -57,7 +76,38 @@ Ssl_filter::Ssl_filter(Move<Unique_ssl> ssl, Ssl_filter::Direction dir, int fd)
 	POSEIDON_THROW_UNLESS(::SSL_set_fd(m_ssl.get(), fd), Exception, Rcnts::view("::SSL_set_fd() failed"));
 }
 Ssl_filter::~Ssl_filter(){
-	//
+	// 如果对方正常关闭了连接，即使我们没有发送 close_notify，会话也是可以复用的。
+	// 否则 ::SSL_free() 会把会话标记为不可复用。
+	if(::SSL_get_shutdown(m_ssl.get()) & SSL_RECEIVED_SHUTDOWN){
+		::SSL_set_shutdown(m_ssl.get(), SSL_RECEIVED_SHUTDOWN | SSL_SENT_SHUTDOWN);
+	}
+}
+
+void Ssl_filter::check_handshake_completion() NOEXCEPT {
+	if(m_handshake_completed){
+		return;
+	}
+	if(!::SSL_is_init_finished(m_ssl.get())){
+		return;
+	}
+	m_handshake_completed = true;
+	const bool resumed = ::SSL_session_reused(m_ssl.get());
+	// 如果启用了 SSL_OP_ENABLE_KTLS 并且内核支持，OpenSSL 会在握手过程中通过 setsockopt(SOL_TLS) 安装密钥。
+#ifdef BIO_get_ktls_send
+	const bool kernel_tls_send = BIO_get_ktls_send(::SSL_get_wbio(m_ssl.get()));
+#else
+	const bool kernel_tls_send = false;
+#endif
+	POSEIDON_LOG_DEBUG("SSL handshake completed: dir = ", m_dir, ", resumed = ", resumed, ", kernel_tls_send = ", kernel_tls_send);
+	if(m_dir == to_accept){
+		atomic_add(resumed ? g_resumed_accepted : g_full_accepted, 1, memory_order_relaxed);
+	} else {
+		atomic_add(resumed ? g_resumed_connected : g_full_connected, 1, memory_order_relaxed);
+	}
+	if(kernel_tls_send){
+		atomic_add(g_kernel_tls_send, 1, memory_order_relaxed);
+		atomic_store(m_kernel_tls_send, true, memory_order_release);
+	}
 }
 
 long Ssl_filter::recv(void *data, unsigned long size){
@@ -65,15 +115,19 @@ long Ssl_filter::recv(void *data, unsigned long size){
 
 	const Mutex::Unique_lock lock(m_mutex);
 	int bytes_read = ::SSL_read(m_ssl.get(), data, static_cast<int>(std::min<unsigned long>(size, INT_MAX)));
+	check_handshake_completion();
 	if(bytes_read <= 0){
 		if(::SSL_get_shutdown(m_ssl.get()) & SSL_RECEIVED_SHUTDOWN){
 			::shutdown(::SSL_get_rfd(m_ssl.get()), SHUT_RD);
 		}
 	}
-	if(bytes_read < 0){
+	if(bytes_read <= 0){
+		// OpenSSL 1.1.1 之后，处理完握手后消息（例如会话票据）时 SSL_read() 也可能返回 0，这并不意味着连接被关闭。
 		const int err = get_errno_from_ssl_ret(m_ssl.get(), bytes_read);
 		if(err == 0){
 			bytes_read = 0;
+		} else {
+			bytes_read = -1;
 		}
 		errno = err;
 	}
@@ -83,7 +137,12 @@ long Ssl_filter::send(const void *data, unsigned long size){
 	POSEIDON_PROFILE_ME;
 
 	const Mutex::Unique_lock lock(m_mutex);
+	if(atomic_load(m_kernel_tls_send, memory_order_acquire)){
+		// 内核负责分片和加密，写入的是明文。
+		return ::send(::SSL_get_wfd(m_ssl.get()), data, size, MSG_NOSIGNAL | MSG_DONTWAIT);
+	}
 	int bytes_written = ::SSL_write(m_ssl.get(), data, static_cast<int>(std::min<unsigned long>(size, INT_MAX)));
+	check_handshake_completion();
 	if(bytes_written <= 0){
 		if(::SSL_get_shutdown(m_ssl.get()) & SSL_SENT_SHUTDOWN){
 			const int status = ::SSL_shutdown(m_ssl.get());
@@ -118,4 +177,16 @@ void Ssl_filter::send_fin() NOEXCEPT {
 	}
 }
 
+bool Ssl_filter::is_kernel_tls_send_enabled() const NOEXCEPT {
+	return atomic_load(m_kernel_tls_send, memory_order_acquire);
+}
+long Ssl_filter::send_file(int file_fd, boost::uint64_t offset, unsigned long size){
+	POSEIDON_PROFILE_ME;
+
+	const Mutex::Unique_lock lock(m_mutex);
+	POSEIDON_THROW_ASSERT(atomic_load(m_kernel_tls_send, memory_order_acquire));
+	::off_t off = static_cast< ::off_t>(offset);
+	return ::sendfile(::SSL_get_wfd(m_ssl.get()), file_fd, &off, size);
+}
+
 }
@@ -8,6 +8,7 @@
 #include "cxx_util.hpp"
 #include "ssl_raii.hpp"
 #include "mutex.hpp"
+#include <boost/cstdint.hpp>
 
 namespace Poseidon {
 
@@ -18,10 +19,26 @@ public:
 		to_accept   = 2,
 	};
 
+	struct Handshake_statistics {
+		boost::uint64_t full_accepted;
+		boost::uint64_t resumed_accepted;
+		boost::uint64_t full_connected;
+		boost::uint64_t resumed_connected;
+		boost::uint64_t kernel_tls_send; // 握手之后由内核加密发送数据的连接数。
+	};
+
+	static Handshake_statistics get_handshake_statistics() NOEXCEPT;
+
 private:
 	const Unique_ssl m_ssl;
+	const Direction m_dir;
 
 	mutable Mutex m_mutex;
+	bool m_handshake_completed;
+	volatile bool m_kernel_tls_send;
+
+private:
+	void check_handshake_completion() NOEXCEPT;
 
 public:
 	Ssl_filter(Move<Unique_ssl> ssl, Direction dir, int fd);
@@ -31,6 +48,11 @@ public:
 	long recv(void *data, unsigned long size);
 	long send(const void *data, unsigned long size);
 	void send_fin() NOEXCEPT;
+
+	// 如果握手之后密钥被安装到了内核中（kTLS），发送的数据不再经过 OpenSSL，可以直接使用 sendfile()。
+	bool is_kernel_tls_send_enabled() const NOEXCEPT;
+	// 只能在 is_kernel_tls_send_enabled() 返回 true 时调用。
+	long send_file(int file_fd, boost::uint64_t offset, unsigned long size);
 };
 
 }
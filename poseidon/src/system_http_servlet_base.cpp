@@ -10,4 +10,8 @@ System_http_servlet_base::~System_http_servlet_base(){
 	//
 }
 
+bool System_http_servlet_base::handle_get_raw(Stream_buffer & /*entity*/, std::string & /*content_type*/) const {
+	return false;
+}
+
 }
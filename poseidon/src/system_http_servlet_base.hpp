@@ -7,10 +7,12 @@
 #include "cxx_util.hpp"
 #include <boost/weak_ptr.hpp>
 #include <boost/shared_ptr.hpp>
+#include <string>
 
 namespace Poseidon {
 
 class Json_object;
+class Stream_buffer;
 
 class System_http_servlet_base : NONCOPYABLE {
 public:
@@ -20,6 +22,9 @@ public:
 	virtual const char * get_uri() const = 0;
 	virtual void handle_get(Json_object &response) const = 0;
 	virtual void handle_post(Json_object &response, Json_object request) const = 0;
+
+	// 如果返回 true，则 GET 请求的响应为 entity，而不是 handle_get() 生成的 JSON。
+	virtual bool handle_get_raw(Stream_buffer &entity, std::string &content_type) const;
 };
 
 }
@@ -93,9 +93,9 @@ void System_http_session::on_sync_request(Http::Request_headers request_headers,
 	response_headers.headers.set(Rcnts::view("Access-Control-Allow-Methods"), "OPTIONS, GET, HEAD, POST");
 
 	Json_object request;
-	Buffer_istream bis;
 	Json_object response;
-	Buffer_ostream bos;
+	Stream_buffer entity;
+	std::string content_type;
 
 	switch(request_headers.verb){
 	case Http::verb_options:
@@ -109,25 +109,33 @@ void System_http_session::on_sync_request(Http::Request_headers request_headers,
 			// no parameters
 		} else {
 			POSEIDON_LOG_DEBUG("Parsing POST entity as JSON Object: ", request_entity);
-			bis.set_buffer(STD_MOVE(request_entity));
-			request.parse(bis);
-			POSEIDON_THROW_UNLESS(bis, Http::Exception, Http::status_bad_request);
+			try {
+				request.parse(request_entity);
+			} catch(Exception &e){
+				POSEIDON_LOG_WARNING("Invalid JSON Object: ", e.what());
+				POSEIDON_THROW(Http::Exception, Http::status_bad_request);
+			}
 		}
 		POSEIDON_LOG_DEBUG("System_http_session request: ", request);
-		if(request_headers.verb != Http::verb_post){
-			m_servlet->handle_get(response);
+		if((request_headers.verb != Http::verb_post) && m_servlet->handle_get_raw(entity, content_type)){
+			POSEIDON_LOG_DEBUG("System_http_session raw response: content_type = ", content_type, ", size = ", entity.size());
 		} else {
-			m_servlet->handle_post(response, STD_MOVE(request));
+			if(request_headers.verb != Http::verb_post){
+				m_servlet->handle_get(response);
+			} else {
+				m_servlet->handle_post(response, STD_MOVE(request));
+			}
+			POSEIDON_LOG_DEBUG("System_http_session response: ", response);
+			response.dump(entity);
+			content_type = "application/json";
 		}
-		POSEIDON_LOG_DEBUG("System_http_session response: ", response);
-		response.dump(bos);
-		response_headers.headers.set(Rcnts::view("Content-Type"), "application/json");
+		response_headers.headers.set(Rcnts::view("Content-Type"), STD_MOVE(content_type));
 		Http::Session::send_chunked_header(STD_MOVE(response_headers));
 		if(request_headers.verb == Http::verb_head){
 			POSEIDON_LOG_DEBUG("The response entity for a HEAD request will be discarded.");
 			break;
 		}
-		Http::Session::send_chunk(STD_MOVE(bos.get_buffer()));
+		Http::Session::send_chunk(STD_MOVE(entity));
 		Http::Session::send_chunked_trailer();
 		break;
 	default:
@@ -31,7 +31,7 @@ Tcp_client_base::Tcp_client_base(const Sock_addr &addr, bool use_ssl, bool verif
 		POSEIDON_LOG_INFO("Initiating SSL handshake...");
 		m_ssl_factory.reset(new Ssl_client_factory(verify_peer));
 		boost::scoped_ptr<Ssl_filter> ssl_filter;
-		m_ssl_factory->create_ssl_filter(ssl_filter, get_fd());
+		m_ssl_factory->create_ssl_filter(ssl_filter, get_fd(), addr);
 		Tcp_session_base::init_ssl(ssl_filter);
 	}
 }
@@ -13,19 +13,32 @@
 #include "log.hpp"
 #include "system_exception.hpp"
 #include "profiler.hpp"
+#include "metrics.hpp"
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <openssl/ssl.h>
 
 namespace Poseidon {
 
 namespace {
-	Unique_file create_tcp_socket(const Sock_addr &addr){
+	Metric_counter g_accepted_connections("poseidon_tcp_accepted_connections_total", "TCP connections accepted by all servers.");
+
+	Unique_file create_tcp_socket(const Sock_addr &addr, bool reuse_port){
 		Unique_file tcp;
 		POSEIDON_THROW_UNLESS(tcp.reset(::socket(addr.get_family(), SOCK_STREAM | SOCK_NONBLOCK, IPPROTO_TCP)), System_exception);
 		static CONSTEXPR const int s_true_value = true;
 		POSEIDON_THROW_UNLESS(::setsockopt(tcp.get(), SOL_SOCKET, SO_REUSEADDR, &s_true_value, sizeof(s_true_value)) == 0, System_exception);
+		if(reuse_port){
+			POSEIDON_THROW_UNLESS(::setsockopt(tcp.get(), SOL_SOCKET, SO_REUSEPORT, &s_true_value, sizeof(s_true_value)) == 0, System_exception);
+		}
+		// 在客户端发送数据之前不唤醒 accept()。
+		const AUTO(defer_accept_timeout, Main_config::get<boost::uint64_t>("tcp_defer_accept_timeout", 0));
+		if(defer_accept_timeout != 0){
+			const int defer_seconds = static_cast<int>(std::min<boost::uint64_t>((defer_accept_timeout + 999) / 1000, INT_MAX));
+			POSEIDON_THROW_UNLESS(::setsockopt(tcp.get(), IPPROTO_TCP, TCP_DEFER_ACCEPT, &defer_seconds, sizeof(defer_seconds)) == 0, System_exception);
+		}
 		POSEIDON_THROW_UNLESS(::bind(tcp.get(), static_cast<const ::sockaddr *>(addr.data()), static_cast<unsigned>(addr.size())) == 0, System_exception);
 		POSEIDON_THROW_UNLESS(::listen(tcp.get(), SOMAXCONN) == 0, System_exception);
 		return tcp;
@@ -33,7 +46,8 @@ namespace {
 }
 
 Tcp_server_base::Tcp_server_base(const Sock_addr &addr, const char *certificate, const char *private_key)
-	: Socket_base(create_tcp_socket(addr))
+	: Socket_base(create_tcp_socket(addr, Main_config::get<std::size_t>("tcp_accept_thread_count", 0) != 0))
+	, m_listener_group_created(false), m_accept_batch_size(16)
 {
 	if(certificate && *certificate){
 		m_ssl_factory.reset(new Ssl_server_factory(certificate, private_key));
@@ -43,17 +57,63 @@ Tcp_server_base::Tcp_server_base(const Sock_addr &addr, const char *certificate,
 }
 Tcp_server_base::~Tcp_server_base(){
 	POSEIDON_LOG(Logger::special_major | Logger::level_info, "Destroyed TCP server on ", get_local_info(), ", SSL = ", !!m_ssl_factory);
+
+	Epoll_daemon::purge_listeners();
+}
+
+bool Tcp_server_base::shutdown_read() NOEXCEPT {
+	const bool result = Socket_base::shutdown_read();
+	Epoll_daemon::purge_listeners();
+	return result;
+}
+void Tcp_server_base::mark_shutdown() NOEXCEPT {
+	Socket_base::mark_shutdown();
+	Epoll_daemon::purge_listeners();
+}
+void Tcp_server_base::force_shutdown() NOEXCEPT {
+	Socket_base::force_shutdown();
+	Epoll_daemon::purge_listeners();
 }
 
 int Tcp_server_base::poll_read_and_process(unsigned char */*hint_buffer*/, std::size_t /*hint_capacity*/, bool /*readable*/){
 	POSEIDON_PROFILE_ME;
 
-	for(unsigned i = 0; i < 16; ++i){
+	if(!m_listener_group_created){
+		// 套接字加入 epoll 之后这个函数会被立即调用一次，此时为每个 accept 线程创建一个监听同一地址的套接字。
+		m_listener_group_created = true;
+		const AUTO(accept_thread_count, Epoll_daemon::get_accept_thread_count());
+		if(accept_thread_count != 0){
+			const AUTO(server, virtual_shared_from_this<Tcp_server_base>());
+			::sockaddr_storage sa;
+			::socklen_t salen = sizeof(sa);
+			POSEIDON_THROW_UNLESS(::getsockname(get_fd(), static_cast< ::sockaddr *>(static_cast<void *>(&sa)), &salen) == 0, System_exception);
+			const Sock_addr addr(&sa, salen);
+			for(std::size_t i = 0; i < accept_thread_count; ++i){
+				Epoll_daemon::add_listener(server, create_tcp_socket(addr, true), i);
+			}
+			POSEIDON_LOG(Logger::special_major | Logger::level_info, "Created TCP listener group on ", get_local_info(), ", accept_thread_count = ", accept_thread_count);
+		}
+	}
+	return accept_and_process(get_fd(), m_accept_batch_size);
+}
+
+int Tcp_server_base::accept_and_process(int listener, std::size_t &batch_size){
+	POSEIDON_PROFILE_ME;
+
+	const AUTO(max_batch_size, std::max<std::size_t>(Main_config::get<std::size_t>("tcp_accept_max_batch_size", 16), 1));
+	const AUTO(tcp_request_timeout, Main_config::get<boost::uint64_t>("tcp_request_timeout", 5000));
+	const AUTO(count, std::min(std::max<std::size_t>(batch_size, 1), max_batch_size));
+	for(std::size_t i = 0; i < count; ++i){
 		boost::shared_ptr<Tcp_session_base> session;
 		try {
 			Unique_file client;
-			if(!client.reset(::accept4(get_fd(), NULLPTR, NULLPTR, SOCK_NONBLOCK))){
-				return errno;
+			if(!client.reset(::accept4(listener, NULLPTR, NULLPTR, SOCK_NONBLOCK))){
+				const int err_code = errno;
+				if((err_code == EWOULDBLOCK) || (err_code == EAGAIN)){
+					// 没有更多连接了，缩小下一批的大小。
+					batch_size = std::max<std::size_t>(std::max(i, count / 2), 1);
+				}
+				return err_code;
 			}
 			session = on_client_connect(STD_MOVE(client));
 			if(!session){
@@ -73,9 +133,9 @@ int Tcp_server_base::poll_read_and_process(unsigned char */*hint_buffer*/, std::
 				m_ssl_factory->create_ssl_filter(ssl_filter, session->get_fd());
 				session->init_ssl(ssl_filter);
 			}
-			const AUTO(tcp_request_timeout, Main_config::get<boost::uint64_t>("tcp_request_timeout", 5000));
 			session->set_timeout(tcp_request_timeout);
 			Epoll_daemon::add_socket(session, true);
+			g_accepted_connections.add();
 			POSEIDON_LOG_INFO("Accepted TCP connection from ", session->get_remote_info());
 		} catch(std::exception &e){
 			POSEIDON_LOG_ERROR("std::exception thrown: what = ", e.what());
@@ -83,6 +143,8 @@ int Tcp_server_base::poll_read_and_process(unsigned char */*hint_buffer*/, std::
 			continue;
 		}
 	}
+	// 这一批全部用完，说明还有连接在排队，扩大下一批的大小。
+	batch_size = std::min(count * 2, max_batch_size);
 	return 0;
 }
 
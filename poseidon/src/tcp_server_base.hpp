@@ -20,16 +20,29 @@ class Tcp_server_base : public Socket_base {
 private:
 	boost::scoped_ptr<Ssl_server_factory> m_ssl_factory;
 
+	bool m_listener_group_created;
+	std::size_t m_accept_batch_size;
+
 public:
 	explicit Tcp_server_base(const Sock_addr &addr, const char *certificate = "", const char *private_key = "");
 	~Tcp_server_base();
 
 protected:
 	// 工厂函数。返回空指针导致抛出一个异常。
+	// 如果 tcp_accept_thread_count 不为零，这个函数会在多个 accept 线程中被并发调用，派生类必须自行保证线程安全。
 	virtual boost::shared_ptr<Tcp_session_base> on_client_connect(Move<Unique_file> client) = 0;
 
 public:
+	// 服务器关闭时同一分组中的其他套接字也要立即关闭。
+	bool shutdown_read() NOEXCEPT OVERRIDE;
+	void mark_shutdown() NOEXCEPT OVERRIDE;
+	void force_shutdown() NOEXCEPT OVERRIDE;
+
 	int poll_read_and_process(unsigned char *hint_buffer, std::size_t hint_capacity, bool readable) OVERRIDE;
+
+	// 从 listener 上接受至多 batch_size 个连接，并根据结果调整 batch_size。
+	// 注意，只能在 epoll 线程或 accept 线程中调用这个函数。
+	int accept_and_process(int listener, std::size_t &batch_size);
 };
 
 }
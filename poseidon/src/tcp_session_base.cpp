@@ -13,13 +13,20 @@
 #include "checked_arithmetic.hpp"
 #include "singletons/timer_daemon.hpp"
 #include "time.hpp"
+#include "metrics.hpp"
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <sys/sendfile.h>
 
 namespace Poseidon {
 
+namespace {
+	Metric_counter g_received_bytes("poseidon_tcp_received_bytes_total", "Bytes received over all TCP connections, after decryption.");
+	Metric_counter g_sent_bytes("poseidon_tcp_sent_bytes_total", "Bytes sent over all TCP connections, before encryption.");
+}
+
 void Tcp_session_base::shutdown_timer_proc(const boost::weak_ptr<Tcp_session_base> &weak, boost::uint64_t now){
 	POSEIDON_PROFILE_ME;
 
@@ -77,6 +84,7 @@ int Tcp_session_base::poll_read_and_process(unsigned char *hint_buffer, std::siz
 			return errno;
 		}
 		data.put(hint_buffer, static_cast<std::size_t>(result));
+		g_received_bytes.add(static_cast<std::size_t>(result));
 		POSEIDON_LOG_TRACE("Read ", result, " byte(s) from ", get_remote_info());
 
 		const AUTO(now, get_fast_mono_clock());
@@ -118,8 +126,23 @@ int Tcp_session_base::poll_write(Mutex::Unique_lock &write_lock, unsigned char *
 		}
 
 		Mutex::Unique_lock lock(m_send_mutex);
-		const std::size_t avail = m_send_buffer.peek(hint_buffer, hint_capacity);
-		if(avail == 0){
+		std::size_t avail = m_send_buffer.peek(hint_buffer, hint_capacity);
+		boost::shared_ptr<Unique_file> file;
+		boost::uint64_t file_offset = 0;
+		std::size_t file_bytes = 0;
+		while((avail == 0) && !m_send_files.empty()){
+			AUTO_REF(elem, m_send_files.front());
+			if(elem.bytes_remaining != 0){
+				file = elem.file;
+				file_offset = elem.offset;
+				file_bytes = static_cast<std::size_t>(std::min<boost::uint64_t>(elem.bytes_remaining, 0x40000000));
+				break;
+			}
+			m_send_buffer.splice(elem.trailing);
+			m_send_files.pop_front();
+			avail = m_send_buffer.peek(hint_buffer, hint_capacity);
+		}
+		if((avail == 0) && !file){
 _check_shutdown:
 			if(should_really_shutdown_write()){
 				if(m_ssl_filter){
@@ -133,24 +156,47 @@ _check_shutdown:
 		lock.unlock();
 
 		::ssize_t result;
-		if(m_ssl_filter){
-			result = m_ssl_filter->send(hint_buffer, avail);
+		if(file){
+			if(m_ssl_filter && m_ssl_filter->is_kernel_tls_send_enabled()){
+				result = m_ssl_filter->send_file(file->get(), file_offset, file_bytes);
+				POSEIDON_THROW_UNLESS(result != 0, Exception, Rcnts::view("File was truncated before it could be sent"));
+			} else if(m_ssl_filter){
+				const ::ssize_t bytes_read = ::pread(file->get(), hint_buffer, std::min(file_bytes, hint_capacity), static_cast< ::off_t>(file_offset));
+				POSEIDON_THROW_UNLESS(bytes_read >= 0, System_exception);
+				POSEIDON_THROW_UNLESS(bytes_read != 0, Exception, Rcnts::view("File was truncated before it could be sent"));
+				result = m_ssl_filter->send(hint_buffer, static_cast<std::size_t>(bytes_read));
+			} else {
+				::off_t offset = static_cast< ::off_t>(file_offset);
+				result = ::sendfile(get_fd(), file->get(), &offset, file_bytes);
+				POSEIDON_THROW_UNLESS(result != 0, Exception, Rcnts::view("File was truncated before it could be sent"));
+			}
 		} else {
-			result = ::send(get_fd(), hint_buffer, avail, MSG_NOSIGNAL | MSG_DONTWAIT);
+			if(m_ssl_filter){
+				result = m_ssl_filter->send(hint_buffer, avail);
+			} else {
+				result = ::send(get_fd(), hint_buffer, avail, MSG_NOSIGNAL | MSG_DONTWAIT);
+			}
 		}
 		if(result < 0){
 			return errno;
 		}
 		POSEIDON_LOG_TRACE("Wrote ", result, " byte(s) to ", get_remote_info());
+		g_sent_bytes.add(static_cast<std::size_t>(result));
 
 		const AUTO(now, get_fast_mono_clock());
 		atomic_store(m_last_use_time, now, memory_order_release);
 		create_shutdown_timer();
 
 		lock.lock();
-		m_send_buffer.discard(static_cast<std::size_t>(result));
+		if(file){
+			AUTO_REF(elem, m_send_files.front());
+			elem.offset += static_cast<std::size_t>(result);
+			elem.bytes_remaining -= static_cast<std::size_t>(result);
+		} else {
+			m_send_buffer.discard(static_cast<std::size_t>(result));
+		}
 		swap(write_lock, lock);
-		if(m_send_buffer.empty()){
+		if(m_send_buffer.empty() && m_send_files.empty()){
 			goto _check_shutdown;
 		}
 	} catch(std::exception &e){
@@ -174,6 +220,9 @@ void Tcp_session_base::on_shutdown_timer(boost::uint64_t now){
 		{
 			const Mutex::Unique_lock lock(m_send_mutex);
 			send_buffer_size = m_send_buffer.size();
+			for(AUTO(it, m_send_files.begin()); it != m_send_files.end(); ++it){
+				send_buffer_size += static_cast<std::size_t>(std::min<boost::uint64_t>(it->bytes_remaining, SIZE_MAX - send_buffer_size)) + it->trailing.size();
+			}
 		}
 		if(send_buffer_size == 0){
 			POSEIDON_LOG(Logger::special_major | Logger::level_debug, "Connection closed due to inactivity: remote = ", get_remote_info());
@@ -243,7 +292,26 @@ bool Tcp_session_base::send(Stream_buffer buffer){
 	}
 
 	const Mutex::Unique_lock lock(m_send_mutex);
-	m_send_buffer.splice(buffer);
+	if(m_send_files.empty()){
+		m_send_buffer.splice(buffer);
+	} else {
+		m_send_files.back().trailing.splice(buffer);
+	}
+	Epoll_daemon::mark_socket_writable(this);
+	return true;
+}
+bool Tcp_session_base::send_file(Move<Unique_file> file, boost::uint64_t offset, boost::uint64_t length){
+	POSEIDON_PROFILE_ME;
+
+	if(has_been_shutdown_write()){
+		POSEIDON_LOG(Logger::special_major | Logger::level_debug, "TCP socket has been shut down for writing: local = ", get_local_info(), ", remote = ", get_remote_info());
+		return false;
+	}
+
+	Send_file_element elem = { boost::make_shared<Unique_file>(), offset, length, Stream_buffer() };
+	elem.file->reset(STD_MOVE(file));
+	const Mutex::Unique_lock lock(m_send_mutex);
+	m_send_files.push_back(STD_MOVE(elem));
 	Epoll_daemon::mark_socket_writable(this);
 	return true;
 }
@@ -9,6 +9,7 @@
 #include "socket_base.hpp"
 #include "session_base.hpp"
 #include <boost/scoped_ptr.hpp>
+#include <boost/container/deque.hpp>
 
 namespace Poseidon {
 
@@ -21,6 +22,14 @@ class Tcp_session_base : public Socket_base, public Session_base {
 	friend Tcp_server_base;
 	friend Tcp_client_base;
 
+private:
+	struct Send_file_element {
+		boost::shared_ptr<Unique_file> file;
+		boost::uint64_t offset;
+		boost::uint64_t bytes_remaining;
+		Stream_buffer trailing; // 在文件发送完之后发送的数据。
+	};
+
 private:
 	static void shutdown_timer_proc(const boost::weak_ptr<Tcp_session_base> &weak, boost::uint64_t now);
 
@@ -32,6 +41,7 @@ private:
 
 	mutable Mutex m_send_mutex;
 	Stream_buffer m_send_buffer;
+	boost::container::deque<Send_file_element> m_send_files;
 
 	volatile boost::uint64_t m_shutdown_time;
 	volatile boost::uint64_t m_last_use_time;
@@ -73,6 +83,8 @@ public:
 	void set_timeout(boost::uint64_t timeout);
 
 	bool send(Stream_buffer buffer) OVERRIDE;
+	// 从 offset 处开始发送文件中 length 个字节。数据不经过用户态缓冲区，在未启用 kTLS 的 SSL 连接上退化为逐块读取。
+	bool send_file(Move<Unique_file> file, boost::uint64_t offset, boost::uint64_t length);
 };
 
 }
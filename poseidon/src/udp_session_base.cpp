@@ -8,6 +8,9 @@
 #include "system_exception.hpp"
 #include "profiler.hpp"
 #include "errno.hpp"
+#include "atomic.hpp"
+#include "singletons/main_config.hpp"
+#include "metrics.hpp"
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -17,6 +20,23 @@
 namespace Poseidon {
 
 namespace {
+	Metric_counter g_packets_received("poseidon_udp_received_packets_total", "UDP packets received by all sockets, including truncated ones.");
+	Metric_counter g_packets_sent("poseidon_udp_sent_packets_total", "UDP packets sent by all sockets.");
+
+	CONSTEXPR const std::size_t s_max_batch_size = 64;
+	// GSO 分段不超过 IPv6 最小 MTU 减去头部的长度，这样不会被内核以 EINVAL 拒绝。
+	CONSTEXPR const std::size_t s_max_gso_segment_size = 1232;
+	CONSTEXPR const std::size_t s_max_gso_segment_count = 64;
+	CONSTEXPR const std::size_t s_max_gso_total_size = 65000;
+
+	std::size_t clamp_batch_size(std::size_t batch_size){
+		return std::min(std::max<std::size_t>(batch_size, 1), s_max_batch_size);
+	}
+
+	bool are_addresses_equal(const Sock_addr &lhs, const Sock_addr &rhs){
+		return (lhs.size() == rhs.size()) && (std::memcmp(lhs.data(), rhs.data(), lhs.size()) == 0);
+	}
+
 	inline int ipproto_of(const Udp_session_base *session){
 		return session->is_using_ipv6() ? IPPROTO_IPV6 : IPPROTO_IP;
 	}
@@ -59,8 +79,13 @@ namespace {
 
 Udp_session_base::Udp_session_base(Move<Unique_file> socket)
 	: Socket_base(STD_MOVE(socket))
+	, m_recv_batch_size(clamp_batch_size(Main_config::get<std::size_t>("udp_recv_batch_size", 32)))
+	, m_recv_slot_size(std::max<std::size_t>(Main_config::get<std::size_t>("udp_recv_slot_size", 8192), 508))
+	, m_send_batch_size(clamp_batch_size(Main_config::get<std::size_t>("udp_send_batch_size", 32)))
+	, m_gso_enabled(false)
+	, m_packets_received(0), m_recv_syscalls(0), m_packets_sent(0), m_send_syscalls(0), m_packets_dropped(0)
 {
-	//
+	m_send_batch.reserve(m_send_batch_size);
 }
 Udp_session_base::~Udp_session_base(){
 	//
@@ -82,79 +107,214 @@ void Udp_session_base::force_shutdown() NOEXCEPT {
 	Socket_base::force_shutdown();
 }
 
-int Udp_session_base::poll_read_and_process(unsigned char *hint_buffer, std::size_t hint_capacity, bool /*readable*/){
+void Udp_session_base::requeue_send_batch(std::size_t begin) NOEXCEPT {
+	try {
+		const Mutex::Unique_lock lock(m_send_mutex);
+		for(std::size_t i = m_send_batch.size(); i > begin; --i){
+			AUTO_REF(entry, m_send_batch.at(i - 1));
+			m_send_queue.emplace_front();
+			m_send_queue.front().first = entry.first;
+			m_send_queue.front().second.swap(entry.second);
+		}
+	} catch(std::exception &e){
+		POSEIDON_LOG_ERROR("std::exception thrown: what = ", e.what());
+	}
+	m_send_batch.clear();
+}
+
+int Udp_session_base::poll_read_and_process(unsigned char */*hint_buffer*/, std::size_t /*hint_capacity*/, bool /*readable*/){
 	POSEIDON_PROFILE_ME;
 
-	for(unsigned i = 0; i < 256; ++i){
-		Sock_addr sock_addr;
-		Stream_buffer data;
-		try {
-			::sockaddr_storage sa;
-			::socklen_t sa_len = sizeof(sa);
-			::ssize_t result = ::recvfrom(get_fd(), hint_buffer, hint_capacity, MSG_NOSIGNAL | MSG_DONTWAIT, static_cast< ::sockaddr *>(static_cast<void *>(&sa)), &sa_len);
-			if(result < 0){
-				return errno;
+	const std::size_t batch_size = m_recv_batch_size;
+	const std::size_t slot_size = m_recv_slot_size;
+	try {
+		if(m_recv_ring.empty()){
+			m_recv_ring.resize(batch_size * slot_size);
+		}
+	} catch(std::exception &e){
+		POSEIDON_LOG_ERROR("std::exception thrown: what = ", e.what());
+		return EINTR;
+	}
+
+	::sockaddr_storage addrs[s_max_batch_size];
+	::iovec vecs[s_max_batch_size];
+	::mmsghdr msgs[s_max_batch_size];
+	for(unsigned round = 0; round < 16; ++round){
+		for(std::size_t i = 0; i < batch_size; ++i){
+			vecs[i].iov_base = m_recv_ring.data() + i * slot_size;
+			vecs[i].iov_len = slot_size;
+			std::memset(msgs + i, 0, sizeof(msgs[i]));
+			msgs[i].msg_hdr.msg_name = addrs + i;
+			msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+			msgs[i].msg_hdr.msg_iov = vecs + i;
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+		const int result = ::recvmmsg(get_fd(), msgs, static_cast<unsigned>(batch_size), MSG_DONTWAIT, NULLPTR);
+		if(result < 0){
+			return errno;
+		}
+		atomic_add(m_recv_syscalls, 1, memory_order_relaxed);
+		atomic_add(m_packets_received, static_cast<unsigned>(result), memory_order_relaxed);
+		g_packets_received.add(static_cast<unsigned>(result));
+		POSEIDON_LOG_TRACE("Read ", result, " UDP packet(s) from ", get_local_info());
+
+		for(int i = 0; i < result; ++i){
+			Sock_addr sock_addr;
+			Stream_buffer data;
+			try {
+				if(msgs[i].msg_hdr.msg_flags & MSG_TRUNC){
+					POSEIDON_LOG(Logger::special_major | Logger::level_debug, "UDP packet has been truncated: udp_recv_slot_size = ", slot_size);
+					atomic_add(m_packets_dropped, 1, memory_order_relaxed);
+					continue;
+				}
+				sock_addr = Sock_addr(msgs[i].msg_hdr.msg_name, msgs[i].msg_hdr.msg_namelen);
+				data.put(vecs[i].iov_base, msgs[i].msg_len);
+			} catch(std::exception &e){
+				POSEIDON_LOG_ERROR("std::exception thrown: what = ", e.what());
+				continue;
+			}
+			try {
+				on_receive(sock_addr, STD_MOVE(data));
+			} catch(std::exception &e){
+				POSEIDON_LOG_ERROR("std::exception thrown: what = ", e.what());
+				continue;
+			} catch(...){
+				POSEIDON_LOG_ERROR("Unknown exception thrown.");
+				continue;
 			}
-			sock_addr = Sock_addr(&sa, sa_len);
-			data.put(hint_buffer, static_cast<std::size_t>(result));
-			POSEIDON_LOG_TRACE("Read ", result, " byte(s) from ", Ip_port(sock_addr));
-		} catch(std::exception &e){
-			POSEIDON_LOG_ERROR("std::exception thrown: what = ", e.what());
-			return EINTR;
 		}
-		try {
-			on_receive(sock_addr, STD_MOVE(data));
-		} catch(std::exception &e){
-			POSEIDON_LOG_ERROR("std::exception thrown: what = ", e.what());
-			continue;
-		} catch(...){
-			POSEIDON_LOG_ERROR("Unknown exception thrown.");
-			continue;
+		if(static_cast<std::size_t>(result) < batch_size){
+			// 接收队列已经读空。
+			return EWOULDBLOCK;
 		}
 	}
 	return 0;
 }
-int Udp_session_base::poll_write(Mutex::Unique_lock &/*write_lock*/, unsigned char *hint_buffer, std::size_t hint_capacity, bool /*writable*/){
+int Udp_session_base::poll_write(Mutex::Unique_lock &/*write_lock*/, unsigned char */*hint_buffer*/, std::size_t /*hint_capacity*/, bool /*writable*/){
 	POSEIDON_PROFILE_ME;
 
-	for(unsigned i = 0; i < 256; ++i){
-		Sock_addr sock_addr;
-		Stream_buffer data;
+	const std::size_t batch_size = m_send_batch_size;
+	::iovec vecs[s_max_batch_size];
+	::mmsghdr msgs[s_max_batch_size];
+#ifdef UDP_SEGMENT
+	union {
+		::cmsghdr header;
+		char bytes[CMSG_SPACE(sizeof(boost::uint16_t))];
+	} controls[s_max_batch_size];
+#endif
+	// 第 i 个消息包含 m_send_batch 中 [first_entries[i], first_entries[i + 1]) 的数据包。
+	std::size_t first_entries[s_max_batch_size + 1];
+
+	for(unsigned round = 0; round < 16; ++round){
+		m_send_batch.clear();
 		try {
 			const Mutex::Unique_lock lock(m_send_mutex);
 			if(m_send_queue.empty()){
 				return EWOULDBLOCK;
 			}
-			sock_addr = m_send_queue.front().first;
-			data.swap(m_send_queue.front().second);
-			m_send_queue.pop_front();
+			while(!m_send_queue.empty() && (m_send_batch.size() < batch_size)){
+				m_send_batch.emplace_back();
+				m_send_batch.back().first = m_send_queue.front().first;
+				m_send_batch.back().second.swap(m_send_queue.front().second);
+				m_send_queue.pop_front();
+			}
 		} catch(std::exception &e){
 			POSEIDON_LOG_ERROR("std::exception thrown: what = ", e.what());
+			requeue_send_batch(0);
 			return EINTR;
 		}
-		try {
-			::sockaddr_storage sa;
-			POSEIDON_THROW_ASSERT(sock_addr.size() <= sizeof(sa));
-			::socklen_t sa_len = static_cast<unsigned>(sock_addr.size());
-			const std::size_t avail = data.peek(hint_buffer, hint_capacity);
-			if(avail < data.size()){
-				POSEIDON_LOG(Logger::special_major | Logger::level_debug, "UDP packet is too large: size = ", data.size());
-		_too_large:
-				on_message_too_large(sock_addr, STD_MOVE(data));
-				continue;
+
+#ifdef UDP_SEGMENT
+		const bool gso_enabled = atomic_load(m_gso_enabled, memory_order_relaxed);
+#else
+		const bool gso_enabled = false;
+#endif
+		std::size_t msg_count = 0;
+		std::size_t entry_index = 0;
+		while(entry_index < m_send_batch.size()){
+			const AUTO_REF(sock_addr, m_send_batch.at(entry_index).first);
+			const std::size_t segment_size = m_send_batch.at(entry_index).second.size();
+			std::memset(msgs + msg_count, 0, sizeof(msgs[msg_count]));
+			AUTO_REF(hdr, msgs[msg_count].msg_hdr);
+			hdr.msg_name = const_cast<void *>(sock_addr.data());
+			hdr.msg_namelen = static_cast< ::socklen_t>(sock_addr.size());
+			hdr.msg_iov = vecs + entry_index;
+			first_entries[msg_count] = entry_index;
+			std::size_t total_size = 0;
+			for(;;){
+				AUTO_REF(data, m_send_batch.at(entry_index).second);
+				vecs[entry_index].iov_base = data.squash();
+				vecs[entry_index].iov_len = data.size();
+				total_size += data.size();
+				++entry_index;
+				// 合并发往同一地址的等长数据包，只有最后一个可以更短。
+				if(!gso_enabled || (segment_size == 0) || (segment_size > s_max_gso_segment_size) || (data.size() != segment_size)){
+					break;
+				}
+				if((entry_index >= m_send_batch.size()) || (entry_index - first_entries[msg_count] >= s_max_gso_segment_count)){
+					break;
+				}
+				const AUTO_REF(next, m_send_batch.at(entry_index));
+				if(!are_addresses_equal(next.first, sock_addr) || next.second.empty() || (next.second.size() > segment_size) || (total_size + next.second.size() > s_max_gso_total_size)){
+					break;
+				}
+			}
+			hdr.msg_iovlen = entry_index - first_entries[msg_count];
+#ifdef UDP_SEGMENT
+			if(hdr.msg_iovlen > 1){
+				hdr.msg_control = controls[msg_count].bytes;
+				hdr.msg_controllen = sizeof(controls[msg_count].bytes);
+				::cmsghdr *const cmsg = CMSG_FIRSTHDR(&hdr);
+				cmsg->cmsg_level = SOL_UDP;
+				cmsg->cmsg_type = UDP_SEGMENT;
+				cmsg->cmsg_len = CMSG_LEN(sizeof(boost::uint16_t));
+				const AUTO(gso_size, static_cast<boost::uint16_t>(segment_size));
+				std::memcpy(CMSG_DATA(cmsg), &gso_size, sizeof(gso_size));
 			}
-			::ssize_t result = ::sendto(get_fd(), hint_buffer, avail, MSG_NOSIGNAL | MSG_DONTWAIT, static_cast< ::sockaddr *>(static_cast<void *>(&sa)), sa_len);
+#endif
+			++msg_count;
+		}
+		first_entries[msg_count] = entry_index;
+
+		std::size_t msg_index = 0;
+		while(msg_index < msg_count){
+			const int result = ::sendmmsg(get_fd(), msgs + msg_index, static_cast<unsigned>(msg_count - msg_index), MSG_NOSIGNAL | MSG_DONTWAIT);
+			atomic_add(m_send_syscalls, 1, memory_order_relaxed);
 			if(result < 0){
-				if(errno == EMSGSIZE){
-					POSEIDON_LOG(Logger::special_major | Logger::level_debug, "UDP packet is too large: size = ", data.size());
-					goto _too_large;
+				const int err_code = errno;
+				if(err_code == EINTR){
+					continue;
+				}
+				if((err_code == EAGAIN) || (err_code == EWOULDBLOCK)){
+					requeue_send_batch(first_entries[msg_index]);
+					return err_code;
+				}
+				if(first_entries[msg_index + 1] - first_entries[msg_index] > 1){
+					POSEIDON_LOG_WARNING("UDP GSO has been rejected by the kernel and will be disabled: errno was ", err_code, " (", get_error_desc(err_code), ")");
+					atomic_store(m_gso_enabled, false, memory_order_relaxed);
+					requeue_send_batch(first_entries[msg_index]);
+					break;
+				}
+				AUTO_REF(entry, m_send_batch.at(first_entries[msg_index]));
+				++msg_index;
+				atomic_add(m_packets_dropped, 1, memory_order_relaxed);
+				if(err_code != EMSGSIZE){
+					POSEIDON_LOG(Logger::special_major | Logger::level_debug, "::sendmmsg() failed: errno was ", err_code, " (", get_error_desc(err_code), "), remote = ", Ip_port(entry.first));
+					continue;
+				}
+				POSEIDON_LOG(Logger::special_major | Logger::level_debug, "UDP packet is too large: size = ", entry.second.size());
+				try {
+					on_message_too_large(entry.first, STD_MOVE(entry.second));
+				} catch(std::exception &e){
+					POSEIDON_LOG_ERROR("std::exception thrown: what = ", e.what());
 				}
 				continue;
 			}
-			POSEIDON_LOG_TRACE("Wrote ", result, " byte(s) to ", Ip_port(sock_addr));
-		} catch(std::exception &e){
-			POSEIDON_LOG_ERROR("std::exception thrown: what = ", e.what());
-			continue;
+			const std::size_t packets_sent = first_entries[msg_index + static_cast<unsigned>(result)] - first_entries[msg_index];
+			atomic_add(m_packets_sent, packets_sent, memory_order_relaxed);
+			g_packets_sent.add(packets_sent);
+			POSEIDON_LOG_TRACE("Wrote ", packets_sent, " UDP packet(s) from ", get_local_info());
+			msg_index += static_cast<unsigned>(result);
 		}
 	}
 	return 0;
@@ -221,6 +381,26 @@ void Udp_session_base::set_multicast_ttl(int ttl){
 	POSEIDON_THROW_UNLESS(::setsockopt(get_fd(), ipproto_of(this), is_using_ipv6() ? IPV6_MULTICAST_HOPS : IP_MULTICAST_TTL, &val, sizeof(val)) == 0, System_exception);
 }
 
+bool Udp_session_base::is_gso_enabled() const NOEXCEPT {
+	return atomic_load(m_gso_enabled, memory_order_relaxed);
+}
+void Udp_session_base::set_gso_enabled(bool enabled) NOEXCEPT {
+#ifdef UDP_SEGMENT
+	atomic_store(m_gso_enabled, enabled, memory_order_relaxed);
+#else
+	(void)enabled;
+#endif
+}
+Udp_session_base::Statistics Udp_session_base::get_statistics() const NOEXCEPT {
+	Statistics stats;
+	stats.packets_received = atomic_load(m_packets_received, memory_order_relaxed);
+	stats.recv_syscalls = atomic_load(m_recv_syscalls, memory_order_relaxed);
+	stats.packets_sent = atomic_load(m_packets_sent, memory_order_relaxed);
+	stats.send_syscalls = atomic_load(m_send_syscalls, memory_order_relaxed);
+	stats.packets_dropped = atomic_load(m_packets_dropped, memory_order_relaxed);
+	return stats;
+}
+
 bool Udp_session_base::send(const Sock_addr &sock_addr, Stream_buffer buffer){
 	POSEIDON_PROFILE_ME;
 
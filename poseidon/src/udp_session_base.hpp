@@ -6,6 +6,8 @@
 
 #include <boost/shared_ptr.hpp>
 #include <boost/container/deque.hpp>
+#include <boost/container/vector.hpp>
+#include <boost/cstdint.hpp>
 #include "socket_base.hpp"
 #include "sock_addr.hpp"
 #include "ip_port.hpp"
@@ -14,10 +16,36 @@
 namespace Poseidon {
 
 class Udp_session_base : public Socket_base {
+public:
+	struct Statistics {
+		boost::uint64_t packets_received;
+		boost::uint64_t recv_syscalls;
+		boost::uint64_t packets_sent;
+		boost::uint64_t send_syscalls;
+		boost::uint64_t packets_dropped;
+	};
+
 private:
 	mutable Mutex m_send_mutex;
 	mutable boost::container::deque<std::pair<Sock_addr, Stream_buffer> > m_send_queue;
 
+	// 这些成员只在 epoll 线程中访问。
+	boost::container::vector<unsigned char> m_recv_ring;
+	boost::container::vector<std::pair<Sock_addr, Stream_buffer> > m_send_batch;
+	std::size_t m_recv_batch_size;
+	std::size_t m_recv_slot_size;
+	std::size_t m_send_batch_size;
+
+	volatile bool m_gso_enabled;
+	volatile boost::uint64_t m_packets_received;
+	volatile boost::uint64_t m_recv_syscalls;
+	volatile boost::uint64_t m_packets_sent;
+	volatile boost::uint64_t m_send_syscalls;
+	volatile boost::uint64_t m_packets_dropped;
+
+private:
+	void requeue_send_batch(std::size_t begin) NOEXCEPT;
+
 public:
 	explicit Udp_session_base(Move<Unique_file> socket);
 	~Udp_session_base();
@@ -42,6 +70,12 @@ public:
 	void set_multicast_loop(bool enabled = true);
 	void set_multicast_ttl(int ttl);
 
+	// 如果内核支持 UDP_SEGMENT，发往同一地址的等长数据包会合并为一次 GSO 发送。
+	// 内核拒绝时会自动关闭。
+	bool is_gso_enabled() const NOEXCEPT;
+	void set_gso_enabled(bool enabled = true) NOEXCEPT;
+	Statistics get_statistics() const NOEXCEPT;
+
 	bool send(const Sock_addr &sock_addr, Stream_buffer buffer);
 };
 
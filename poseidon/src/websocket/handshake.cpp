@@ -77,10 +77,8 @@ std::pair<Http::Request_headers, std::string> make_handshake_request(std::string
 	request.headers.set(Rcnts::view("Sec-WebSocket-Version"), "13");
 	request.headers.set(Rcnts::view("Pragma"), "no-cache");
 	request.headers.set(Rcnts::view("Cache-Control"), "no-cache");
-	boost::uint32_t key[4];
-	for(unsigned i = 0; i < 4; ++i){
-		key[i] = random_uint32();
-	}
+	unsigned char key[16];
+	random_fill_secure(key, sizeof(key));
 	Base64_encoder enc;
 	enc.put(key, sizeof(key));
 	AUTO(sec_websocket_key, enc.finalize().dump_string());
@@ -0,0 +1,274 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2018, LH_Mouse. All wrongs reserved.
+
+#include "precompiled.hpp"
+#include "write_journal.hpp"
+#include "crc32.hpp"
+#include "endian.hpp"
+#include "exception.hpp"
+#include "system_exception.hpp"
+#include "log.hpp"
+#include "profiler.hpp"
+#include <boost/static_assert.hpp>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace Poseidon {
+
+namespace {
+	// 所有整数均为大端序。校验和覆盖 crc 置零的头部和数据。
+	struct Record_header {
+		boost::uint32_t magic;
+		boost::uint32_t type;
+		boost::uint64_t seq;
+		boost::uint32_t size;
+		boost::uint32_t crc;
+	};
+	BOOST_STATIC_ASSERT(sizeof(Record_header) == 24);
+
+	const boost::uint32_t s_magic = 0x504A524E; // PJRN
+
+	enum {
+		type_write        = 1,
+		type_acknowledge  = 2,
+	};
+
+	Crc32 calculate_crc(const Record_header &header, const void *data, std::size_t size){
+		Record_header temp = header;
+		temp.crc = 0;
+		Crc32_streambuf sb;
+		sb.put(&temp, sizeof(temp));
+		sb.put(data, size);
+		return sb.finalize();
+	}
+	void encode_record(Stream_buffer &buffer, boost::uint32_t type, boost::uint64_t seq, const void *data, std::size_t size){
+		POSEIDON_THROW_UNLESS(size <= 0x7FFFFFFF, Exception, Rcnts::view("Journal record is too large"));
+		Record_header header;
+		store_be(header.magic, s_magic);
+		store_be(header.type, type);
+		store_be(header.seq, seq);
+		store_be(header.size, static_cast<boost::uint32_t>(size));
+		header.crc = 0;
+		store_be(header.crc, calculate_crc(header, data, size));
+		buffer.put(&header, sizeof(header));
+		buffer.put(data, size);
+	}
+
+	void write_all(int fd, const std::string &path, Stream_buffer &data){
+		while(!data.empty()){
+			::iovec vecs[64];
+			int count = 0;
+			Stream_buffer::Enumeration_cookie cookie;
+			void *chunk_data;
+			std::size_t chunk_size;
+			while((count < static_cast<int>(sizeof(vecs) / sizeof(vecs[0]))) && data.enumerate_chunk(&chunk_data, &chunk_size, cookie)){
+				if(chunk_size == 0){
+					continue;
+				}
+				vecs[count].iov_base = chunk_data;
+				vecs[count].iov_len = chunk_size;
+				++count;
+			}
+			const ::ssize_t result = ::writev(fd, vecs, count);
+			if(result < 0){
+				const int err_code = errno;
+				if(err_code == EINTR){
+					continue;
+				}
+				POSEIDON_LOG_ERROR("Error writing journal: path = ", path, ", err_code = ", err_code);
+				POSEIDON_THROW(System_exception, err_code);
+			}
+			data.discard(static_cast<std::size_t>(result));
+		}
+	}
+	void sync_file(int fd, const std::string &path){
+		if(::fdatasync(fd) != 0){
+			const int err_code = errno;
+			POSEIDON_LOG_ERROR("Error synchronizing journal: path = ", path, ", err_code = ", err_code);
+			POSEIDON_THROW(System_exception, err_code);
+		}
+	}
+	void sync_parent_directory(const std::string &path){
+		const AUTO(pos, path.rfind('/'));
+		const AUTO(dir, (pos == std::string::npos) ? std::string(".") : path.substr(0, pos + 1));
+		Unique_file file;
+		if(!file.reset(::open(dir.c_str(), O_RDONLY | O_CLOEXEC))){
+			const int err_code = errno;
+			POSEIDON_LOG_WARNING("Failed to open directory: dir = ", dir, ", err_code = ", err_code);
+			return;
+		}
+		::fsync(file.get());
+	}
+}
+
+std::size_t Write_journal::replay(const std::string &path, const Replay_callback &callback){
+	POSEIDON_PROFILE_ME;
+
+	Unique_file file;
+	if(!file.reset(::open(path.c_str(), O_RDONLY | O_CLOEXEC))){
+		const int err_code = errno;
+		if(err_code == ENOENT){
+			return 0;
+		}
+		POSEIDON_LOG_ERROR("Failed to open journal: path = ", path, ", err_code = ", err_code);
+		POSEIDON_THROW(System_exception, err_code);
+	}
+	std::string data;
+	for(;;){
+		char temp[65536];
+		const ::ssize_t result = ::read(file.get(), temp, sizeof(temp));
+		if(result == 0){
+			break;
+		}
+		if(result < 0){
+			const int err_code = errno;
+			if(err_code == EINTR){
+				continue;
+			}
+			POSEIDON_LOG_ERROR("Error reading journal: path = ", path, ", err_code = ", err_code);
+			POSEIDON_THROW(System_exception, err_code);
+		}
+		data.append(temp, static_cast<std::size_t>(result));
+	}
+
+	boost::container::map<boost::uint64_t, std::string> records;
+	std::size_t offset = 0;
+	while(data.size() - offset >= sizeof(Record_header)){
+		Record_header header;
+		std::memcpy(&header, data.data() + offset, sizeof(header));
+		if(load_be(header.magic) != s_magic){
+			POSEIDON_LOG_WARNING("Invalid journal record: path = ", path, ", offset = ", offset);
+			break;
+		}
+		const std::size_t size = load_be(header.size);
+		if(data.size() - offset - sizeof(header) < size){
+			// 写到一半的记录。
+			break;
+		}
+		const char *const payload = data.data() + offset + sizeof(header);
+		if(load_be(header.crc) != calculate_crc(header, payload, size)){
+			POSEIDON_LOG_WARNING("Journal record checksum mismatch: path = ", path, ", offset = ", offset);
+			break;
+		}
+		offset += sizeof(header) + size;
+
+		const boost::uint64_t seq = load_be(header.seq);
+		switch(load_be(header.type)){
+		case type_write:
+			records[seq].assign(payload, size);
+			break;
+		case type_acknowledge:
+			records.erase(seq);
+			break;
+		default:
+			POSEIDON_LOG_WARNING("Unknown journal record type: path = ", path, ", type = ", load_be(header.type));
+			break;
+		}
+	}
+	if(offset != data.size()){
+		POSEIDON_LOG_WARNING("Ignoring trailing bytes in journal: path = ", path, ", bytes = ", data.size() - offset);
+	}
+	POSEIDON_LOG(Logger::special_major | Logger::level_info, "Replaying journal: path = ", path, ", records = ", records.size());
+	for(AUTO(it, records.begin()); it != records.end(); ++it){
+		callback(it->second);
+	}
+	return records.size();
+}
+
+Write_journal::Write_journal(std::string path, boost::uint64_t compact_size)
+	: m_path(STD_MOVE(path)), m_compact_size(compact_size)
+	, m_file(), m_file_size(0), m_compacted_size(0)
+	, m_next_seq(1), m_pending(), m_unacknowledged()
+{
+	if(!m_file.reset(::open(m_path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_TRUNC | O_CLOEXEC, 0644))){
+		const int err_code = errno;
+		POSEIDON_LOG_ERROR("Failed to create journal: path = ", m_path, ", err_code = ", err_code);
+		POSEIDON_THROW(System_exception, err_code);
+	}
+}
+Write_journal::~Write_journal(){
+	//
+}
+
+void Write_journal::compact(){
+	POSEIDON_PROFILE_ME;
+
+	// 必须在持有 m_io_mutex 时调用。重写期间 append() 会被阻塞，不过这种情况很少发生。
+	const AUTO(temp_path, m_path + ".tmp");
+	Unique_file file;
+	if(!file.reset(::open(temp_path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_TRUNC | O_CLOEXEC, 0644))){
+		const int err_code = errno;
+		POSEIDON_LOG_ERROR("Failed to create journal: path = ", temp_path, ", err_code = ", err_code);
+		POSEIDON_THROW(System_exception, err_code);
+	}
+	const Mutex::Unique_lock lock(m_mutex);
+	Stream_buffer data;
+	for(AUTO(it, m_unacknowledged.begin()); it != m_unacknowledged.end(); ++it){
+		encode_record(data, type_write, it->first, it->second.data(), it->second.size());
+	}
+	const boost::uint64_t size = data.size();
+	write_all(file.get(), temp_path, data);
+	sync_file(file.get(), temp_path);
+	if(::rename(temp_path.c_str(), m_path.c_str()) != 0){
+		const int err_code = errno;
+		POSEIDON_LOG_ERROR("Failed to rename journal: path = ", temp_path, ", err_code = ", err_code);
+		POSEIDON_THROW(System_exception, err_code);
+	}
+	sync_parent_directory(m_path);
+	POSEIDON_LOG_DEBUG("Compacted journal: path = ", m_path, ", old_size = ", m_file_size, ", new_size = ", size);
+	m_file.swap(file);
+	m_file_size = size;
+	m_compacted_size = size;
+	// 尚未写入的写记录已经包含在新文件中，确认记录也不再需要了。
+	m_pending.clear();
+}
+
+std::size_t Write_journal::get_unacknowledged_count() const {
+	const Mutex::Unique_lock lock(m_mutex);
+	return m_unacknowledged.size();
+}
+
+boost::uint64_t Write_journal::append(std::string payload){
+	const Mutex::Unique_lock lock(m_mutex);
+	const boost::uint64_t seq = m_next_seq;
+	encode_record(m_pending, type_write, seq, payload.data(), payload.size());
+	m_unacknowledged[seq].swap(payload);
+	++m_next_seq;
+	return seq;
+}
+void Write_journal::acknowledge(boost::uint64_t seq){
+	const Mutex::Unique_lock lock(m_mutex);
+	if(m_unacknowledged.erase(seq) == 0){
+		return;
+	}
+	encode_record(m_pending, type_acknowledge, seq, NULLPTR, 0);
+}
+void Write_journal::flush(){
+	POSEIDON_PROFILE_ME;
+
+	const Mutex::Unique_lock io_lock(m_io_mutex);
+	Stream_buffer pending;
+	{
+		const Mutex::Unique_lock lock(m_mutex);
+		pending.swap(m_pending);
+	}
+	if(!pending.empty()){
+		const boost::uint64_t size = pending.size();
+		try {
+			write_all(m_file.get(), m_path, pending);
+			sync_file(m_file.get(), m_path);
+		} catch(...){
+			// 文件末尾可能有写到一半的记录，下次必须重写整个文件。
+			m_file_size = m_compacted_size + m_compact_size;
+			throw;
+		}
+		m_file_size += size;
+	}
+	if(m_file_size - m_compacted_size >= m_compact_size){
+		compact();
+	}
+}
+
+}
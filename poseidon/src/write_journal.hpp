@@ -0,0 +1,67 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2018, LH_Mouse. All wrongs reserved.
+
+#ifndef POSEIDON_WRITE_JOURNAL_HPP_
+#define POSEIDON_WRITE_JOURNAL_HPP_
+
+#include "cxx_ver.hpp"
+#include "cxx_util.hpp"
+#include "mutex.hpp"
+#include "raii.hpp"
+#include "stream_buffer.hpp"
+#include <boost/function.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/container/map.hpp>
+#include <string>
+#include <cstddef>
+
+namespace Poseidon {
+
+// 只追加的日志文件，记录已经排队但尚未完成的写操作，用于在进程崩溃之后重做。
+// 每条记录带有序号和 CRC32 校验。append() 和 acknowledge() 只写入内存缓冲区，由 flush() 一次性写入文件并调用 fdatasync()，因此多条记录共用一次同步。
+// 文件超过 compact_size 字节时，用尚未确认的记录重写整个文件。
+class Write_journal : NONCOPYABLE {
+public:
+	typedef boost::function<void (const std::string &payload)> Replay_callback;
+
+	// 按写入顺序回放 path 中所有尚未确认的记录。文件末尾不完整或者校验失败的记录及其之后的内容被忽略。
+	// 返回回放的记录数。文件不存在时返回 0。
+	static std::size_t replay(const std::string &path, const Replay_callback &callback);
+
+private:
+	const std::string m_path;
+	const boost::uint64_t m_compact_size;
+
+	mutable Mutex m_io_mutex; // 在 m_mutex 之前锁定。
+	Unique_file m_file;
+	boost::uint64_t m_file_size;
+	boost::uint64_t m_compacted_size; // 上次重写之后的文件大小。
+
+	mutable Mutex m_mutex;
+	boost::uint64_t m_next_seq;
+	Stream_buffer m_pending;
+	boost::container::map<boost::uint64_t, std::string> m_unacknowledged;
+
+public:
+	// 如果文件已经存在则被截断，因此应当先调用 replay()。
+	Write_journal(std::string path, boost::uint64_t compact_size);
+	~Write_journal();
+
+private:
+	void compact();
+
+public:
+	const std::string & get_path() const {
+		return m_path;
+	}
+	std::size_t get_unacknowledged_count() const;
+
+	// 返回记录的序号，不会是零。
+	boost::uint64_t append(std::string payload);
+	void acknowledge(boost::uint64_t seq);
+	void flush();
+};
+
+}
+
+#endif